@@ -0,0 +1,239 @@
+//
+//  ImmutableRope.cpp
+//  Permafrost
+//
+//  Copyright (c) 2014 Marcus Zetterquist. All rights reserved.
+//
+
+#include "ImmutableRope.h"
+
+
+
+///////////////////////////		immutable_rope
+
+
+
+immutable_rope::immutable_rope(){
+	ASSERT(check_invariant());
+}
+
+immutable_rope::immutable_rope(const std::string& iUTF8) :
+	_bytes(reinterpret_cast<const rope_byte*>(iUTF8.data()), iUTF8.size())
+{
+	ASSERT(IsValidUTF8(iUTF8));
+
+	ASSERT(check_invariant());
+}
+
+//	One copy: the string's bytes go straight into the chunks.
+immutable_rope::immutable_rope(const immutable_string& iString) :
+	_bytes(reinterpret_cast<const rope_byte*>(iString.data()), iString.size())
+{
+	ASSERT(check_invariant());
+}
+
+immutable_rope::immutable_rope(const steady::vector<rope_byte>& iBytes) :
+	_bytes(iBytes)
+{
+	ASSERT(check_invariant());
+}
+
+bool immutable_rope::check_invariant() const{
+	ASSERT(_bytes.check_invariant());
+
+	return true;
+}
+
+std::size_t immutable_rope::size() const {
+	ASSERT(check_invariant());
+
+	return _bytes.size();
+}
+
+bool immutable_rope::empty() const {
+	ASSERT(check_invariant());
+
+	return _bytes.empty();
+}
+
+bool immutable_rope::is_char_boundary(std::size_t iPos) const {
+	ASSERT(check_invariant());
+	ASSERT(iPos <= _bytes.size());
+
+	return iPos == _bytes.size() || (_bytes[iPos]._value & 0xc0) != 0x80;
+}
+
+immutable_rope immutable_rope::insert(std::size_t iPos, const immutable_rope& iText) const {
+	ASSERT(check_invariant());
+	ASSERT(iText.check_invariant());
+	ASSERT(is_char_boundary(iPos));
+
+	const auto left = _bytes.truncate(iPos);
+	const auto right = _bytes.slice(iPos, _bytes.size());
+	return immutable_rope(left + iText._bytes + right);
+}
+
+immutable_rope immutable_rope::erase(std::size_t iPos, std::size_t iCount) const {
+	ASSERT(check_invariant());
+	ASSERT(iPos + iCount <= _bytes.size());
+	ASSERT(is_char_boundary(iPos) && is_char_boundary(iPos + iCount));
+
+	const auto left = _bytes.truncate(iPos);
+	const auto right = _bytes.slice(iPos + iCount, _bytes.size());
+	return immutable_rope(left + right);
+}
+
+immutable_rope immutable_rope::substr(std::size_t iPos, std::size_t iCount) const {
+	ASSERT(check_invariant());
+	ASSERT(iPos + iCount <= _bytes.size());
+	ASSERT(is_char_boundary(iPos) && is_char_boundary(iPos + iCount));
+
+	return immutable_rope(_bytes.slice(iPos, iPos + iCount));
+}
+
+immutable_rope immutable_rope::operator+(const immutable_rope& iOther) const {
+	ASSERT(check_invariant());
+	ASSERT(iOther.check_invariant());
+
+	return immutable_rope(_bytes + iOther._bytes);
+}
+
+//	Chunks shared by the two ropes are not compared.
+bool immutable_rope::operator==(const immutable_rope& iOther) const {
+	ASSERT(check_invariant());
+	ASSERT(iOther.check_invariant());
+
+	return _bytes == iOther._bytes;
+}
+
+std::string immutable_rope::get_utf8() const {
+	ASSERT(check_invariant());
+
+	std::string result(_bytes.size(), '\0');
+	if(!result.empty()){
+		_bytes.copy_range(0, _bytes.size(), reinterpret_cast<rope_byte*>(&result[0]));
+	}
+	return result;
+}
+
+immutable_string immutable_rope::get_string() const {
+	ASSERT(check_invariant());
+
+	//	One copy: the chunks are written straight into the string.
+	const auto& bytes = _bytes;
+	return immutable_string(bytes.size(), [&bytes](std::uint8_t oUTF8[]){
+		if(!bytes.empty()){
+			bytes.copy_range(0, bytes.size(), reinterpret_cast<rope_byte*>(oUTF8));
+		}
+	});
+}
+
+
+
+///////////////////////////		UNIT TESTS
+
+
+namespace {
+
+	std::string MakeText(std::size_t iSize){
+		std::string result;
+		for(std::size_t i = 0 ; i < iSize ; i++){
+			result.push_back(static_cast<char>('a' + i % 26));
+		}
+		return result;
+	}
+
+}
+
+
+///////////////////////////		immutable_rope()
+
+
+UNIT_TEST("ImmutableRope", "immutable_rope()", "Basic construction", "empty() == true"){
+	const immutable_rope a;
+	UT_VERIFY(a.empty());
+	UT_VERIFY(a.get_utf8() == "");
+}
+
+UNIT_TEST("ImmutableRope", "immutable_rope(immutable_string)", "Out-of-line string: a-z", "get_string() == 'a-z'"){
+	const immutable_string a("abcdefghijklmnopqrstuvwxyz");
+	const immutable_rope b(a);
+	UT_VERIFY(b.size() == 26);
+	UT_VERIFY(b.get_string() == a);
+}
+
+UNIT_TEST("ImmutableRope", "get_string()", "100000 bytes, relaxed chunks", "same text"){
+	const auto text = MakeText(100000);
+	const immutable_rope a(text);
+	const auto b = a.substr(1, 4000) + a;
+	UT_VERIFY(b.get_string() == immutable_string(text.substr(1, 4000) + text));
+	UT_VERIFY(immutable_rope(b.get_string()) == b);
+}
+
+
+///////////////////////////		immutable_rope::insert()
+
+
+UNIT_TEST("ImmutableRope", "immutable_rope::insert()", "Middle of 100000 bytes", "correct text, original unchanged"){
+	const auto text = MakeText(100000);
+	const immutable_rope a(text);
+	const auto b = a.insert(50000, immutable_rope(std::string("XYZ")));
+
+	UT_VERIFY(a.get_utf8() == text);
+	UT_VERIFY(b.size() == 100003);
+	UT_VERIFY(b.get_utf8() == text.substr(0, 50000) + "XYZ" + text.substr(50000));
+}
+
+UNIT_TEST("ImmutableRope", "immutable_rope::insert()", "1 byte into 100000 bytes", "reuses the unchanged chunks"){
+#if STEADY_STATS_ON
+	const immutable_rope a(MakeText(100000));
+	const auto leaves = steady::get_leaf_count<rope_byte>();
+	const auto b = a.insert(40000, immutable_rope(std::string("X")));
+
+	//	A few new chunks around the edit instead of 100000 / 128.
+	UT_VERIFY(steady::get_leaf_count<rope_byte>() - leaves < 16);
+	UT_VERIFY(b.size() == 100001);
+#endif
+}
+
+UNIT_TEST("ImmutableRope", "immutable_rope::insert()", "Multi-byte code points", "boundaries respected"){
+	const immutable_rope a(std::string("a\xc3\xa5" "b"));
+	UT_VERIFY(a.is_char_boundary(1));
+	UT_VERIFY(!a.is_char_boundary(2));
+	UT_VERIFY(a.insert(3, immutable_rope(std::string("-"))).get_utf8() == "a\xc3\xa5-b");
+}
+
+
+///////////////////////////		immutable_rope::erase()
+
+
+UNIT_TEST("ImmutableRope", "immutable_rope::erase()", "Middle of 100000 bytes", "correct text"){
+	const auto text = MakeText(100000);
+	const auto b = immutable_rope(text).erase(1000, 60000);
+	UT_VERIFY(b.get_utf8() == text.substr(0, 1000) + text.substr(61000));
+}
+
+UNIT_TEST("ImmutableRope", "immutable_rope::erase()", "Everything", "empty"){
+	UT_VERIFY(immutable_rope(std::string("abc")).erase(0, 3).empty());
+}
+
+
+///////////////////////////		immutable_rope::substr()
+
+
+UNIT_TEST("ImmutableRope", "immutable_rope::substr()", "Middle of 100000 bytes", "correct text"){
+	const auto text = MakeText(100000);
+	const auto b = immutable_rope(text).substr(33333, 333);
+	UT_VERIFY(b.get_utf8() == text.substr(33333, 333));
+}
+
+
+///////////////////////////		immutable_rope::operator==()
+
+
+UNIT_TEST("ImmutableRope", "immutable_rope::operator==()", "Same text, different edits", "equal"){
+	const immutable_rope a(std::string("hello world"));
+	const auto b = a.erase(5, 6) + immutable_rope(std::string(" world"));
+	UT_VERIFY(a == b);
+	UT_VERIFY(a != a.erase(0, 1));
+}
@@ -0,0 +1,96 @@
+//
+//  ImmutableRope.h
+//  Permafrost
+//
+//  Copyright (c) 2014 Marcus Zetterquist. All rights reserved.
+//
+
+#ifndef __Permafrost__ImmutableRope__
+#define __Permafrost__ImmutableRope__
+
+#include <string>
+#include <cstdint>
+#include "cpp_extension.h"
+#include "ImmutableString.h"
+#include "../steady/steady_vector.h"
+
+
+
+///////////////////////////		rope_byte
+
+
+/**
+	One UTF-8 code unit of an immutable_rope. A type of its own so the rope can pick its own branching factor: each
+	leaf node of the steady::vector is a chunk of 128 bytes.
+*/
+struct rope_byte {
+	bool operator==(const rope_byte& iOther) const {
+		return _value == iOther._value;
+	}
+
+	std::uint8_t _value;
+};
+
+namespace steady {
+	template <> struct branching_factor_policy<rope_byte> { static const int SHIFT = 7; };
+}
+
+
+
+///////////////////////////		immutable_rope
+
+
+/**
+	Cannot be modified. Text for big documents that are edited in small steps, with every revision kept.
+
+	The UTF-8 bytes live in a steady::vector<rope_byte>: its leaf nodes are chunks of text and the size tables of its
+	inodes hold the lengths of their subtrees. insert(), erase(), substr() and operator+() are O(log n) and share
+	every chunk they don't change with the original, so each revision only costs memory proportional to the edit.
+
+	Positions are byte offsets into the UTF-8 and must be on code point boundaries.
+*/
+
+class immutable_rope {
+	public: immutable_rope();
+
+	/**
+		iUTF8 must be well-formed UTF8 Unicode using Normalization D. Else defect.
+	*/
+	public: explicit immutable_rope(const std::string& iUTF8);
+	public: explicit immutable_rope(const immutable_string& iString);
+
+	public: bool check_invariant() const;
+
+	//	In bytes.
+	public: std::size_t size() const;
+
+	public: bool empty() const;
+
+	public: immutable_rope insert(std::size_t iPos, const immutable_rope& iText) const;
+	public: immutable_rope erase(std::size_t iPos, std::size_t iCount) const;
+	public: immutable_rope substr(std::size_t iPos, std::size_t iCount) const;
+	public: immutable_rope operator+(const immutable_rope& iOther) const;
+
+	//	True if iPos is the start of a code point or the end of the text.
+	public: bool is_char_boundary(std::size_t iPos) const;
+
+	public: bool operator==(const immutable_rope& iOther) const;
+
+	public: bool operator!=(const immutable_rope& iOther) const {
+		return !(*this == iOther);
+	}
+
+	//	Flattens the rope. O(n).
+	public: std::string get_utf8() const;
+	public: immutable_string get_string() const;
+
+
+	//////////////////		State
+		private: explicit immutable_rope(const steady::vector<rope_byte>& iBytes);
+
+		private: steady::vector<rope_byte> _bytes;
+};
+
+
+
+#endif /* defined(__Permafrost__ImmutableRope__) */
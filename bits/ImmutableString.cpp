@@ -9,6 +9,8 @@
 #include "ImmutableString.h"
 
 #include <utility>
+#include <new>
+#include <cstring>
 
 
 
@@ -21,35 +23,84 @@ bool IsValidUTF8(const std::string& /*iString*/){
 
 
 
+namespace {
+
+	//	64-bit FNV-1a. Never returns 0, which marks a hash that isn't computed yet.
+	std::size_t CalcHash(const std::uint8_t iData[], std::size_t iSize){
+		std::uint64_t hash = 14695981039346656037ULL;
+		for(std::size_t i = 0 ; i < iSize ; i++){
+			hash ^= iData[i];
+			hash *= 1099511628211ULL;
+		}
+		const std::size_t result = static_cast<std::size_t>(hash);
+		return result == 0 ? 1 : result;
+	}
+
+}
+
+
+immutable_string::TContainer::TSharedBuffer* immutable_string::TContainer::MakeBuffer(std::size_t iSize){
+	void* memory = ::operator new(sizeof(TSharedBuffer) + iSize);
+	TSharedBuffer* result = new (memory) TSharedBuffer();
+	result->_rc.store(1, std::memory_order_relaxed);
+	result->_hash.store(0, std::memory_order_relaxed);
+	return result;
+}
+
+void immutable_string::TContainer::ReleaseBuffer(TSharedBuffer* iBuffer){
+	ASSERT(iBuffer != nullptr);
+
+	if(iBuffer->_rc.fetch_sub(1, std::memory_order_acq_rel) == 1){
+		iBuffer->~TSharedBuffer();
+		::operator delete(iBuffer);
+	}
+}
+
 immutable_string::TContainer::TContainer() :
 	_size(0)
 {
 	ASSERT(check_invariant());
 }
 
-immutable_string::TContainer::TContainer(const std::string& iData) :
-	_size(iData.size())
+immutable_string::TContainer::TContainer(std::size_t iSize) :
+	_size(iSize)
 {
 	if(_size > kInlineSize){
-		_data._ptr = new std::uint8_t[_size];
-		memcpy(_data._ptr, iData.c_str(), _size);
+		_data._buffer = MakeBuffer(_size);
 	}
 	else{
-		memcpy(_data._inline, iData.c_str(), _size);
 	}
 
 	ASSERT(check_invariant());
-	ASSERT(iData == std::string(data(), data() + _size));
 }
 
+immutable_string::TContainer::TContainer(const std::uint8_t iData[], std::size_t iSize) :
+	TContainer(iSize)
+{
+	ASSERT(iData != nullptr || iSize == 0);
+
+	if(iSize > 0){
+		memcpy(GetWritableData(), iData, iSize);
+	}
+
+	ASSERT(check_invariant());
+	ASSERT(iSize == 0 || memcmp(data(), iData, iSize) == 0);
+}
+
+immutable_string::TContainer::TContainer(const std::string& iData) :
+	TContainer(reinterpret_cast<const std::uint8_t*>(iData.data()), iData.size())
+{
+}
+
+//	Out-of-line strings share the buffer of iOther.
 immutable_string::TContainer::TContainer(const TContainer& iOther) :
 	_size(iOther._size)
 {
 	ASSERT(iOther.check_invariant());
 
 	if(_size > kInlineSize){
-		_data._ptr = new std::uint8_t[_size];
-		memcpy(_data._ptr, iOther._data._ptr, _size);
+		_data._buffer = iOther._data._buffer;
+		_data._buffer->_rc.fetch_add(1, std::memory_order_relaxed);
 	}
 	else{
 		memcpy(_data._inline, iOther._data._inline, _size);
@@ -62,8 +113,8 @@ immutable_string::TContainer::~TContainer(){
 	ASSERT(check_invariant());
 
 	if(_size > kInlineSize){
-		delete[] _data._ptr;
-		_data._ptr = nullptr;
+		ReleaseBuffer(_data._buffer);
+		_data._buffer = nullptr;
 	}
 	else{
 	}
@@ -73,7 +124,8 @@ bool immutable_string::TContainer::check_invariant() const{
 	ASSERT(this != nullptr);
 
 	if(_size > kInlineSize){
-		ASSERT(_data._ptr != nullptr);
+		ASSERT(_data._buffer != nullptr);
+		ASSERT(_data._buffer->_rc.load(std::memory_order_relaxed) > 0);
 	}
 	else{
 	}
@@ -85,7 +137,18 @@ const std::uint8_t* immutable_string::TContainer::data() const{
 	ASSERT(check_invariant());
 
 	if(_size > kInlineSize){
-		return _data._ptr;
+		return _data._buffer->data();
+	}
+	else{
+		return &_data._inline[0];
+	}
+}
+
+std::uint8_t* immutable_string::TContainer::GetWritableData(){
+	ASSERT(check_invariant());
+
+	if(_size > kInlineSize){
+		return _data._buffer->data();
 	}
 	else{
 		return &_data._inline[0];
@@ -98,15 +161,47 @@ std::size_t immutable_string::TContainer::size() const{
 	return _size;
 }
 
+/**
+	Inline strings are short, so their hash is computed each time. Threads that compute the hash of the same buffer
+	at once all get the same value, so any of them can store it.
+*/
+std::size_t immutable_string::TContainer::get_hash() const{
+	ASSERT(check_invariant());
+
+	if(_size > kInlineSize){
+		std::size_t hash = _data._buffer->_hash.load(std::memory_order_relaxed);
+		if(hash == 0){
+			hash = CalcHash(_data._buffer->data(), _size);
+			_data._buffer->_hash.store(hash, std::memory_order_relaxed);
+		}
+		return hash;
+	}
+	else{
+		return CalcHash(_data._inline, _size);
+	}
+}
+
+//	Out-of-line strings are equal if they share a buffer and different if their hashes differ.
 bool immutable_string::TContainer::operator==(const TContainer& iOther) const {
 	ASSERT(check_invariant());
 	ASSERT(iOther.check_invariant());
 
-	if(_size == iOther._size){
-		return memcmp(data(), iOther.data(), _size) == 0;
+	if(_size != iOther._size){
+		return false;
+	}
+	else if(_size > kInlineSize){
+		if(_data._buffer == iOther._data._buffer){
+			return true;
+		}
+		else if(get_hash() != iOther.get_hash()){
+			return false;
+		}
+		else{
+			return memcmp(data(), iOther.data(), _size) == 0;
+		}
 	}
 	else{
-		return false;
+		return memcmp(data(), iOther.data(), _size) == 0;
 	}
 }
 
@@ -174,6 +269,13 @@ immutable_string::immutable_string(const immutable_string& iOther) :
 {
 	ASSERT(check_invariant());
 }
+
+//	Constructor #5
+immutable_string::immutable_string(const std::uint8_t iUTF8[], std::size_t iSize) :
+	_container(iUTF8, iSize)
+{
+	ASSERT(check_invariant());
+}
 	
 /*
 //	Constructor #5
@@ -222,6 +324,18 @@ std::string immutable_string::get_utf8() const {
 	return std::string(p, p + _container.size());
 }
 
+const std::uint8_t* immutable_string::data() const {
+	ASSERT(check_invariant());
+
+	return _container.data();
+}
+
+std::size_t immutable_string::get_hash() const {
+	ASSERT(check_invariant());
+
+	return _container.get_hash();
+}
+
 
 
 ///////////////////////////		UNIT TESTS
@@ -245,9 +359,14 @@ UNIT_TEST("ImmutableString", "immutable_string()", "Inline string: abc", "get_ut
 ///////////////////////////		immutable_string(std::string)
 
 
-UNIT_TEST("ImmutableString", "immutable_string(std::string)", "Out-of-line string: 123456789", "get_utf8() == '123456789'"){
-	UT_VERIFY(immutable_string::TContainer::kInlineSize == 8);
-	UT_VERIFY(immutable_string("123456789").get_utf8() == "123456789");
+UNIT_TEST("ImmutableString", "immutable_string(std::string)", "Out-of-line string: a-z", "get_utf8() == 'a-z'"){
+	UT_VERIFY(immutable_string::TContainer::kInlineSize == 22);
+	UT_VERIFY(immutable_string("abcdefghijklmnopqrstuvwxyz").get_utf8() == "abcdefghijklmnopqrstuvwxyz");
+}
+
+UNIT_TEST("ImmutableString", "immutable_string(std::string)", "22 and 23 characters", "get_utf8() == correct"){
+	UT_VERIFY(immutable_string("1234567890123456789012").get_utf8() == "1234567890123456789012");
+	UT_VERIFY(immutable_string("12345678901234567890123").get_utf8() == "12345678901234567890123");
 }
 
 UNIT_TEST("ImmutableString", "immutable_string(std::string)", "String with embedded nulls", "get_utf8() == correct"){
@@ -255,6 +374,24 @@ UNIT_TEST("ImmutableString", "immutable_string(std::string)", "String with embed
 }
 
 
+UNIT_TEST("ImmutableString", "immutable_string(const std::uint8_t[], std::size_t)", "Inline and out-of-line bytes", "get_utf8() == correct"){
+	const std::string text("abcdefghijklmnopqrstuvwxyz");
+	const auto bytes = reinterpret_cast<const std::uint8_t*>(text.data());
+	UT_VERIFY(immutable_string(bytes, 3).get_utf8() == "abc");
+	UT_VERIFY(immutable_string(bytes, 26) == immutable_string(text));
+	UT_VERIFY(immutable_string(bytes, 0).empty());
+}
+
+UNIT_TEST("ImmutableString", "immutable_string(std::size_t, F)", "Out-of-line string filled in two pieces", "get_utf8() == correct"){
+	const immutable_string a(26, [](std::uint8_t oUTF8[]){
+		memcpy(oUTF8, "abcdefghijklm", 13);
+		memcpy(oUTF8 + 13, "nopqrstuvwxyz", 13);
+	});
+	UT_VERIFY(a.get_utf8() == "abcdefghijklmnopqrstuvwxyz");
+	UT_VERIFY(a.get_hash() == immutable_string("abcdefghijklmnopqrstuvwxyz").get_hash());
+}
+
+
 ///////////////////////////		immutable_string(const immutable_string)
 
 
@@ -264,11 +401,21 @@ UNIT_TEST("ImmutableString", "immutable_string(const immutable_string)", "Inline
 	UT_VERIFY(copy.get_utf8() == "abcd");
 }
 
-UNIT_TEST("ImmutableString", "immutable_string(const immutable_string)", "Out-of-line string: 123456789", "get_utf8() == '123456789'"){
-	UT_VERIFY(immutable_string::TContainer::kInlineSize == 8);
-	const immutable_string temp("123456789");
+UNIT_TEST("ImmutableString", "immutable_string(const immutable_string)", "Out-of-line string: a-z", "get_utf8() == 'a-z'"){
+	UT_VERIFY(immutable_string::TContainer::kInlineSize == 22);
+	const immutable_string temp("abcdefghijklmnopqrstuvwxyz");
 	const immutable_string copy(temp);
-	UT_VERIFY(copy.get_utf8() == "123456789");
+	UT_VERIFY(copy.get_utf8() == "abcdefghijklmnopqrstuvwxyz");
+}
+
+UNIT_TEST("ImmutableString", "immutable_string(const immutable_string)", "Out-of-line string: a-z", "shares the characters"){
+	const immutable_string::TContainer temp(std::string("abcdefghijklmnopqrstuvwxyz"));
+	immutable_string::TContainer copy(temp);
+	UT_VERIFY(copy.data() == temp.data());
+
+	copy = immutable_string::TContainer(std::string("xyz"));
+	UT_VERIFY(copy.data() != temp.data());
+	UT_VERIFY(copy.size() == 3);
 }
 
 
@@ -279,9 +426,9 @@ UNIT_TEST("ImmutableString", "immutable_string::size()", "Inline string: abc", "
 	UT_VERIFY(immutable_string("abcd").size() == 4);
 }
 
-UNIT_TEST("ImmutableString", "immutable_string::size()", "Out-of-line string: 123456789", "size() == 9"){
-	UT_VERIFY(immutable_string::TContainer::kInlineSize == 8);
-	UT_VERIFY(immutable_string("123456789").size() == 9);
+UNIT_TEST("ImmutableString", "immutable_string::size()", "Out-of-line string: a-z", "size() == 26"){
+	UT_VERIFY(immutable_string::TContainer::kInlineSize == 22);
+	UT_VERIFY(immutable_string("abcdefghijklmnopqrstuvwxyz").size() == 26);
 }
 
 
@@ -308,6 +455,24 @@ UNIT_TEST("ImmutableString", "immutable_string::operator==()", "Two non-empty st
 	UT_VERIFY(!(immutable_string("abc") == immutable_string("xyz")));
 }
 
+UNIT_TEST("ImmutableString", "immutable_string::operator==()", "Two out-of-line strings, same size", "equal / not equal"){
+	UT_VERIFY(immutable_string("abcdefghijklmnopqrstuvwxyz") == immutable_string("abcdefghijklmnopqrstuvwxyz"));
+	UT_VERIFY(!(immutable_string("abcdefghijklmnopqrstuvwxyz") == immutable_string("abcdefghijklmnopqrstuvwxyZ")));
+}
+
+
+///////////////////////////		immutable_string::get_hash()
+
+
+UNIT_TEST("ImmutableString", "immutable_string::get_hash()", "Equal strings", "same hash"){
+	UT_VERIFY(immutable_string("abc").get_hash() == immutable_string("abc").get_hash());
+
+	const immutable_string a("abcdefghijklmnopqrstuvwxyz");
+	UT_VERIFY(a.get_hash() == a.get_hash());
+	UT_VERIFY(a.get_hash() == immutable_string("abcdefghijklmnopqrstuvwxyz").get_hash());
+	UT_VERIFY(a.get_hash() != immutable_string("abcdefghijklmnopqrstuvwxyZ").get_hash());
+}
+
 
 ///////////////////////////		immutable_string::get_utf8()
 
@@ -320,8 +485,8 @@ UNIT_TEST("ImmutableString", "immutable_string::get_utf8()", "Inline string: abc
 	UT_VERIFY(immutable_string("abc").get_utf8() == "abc");
 }
 
-UNIT_TEST("ImmutableString", "immutable_string::get_utf8()", "Out-of-line string: 123456789", "123456789"){
-	UT_VERIFY(immutable_string("123456789").get_utf8() == "123456789");
+UNIT_TEST("ImmutableString", "immutable_string::get_utf8()", "Out-of-line string: a-z", "a-z"){
+	UT_VERIFY(immutable_string("abcdefghijklmnopqrstuvwxyz").get_utf8() == "abcdefghijklmnopqrstuvwxyz");
 }
 
 
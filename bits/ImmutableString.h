@@ -11,6 +11,8 @@
 
 #include <string>
 #include <initializer_list>
+#include <atomic>
+#include <cstdint>
 #include "cpp_extension.h"
 
 
@@ -28,6 +30,10 @@ bool IsValidUTF8(const std::string& iString);
 
 	All comparisons are done using Unicode Normalization D.
 	Pure - can contain binary-zeros.
+
+	Strings up to kInlineSize bytes are stored inside the object. Longer strings live in a shared buffer with an atomic
+	reference counter, so copying an immutable_string never allocates or copies characters, and it is safe to copy
+	and destroy copies from several threads. The buffer also caches the hash of the string.
 */
 
 class immutable_string {
@@ -43,6 +49,25 @@ class immutable_string {
 	//	Constructor #4
 	public: immutable_string(const immutable_string& iOther);
 
+	//	Constructor #5
+	/**
+		The iSize bytes at iUTF8, same rules as constructor #3.
+	*/
+	public: immutable_string(const std::uint8_t iUTF8[], std::size_t iSize);
+
+	//	Constructor #6
+	/**
+		Makes a string of iSize bytes and calls iFill(std::uint8_t oUTF8[]) once to write them. Lets text that is stored
+		in pieces be copied straight into the string. Same rules as constructor #3.
+	*/
+	public: template <class F> immutable_string(std::size_t iSize, F iFill) :
+		_container(iSize)
+	{
+		iFill(_container.GetWritableData());
+
+		ASSERT(check_invariant());
+	}
+
 	public: ~immutable_string();
 
 	public: bool check_invariant() const;
@@ -59,28 +84,59 @@ class immutable_string {
 
 	public: std::string get_utf8() const;
 
+	//	The size() bytes of UTF-8. Valid as long as this string.
+	public: const std::uint8_t* data() const;
+
+	//	Computed the first time it's needed for an out-of-line string, then cached in its shared buffer.
+	public: std::size_t get_hash() const;
+
 
 	//////////////////		State
 		public: class TContainer {
-			public: static const std::size_t kInlineSize = 8;
+			public: static const std::size_t kInlineSize = 22;
 
 			public: TContainer();
 			public: TContainer(const std::string& iData);
+			public: TContainer(const std::uint8_t iData[], std::size_t iSize);
+
+			//	iSize bytes that aren't set yet, see GetWritableData().
+			public: explicit TContainer(std::size_t iSize);
 			public: TContainer(const TContainer& iOther);
 			public: ~TContainer();
 			public: bool check_invariant() const;
 			public: const std::uint8_t* data() const;
+
+			//	Only while making the string.
+			public: std::uint8_t* GetWritableData();
 			public: std::size_t size() const;
 			public: bool operator==(const TContainer& iOther) const;
+			public: std::size_t get_hash() const;
 
 			public: TContainer& operator=(const TContainer& iOther);
 			public: void swap(TContainer& iOther) throw();
 
+			/**
+				Header of an out-of-line string. The _size characters follow right after it, in the same allocation.
+				_hash is 0 until get_hash() computes it.
+			*/
+			private: struct TSharedBuffer {
+				std::atomic<int> _rc;
+				mutable std::atomic<std::size_t> _hash;
+
+				std::uint8_t* data(){
+					return reinterpret_cast<std::uint8_t*>(this + 1);
+				}
+			};
+
+			//	The iSize characters aren't set.
+			private: static TSharedBuffer* MakeBuffer(std::size_t iSize);
+			private: static void ReleaseBuffer(TSharedBuffer* iBuffer);
+
 			private: union UData {
-				UData() : _ptr(nullptr){};
+				UData() : _buffer(nullptr){};
 
 				std::uint8_t _inline[kInlineSize];
-				std::uint8_t* _ptr;
+				TSharedBuffer* _buffer;
 			};
 
 			private: UData _data;
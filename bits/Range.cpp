@@ -139,3 +139,49 @@ UNIT_TEST("Range", "", "", ""){
 	}
 }
 
+
+
+///////////////////////////		Chunk ranges
+
+
+UNIT_TEST("Range", "Reduce()", "std::vector", "sum"){
+	const std::vector<int> a = { 20, 21, 22 };
+	UT_VERIFY(Reduce(MakeChunkRange(a), 0, [](int acc, int value){ return acc + value; }) == 63);
+	UT_VERIFY(Reduce(MakeChunkRange(std::vector<int>()), 7, [](int acc, int value){ return acc + value; }) == 7);
+}
+
+UNIT_TEST("Range", "Reduce()", "Concatenated steady::vector", "sum, one chunk per leaf node"){
+	std::vector<int> values;
+	for(int i = 0 ; i < 1000 ; i++){
+		values.push_back(i);
+	}
+	const steady::vector<int> a(values);
+	const auto b = a.slice(3, 1000) + a;
+
+	UT_VERIFY(Reduce(MakeChunkRange(b), 0, [](int acc, int value){ return acc + value; }) == 499500 - 3 + 499500);
+
+	std::size_t chunk_count = 0;
+	std::size_t value_count = 0;
+	ForEachChunk(MakeChunkRange(b), [&](const int values[], std::size_t count){
+		UT_VERIFY(count <= steady::branching_factor<int>::FACTOR);
+		for(std::size_t i = 0 ; i < count ; i++){
+			//	b is 3...999 then 0...999.
+			const auto index = value_count + i;
+			UT_VERIFY(values[i] == int(index < 997 ? index + 3 : index - 997));
+		}
+		chunk_count++;
+		value_count += count;
+	});
+	UT_VERIFY(value_count == b.size());
+	UT_VERIFY(chunk_count < b.size() / 4);
+}
+
+UNIT_TEST("Range", "Reduce()", "Part of steady::vector", "sum"){
+	const steady::vector<int> a = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+	UT_VERIFY(Reduce(MakeChunkRange(a, 2, 5), 0, [](int acc, int value){ return acc + value; }) == 3 + 4 + 5);
+}
+
+UNIT_TEST("Range", "Reduce()", "immutable_string", "count of bytes"){
+	const immutable_string a("abcdefghijklmnopqrstuvwxyz");
+	UT_VERIFY(Reduce(MakeChunkRange(a), 0, [](int acc, std::uint8_t value){ return acc + (value == 'e' ? 1 : 0); }) == 1);
+}
@@ -12,12 +12,17 @@
 
 #include <vector>
 #include <initializer_list>
+#include <algorithm>
+#include <cstdint>
 #include "cpp_extension.h"
+#include "ImmutableString.h"
+#include "../steady/steady_vector.h"
 
 ///////////////////////////		immutable_vector
 
 
 /**
+	Costs a virtual call per value: use a chunk range instead, below.
 */
 template <typename T>
 struct irange_support {
@@ -27,4 +32,134 @@ struct irange_support {
 };
 
 
+
+///////////////////////////		Chunk ranges
+
+
+/**
+	A chunk range hands out its values as contiguous chunks, in order:
+
+		TChunk<T> next_chunk();
+
+	returns the next chunk, or a chunk with fCount == 0 when there are no more values. Ranges are plain values, not
+	virtual interfaces, so generic code over them is templated on the range type. Then the loop over the values of a
+	chunk inlines and can be vectorized, and the range is only asked once per chunk.
+*/
+template <typename T>
+struct TChunk {
+	const T* fValues;
+	std::size_t fCount;
+};
+
+
+/**
+	One contiguous array: std::vector<>, immutable_string or a C array.
+*/
+template <typename T>
+struct TArrayChunkRange {
+	typedef T value_type;
+
+	TArrayChunkRange(const T iValues[], std::size_t iCount) :
+		fValues(iValues),
+		fCount(iCount)
+	{
+	}
+
+	TChunk<T> next_chunk(){
+		const TChunk<T> result = { fValues, fCount };
+		fValues += fCount;
+		fCount = 0;
+		return result;
+	}
+
+
+	//////////////		State
+		private: const T* fValues;
+		private: std::size_t fCount;
+};
+
+
+/**
+	One chunk per leaf node of a steady::vector<>, also for vectors made by concatenation. Holds a copy of the vector,
+	which is free and keeps the leaf nodes alive.
+*/
+template <typename T>
+struct TSteadyChunkRange {
+	typedef T value_type;
+
+	TSteadyChunkRange(const steady::vector<T>& iVector, std::size_t iStart, std::size_t iEnd) :
+		fVector(iVector),
+		fStart(iStart),
+		fEnd(iEnd)
+	{
+		ASSERT(iStart <= iEnd && iEnd <= iVector.size());
+	}
+
+	TChunk<T> next_chunk(){
+		if(fStart == fEnd){
+			const TChunk<T> result = { nullptr, 0 };
+			return result;
+		}
+
+		std::size_t leaf_begin = 0;
+		std::size_t leaf_size = 0;
+		const T* values = steady::internals::find_leaf_values(fVector, fStart, leaf_begin, leaf_size);
+		const std::size_t offset = fStart - leaf_begin;
+		const std::size_t count = std::min(leaf_size - offset, fEnd - fStart);
+
+		const TChunk<T> result = { values + offset, count };
+		fStart += count;
+		return result;
+	}
+
+
+	//////////////		State
+		private: steady::vector<T> fVector;
+		private: std::size_t fStart;
+		private: std::size_t fEnd;
+};
+
+
+template <typename T>
+TArrayChunkRange<T> MakeChunkRange(const std::vector<T>& iVector){
+	return TArrayChunkRange<T>(iVector.data(), iVector.size());
+}
+
+template <typename T>
+TSteadyChunkRange<T> MakeChunkRange(const steady::vector<T>& iVector){
+	return TSteadyChunkRange<T>(iVector, 0, iVector.size());
+}
+
+template <typename T>
+TSteadyChunkRange<T> MakeChunkRange(const steady::vector<T>& iVector, std::size_t iStart, std::size_t iEnd){
+	return TSteadyChunkRange<T>(iVector, iStart, iEnd);
+}
+
+//	The UTF-8 bytes.
+inline TArrayChunkRange<std::uint8_t> MakeChunkRange(const immutable_string& iString){
+	return TArrayChunkRange<std::uint8_t>(iString.data(), iString.size());
+}
+
+
+//	Calls iF(const T values[], std::size_t count) for each chunk.
+template <typename R, typename F>
+void ForEachChunk(R iRange, F iF){
+	for(auto chunk = iRange.next_chunk() ; chunk.fCount > 0 ; chunk = iRange.next_chunk()){
+		iF(chunk.fValues, chunk.fCount);
+	}
+}
+
+//	Returns iOp(...iOp(iOp(iInit, v0), v1)..., vn).
+template <typename R, typename T, typename Op>
+T Reduce(R iRange, T iInit, Op iOp){
+	T result = iInit;
+	for(auto chunk = iRange.next_chunk() ; chunk.fCount > 0 ; chunk = iRange.next_chunk()){
+		for(std::size_t i = 0 ; i < chunk.fCount ; i++){
+			result = iOp(result, chunk.fValues[i]);
+		}
+	}
+	return result;
+}
+
+
 #endif /* defined(__Permafrost__Range__) */
@@ -0,0 +1,455 @@
+/*
+	Copyright 2015 Marcus Zetterquist
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+
+	Microbenchmarks of steady::vector<> against std::vector<>.
+
+	Build it as its own executable, with asserts and tracing turned off, once per branching factor. The value types
+	specialize branching_factor_policy<T>, so every size uses BRANCHING_FACTOR_SHIFT instead of being clamped to
+	MAX_DEFAULT_LEAF_BYTES like other big T:
+
+		for shift in 2 3 4 5 6 ; do
+			c++ -std=c++11 -O3 -pthread -DQUARK_ASSERT_ON=0 -DQUARK_TRACE_ON=0 -DQUARK_UNIT_TESTS_ON=0 \
+				-DBRANCHING_FACTOR_SHIFT=$shift benchmark.cpp quark.cpp -o benchmark_$shift && ./benchmark_$shift
+		done
+
+	Each benchmark runs with fixed sizes and random seeds and reports the fastest of its runs. Allocations are counted by
+	replacing global operator new, so they include the nodes of steady::vector<> and the buffers of std::vector<>.
+*/
+
+#include "steady_vector.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include <atomic>
+#include <new>
+#include "quark.h"
+
+
+////////////////////////////////////////////		Allocation counting
+
+
+static std::atomic<std::size_t> g_allocation_count(0);
+static std::atomic<std::size_t> g_allocation_bytes(0);
+
+/*
+	All forms of operator new and delete are replaced, so every block is counted and freed by the function family that
+	allocated it. The nothrow forms call these by default.
+*/
+static void* counted_allocate(std::size_t size){
+	g_allocation_count.fetch_add(1, std::memory_order_relaxed);
+	g_allocation_bytes.fetch_add(size, std::memory_order_relaxed);
+	void* result = std::malloc(size == 0 ? 1 : size);
+	if(result == nullptr){
+		throw std::bad_alloc();
+	}
+	return result;
+}
+
+void* operator new(std::size_t size){
+	return counted_allocate(size);
+}
+
+void* operator new[](std::size_t size){
+	return counted_allocate(size);
+}
+
+void operator delete(void* p) noexcept{
+	std::free(p);
+}
+
+void operator delete[](void* p) noexcept{
+	std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept{
+	std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept{
+	std::free(p);
+}
+
+#if __cpp_aligned_new
+static void* counted_allocate(std::size_t size, std::align_val_t alignment){
+	g_allocation_count.fetch_add(1, std::memory_order_relaxed);
+	g_allocation_bytes.fetch_add(size, std::memory_order_relaxed);
+
+	//	aligned_alloc() wants a size that is a multiple of the alignment.
+	const auto align = static_cast<std::size_t>(alignment);
+	void* result = std::aligned_alloc(align, (size + align - 1) / align * align);
+	if(result == nullptr){
+		throw std::bad_alloc();
+	}
+	return result;
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment){
+	return counted_allocate(size, alignment);
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment){
+	return counted_allocate(size, alignment);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept{
+	std::free(p);
+}
+
+void operator delete[](void* p, std::align_val_t) noexcept{
+	std::free(p);
+}
+
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept{
+	std::free(p);
+}
+
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept{
+	std::free(p);
+}
+#endif
+
+
+
+////////////////////////////////////////////		Value types
+
+
+//	Values of 4, 16 and 64 bytes.
+template <std::size_t SIZE>
+struct value_t {
+	value_t() = default;
+	explicit value_t(std::uint32_t value){
+		for(auto& i: _words){
+			i = value;
+		}
+	}
+
+	bool operator==(const value_t& other) const{
+		return _words == other._words;
+	}
+
+	std::uint32_t get() const{
+		return _words[0];
+	}
+
+	std::array<std::uint32_t, SIZE / 4> _words;
+};
+
+namespace steady {
+	template <std::size_t SIZE> struct branching_factor_policy<value_t<SIZE>> { static const int SHIFT = BRANCHING_FACTOR_SHIFT; };
+}
+
+
+
+////////////////////////////////////////////		Measuring
+
+
+namespace {
+
+	//	Results are added to this so the compiler can't remove the work.
+	volatile std::uint64_t g_sink = 0;
+
+	/*
+		Makes the compiler assume the memory at _p_ is read, so work that only fills memory - like a copy of a vector
+		whose values are never used - isn't removed.
+	*/
+	inline void escape(const void* p){
+	#if defined(__GNUC__)
+		asm volatile("" : : "g"(p) : "memory");
+	#else
+		static const void* volatile s_escaped = nullptr;
+		s_escaped = p;
+	#endif
+	}
+
+	const std::size_t VALUE_COUNT = 100000;
+	const int RUN_COUNT = 5;
+
+	struct measurement {
+		double _ns_per_op;
+		double _allocations_per_op;
+		double _bytes_per_op;
+	};
+
+	/*
+		_setup_ makes the input for one run. Only _f_ is measured. _op_count_ is the number of operations _f_ does.
+	*/
+	template <class Setup, class F>
+	measurement measure(std::size_t op_count, Setup setup, F f){
+		measurement best = { 1e30, 0.0, 0.0 };
+		for(int run = 0 ; run < RUN_COUNT ; run++){
+			auto input = setup();
+
+			const auto allocation_count = g_allocation_count.load();
+			const auto allocation_bytes = g_allocation_bytes.load();
+			const auto start = std::chrono::steady_clock::now();
+
+			f(input);
+
+			const auto end = std::chrono::steady_clock::now();
+			const double ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+			if(ns / op_count < best._ns_per_op){
+				best._ns_per_op = ns / op_count;
+				best._allocations_per_op = double(g_allocation_count.load() - allocation_count) / op_count;
+				best._bytes_per_op = double(g_allocation_bytes.load() - allocation_bytes) / op_count;
+			}
+		}
+		return best;
+	}
+
+	void print_header(){
+		std::printf("%-28s %6s %12s %12s %8s %10s %10s %10s %10s\n",
+			"benchmark", "sizeof", "steady ns", "std ns", "ratio",
+			"steady a", "steady B", "std a", "std B"
+		);
+	}
+
+	void print_result(const char name[], std::size_t value_size, const measurement& steady_result, const measurement& std_result){
+		std::printf("%-28s %6d %12.2f %12.2f %8.2f %10.3f %10.1f %10.3f %10.1f\n",
+			name,
+			int(value_size),
+			steady_result._ns_per_op,
+			std_result._ns_per_op,
+			steady_result._ns_per_op / std_result._ns_per_op,
+			steady_result._allocations_per_op,
+			steady_result._bytes_per_op,
+			std_result._allocations_per_op,
+			std_result._bytes_per_op
+		);
+	}
+
+	template <class T>
+	std::vector<T> make_values(std::size_t count){
+		std::vector<T> result;
+		result.reserve(count);
+		for(std::size_t i = 0 ; i < count ; i++){
+			result.push_back(T(std::uint32_t(i)));
+		}
+		return result;
+	}
+
+	std::vector<std::size_t> make_random_indices(std::size_t count, std::size_t size){
+		std::mt19937 random(1);
+		std::uniform_int_distribution<std::size_t> distribution(0, size - 1);
+		std::vector<std::size_t> result;
+		result.reserve(count);
+		for(std::size_t i = 0 ; i < count ; i++){
+			result.push_back(distribution(random));
+		}
+		return result;
+	}
+
+}
+
+
+
+////////////////////////////////////////////		Benchmarks
+
+
+template <class T>
+void run_benchmarks(){
+	typedef steady::vector<T> steady_vec;
+	typedef std::vector<T> std_vec;
+
+	const auto n = VALUE_COUNT;
+	const auto values = make_values<T>(n);
+	const auto indices = make_random_indices(n, n);
+	const steady_vec steady_values(values);
+
+	std::printf("sizeof(T) %d: branching factor shift %d\n", int(sizeof(T)), steady::branching_factor<T>::SHIFT);
+
+	auto no_setup = []{ return 0; };
+	auto copy_steady = [&]{ return steady_values; };
+	auto copy_std = [&]{ return values; };
+
+	{
+		const auto s = measure(n, no_setup, [&](int){
+			steady_vec v;
+			for(const auto& value: values){
+				v = v.push_back(value);
+			}
+			g_sink += v.size();
+		});
+		const auto d = measure(n, no_setup, [&](int){
+			std_vec v;
+			for(const auto& value: values){
+				v.push_back(value);
+			}
+			escape(v.data());
+			g_sink += v.size();
+		});
+		print_result("push_back()", sizeof(T), s, d);
+	}
+
+	{
+		const std::size_t batch = 1000;
+		const auto s = measure(n, no_setup, [&](int){
+			steady_vec v;
+			for(std::size_t i = 0 ; i < n ; i += batch){
+				v = v.push_back(&values[i], std::min(batch, n - i));
+			}
+			g_sink += v.size();
+		});
+		const auto d = measure(n, no_setup, [&](int){
+			std_vec v;
+			for(std::size_t i = 0 ; i < n ; i += batch){
+				v.insert(v.end(), values.begin() + i, values.begin() + std::min(i + batch, n));
+			}
+			escape(v.data());
+			g_sink += v.size();
+		});
+		print_result("push_back() batch of 1000", sizeof(T), s, d);
+	}
+
+	{
+		const auto s = measure(n, copy_steady, [&](steady_vec& v){
+			for(const auto i: indices){
+				v = v.store(i, T(std::uint32_t(i)));
+			}
+			g_sink += v.size();
+		});
+		const auto d = measure(n, copy_std, [&](std_vec& v){
+			for(const auto i: indices){
+				v[i] = T(std::uint32_t(i));
+			}
+			escape(v.data());
+			g_sink += v.size();
+		});
+		print_result("store() random", sizeof(T), s, d);
+	}
+
+	{
+		const auto s = measure(n, copy_steady, [&](const steady_vec& v){
+			std::uint64_t sum = 0;
+			for(std::size_t i = 0 ; i < n ; i++){
+				sum += v[i].get();
+			}
+			g_sink += sum;
+		});
+		const auto d = measure(n, copy_std, [&](const std_vec& v){
+			std::uint64_t sum = 0;
+			for(std::size_t i = 0 ; i < n ; i++){
+				sum += v[i].get();
+			}
+			g_sink += sum;
+		});
+		print_result("operator[]() sequential", sizeof(T), s, d);
+	}
+
+	{
+		const auto s = measure(n, copy_steady, [&](const steady_vec& v){
+			std::uint64_t sum = 0;
+			for(const auto i: indices){
+				sum += v[i].get();
+			}
+			g_sink += sum;
+		});
+		const auto d = measure(n, copy_std, [&](const std_vec& v){
+			std::uint64_t sum = 0;
+			for(const auto i: indices){
+				sum += v[i].get();
+			}
+			g_sink += sum;
+		});
+		print_result("operator[]() random", sizeof(T), s, d);
+	}
+
+	{
+		const auto s = measure(1, copy_steady, [&](const steady_vec& v){
+			const auto result = v.to_vec();
+			escape(result.data());
+			g_sink += result.size();
+		});
+		const auto d = measure(1, copy_std, [&](const std_vec& v){
+			const std_vec result(v);
+			escape(result.data());
+			g_sink += result.size();
+		});
+		print_result("to_vec() per vector", sizeof(T), s, d);
+	}
+
+	{
+		//	The two vectors share no nodes, so every value is compared.
+		const auto s = measure(1, [&]{ return steady_vec(values); }, [&](const steady_vec& v){
+			g_sink += (v == steady_values) ? 1 : 0;
+		});
+		const auto d = measure(1, copy_std, [&](const std_vec& v){
+			g_sink += (v == values) ? 1 : 0;
+		});
+		print_result("operator==() per vector", sizeof(T), s, d);
+	}
+
+	{
+		const auto s = measure(n, copy_steady, [&](steady_vec& v){
+			while(!v.empty()){
+				v = v.pop_back();
+				escape(&v);
+			}
+			g_sink += v.size();
+		});
+		const auto d = measure(n, copy_std, [&](std_vec& v){
+			while(!v.empty()){
+				v.pop_back();
+				escape(&v);
+			}
+			g_sink += v.size();
+		});
+		print_result("pop_back()", sizeof(T), s, d);
+	}
+
+	{
+		const auto s = measure(1, copy_steady, [&](const steady_vec& v){
+			g_sink += (v + steady_values).size();
+		});
+		const auto d = measure(1, copy_std, [&](const std_vec& v){
+			std_vec result(v);
+			result.insert(result.end(), values.begin(), values.end());
+			escape(result.data());
+			g_sink += result.size();
+		});
+		print_result("concat per vector", sizeof(T), s, d);
+	}
+
+	{
+		const auto s = measure(1, copy_steady, [&](const steady_vec& v){
+			const steady_vec copy(v);
+			escape(&copy);
+			g_sink += copy.size();
+		});
+		const auto d = measure(1, copy_std, [&](const std_vec& v){
+			const std_vec copy(v);
+			escape(copy.data());
+			g_sink += copy.size();
+		});
+		print_result("copy per vector", sizeof(T), s, d);
+	}
+}
+
+
+int main(int argc, const char * argv[]){
+	std::printf("steady::vector<> vs std::vector<>, BRANCHING_FACTOR_SHIFT %d, %d values\n", BRANCHING_FACTOR_SHIFT, int(VALUE_COUNT));
+	std::printf("ns = nanoseconds per operation, a = allocations per operation, B = bytes allocated per operation\n");
+#if QUARK_ASSERT_ON
+	std::printf("Warning: asserts are on, build with -DQUARK_ASSERT_ON=0 to get real numbers.\n");
+#endif
+	print_header();
+
+	run_benchmarks<value_t<4>>();
+	run_benchmarks<value_t<16>>();
+	run_benchmarks<value_t<64>>();
+	return 0;
+}
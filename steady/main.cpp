@@ -198,11 +198,13 @@ image make_image(int width, int height){
 //	There is no way to trip-up caller because image is a copy.
 image worker8(image img) {
 	const size_t count = std::min<size_t>(300, img._pixels.size());
-	for(size_t i = 0 ; i < count ; i++){
-		auto pixel = img._pixels[i];
-		pixel._red = 1.0f - pixel._red;
-		img._pixels = img._pixels.store(i, pixel);
-	}
+
+	//	Changes all pixels in one go: each node is copied once, not once per pixel.
+	img._pixels = img._pixels.update_range(0, count, [](const pixel& p){
+		auto result = p;
+		result._red = 1.0f - result._red;
+		return result;
+	});
 	return img;
 }
 
@@ -254,6 +256,10 @@ void example8(){
 	const auto extra_leaf_nodes = leaf_nodes2 - leaf_nodes1;
 
 	QUARK_TRACE_SS("Extra storage requried for a + b: inodes: " << extra_inodes << ", leaf nodes: " << extra_leaf_nodes);
+
+	const steady::vector<pixel> versions[] = { a._pixels, b._pixels, c._pixels };
+	QUARK_TRACE_SS("Sharing ratio: " << steady::get_sharing_ratio(versions, 3));
+	steady::trace_stats();
 }
 
 
@@ -23,6 +23,10 @@
 #include <cmath>
 #include <cassert>
 #include <sstream>
+#include <mutex>
+#include <unordered_map>
+#include <algorithm>
+#include <thread>
 
 
 
@@ -116,6 +120,143 @@ void on_trace_hook(runtime_i* runtime, const std::stringstream& s){
 
 
 
+//	PROFILING
+//	====================================================================================================================
+
+
+
+namespace {
+
+	//	Never deleted: threads can still be timing scopes while the program exits.
+	struct profile_registry {
+		std::mutex _mutex;
+		std::vector<profile_buffer*> _buffers;
+		std::unordered_map<std::uint32_t, std::string> _names;
+	};
+
+	profile_registry& get_profile_registry(){
+		static profile_registry* registry = new profile_registry();
+		return *registry;
+	}
+
+	void write_json_string(std::ostream& out, const std::string& s){
+		out << '"';
+		for(const auto c: s){
+			if(c == '"' || c == '\\'){
+				out << '\\' << c;
+			}
+			else if(static_cast<unsigned char>(c) < 0x20){
+				out << ' ';
+			}
+			else{
+				out << c;
+			}
+		}
+		out << '"';
+	}
+
+}
+
+profile_buffer* make_profile_buffer(){
+	auto& registry = get_profile_registry();
+	std::lock_guard<std::mutex> lock(registry._mutex);
+
+	//	Events left by the ended thread would get the new thread's id, so only empty buffers are reused.
+	for(const auto buffer: registry._buffers){
+		if(!buffer->_owned && buffer->empty()){
+			buffer->_owned = true;
+			return buffer;
+		}
+	}
+
+	const auto result = new profile_buffer(static_cast<std::uint32_t>(registry._buffers.size() + 1));
+	registry._buffers.push_back(result);
+	return result;
+}
+
+void release_profile_buffer(profile_buffer* buffer){
+	assert(buffer != nullptr);
+
+	auto& registry = get_profile_registry();
+	std::lock_guard<std::mutex> lock(registry._mutex);
+	buffer->_owned = false;
+}
+
+void register_profile_name(std::uint32_t id, const char name[]){
+	assert(name != nullptr);
+
+	auto& registry = get_profile_registry();
+	std::lock_guard<std::mutex> lock(registry._mutex);
+
+	const auto it = registry._names.find(id);
+	if(it == registry._names.end()){
+		registry._names.insert(std::make_pair(id, std::string(name)));
+	}
+	else{
+		//	Two names with the same hash.
+		QUARK_ASSERT(it->second == name);
+	}
+}
+
+std::string get_profile_name(std::uint32_t id){
+	auto& registry = get_profile_registry();
+	std::lock_guard<std::mutex> lock(registry._mutex);
+
+	const auto it = registry._names.find(id);
+	return it == registry._names.end() ? std::to_string(id) : it->second;
+}
+
+std::vector<profile_event> collect_profile_events(){
+	auto& registry = get_profile_registry();
+	std::lock_guard<std::mutex> lock(registry._mutex);
+
+	std::vector<profile_event> result;
+	for(const auto buffer: registry._buffers){
+		buffer->pop_all(result);
+	}
+	//	An enclosing scope comes before the scopes inside it, also when they start at the same time.
+	std::stable_sort(result.begin(), result.end(), [](const profile_event& a, const profile_event& b){
+		return a._start_ns < b._start_ns || (a._start_ns == b._start_ns && a._duration_ns > b._duration_ns);
+	});
+	return result;
+}
+
+std::uint64_t get_dropped_profile_event_count(){
+	auto& registry = get_profile_registry();
+	std::lock_guard<std::mutex> lock(registry._mutex);
+
+	std::uint64_t result = 0;
+	for(const auto buffer: registry._buffers){
+		result += buffer->_dropped.load(std::memory_order_relaxed);
+	}
+	return result;
+}
+
+void write_chrome_trace(std::ostream& out, const std::vector<profile_event>& events){
+	std::unordered_map<std::uint32_t, std::string> names;
+
+	out << "{\"traceEvents\":[";
+	for(std::size_t i = 0 ; i < events.size() ; i++){
+		const auto& event = events[i];
+		auto it = names.find(event._id);
+		if(it == names.end()){
+			it = names.insert(std::make_pair(event._id, get_profile_name(event._id))).first;
+		}
+
+		out << (i == 0 ? "\n" : ",\n") << "{\"name\":";
+		write_json_string(out, it->second);
+		out << ",\"ph\":\"X\",\"pid\":0,\"tid\":" << event._thread
+			<< ",\"ts\":" << (event._start_ns / 1000) << '.' << std::to_string(1000 + event._start_ns % 1000).substr(1)
+			<< ",\"dur\":" << (event._duration_ns / 1000) << '.' << std::to_string(1000 + event._duration_ns % 1000).substr(1)
+			<< "}";
+	}
+	out << "\n]}\n";
+}
+
+
+
+
+
 //	UNIT TEST SUPPORT
 //	====================================================================================================================
 
@@ -253,6 +394,7 @@ void test_macros(){
 	QUARK_SCOPED_TRACE("");
 	QUARK_SCOPED_TRACE(std::string("scoped trace") + "std::string version");
 	QUARK_TRACE_FUNCTION();
+	QUARK_SCOPED_TIMER("test_macros");
 }
 
 QUARK_UNIT_TEST("", "", "", ""){
@@ -260,6 +402,70 @@ QUARK_UNIT_TEST("", "", "", ""){
 	QUARK_TEST_VERIFY(true);
 }
 
+QUARK_UNIT_TEST("", "QUARK_SCOPED_TIMER()", "two scopes", "two events, in start order"){
+	collect_profile_events();
+	{
+		QUARK_SCOPED_TIMER("outer");
+		{
+			QUARK_SCOPED_TIMER("inner");
+		}
+	}
+	const auto events = collect_profile_events();
+#if QUARK_PROFILE_ON
+	QUARK_UT_VERIFY(events.size() == 2);
+	QUARK_UT_VERIFY(events[0]._id == make_profile_id("outer"));
+	QUARK_UT_VERIFY(events[1]._id == make_profile_id("inner"));
+	QUARK_UT_VERIFY(events[0]._duration_ns >= events[1]._duration_ns);
+	QUARK_UT_VERIFY(get_profile_name(events[1]._id) == "inner");
+#endif
+	QUARK_UT_VERIFY(collect_profile_events().empty());
+}
+
+QUARK_UNIT_TEST("", "QUARK_SCOPED_TIMER()", "two threads, one after the other", "second reuses the first's buffer"){
+	auto time_scope = []{
+		QUARK_SCOPED_TIMER("thread");
+	};
+
+	//	Only empty buffers are reused, and then the first ended thread's buffer is the first free one.
+	collect_profile_events();
+	std::thread a(time_scope);
+	a.join();
+	const auto a_events = collect_profile_events();
+
+	std::thread b(time_scope);
+	b.join();
+	const auto b_events = collect_profile_events();
+#if QUARK_PROFILE_ON
+	QUARK_UT_VERIFY(a_events.size() == 1 && b_events.size() == 1);
+	QUARK_UT_VERIFY(a_events[0]._thread == b_events[0]._thread);
+#endif
+	(void)a_events;
+	(void)b_events;
+}
+
+QUARK_UNIT_TEST("", "profile_buffer::push()", "full buffer", "event dropped"){
+	profile_buffer buffer(7);
+	const profile_event event = { 1, 2, 3, 0 };
+	for(std::size_t i = 0 ; i < profile_buffer::CAPACITY + 1 ; i++){
+		buffer.push(event);
+	}
+	QUARK_UT_VERIFY(buffer._dropped.load() == 1);
+
+	std::vector<profile_event> events;
+	buffer.pop_all(events);
+	QUARK_UT_VERIFY(events.size() == profile_buffer::CAPACITY);
+	QUARK_UT_VERIFY(events[0]._thread == 7);
+}
+
+QUARK_UNIT_TEST("", "write_chrome_trace()", "one event", "JSON"){
+	register_profile_name(make_profile_id("push_back"), "push_back");
+	const profile_event event = { 1500, 250, make_profile_id("push_back"), 2 };
+
+	std::stringstream ss;
+	write_chrome_trace(ss, std::vector<profile_event>{ event });
+	QUARK_UT_VERIFY(ss.str() == "{\"traceEvents\":[\n{\"name\":\"push_back\",\"ph\":\"X\",\"pid\":0,\"tid\":2,\"ts\":1.500,\"dur\":0.250}\n]}\n");
+}
+
 
 }
 
@@ -39,6 +39,8 @@
 		QUARK_TRACE_SS(x)
 		QUARK_SCOPED_TRACE(x)
 
+		QUARK_SCOPED_TIMER(x)
+
 		QUARK_UNIT_TEST
 		QUARK_TEST_VERIFY(x)
 
@@ -51,6 +53,7 @@
 
 		#define QUARK_ASSERT_ON true
 		#define QUARK_TRACE_ON true
+		#define QUARK_PROFILE_ON true
 		#define QUARK_UNIT_TESTS_ON true
 
 	They are independent of each other and any combination is valid! If you don't set them, they default to the above.
@@ -135,6 +138,36 @@
 				...
 
 
+	PROFILING
+	====================================================================================================================
+	Timing that is cheap enough to leave on around hot code. Use QUARK_PROFILE_ON to enable / disable it.
+
+
+	QUARK_SCOPED_TIMER(x)
+	Records how long the rest of the stack scope takes. x must be a string literal: it is hashed to a 32-bit id at
+	compile time. The timer writes one 24-byte event to a ring buffer owned by the calling thread - no locks, no strings,
+	no virtual calls. When the ring buffer is full, events are dropped and counted.
+
+	collect_profile_events() drains the events of all threads and write_chrome_trace() writes them as JSON, which
+	chrome://tracing and Perfetto can open.
+
+	Each ring buffer is about 384 KB and is never freed. When a thread ends, its buffer is reused by a later thread once
+	its events have been collected, so a program that keeps making threads only has as many buffers as it has threads
+	running at once, plus the ones not collected yet.
+
+
+	Example:
+
+		void render_frame(){
+			QUARK_SCOPED_TIMER("render_frame");
+			...
+		}
+
+		...
+		std::ofstream file("trace.json");
+		quark::write_chrome_trace(file, quark::collect_profile_events());
+
+
 	UNIT TESTS
 	====================================================================================================================
 	You can easily add a unit test where ever you can define a function. It's possible to interleave the functions with
@@ -255,6 +288,11 @@
 #include <vector>
 #include <string>
 #include <sstream>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <type_traits>
 
 
 #ifndef QUARK_ASSERT_ON
@@ -265,6 +303,10 @@
 	#define QUARK_TRACE_ON 1
 #endif
 
+#ifndef QUARK_PROFILE_ON
+	#define QUARK_PROFILE_ON 1
+#endif
+
 #ifndef QUARK_UNIT_TESTS_ON
 	#define QUARK_UNIT_TESTS_ON 1
 #endif
@@ -446,6 +488,199 @@ void set_runtime(runtime_i* iRuntime);
 
 
 
+//	PROFILING
+//	====================================================================================================================
+
+
+
+////////////////////////////		profile_event
+/*
+	One timed scope. _thread is filled in by collect_profile_events().
+*/
+
+struct profile_event {
+	std::uint64_t _start_ns;
+	std::uint64_t _duration_ns;
+	std::uint32_t _id;
+	std::uint32_t _thread;
+};
+
+
+//	32-bit FNV-1a of a string. Evaluated at compile time by QUARK_SCOPED_TIMER().
+constexpr std::uint32_t make_profile_id(const char s[], std::uint32_t hash = 2166136261u){
+	return *s == 0 ? hash : make_profile_id(s + 1, (hash ^ std::uint32_t(std::uint8_t(*s))) * 16777619u);
+}
+
+//	Nanoseconds since the program started.
+inline std::uint64_t get_profile_time(){
+	static const auto start = std::chrono::steady_clock::now();
+	return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+}
+
+
+////////////////////////////		profile_buffer
+/*
+	Ring buffer with the events of one thread. Only its thread pushes and only collect_profile_events() pops, so it
+	needs no locks: each side owns its own counter and publishes it with release / acquire.
+*/
+
+struct profile_buffer {
+	public: static const std::size_t CAPACITY = 1 << 14;
+
+	public: profile_buffer(std::uint32_t thread) :
+		_write(0),
+		_read(0),
+		_dropped(0),
+		_owned(true),
+		_thread(thread),
+		_events(CAPACITY)
+	{
+	}
+
+	public: bool empty() const{
+		return _read.load(std::memory_order_acquire) == _write.load(std::memory_order_acquire);
+	}
+
+	public: void push(const profile_event& event){
+		const auto write = _write.load(std::memory_order_relaxed);
+		if(write - _read.load(std::memory_order_acquire) == CAPACITY){
+			_dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		_events[write & (CAPACITY - 1)] = event;
+		_write.store(write + 1, std::memory_order_release);
+	}
+
+	//	Appends all events in the buffer to _out_ and removes them.
+	public: void pop_all(std::vector<profile_event>& out){
+		const auto read = _read.load(std::memory_order_relaxed);
+		const auto write = _write.load(std::memory_order_acquire);
+		for(auto i = read ; i != write ; i++){
+			auto event = _events[i & (CAPACITY - 1)];
+			event._thread = _thread;
+			out.push_back(event);
+		}
+		_read.store(write, std::memory_order_release);
+	}
+
+
+	////////////////		State.
+		std::atomic<std::uint64_t> _write;
+		std::atomic<std::uint64_t> _read;
+		std::atomic<std::uint64_t> _dropped;
+
+		//	False when its thread has ended. Changed with the registry's mutex locked.
+		bool _owned;
+		const std::uint32_t _thread;
+		std::vector<profile_event> _events;
+};
+
+
+/*
+	Gets a ring buffer for the calling thread: an empty one whose thread has ended, or a new one. Buffers live until the
+	program ends, so their events can be collected after the thread is gone.
+*/
+profile_buffer* make_profile_buffer();
+
+//	Lets a later thread reuse _buffer_, once its events have been collected.
+void release_profile_buffer(profile_buffer* buffer);
+
+inline profile_buffer*& get_profile_buffer_slot(){
+	static thread_local profile_buffer* buffer = nullptr;
+	return buffer;
+}
+
+//	Set when the thread's buffer has been released. Trivially destructible, so it can be read during thread exit.
+inline bool& is_profile_thread_ended(){
+	static thread_local bool ended = false;
+	return ended;
+}
+
+struct profile_buffer_owner {
+	profile_buffer_owner(){
+		get_profile_buffer_slot() = make_profile_buffer();
+	}
+
+	~profile_buffer_owner(){
+		release_profile_buffer(get_profile_buffer_slot());
+		get_profile_buffer_slot() = nullptr;
+		is_profile_thread_ended() = true;
+	}
+};
+
+/*
+	The ring buffer of the calling thread, about 384 KB, made the first time the thread times a scope. It goes back to
+	the registry when the thread ends. nullptr after that: scopes timed by thread_local destructors are not recorded.
+*/
+inline profile_buffer* get_profile_buffer(){
+	const auto buffer = get_profile_buffer_slot();
+	if(buffer != nullptr || is_profile_thread_ended()){
+		return buffer;
+	}
+	static thread_local profile_buffer_owner owner;
+	return get_profile_buffer_slot();
+}
+
+//	Remembers the string for an id, for write_chrome_trace(). Called once per QUARK_SCOPED_TIMER().
+void register_profile_name(std::uint32_t id, const char name[]);
+std::string get_profile_name(std::uint32_t id);
+
+//	Removes the events from all threads' ring buffers and returns them, sorted on start time.
+std::vector<profile_event> collect_profile_events();
+
+//	The number of events dropped because a ring buffer was full.
+std::uint64_t get_dropped_profile_event_count();
+
+//	Writes events in the Chrome trace event format: complete events ("ph": "X") with microsecond timestamps.
+void write_chrome_trace(std::ostream& out, const std::vector<profile_event>& events);
+
+
+////////////////////////////		scoped_timer
+/*
+	Part of internal mechanism of QUARK_SCOPED_TIMER().
+*/
+
+struct profile_name_rec {
+	profile_name_rec(std::uint32_t id, const char name[]){
+		register_profile_name(id, name);
+	}
+};
+
+struct scoped_timer {
+	scoped_timer(std::uint32_t id) :
+		_id(id),
+		_start_ns(get_profile_time())
+	{
+	}
+
+	~scoped_timer(){
+		const auto buffer = get_profile_buffer();
+		if(buffer != nullptr){
+			const profile_event event = { _start_ns, get_profile_time() - _start_ns, _id, 0 };
+			buffer->push(event);
+		}
+	}
+
+	private: const std::uint32_t _id;
+	private: const std::uint64_t _start_ns;
+};
+
+
+#if QUARK_PROFILE_ON
+
+	#define QUARK_SCOPED_TIMER(name) \
+		static const ::quark::profile_name_rec QUARK_UNIQUE_LABEL(profile_name)(std::integral_constant<std::uint32_t, ::quark::make_profile_id(name)>::value, name); \
+		::quark::scoped_timer QUARK_UNIQUE_LABEL(scoped_timer)(std::integral_constant<std::uint32_t, ::quark::make_profile_id(name)>::value)
+
+#else
+
+	#define QUARK_SCOPED_TIMER(name)
+
+#endif
+
+
+
+
 //	UNIT TEST SUPPORT
 //	====================================================================================================================
 
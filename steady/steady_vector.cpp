@@ -19,7 +19,13 @@
 #include "steady_vector.h"
 
 #include <algorithm>
+#include <numeric>
+#include <list>
+#include <iterator>
+#include <sstream>
 #include <memory>
+#include <thread>
+#include <unordered_map>
 #include "quark.h"
 
 
@@ -30,6 +36,14 @@
 #define VERIFY(x) STEADY_TEST_VERIFY(x)
 #define SCOPED_TRACE(x) STEADY_SCOPED_TRACE(x)
 
+//	Node counts are only available when STEADY_STATS_ON. Otherwise _x_ is still compiled, not run, so the counts it
+//	uses aren't unused variables.
+#if STEADY_STATS_ON
+	#define VERIFY_NODES(x) VERIFY(x)
+#else
+	#define VERIFY_NODES(x) (void)sizeof(x)
+#endif
+
 
 
 namespace steady {
@@ -44,43 +58,43 @@ using namespace internals;
 
 
 
-////////////////////////////////////////////			count_to_depth()
+////////////////////////////////////////////			count_to_depth<int>()
 
 
 QUARK_UNIT_TEST("", "count_to_depth()", "0", "-1"){
-	VERIFY(count_to_depth(0) == 0);
+	VERIFY(count_to_depth<int>(0) == 0);
 
-	VERIFY(count_to_depth(1) == 1);
-	VERIFY(count_to_depth(2) == 1);
-	VERIFY(count_to_depth(3) == 1);
+	VERIFY(count_to_depth<int>(1) == 1);
+	VERIFY(count_to_depth<int>(2) == 1);
+	VERIFY(count_to_depth<int>(3) == 1);
 
-	VERIFY(count_to_depth(BRANCHING_FACTOR + 1) == 2);
-	VERIFY(count_to_depth(BRANCHING_FACTOR * BRANCHING_FACTOR) == 2);
+	VERIFY(count_to_depth<int>(BRANCHING_FACTOR + 1) == 2);
+	VERIFY(count_to_depth<int>(BRANCHING_FACTOR * BRANCHING_FACTOR) == 2);
 
-	VERIFY(count_to_depth(BRANCHING_FACTOR * BRANCHING_FACTOR + 1) == 3);
-	VERIFY(count_to_depth(BRANCHING_FACTOR * BRANCHING_FACTOR * BRANCHING_FACTOR) == 3);
+	VERIFY(count_to_depth<int>(BRANCHING_FACTOR * BRANCHING_FACTOR + 1) == 3);
+	VERIFY(count_to_depth<int>(BRANCHING_FACTOR * BRANCHING_FACTOR * BRANCHING_FACTOR) == 3);
 }
 
 
-////////////////////////////////////////////			vector_size_to_shift()
+////////////////////////////////////////////			vector_size_to_shift<int>()
 
 
 QUARK_UNIT_TEST("", "vector_size_to_shift()", "", ""){
-	VERIFY(vector_size_to_shift(0) == EMPTY_TREE_SHIFT);
-	VERIFY(vector_size_to_shift(1) == LEAF_NODE_SHIFT);
-	VERIFY(vector_size_to_shift(BRANCHING_FACTOR * 1) == LEAF_NODE_SHIFT);
-	VERIFY(vector_size_to_shift(BRANCHING_FACTOR * 1 + 1) == LOWEST_LEVEL_INODE_SHIFT);
+	VERIFY(vector_size_to_shift<int>(0) == branching_factor<int>::EMPTY_TREE_SHIFT);
+	VERIFY(vector_size_to_shift<int>(1) == LEAF_NODE_SHIFT);
+	VERIFY(vector_size_to_shift<int>(BRANCHING_FACTOR * 1) == LEAF_NODE_SHIFT);
+	VERIFY(vector_size_to_shift<int>(BRANCHING_FACTOR * 1 + 1) == branching_factor<int>::LOWEST_LEVEL_INODE_SHIFT);
 }
 
 
-////////////////////////////////////////////			shift_to_max_size()
+////////////////////////////////////////////			shift_to_max_size<int>()
 
 
 QUARK_UNIT_TEST("", "shift_to_max_size()", "", ""){
-	VERIFY(shift_to_max_size(EMPTY_TREE_SHIFT) == 0);
-	VERIFY(shift_to_max_size(LEAF_NODE_SHIFT) == BRANCHING_FACTOR * 1);
-	VERIFY(shift_to_max_size(LOWEST_LEVEL_INODE_SHIFT) == BRANCHING_FACTOR * BRANCHING_FACTOR);
-	VERIFY(shift_to_max_size(BRANCHING_FACTOR_SHIFT * 2) == BRANCHING_FACTOR * BRANCHING_FACTOR * BRANCHING_FACTOR);
+	VERIFY(shift_to_max_size<int>(branching_factor<int>::EMPTY_TREE_SHIFT) == 0);
+	VERIFY(shift_to_max_size<int>(LEAF_NODE_SHIFT) == BRANCHING_FACTOR * 1);
+	VERIFY(shift_to_max_size<int>(branching_factor<int>::LOWEST_LEVEL_INODE_SHIFT) == BRANCHING_FACTOR * BRANCHING_FACTOR);
+	VERIFY(shift_to_max_size<int>(BRANCHING_FACTOR_SHIFT * 2) == BRANCHING_FACTOR * BRANCHING_FACTOR * BRANCHING_FACTOR);
 }
 
 
@@ -112,8 +126,8 @@ template <class T>
 struct test_fixture {
 	test_fixture() :
 		_scoped_tracer("test_fixture"),
-		_inode_count(inode<T>::_debug_count),
-		_leaf_count(leaf_node<T>::_debug_count)
+		_inode_count(get_inode_count<T>()),
+		_leaf_count(get_leaf_count<T>())
 	{
 		TRACE_SS("inode count: " << _inode_count << " " << "Leaf node count: " << _leaf_count);
 	}
@@ -123,8 +137,8 @@ struct test_fixture {
 	*/
 	test_fixture(int inode_expected_count, int leaf_expected_count) :
 		_scoped_tracer("test_fixture"),
-		_inode_count(inode<T>::_debug_count),
-		_leaf_count(leaf_node<T>::_debug_count),
+		_inode_count(get_inode_count<T>()),
+		_leaf_count(get_leaf_count<T>()),
 
 		_inode_expected_count(inode_expected_count),
 		_leaf_expected_count(leaf_expected_count)
@@ -133,17 +147,18 @@ struct test_fixture {
 	}
 
 	~test_fixture(){
-		int inode_count = inode<T>::_debug_count;
-		int leaf_count = leaf_node<T>::_debug_count;
+		int inode_count = get_inode_count<T>();
+		int leaf_count = get_leaf_count<T>();
 
 		TRACE_SS("inode count: " << inode_count << " " << "Leaf node count: " << leaf_count);
 
+	#if STEADY_STATS_ON
 		int inode_diff_count = inode_count - _inode_count;
 		int leaf_expected_diff = leaf_count - _leaf_count;
 
-
 		ASSERT(inode_diff_count == _inode_expected_count);
 		ASSERT(leaf_expected_diff == _leaf_expected_count);
+	#endif
 	}
 
 	quark::scoped_trace _scoped_tracer;
@@ -222,6 +237,44 @@ std::array<int, BRANCHING_FACTOR> generate_leaves(int start, int count){
 	return result;
 }
 
+//	True if _leaf_ holds exactly the values in _expected_.
+bool same_leaf_values(const leaf_node<int>& leaf, const std::array<int, BRANCHING_FACTOR>& expected){
+	return leaf.get_count() == BRANCHING_FACTOR && std::equal(expected.begin(), expected.end(), leaf.get_values());
+}
+
+
+template <class T>
+bool same_node(const node_ref<T>& a, const node_ref<T>& b){
+	return a.same_node(b);
+}
+
+template <class T>
+bool same_root(const vector<T>& a, const vector<T>& b){
+	return same_node(a.get_root(), b.get_root()) && same_node(a.get_tail(), b.get_tail());
+}
+
+//	Checks all nodes in the tree of _v_, see validate_tree().
+template <class T>
+bool validate_vector(const vector<T>& v){
+	ASSERT(v.check_invariant());
+	if(v.get_tail_offset() > 0){
+		ASSERT(validate_tree(sized_node<T>{ v.get_root(), v.get_tail_offset() }, v.get_shift()));
+	}
+	return true;
+}
+
+//	Reads back _v_ both using to_vec() and operator[].
+bool same_values(const vector<int>& v, const std::vector<int>& expected){
+	if(v.to_vec() != expected){
+		return false;
+	}
+	for(size_t i = 0 ; i < expected.size() ; i++){
+		if(v[i] != expected[i]){
+			return false;
+		}
+	}
+	return true;
+}
 
 /*
 	Construct a vector that uses 1 leaf node.
@@ -242,11 +295,9 @@ QUARK_UNIT_TEST("", "make_manual_vector1()", "", "correct nodes"){
 	const auto a = make_manual_vector1();
 	VERIFY(a.size() == 1);
 	VERIFY(a.get_root().get_type() == node_type::leaf_node);
-	VERIFY(a.get_root().get_leaf_node()->_rc == 1);
-	VERIFY(a.get_root().get_leaf_node()->_values[0] == 7);
-	for(int i = 1 ; i < BRANCHING_FACTOR ; i++){
-		VERIFY(a.get_root().get_leaf_node()->_values[i] == 0);
-	}
+	VERIFY(a.get_root().get_leaf_node()->_rc.get() == 1);
+	VERIFY(a.get_root().get_leaf_node()->get_count() == 1);
+	VERIFY(a.get_root().get_leaf_node()->get_values()[0] == 7);
 }
 
 
@@ -269,11 +320,11 @@ QUARK_UNIT_TEST("", "make_manual_vector2()", "", "correct nodes"){
 	const auto a = make_manual_vector2();
 	VERIFY(a.size() == 2);
 	VERIFY(a.get_root().get_type() == node_type::leaf_node);
-	VERIFY(a.get_root().get_leaf_node()->_rc == 1);
-	VERIFY(a.get_root().get_leaf_node()->_values[0] == 7);
-	VERIFY(a.get_root().get_leaf_node()->_values[1] == 8);
-	VERIFY(a.get_root().get_leaf_node()->_values[2] == 0);
-	VERIFY(a.get_root().get_leaf_node()->_values[3] == 0);
+	VERIFY(a.get_root().get_leaf_node()->_rc.get() == 1);
+	VERIFY(a.get_root().get_leaf_node()->get_values()[0] == 7);
+	VERIFY(a.get_root().get_leaf_node()->get_values()[1] == 8);
+	VERIFY(a.get_root().get_leaf_node()->get_values()[2] == 0);
+	VERIFY(a.get_root().get_leaf_node()->get_values()[3] == 0);
 }
 
 
@@ -294,7 +345,7 @@ vector<int> make_manual_vector_branchfactor_plus_1(){
 	node_ref<int> leaf1 = make_leaf_node<int>(generate_leaves(7 + BRANCHING_FACTOR, 1));
 	std::vector<node_ref<int>> leafs = { leaf0, leaf1 };
 	node_ref<int> inode = make_inode_from_vector(leafs);
-	return vector<int>(inode, BRANCHING_FACTOR + 1, vector_size_to_shift(BRANCHING_FACTOR + 1));
+	return vector<int>(inode, BRANCHING_FACTOR + 1, vector_size_to_shift<int>(BRANCHING_FACTOR + 1));
 }
 
 QUARK_UNIT_TEST("", "make_manual_vector_branchfactor_plus_1()", "", "correct nodes"){
@@ -304,18 +355,18 @@ QUARK_UNIT_TEST("", "make_manual_vector_branchfactor_plus_1()", "", "correct nod
 	VERIFY(a.size() == BRANCHING_FACTOR + 1);
 
 	VERIFY(a.get_root().get_type() == node_type::inode);
-	VERIFY(a.get_root().get_inode()->_rc == 1);
+	VERIFY(a.get_root().get_inode()->_rc.get() == 1);
 	VERIFY(a.get_root().get_inode()->count_children() == 2);
 	VERIFY(a.get_root().get_inode()->get_child(0).get_type() == node_type::leaf_node);
 	VERIFY(a.get_root().get_inode()->get_child(1).get_type() == node_type::leaf_node);
 
 	const auto leaf0 = a.get_root().get_inode()->get_child_as_leaf_node(0);
-	VERIFY(leaf0->_rc == 1);
-	VERIFY(leaf0->_values == generate_leaves(7 + BRANCHING_FACTOR * 0, BRANCHING_FACTOR));
+	VERIFY(leaf0->_rc.get() == 1);
+	VERIFY(same_leaf_values(*leaf0, generate_leaves(7 + BRANCHING_FACTOR * 0, BRANCHING_FACTOR)));
 
 	const auto leaf1 = a.get_root().get_inode()->get_child_as_leaf_node(1);
-	VERIFY(leaf1->_rc == 1);
-	VERIFY(leaf1->_values == generate_leaves(7 + BRANCHING_FACTOR * 1, 1));
+	VERIFY(leaf1->_rc.get() == 1);
+	VERIFY(same_leaf_values(*leaf1, generate_leaves(7 + BRANCHING_FACTOR * 1, 1)));
 }
 
 /*
@@ -354,7 +405,7 @@ vector<int> make_manual_vector_branchfactor_square_plus_1(){
 	node_ref<int> inodeB = make_inode_from_vector<int>({ extraLeaf });
 	node_ref<int> rootInode = make_inode_from_vector<int>({ inodeA, inodeB });
 	const size_t size = BRANCHING_FACTOR * BRANCHING_FACTOR + 1;
-	return vector<int>(rootInode, size, vector_size_to_shift(size));
+	return vector<int>(rootInode, size, vector_size_to_shift<int>(size));
 }
 
 QUARK_UNIT_TEST("", "make_manual_vector_branchfactor_square_plus_1()", "", "correct nodes"){
@@ -365,32 +416,60 @@ QUARK_UNIT_TEST("", "make_manual_vector_branchfactor_square_plus_1()", "", "corr
 
 	node_ref<int> rootINode = a.get_root();
 	VERIFY(rootINode.get_type() == node_type::inode);
-	VERIFY(rootINode.get_inode()->_rc == 2);
+	VERIFY(rootINode.get_inode()->_rc.get() == 2);
 	VERIFY(rootINode.get_inode()->count_children() == 2);
 	VERIFY(rootINode.get_inode()->get_child(0).get_type() == node_type::inode);
 	VERIFY(rootINode.get_inode()->get_child(1).get_type() == node_type::inode);
 
 	node_ref<int> inodeA = rootINode.get_inode()->get_child(0);
 		VERIFY(inodeA.get_type() == node_type::inode);
-		VERIFY(inodeA.get_inode()->_rc == 2);
+		VERIFY(inodeA.get_inode()->_rc.get() == 2);
 		VERIFY(inodeA.get_inode()->count_children() == BRANCHING_FACTOR);
 		for(int i = 0 ; i < BRANCHING_FACTOR ; i++){
 			const auto leafNode = inodeA.get_inode()->get_child_as_leaf_node(i);
-			VERIFY(leafNode->_rc == 1);
-			VERIFY(leafNode->_values == generate_leaves(1000 + BRANCHING_FACTOR * i, BRANCHING_FACTOR));
+			VERIFY(leafNode->_rc.get() == 1);
+			VERIFY(same_leaf_values(*leafNode, generate_leaves(1000 + BRANCHING_FACTOR * i, BRANCHING_FACTOR)));
 		}
 
 	node_ref<int> inodeB = rootINode.get_inode()->get_child(1);
 		VERIFY(inodeB.get_type() == node_type::inode);
-		VERIFY(inodeB.get_inode()->_rc == 2);
+		VERIFY(inodeB.get_inode()->_rc.get() == 2);
 		VERIFY(inodeB.get_inode()->count_children() == 1);
 		VERIFY(inodeB.get_inode()->get_child(0).get_type() == node_type::leaf_node);
 
 		const auto leaf4 = inodeB.get_inode()->get_child_as_leaf_node(0);
-		VERIFY(leaf4->_rc == 1);
-		VERIFY(leaf4->_values == generate_leaves(1000 + BRANCHING_FACTOR * BRANCHING_FACTOR + 0, 1));
+		VERIFY(leaf4->_rc.get() == 1);
+		VERIFY(same_leaf_values(*leaf4, generate_leaves(1000 + BRANCHING_FACTOR * BRANCHING_FACTOR + 0, 1)));
+}
+
+
+////////////////////////////////////////////		node_ref<T>
+
+
+QUARK_UNIT_TEST("", "node_ref<T>", "", "one pointer, inodes hold BRANCHING_FACTOR pointers"){
+	VERIFY(sizeof(node_ref<int>) == sizeof(void*));
+	VERIFY(sizeof(inode<int>::children_t) == BRANCHING_FACTOR * sizeof(void*));
 }
 
+QUARK_UNIT_TEST("", "node_ref<T>", "leaf node, inode, null", "correct types and nodes"){
+	test_fixture<int> f;
+	const auto leaf = make_leaf_node<int>({ 7 });
+	const auto node = make_inode_from_array<int>({ leaf, leaf });
+	const node_ref<int> null;
+
+	VERIFY(leaf.get_type() == node_type::leaf_node);
+	VERIFY(node.get_type() == node_type::inode);
+	VERIFY(null.get_type() == node_type::null_node);
+
+	VERIFY(leaf.get_leaf_node()->get_values()[0] == 7);
+	VERIFY(leaf.get_leaf_node()->_rc.get() == 3);
+	VERIFY(node.get_inode()->get_child_as_leaf_node(1) == leaf.get_leaf_node());
+	VERIFY(node.get_inode()->get_child(0).same_node(leaf));
+	VERIFY(!node.same_node(leaf));
+	VERIFY(null.same_node(node_ref<int>()));
+}
+
+
 
 ////////////////////////////////////////////		vector::vector()
 
@@ -523,9 +602,9 @@ vector<int> push_back_n(int count, int value0){
 void test_values(const vector<int>& vec, int value0){
 	test_fixture<int> f;
 
-	for(int i = 0 ; i < vec.size() ; i++){
+	for(size_t i = 0 ; i < vec.size() ; i++){
 		const auto value = vec[i];
-		const auto expected = value0 + i;
+		const auto expected = value0 + int(i);
 		VERIFY(value == expected);
 	}
 }
@@ -601,6 +680,158 @@ QUARK_UNIT_TEST("vector", "push_back()", "3-levels of inodes + add leaf-node to
 }
 
 
+QUARK_UNIT_TEST("vector", "push_back()", "value fits in tail", "only tail is copied"){
+	test_fixture<int> f;
+	const auto a = push_back_n(BRANCHING_FACTOR * BRANCHING_FACTOR + 2, 1000);
+	VERIFY(a.get_tail_size() == 2);
+
+	const auto inode_count = get_inode_count<int>();
+	const auto leaf_count = get_leaf_count<int>();
+	const auto b = a.push_back(1000 + a.size());
+
+	VERIFY_NODES(get_inode_count<int>() == inode_count);
+	VERIFY_NODES(get_leaf_count<int>() == leaf_count + 1);
+	VERIFY(same_node(a.get_root(), b.get_root()));
+	VERIFY(b.get_tail_size() == 3);
+	test_values(b, 1000);
+}
+
+QUARK_UNIT_TEST("vector", "push_back()", "full tail", "tail moves into tree"){
+	test_fixture<int> f;
+	const auto a = push_back_n(BRANCHING_FACTOR * 2, 1000);
+	VERIFY(a.get_tail_size() == BRANCHING_FACTOR);
+	VERIFY(a.get_tail_offset() == BRANCHING_FACTOR);
+
+	const auto b = a.push_back(1000 + BRANCHING_FACTOR * 2);
+	VERIFY(b.get_tail_size() == 1);
+	VERIFY(b.get_tail_offset() == BRANCHING_FACTOR * 2);
+	VERIFY(b.get_root().get_inode()->get_child_as_leaf_node(1) == a.get_tail().get_leaf_node());
+	test_values(b, 1000);
+}
+
+QUARK_UNIT_TEST("vector", "push_back()", "vector without tail, partial last leaf node", "read back all values"){
+	test_fixture<int> f;
+	auto a = make_manual_vector_branchfactor_plus_1();
+	VERIFY(a.get_tail_size() == 0);
+	for(int i = 0 ; i < BRANCHING_FACTOR * 2 ; i++){
+		a = a.push_back(8 + BRANCHING_FACTOR + i);
+	}
+	test_values(a, 7);
+}
+
+
+////////////////////////////////////////////		vector::store_many(), update_range()
+
+
+QUARK_UNIT_TEST("vector", "store_many()", "3 levels, many changes in two leaf nodes", "each touched node copied once"){
+	test_fixture<int> f;
+	const auto a = push_back_n(2 * BRANCHING_FACTOR * BRANCHING_FACTOR + 3, 1000);
+	const auto inodes = get_inode_count<int>();
+	const auto leaves = get_leaf_count<int>();
+
+	std::vector<std::pair<size_t, int>> changes;
+	for(int round = 0 ; round < 10 ; round++){
+		for(size_t i = 0 ; i < BRANCHING_FACTOR ; i++){
+			changes.push_back(std::pair<size_t, int>(i, -int(i) - round));
+			changes.push_back(std::pair<size_t, int>(BRANCHING_FACTOR * BRANCHING_FACTOR + i, round));
+		}
+	}
+	const auto b = a.store_many(changes);
+
+	//	Root + one inode per changed subtree. Two leaf nodes.
+	VERIFY_NODES(get_inode_count<int>() == inodes + 3);
+	VERIFY_NODES(get_leaf_count<int>() == leaves + 2);
+
+	test_values(a, 1000);
+	VERIFY(b[0] == -9);
+	VERIFY(b[1] == -10);
+	VERIFY(b[BRANCHING_FACTOR] == 1000 + BRANCHING_FACTOR);
+	VERIFY(b[BRANCHING_FACTOR * BRANCHING_FACTOR + 1] == 9);
+	VERIFY(b[b.size() - 1] == a[a.size() - 1]);
+}
+
+QUARK_UNIT_TEST("vector", "store_many()", "no changes, change in tail", "correct"){
+	test_fixture<int> f;
+	const auto a = push_back_n(BRANCHING_FACTOR + 3, 1000);
+	VERIFY(same_root(a.store_many(std::vector<std::pair<size_t, int>>()), a));
+
+	const std::pair<size_t, int> changes[] = { { 0, 7 }, { BRANCHING_FACTOR + 2, 8 } };
+	const auto b = a.store_many(changes, 2);
+	VERIFY(b[0] == 7);
+	VERIFY(b[BRANCHING_FACTOR + 1] == 1000 + BRANCHING_FACTOR + 1);
+	VERIFY(b[BRANCHING_FACTOR + 2] == 8);
+	test_values(a, 1000);
+}
+
+QUARK_UNIT_TEST("vector", "update_range()", "range spanning leaf nodes and tail", "only range changed"){
+	test_fixture<int> f;
+	const auto a = push_back_n(BRANCHING_FACTOR * BRANCHING_FACTOR + 3, 1000);
+	const size_t begin = BRANCHING_FACTOR - 1;
+	const size_t end = a.size() - 1;
+	const auto b = a.update_range(begin, end, [](int value){ return -value; });
+
+	for(size_t i = 0 ; i < a.size() ; i++){
+		const int expected = 1000 + int(i);
+		VERIFY(b[i] == (i >= begin && i < end ? -expected : expected));
+	}
+	test_values(a, 1000);
+	VERIFY(same_root(a.update_range(3, 3, [](int value){ return value; }), a));
+}
+
+
+
+////////////////////////////////////////////		vector::map_preserving()
+
+
+QUARK_UNIT_TEST("vector", "map_preserving()", "f changes nothing", "all nodes shared"){
+	test_fixture<int> f;
+	const auto a = push_back_n(2 * BRANCHING_FACTOR * BRANCHING_FACTOR + 3, 1000);
+	const auto inodes = get_inode_count<int>();
+	const auto leaves = get_leaf_count<int>();
+
+	const auto b = a.map_preserving([](int value){ return std::min(value, 1000000); });
+	VERIFY(b == a);
+	VERIFY(same_node(b.get_root(), a.get_root()));
+	VERIFY(same_node(b.get_tail(), a.get_tail()));
+	VERIFY_NODES(get_inode_count<int>() == inodes);
+	VERIFY_NODES(get_leaf_count<int>() == leaves);
+}
+
+QUARK_UNIT_TEST("vector", "map_preserving()", "f changes one value in tree and one in tail", "only changed paths copied"){
+	test_fixture<int> f;
+	const auto a = push_back_n(2 * BRANCHING_FACTOR * BRANCHING_FACTOR + 3, 1000);
+	const auto inodes = get_inode_count<int>();
+	const auto leaves = get_leaf_count<int>();
+
+	const int last = 1000 + int(a.size()) - 1;
+	const auto b = a.map_preserving([last](int value){ return value == 1003 || value == last ? -value : value; });
+	VERIFY(b.size() == a.size());
+	VERIFY(b[3] == -1003);
+	VERIFY(b[b.size() - 1] == -last);
+	VERIFY(diff(a, b) == (std::vector<std::pair<size_t, size_t>>{ std::make_pair(size_t(3), size_t(4)), std::make_pair(a.size() - 1, a.size()) }));
+
+	//	3 level tree: root + one inode + one leaf on the changed path, plus a new tail.
+	VERIFY_NODES(get_inode_count<int>() == inodes + 2);
+	VERIFY_NODES(get_leaf_count<int>() == leaves + 2);
+	VERIFY(same_node(b.get_root().get_inode()->get_child(1), a.get_root().get_inode()->get_child(1)));
+}
+
+QUARK_UNIT_TEST("vector", "map_preserving()", "relaxed vector, clamp", "same as mapping each value"){
+	test_fixture<int> f;
+	const auto a = push_back_n(BRANCHING_FACTOR * BRANCHING_FACTOR + 5, 1000);
+	const auto c = concat(a.slice(3, a.size()), a);
+	VERIFY(c.is_relaxed());
+
+	auto clamp = [](int value){ return std::min(value, 1000 + BRANCHING_FACTOR * 2); };
+	const auto d = c.map_preserving(clamp);
+	VERIFY(d.check_invariant());
+	VERIFY(d.is_relaxed());
+	for(size_t i = 0 ; i < c.size() ; i++){
+		VERIFY(d[i] == clamp(c[i]));
+	}
+}
+
+
 ////////////////////////////////////////////		vector::push_back(const std::vector<T>& values)
 
 
@@ -640,6 +871,75 @@ QUARK_UNIT_TEST("vector", "pop_back()", "basic", "correct result vector"){
 }
 
 
+QUARK_UNIT_TEST("vector", "pop_back()", "values in tail", "correct result vector"){
+	test_fixture<int> f;
+	const auto a = push_back_n(BRANCHING_FACTOR + 3, 1000);
+	const auto b = a.pop_back();
+	VERIFY(same_node(a.get_root(), b.get_root()));
+	VERIFY(b.size() == BRANCHING_FACTOR + 2);
+	VERIFY(b.get_tail_size() == 2);
+	test_values(b, 1000);
+}
+
+
+QUARK_UNIT_TEST("vector", "pop_back()", "pop all values of 3-level tree", "correct values every step"){
+	test_fixture<int> f;
+	const auto count = BRANCHING_FACTOR * BRANCHING_FACTOR + BRANCHING_FACTOR + 3;
+	auto a = push_back_n(count, 1000);
+	while(!a.empty()){
+		a = a.pop_back();
+		VERIFY(a.get_shift() == vector_size_to_shift<int>(a.get_tail_offset()));
+		test_values(a, 1000);
+	}
+	VERIFY(a.get_root().get_type() == node_type::null_node);
+}
+
+QUARK_UNIT_TEST("vector", "pop_back()", "tail holds 1 value", "last leaf node in tree becomes tail"){
+	test_fixture<int> f;
+	const auto a = push_back_n(BRANCHING_FACTOR * 2 + 1, 1000);
+	const auto b = a.pop_back();
+	VERIFY(b.get_tail_size() == BRANCHING_FACTOR);
+	VERIFY(b.get_tail().get_leaf_node() == a.get_root().get_inode()->get_child_as_leaf_node(1));
+	VERIFY(b.get_root().get_leaf_node() == a.get_root().get_inode()->get_child_as_leaf_node(0));
+	test_values(b, 1000);
+}
+
+
+////////////////////////////////////////////		vector::truncate()
+
+
+QUARK_UNIT_TEST("vector", "truncate()", "0 and size()", "empty and unchanged"){
+	test_fixture<int> f;
+	const auto a = push_back_n(50, 1000);
+	VERIFY(a.truncate(0).empty());
+	VERIFY(same_root(a.truncate(50), a));
+}
+
+QUARK_UNIT_TEST("vector", "truncate()", "3-levels of inodes to 1 inode", "root collapses, shares leaf nodes"){
+	test_fixture<int> f;
+	const auto a = push_back_n(BRANCHING_FACTOR * BRANCHING_FACTOR * 2, 1000);
+	VERIFY(a.get_shift() == BRANCHING_FACTOR_SHIFT * 2);
+
+	const auto b = a.truncate(BRANCHING_FACTOR * 3 + 2);
+	VERIFY(b.size() == BRANCHING_FACTOR * 3 + 2);
+	VERIFY(b.get_shift() == branching_factor<int>::LOWEST_LEVEL_INODE_SHIFT);
+	VERIFY(b.get_tail_size() == 2);
+	VERIFY(b.get_root().get_inode()->count_children() == 3);
+	VERIFY(b.get_root().get_inode()->get_child_as_leaf_node(0) == a.get_root().get_inode()->get_child(0).get_inode()->get_child_as_leaf_node(0));
+	test_values(b, 1000);
+	test_values(a, 1000);
+}
+
+QUARK_UNIT_TEST("vector", "truncate()", "vector without tail", "read back all values"){
+	test_fixture<int> f;
+	const auto a = make_manual_vector_branchfactor_square_plus_1();
+	const auto b = a.truncate(BRANCHING_FACTOR + 1);
+	VERIFY(b.to_vec() == generate_numbers(1000, BRANCHING_FACTOR + 1, BRANCHING_FACTOR + 1));
+	const auto c = a.truncate(BRANCHING_FACTOR);
+	VERIFY(c.to_vec() == generate_numbers(1000, BRANCHING_FACTOR, BRANCHING_FACTOR));
+}
+
+
 ////////////////////////////////////////////		vector::operator==()
 
 
@@ -667,6 +967,15 @@ QUARK_UNIT_TEST("vector", "operator==()", "1000 vs 1000", "true"){
 	VERIFY(a == b);
 }
 
+QUARK_UNIT_TEST("vector", "operator==()", "with tail vs without tail", "true"){
+	test_fixture<int> f;
+	const auto a = make_manual_vector_branchfactor_plus_1();
+	const auto b = vector<int>(generate_numbers(7, BRANCHING_FACTOR + 1, BRANCHING_FACTOR + 1));
+	VERIFY(a.get_tail_size() == 0);
+	VERIFY(b.get_tail_size() == 1);
+	VERIFY(a == b);
+}
+
 QUARK_UNIT_TEST("vector", "operator==()", "1000 vs 1000", "false"){
 	test_fixture<int> f;
 	const auto data = generate_numbers(4, 50, 50);
@@ -679,6 +988,359 @@ QUARK_UNIT_TEST("vector", "operator==()", "1000 vs 1000", "false"){
 }
 
 
+QUARK_UNIT_TEST("vector", "operator==()", "relaxed vs strict, same values", "true"){
+	test_fixture<int> f;
+	const auto a = push_back_n(BRANCHING_FACTOR * BRANCHING_FACTOR + 7, 1000);
+	const auto b = concat(a.slice(0, 3), a.slice(3, a.size()));
+	VERIFY(b.is_relaxed());
+	VERIFY(a == b);
+	VERIFY(b == a);
+	VERIFY(!(a == b.store(b.size() - 1, 0)));
+	VERIFY(!(b.store(BRANCHING_FACTOR + 1, 0) == a));
+}
+
+namespace {
+	size_t g_equal_count = 0;
+
+	struct equal_counter {
+		equal_counter(int value) : _value(value) {}
+		bool operator==(const equal_counter& rhs) const { g_equal_count++; return _value == rhs._value; }
+
+		int _value;
+	};
+
+	vector<equal_counter> make_equal_counters(size_t count){
+		std::vector<equal_counter> values;
+		for(size_t i = 0 ; i < count ; i++){
+			values.push_back(equal_counter(int(i)));
+		}
+		return vector<equal_counter>(values);
+	}
+}
+
+QUARK_UNIT_TEST("vector", "operator==()", "one store() in 3 level tree", "only compares values of one leaf node"){
+	const auto a = make_equal_counters(2 * BRANCHING_FACTOR * BRANCHING_FACTOR + 3);
+	const auto b = a.store(BRANCHING_FACTOR + 3, equal_counter(BRANCHING_FACTOR + 3));
+	const auto c = a.store(BRANCHING_FACTOR + 3, equal_counter(-1));
+
+	g_equal_count = 0;
+	VERIFY(a == b);
+	VERIFY(g_equal_count == BRANCHING_FACTOR);
+
+	g_equal_count = 0;
+	VERIFY(!(a == c));
+	VERIFY(g_equal_count == 4);
+}
+
+
+////////////////////////////////////////////		diff()
+
+
+QUARK_UNIT_TEST("", "diff()", "same vector", "no ranges"){
+	test_fixture<int> f;
+	const auto a = push_back_n(BRANCHING_FACTOR * 3 + 1, 1000);
+	VERIFY(diff(a, a).empty());
+	VERIFY(diff(vector<int>(), vector<int>()).empty());
+}
+
+QUARK_UNIT_TEST("", "diff()", "different sizes", "extra values are last range"){
+	test_fixture<int> f;
+	const auto a = push_back_n(BRANCHING_FACTOR * 3 + 1, 1000);
+	const auto b = a.push_back(7).push_back(8).store(2, 0);
+
+	const auto d = diff(a, b);
+	VERIFY(d.size() == 2);
+	VERIFY(d[0] == std::make_pair(size_t(2), size_t(3)));
+	VERIFY(d[1] == std::make_pair(a.size(), b.size()));
+	VERIFY(diff(b, a) == d);
+	VERIFY(diff(vector<int>(), a) == (std::vector<std::pair<size_t, size_t>>{ std::make_pair(size_t(0), a.size()) }));
+}
+
+QUARK_UNIT_TEST("", "diff()", "stores in relaxed vector", "same as comparing each value"){
+	test_fixture<int> f;
+	const auto a = push_back_n(2 * BRANCHING_FACTOR * BRANCHING_FACTOR + 3, 1000);
+	const auto b = concat(a.slice(0, 5), a.slice(5, a.size()));
+	VERIFY(b.is_relaxed());
+
+	std::vector<std::pair<size_t, int>> changes;
+	const size_t indexes[] = { 0, 1, 2, BRANCHING_FACTOR, BRANCHING_FACTOR * BRANCHING_FACTOR + 1, a.size() - 2, a.size() - 1 };
+	for(const auto index: indexes){
+		changes.push_back(std::make_pair(index, -1));
+	}
+	const auto c = b.store_many(changes);
+
+	std::vector<std::pair<size_t, size_t>> expected;
+	for(size_t i = 0 ; i < a.size() ; i++){
+		if(a[i] != c[i]){
+			if(!expected.empty() && expected.back().second == i){
+				expected.back().second++;
+			}
+			else{
+				expected.push_back(std::make_pair(i, i + 1));
+			}
+		}
+	}
+	VERIFY(expected.size() == 4);
+	VERIFY(diff(a, c) == expected);
+	VERIFY(diff(c, a) == expected);
+	VERIFY(diff(a, b).empty());
+}
+
+
+////////////////////////////////////////////		parallel::for_each(), reduce(), transform()
+
+
+QUARK_UNIT_TEST("parallel", "worker_pool::run()", "3 workers, 1000 tasks", "each task run once"){
+	internals::worker_pool pool(3);
+	VERIFY(pool.get_thread_count() == 4);
+
+	std::vector<std::atomic<int>> runs(1000);
+	for(auto& r: runs){
+		r = 0;
+	}
+	for(int pass = 0 ; pass < 10 ; pass++){
+		pool.run(runs.size(), [&runs](size_t index){ runs[index]++; });
+	}
+	for(const auto& r: runs){
+		VERIFY(r == 10);
+	}
+}
+
+QUARK_UNIT_TEST("parallel", "worker_pool::run()", "task throws", "exception rethrown after all tasks are done"){
+	internals::worker_pool pool(3);
+	std::atomic<int> count(0);
+	bool thrown = false;
+	try {
+		pool.run(100, [&count](size_t index){
+			count++;
+			if(index == 50){
+				throw std::runtime_error("task 50");
+			}
+		});
+	}
+	catch(const std::runtime_error&){
+		thrown = true;
+	}
+	VERIFY(thrown);
+	VERIFY(count == 100);
+}
+
+QUARK_UNIT_TEST("parallel", "for_each()", "relaxed vector", "each value visited once"){
+	test_fixture<int> f;
+	const auto a = push_back_n(3 * BRANCHING_FACTOR * BRANCHING_FACTOR + 7, 1000);
+	const auto b = concat(a.slice(5, a.size()), a);
+	VERIFY(b.is_relaxed());
+
+	std::atomic<long long> sum(0);
+	std::atomic<size_t> count(0);
+	parallel::for_each(b, [&](int value){ sum += value; count++; });
+
+	const auto values = b.to_vec();
+	VERIFY(count == b.size());
+	VERIFY(sum == std::accumulate(values.begin(), values.end(), 0LL));
+}
+
+QUARK_UNIT_TEST("parallel", "reduce()", "sum and empty vector", "same as std::accumulate"){
+	test_fixture<int> f;
+	const auto a = push_back_n(3 * BRANCHING_FACTOR * BRANCHING_FACTOR + 7, 1000);
+	const auto values = a.to_vec();
+	VERIFY(parallel::reduce(a, 3, [](int x, int y){ return x + y; }) == std::accumulate(values.begin(), values.end(), 3));
+	VERIFY(parallel::reduce(vector<int>(), 3, [](int x, int y){ return x + y; }) == 3);
+}
+
+QUARK_UNIT_TEST("parallel", "reduce()", "non-commutative op", "values combined in order"){
+	test_fixture<std::string> f;
+	std::vector<std::string> values;
+	for(size_t i = 0 ; i < 2 * BRANCHING_FACTOR * BRANCHING_FACTOR + 3 ; i++){
+		values.push_back(std::string(1, char('a' + i % 26)));
+	}
+	const vector<std::string> a(values);
+	const auto r = parallel::reduce(a, std::string(">"), [](const std::string& x, const std::string& y){ return x + y; });
+	VERIFY(r == std::accumulate(values.begin(), values.end(), std::string(">")));
+}
+
+QUARK_UNIT_TEST("parallel", "reduce()", "many chunks of bool", "each chunk result kept"){
+	test_fixture<bool> f;
+	vector<bool> a;
+	for(size_t i = 0 ; i < 8 * BRANCHING_FACTOR * BRANCHING_FACTOR ; i++){
+		a = a.push_back(i != 5);
+	}
+	VERIFY(parallel::reduce(a, true, [](bool x, bool y){ return x && y; }) == false);
+	VERIFY(parallel::reduce(a.store(5, true), true, [](bool x, bool y){ return x && y; }) == true);
+	VERIFY(parallel::reduce(a, false, [](bool x, bool y){ return x || y; }) == true);
+}
+
+QUARK_UNIT_TEST("parallel", "transform()", "relaxed vector of int to double", "same shape, transformed values"){
+	test_fixture<int> f;
+	const auto a = push_back_n(3 * BRANCHING_FACTOR * BRANCHING_FACTOR + 7, 1000);
+	const auto b = concat(a.slice(5, a.size()), a);
+
+	const auto c = parallel::transform(b, [](int value){ return value * 0.5; });
+	VERIFY(c.size() == b.size());
+	VERIFY(c.is_relaxed() == b.is_relaxed());
+	VERIFY(c.get_shift() == b.get_shift());
+	VERIFY(c.get_tail_size() == b.get_tail_size());
+	for(size_t i = 0 ; i < b.size() ; i++){
+		VERIFY(c[i] == b[i] * 0.5);
+	}
+
+	VERIFY(parallel::transform(vector<int>(), [](int value){ return value; }).empty());
+	VERIFY(parallel::transform(vector<int>{ 7 }, [](int value){ return value + 1; }) == vector<int>{ 8 });
+}
+
+
+////////////////////////////////////////////		snapshot_writer, read_snapshot()
+
+
+namespace {
+	std::string write_snapshot(const std::vector<vector<int>>& vectors, size_t& node_count){
+		snapshot_writer<int> writer;
+		for(const auto& v: vectors){
+			writer.add(v);
+		}
+		node_count = writer.get_node_count();
+
+		std::ostringstream out;
+		writer.write(out);
+		return out.str();
+	}
+}
+
+QUARK_UNIT_TEST("snapshot", "read_snapshot()", "generations of a vector", "same values, shared nodes written once"){
+	test_fixture<int> f;
+	const auto a = push_back_n(2 * BRANCHING_FACTOR * BRANCHING_FACTOR + 3, 1000);
+	const auto b = a.store(5, -5);
+	const auto c = concat(b.slice(1, b.size()), a).push_back(7);
+	const std::vector<vector<int>> vectors{ a, b, c, vector<int>(), vector<int>{ 1, 2 }, a.truncate(BRANCHING_FACTOR + 3) };
+
+	size_t node_count = 0;
+	const auto data = write_snapshot(vectors, node_count);
+	size_t separate_size = 0;
+	for(const auto& v: vectors){
+		size_t count = 0;
+		separate_size += write_snapshot({ v }, count).size();
+	}
+	VERIFY(data.size() * 3 < separate_size * 2);
+
+	//	b only adds the root, inode and leaf node on the path to index 5.
+	size_t a_count = 0;
+	write_snapshot({ a }, a_count);
+	size_t ab_count = 0;
+	write_snapshot({ a, b }, ab_count);
+	VERIFY(ab_count == a_count + 3);
+
+	const auto result = read_snapshot<int>(data.data(), data.size());
+	VERIFY(result.size() == vectors.size());
+	for(size_t i = 0 ; i < vectors.size() ; i++){
+		VERIFY(result[i].check_invariant());
+		VERIFY(result[i] == vectors[i]);
+		VERIFY(result[i].is_relaxed() == vectors[i].is_relaxed());
+		VERIFY(result[i].get_shift() == vectors[i].get_shift());
+	}
+	VERIFY(same_node(result[0].get_root().get_inode()->get_child(1), result[1].get_root().get_inode()->get_child(1)));
+	VERIFY(same_node(result[0].get_tail(), result[1].get_tail()));
+}
+
+QUARK_UNIT_TEST("snapshot", "read_snapshot()", "bad data", "throws"){
+	test_fixture<int> f;
+	size_t node_count = 0;
+	const auto data = write_snapshot({ push_back_n(BRANCHING_FACTOR * 3 + 1, 1000) }, node_count);
+
+	auto throws = [](const std::string& bytes){
+		try {
+			read_snapshot<int>(bytes.data(), bytes.size());
+			return false;
+		}
+		catch(const std::runtime_error&){
+			return true;
+		}
+	};
+	VERIFY(!throws(data));
+	VERIFY(throws(data.substr(0, data.size() - 1)));
+	VERIFY(throws(data + "x"));
+	VERIFY(throws("STEADYV2" + data.substr(8)));
+	VERIFY(throws(std::string()));
+
+	//	Not readable as a vector of another type.
+	try {
+		read_snapshot<char>(data.data(), data.size());
+		VERIFY(false);
+	}
+	catch(const std::runtime_error&){
+	}
+}
+
+namespace {
+	template <class U>
+	U peek(const std::string& data, size_t pos){
+		U result;
+		std::memcpy(&result, &data[pos], sizeof(U));
+		return result;
+	}
+
+	template <class U>
+	std::string poke(std::string data, size_t pos, U value){
+		std::memcpy(&data[pos], &value, sizeof(U));
+		return data;
+	}
+
+	bool read_snapshot_throws(const std::string& data){
+		try {
+			read_snapshot<int>(data.data(), data.size());
+			return false;
+		}
+		catch(const std::runtime_error&){
+			return true;
+		}
+	}
+}
+
+QUARK_UNIT_TEST("snapshot", "read_snapshot()", "valid format, bad tree", "throws"){
+	test_fixture<int> f;
+	size_t node_count = 0;
+	const auto data = write_snapshot({ push_back_n(BRANCHING_FACTOR * 3 + 1, 1000) }, node_count);
+	VERIFY(!read_snapshot_throws(data));
+
+	//	The vector table is at the end: size, shift, root, tail, tail size.
+	const auto table = data.size() - 5 * sizeof(std::uint64_t);
+	VERIFY(read_snapshot_throws(poke(data, table, std::uint64_t(BRANCHING_FACTOR * 3 + 2))));
+	VERIFY(read_snapshot_throws(poke(data, table, std::uint64_t(BRANCHING_FACTOR * 4 + 1))));
+	VERIFY(read_snapshot_throws(poke(data, table + 8, std::uint64_t(3 * branching_factor<int>::SHIFT))));
+	VERIFY(read_snapshot_throws(poke(data, table + 8, std::uint64_t(0))));
+
+	//	First leaf node has one value less: the strict inode above it isn't full.
+	const size_t header_size = 8 + 4 * sizeof(std::uint32_t) + 2 * sizeof(std::uint64_t);
+	VERIFY(peek<std::uint32_t>(data, header_size + 4) == BRANCHING_FACTOR);
+	auto short_leaf = poke(data, header_size + 4, std::uint32_t(BRANCHING_FACTOR - 1));
+	short_leaf.erase(header_size + 8, sizeof(int));
+	short_leaf = poke(short_leaf, short_leaf.size() - 5 * sizeof(std::uint64_t), std::uint64_t(BRANCHING_FACTOR * 3));
+	VERIFY(read_snapshot_throws(short_leaf));
+	VERIFY(read_snapshot_throws(poke(data, header_size + 4, std::uint32_t(BRANCHING_FACTOR + 1))));
+}
+
+QUARK_UNIT_TEST("snapshot", "read_snapshot()", "relaxed tree with bad size table", "throws"){
+	test_fixture<int> f;
+	const auto a = push_back_n(BRANCHING_FACTOR * 3, 1000);
+	const auto b = concat(a.slice(1, a.size()), a);
+	VERIFY(b.is_relaxed());
+
+	size_t node_count = 0;
+	const auto data = write_snapshot({ b }, node_count);
+	VERIFY(!read_snapshot_throws(data));
+
+	//	The root inode is the last node, its size table is just before the vector table.
+	const auto table = data.size() - 5 * sizeof(std::uint64_t);
+	const auto root_count = b.get_root().get_inode()->count_children();
+	const auto last_size = table - sizeof(std::uint64_t);
+	const auto first_size = table - root_count * sizeof(std::uint64_t);
+	VERIFY(peek<std::uint64_t>(data, last_size) == b.get_tail_offset());
+	VERIFY(peek<std::uint64_t>(data, first_size) == (*b.get_root().get_inode()->_sizes)[0]);
+	VERIFY(read_snapshot_throws(poke(data, last_size, std::uint64_t(b.get_tail_offset() + 1))));
+	VERIFY(read_snapshot_throws(poke(data, first_size, std::uint64_t(b.get_tail_offset()))));
+	VERIFY(read_snapshot_throws(poke(data, first_size, std::uint64_t(1))));
+}
+
+
 ////////////////////////////////////////////		vector::size()
 
 
@@ -769,6 +1431,90 @@ QUARK_UNIT_TEST("vector", "vector(std::initializer_list<T> args)", "7 values", "
 }
 
 
+////////////////////////////////////////////		vector(std::vector<T>&& values), vector(InputIt first, InputIt last)
+
+
+//	The bottom-up builder must make the same tree shape as pushing one value at a time.
+QUARK_UNIT_TEST("vector", "vector(const std::vector<T>& values)", "edge sizes", "same tree as push_back()"){
+	test_fixture<int> f;
+	const size_t sizes[] = {
+		0, 1, BRANCHING_FACTOR - 1, BRANCHING_FACTOR, BRANCHING_FACTOR + 1, 2 * BRANCHING_FACTOR, 2 * BRANCHING_FACTOR + 1,
+		BRANCHING_FACTOR * BRANCHING_FACTOR, BRANCHING_FACTOR * BRANCHING_FACTOR + 1,
+		BRANCHING_FACTOR * BRANCHING_FACTOR + BRANCHING_FACTOR, BRANCHING_FACTOR * BRANCHING_FACTOR + BRANCHING_FACTOR + 1,
+		BRANCHING_FACTOR * BRANCHING_FACTOR * BRANCHING_FACTOR + BRANCHING_FACTOR + 1
+	};
+	for(const auto size: sizes){
+		const auto data = generate_numbers(7, int(size), int(size));
+		vector<int> expected;
+		for(const auto value: data){
+			expected = expected.push_back(value);
+		}
+
+		const vector<int> a(data);
+		VERIFY(a.check_invariant());
+		VERIFY(a.size() == size);
+		VERIFY(a.get_shift() == expected.get_shift());
+		VERIFY(a.get_tail_size() == expected.get_tail_size());
+		VERIFY(!a.is_relaxed());
+		VERIFY(a.to_vec() == data);
+	}
+}
+
+namespace {
+	size_t g_copy_count = 0;
+
+	struct copy_counter {
+		copy_counter(int value) : _value(value) {}
+		copy_counter(const copy_counter& other) : _value(other._value) { g_copy_count++; }
+		copy_counter(copy_counter&& other) : _value(other._value) {}
+		copy_counter& operator=(const copy_counter& other) { _value = other._value; g_copy_count++; return *this; }
+		bool operator==(const copy_counter& rhs) const { return _value == rhs._value; }
+
+		int _value;
+	};
+}
+
+QUARK_UNIT_TEST("vector", "vector(std::vector<T>&& values)", "3 levels", "values moved, not copied"){
+	std::vector<copy_counter> values;
+	for(int i = 0 ; i < 2 * BRANCHING_FACTOR * BRANCHING_FACTOR + 3 ; i++){
+		values.push_back(copy_counter(i));
+	}
+
+	g_copy_count = 0;
+	const vector<copy_counter> a(std::move(values));
+	VERIFY(g_copy_count == 0);
+	VERIFY(a.size() == 2 * BRANCHING_FACTOR * BRANCHING_FACTOR + 3);
+	VERIFY(a[BRANCHING_FACTOR * BRANCHING_FACTOR]._value == BRANCHING_FACTOR * BRANCHING_FACTOR);
+}
+
+QUARK_UNIT_TEST("vector", "vector(InputIt first, InputIt last)", "std::list and std::istream_iterator", "correct values"){
+	test_fixture<int> f;
+	const auto data = generate_numbers(3, BRANCHING_FACTOR * 3 + 1, BRANCHING_FACTOR * 3 + 1);
+	const std::list<int> list(data.begin(), data.end());
+	const vector<int> a(list.begin(), list.end());
+	VERIFY(a.to_vec() == data);
+
+	std::istringstream stream("5 6 7");
+	const vector<int> b((std::istream_iterator<int>(stream)), std::istream_iterator<int>());
+	VERIFY(b == (vector<int>{ 5, 6, 7 }));
+
+	const vector<int> c(list.begin(), list.begin());
+	VERIFY(c.empty());
+}
+
+QUARK_UNIT_TEST("vector", "vector(InputIt first, InputIt last)", "std::make_move_iterator()", "values moved, not copied"){
+	std::vector<copy_counter> values;
+	for(int i = 0 ; i < BRANCHING_FACTOR + 3 ; i++){
+		values.push_back(copy_counter(i));
+	}
+
+	g_copy_count = 0;
+	const vector<copy_counter> a(std::make_move_iterator(values.begin()), std::make_move_iterator(values.end()));
+	VERIFY(g_copy_count == 0);
+	VERIFY(a.size() == BRANCHING_FACTOR + 3);
+}
+
+
 ////////////////////////////////////////////		vector::to_vec()
 
 
@@ -786,32 +1532,148 @@ QUARK_UNIT_TEST("vector", "to_vec()", "50", "correct data"){
 }
 
 
-////////////////////////////////////////////		vector::vector(const vector& rhs)
+////////////////////////////////////////////		vector::begin(), vector::end()
 
 
-QUARK_UNIT_TEST("vector", "vector(const vector& rhs)", "empty", "empty"){
-	test_fixture<int> f;
-	const auto a = vector<int>();
-	const auto b(a);
-	VERIFY(a.empty());
-	VERIFY(b.empty());
+QUARK_UNIT_TEST("vector", "begin(), end()", "empty vector", "begin() == end()"){
+	const vector<int> a;
+	VERIFY(a.begin() == a.end());
+	VERIFY(a.end() - a.begin() == 0);
 }
 
-template <class T>
-bool same_root(const vector<T>& a, const vector<T>& b){
-	if(a.get_root().get_type() == node_type::inode){
-		return a.get_root().get_inode() == b.get_root().get_inode();
-	}
-	else{
-		return a.get_root().get_leaf_node() == b.get_root().get_leaf_node();
+QUARK_UNIT_TEST("vector", "begin(), end()", "3 levels + tail, range-for", "all values in order"){
+	test_fixture<int> f;
+	const auto a = push_back_n(2 * BRANCHING_FACTOR * BRANCHING_FACTOR + 3, 1000);
+
+	int expected = 1000;
+	for(const auto& value: a){
+		VERIFY(value == expected);
+		expected++;
 	}
+	VERIFY(expected == 1000 + int(a.size()));
+	VERIFY(std::vector<int>(a.begin(), a.end()) == a.to_vec());
+	VERIFY(size_t(std::distance(a.begin(), a.end())) == a.size());
 }
 
-QUARK_UNIT_TEST("vector", "vector(const vector& rhs)", "7 values", "identical, sharing root"){
+QUARK_UNIT_TEST("vector", "begin(), end()", "relaxed vector", "all values in order"){
 	test_fixture<int> f;
-	const auto data = std::vector<int>{	3, 4, 5, 6, 7, 8, 9	};
-	const vector<int> a = data;
-	const auto b(a);
+	const auto a = push_back_n(BRANCHING_FACTOR * BRANCHING_FACTOR + 5, 1000);
+	const auto b = push_back_n(BRANCHING_FACTOR * 3 + 1, 2000);
+	const auto c = concat(a.slice(3, a.size()), b);
+	VERIFY(c.is_relaxed());
+
+	const auto expected = c.to_vec();
+	VERIFY(std::vector<int>(c.begin(), c.end()) == expected);
+	VERIFY(std::accumulate(c.begin(), c.end(), 0) == std::accumulate(expected.begin(), expected.end(), 0));
+}
+
+QUARK_UNIT_TEST("vector", "begin(), end()", "random access, STL algorithms", "correct"){
+	test_fixture<int> f;
+	const auto a = push_back_n(BRANCHING_FACTOR * BRANCHING_FACTOR + BRANCHING_FACTOR + 2, 1000);
+	auto it = a.begin();
+
+	VERIFY(it[BRANCHING_FACTOR + 1] == 1000 + BRANCHING_FACTOR + 1);
+	it += BRANCHING_FACTOR * 2;
+	VERIFY(*it == 1000 + BRANCHING_FACTOR * 2);
+	VERIFY(*(it - 1) == 1000 + BRANCHING_FACTOR * 2 - 1);
+	--it;
+	VERIFY(*it == 1000 + BRANCHING_FACTOR * 2 - 1);
+	VERIFY(it > a.begin() && it < a.end() && a.begin() <= it && a.end() >= it);
+	VERIFY(*(a.end() - 1) == a[a.size() - 1]);
+
+	//	Sorted: binary search works.
+	const auto found = std::lower_bound(a.begin(), a.end(), 1000 + BRANCHING_FACTOR * BRANCHING_FACTOR + 1);
+	VERIFY(found.get_index() == BRANCHING_FACTOR * BRANCHING_FACTOR + 1);
+
+	//	Backwards.
+	int expected = 1000 + int(a.size()) - 1;
+	for(auto r = a.end() ; r != a.begin() ; ){
+		--r;
+		VERIFY(*r == expected);
+		expected--;
+	}
+}
+
+
+////////////////////////////////////////////		vector::copy_range(), vector::get_many()
+
+
+QUARK_UNIT_TEST("vector", "copy_range()", "relaxed vector, all sub ranges at leaf edges", "same as operator[]"){
+	test_fixture<int> f;
+	const auto a = push_back_n(BRANCHING_FACTOR * BRANCHING_FACTOR + 5, 1000);
+	const auto b = push_back_n(BRANCHING_FACTOR * 2 + 3, 2000);
+	const auto c = concat(a.slice(3, a.size()), b);
+	VERIFY(c.is_relaxed());
+
+	const size_t edges[] = { 0, 1, BRANCHING_FACTOR - 1, BRANCHING_FACTOR, BRANCHING_FACTOR + 1, c.size() / 2, c.size() - 1, c.size() };
+	for(const auto begin: edges){
+		for(const auto end: edges){
+			if(begin <= end){
+				std::vector<int> out(end - begin, -1);
+				c.copy_range(begin, end, out.empty() ? nullptr : &out[0]);
+				for(size_t i = 0 ; i < out.size() ; i++){
+					VERIFY(out[i] == c[begin + i]);
+				}
+			}
+		}
+	}
+}
+
+QUARK_UNIT_TEST("vector", "get_many()", "unsorted indices with duplicates", "same as operator[]"){
+	test_fixture<int> f;
+	const auto a = push_back_n(2 * BRANCHING_FACTOR * BRANCHING_FACTOR + 3, 1000);
+
+	std::vector<size_t> indices;
+	for(size_t i = 0 ; i < 200 ; i++){
+		indices.push_back((i * 7919) % a.size());
+	}
+	indices.push_back(0);
+	indices.push_back(a.size() - 1);
+	indices.push_back(0);
+
+	std::vector<int> out(indices.size(), -1);
+	a.get_many(&indices[0], indices.size(), &out[0]);
+	for(size_t i = 0 ; i < indices.size() ; i++){
+		VERIFY(out[i] == a[indices[i]]);
+	}
+}
+
+QUARK_UNIT_TEST("vector", "get_many()", "sorted indices, relaxed vector", "same as operator[]"){
+	test_fixture<int> f;
+	const auto a = push_back_n(BRANCHING_FACTOR * BRANCHING_FACTOR + 5, 1000);
+	const auto c = a.slice(1, a.size()) + a;
+	VERIFY(c.is_relaxed());
+
+	std::vector<size_t> indices;
+	for(size_t i = 0 ; i < c.size() ; i += 3){
+		indices.push_back(i);
+	}
+	std::vector<int> out(indices.size(), -1);
+	c.get_many(&indices[0], indices.size(), &out[0]);
+	for(size_t i = 0 ; i < indices.size() ; i++){
+		VERIFY(out[i] == c[indices[i]]);
+	}
+
+	c.get_many(nullptr, 0, nullptr);
+}
+
+
+////////////////////////////////////////////		vector::vector(const vector& rhs)
+
+
+QUARK_UNIT_TEST("vector", "vector(const vector& rhs)", "empty", "empty"){
+	test_fixture<int> f;
+	const auto a = vector<int>();
+	const auto b(a);
+	VERIFY(a.empty());
+	VERIFY(b.empty());
+}
+
+QUARK_UNIT_TEST("vector", "vector(const vector& rhs)", "7 values", "identical, sharing root"){
+	test_fixture<int> f;
+	const auto data = std::vector<int>{	3, 4, 5, 6, 7, 8, 9	};
+	const vector<int> a = data;
+	const auto b(a);
 
 	VERIFY(a.to_vec() == data);
 	VERIFY(b.to_vec() == data);
@@ -820,6 +1682,68 @@ QUARK_UNIT_TEST("vector", "vector(const vector& rhs)", "7 values", "identical, s
 
 
 
+////////////////////////////////////////////		vector::vector(vector&& rhs)
+
+
+QUARK_UNIT_TEST("vector", "vector(vector&& rhs)", "2 levels + tail", "takes over root, rhs empty, no extra references"){
+	test_fixture<int> f;
+	auto a = push_back_n(BRANCHING_FACTOR * BRANCHING_FACTOR + 3, 1000);
+	const auto root = a.get_root().get_inode();
+	const auto rc = root->_rc.get();
+
+	const auto b(std::move(a));
+
+	VERIFY(a.empty());
+	VERIFY(a.check_invariant());
+	VERIFY(b.get_root().get_inode() == root);
+	VERIFY(root->_rc.get() == rc);
+	test_values(b, 1000);
+}
+
+QUARK_UNIT_TEST("vector", "operator=(vector&& rhs)", "7 values", "takes over root, rhs empty"){
+	test_fixture<int> f;
+	const auto data = std::vector<int>{	3, 4, 5, 6, 7, 8, 9	};
+	vector<int> a = data;
+	auto b = vector<int>{ 1, 2 };
+
+	b = std::move(a);
+
+	VERIFY(a.empty());
+	VERIFY(b.to_vec() == data);
+
+	a = b.push_back(10);
+	VERIFY(a.size() == 8);
+}
+
+
+////////////////////////////////////////////		vector::store() path copying
+
+
+QUARK_UNIT_TEST("vector", "store()", "3 levels", "new path holds one reference to each shared child"){
+	test_fixture<int> f;
+	const auto a = push_back_n(2 * BRANCHING_FACTOR * BRANCHING_FACTOR + 3, 1000);
+	const auto b = a.store(BRANCHING_FACTOR + 1, 7);
+
+	const auto& root_a = *a.get_root().get_inode();
+	const auto& root_b = *b.get_root().get_inode();
+	VERIFY(root_a._rc.get() == 1);
+	VERIFY(root_b._rc.get() == 1);
+
+	//	First child of the root is copied, the second is shared.
+	VERIFY(!root_a.get_child(0).same_node(root_b.get_child(0)));
+	VERIFY(root_a.get_child(1).same_node(root_b.get_child(1)));
+	VERIFY(root_a.get_child(1).get_inode()->_rc.get() == 2);
+
+	//	Leaf node 0 is shared, leaf node 1 is copied.
+	const auto& inode_b = *root_b.get_child(0).get_inode();
+	VERIFY(inode_b._rc.get() == 1);
+	VERIFY(inode_b.get_child(0).get_leaf_node()->_rc.get() == 2);
+	VERIFY(inode_b.get_child(1).get_leaf_node()->_rc.get() == 1);
+	VERIFY(b[BRANCHING_FACTOR + 1] == 7);
+}
+
+
+
 ////////////////////////////////////////////		vector::operator=()
 
 
@@ -861,6 +1785,1205 @@ QUARK_UNIT_TEST("vector", "operator+()", "3 + 4 values", "7 values"){
 	VERIFY(c.to_vec() == (std::vector<int>{ 2, 3, 4, 5, 6, 7, 8 }));
 }
 
+QUARK_UNIT_TEST("vector", "operator+()", "b only has a tail", "a stays strict"){
+	test_fixture<int> f;
+	const auto a = push_back_n(BRANCHING_FACTOR * BRANCHING_FACTOR + 3, 1000);
+	const auto b = push_back_n(BRANCHING_FACTOR, 1000 + BRANCHING_FACTOR * BRANCHING_FACTOR + 3);
+
+	const auto c = a + b;
+	VERIFY(!c.is_relaxed());
+	test_values(c, 1000);
+}
+
+
+////////////////////////////////////////////		concat()
+
+
+QUARK_UNIT_TEST("vector", "concat()", "two 3-level trees", "correct values, originals unchanged"){
+	test_fixture<int> f;
+	const auto count_a = BRANCHING_FACTOR * BRANCHING_FACTOR + 7;
+	const auto count_b = BRANCHING_FACTOR * BRANCHING_FACTOR * 2 + 3;
+	const auto a = push_back_n(count_a, 1000);
+	const auto b = push_back_n(count_b, 1000 + count_a);
+
+	const auto c = concat(a, b);
+	VERIFY(c.size() == count_a + count_b);
+	VERIFY(c.is_relaxed());
+	VERIFY(validate_vector(c));
+	VERIFY(same_values(c, generate_numbers(1000, count_a + count_b, count_a + count_b)));
+	test_values(a, 1000);
+	test_values(b, 1000 + count_a);
+}
+
+QUARK_UNIT_TEST("vector", "concat()", "two 3-level trees", "leaf nodes away from the seam are shared"){
+	test_fixture<int> f;
+	const auto count = BRANCHING_FACTOR * BRANCHING_FACTOR * 2 + 3;
+	const auto a = push_back_n(count, 1000);
+	const auto b = push_back_n(count, 1000 + count);
+
+	const auto c = concat(a, b);
+	VERIFY(same_node(find_leaf_node(c, 0), find_leaf_node(a, 0)));
+	VERIFY(same_node(find_leaf_node(c, count + b.get_tail_offset() - 1), find_leaf_node(b, b.get_tail_offset() - 1)));
+	VERIFY(same_node(c.get_tail(), b.get_tail()));
+}
+
+QUARK_UNIT_TEST("vector", "concat()", "many vectors of odd sizes", "correct values"){
+	test_fixture<int> f;
+	std::vector<int> expected;
+	vector<int> a;
+	uint32_t seed = 1;
+	for(int i = 0 ; i < 60 ; i++){
+		seed = seed * 1664525 + 1013904223;
+		const auto count = static_cast<int>((seed >> 16) % (BRANCHING_FACTOR * 3)) + 1;
+		const auto data = generate_numbers(i * 1000, count, count);
+
+		//	Mostly add to the end, sometimes to the front.
+		if(i % 3 == 2){
+			a = concat(vector<int>(data), a);
+			expected.insert(expected.begin(), data.begin(), data.end());
+		}
+		else{
+			a = concat(a, vector<int>(data));
+			expected.insert(expected.end(), data.begin(), data.end());
+		}
+		VERIFY(validate_vector(a));
+		VERIFY(a.size() == expected.size());
+	}
+	VERIFY(same_values(a, expected));
+}
+
+QUARK_UNIT_TEST("vector", "concat()", "relaxed vectors", "correct values"){
+	test_fixture<int> f;
+	const auto count = BRANCHING_FACTOR * BRANCHING_FACTOR + 5;
+	const auto a = push_back_n(count, 0).slice(3, count);
+	const auto b = push_back_n(count, count).slice(0, count - 7);
+	VERIFY(a.is_relaxed());
+
+	const auto c = concat(concat(a, b), concat(b, a));
+	VERIFY(validate_vector(c));
+
+	const auto a_values = a.to_vec();
+	const auto b_values = b.to_vec();
+	auto expected = generate_numbers(3, count * 2 - 10, count * 2 - 10);
+	expected.insert(expected.end(), b_values.begin(), b_values.end());
+	expected.insert(expected.end(), a_values.begin(), a_values.end());
+	VERIFY(same_values(c, expected));
+	VERIFY(c == vector<int>(expected));
+}
+
+
+////////////////////////////////////////////		slice()
+
+
+QUARK_UNIT_TEST("vector", "slice()", "all ranges of small vector", "correct values"){
+	test_fixture<int> f;
+	const auto count = BRANCHING_FACTOR * 3 + 5;
+	const auto a = push_back_n(count, 1000);
+	for(int begin = 0 ; begin <= count ; begin++){
+		for(int end = begin ; end <= count ; end++){
+			const auto b = a.slice(begin, end);
+			VERIFY(validate_vector(b));
+			VERIFY(same_values(b, generate_numbers(1000 + begin, end - begin, end - begin)));
+		}
+	}
+}
+
+QUARK_UNIT_TEST("vector", "slice()", "middle of 3-level tree", "correct values, can be modified"){
+	test_fixture<int> f;
+	const auto count = BRANCHING_FACTOR * BRANCHING_FACTOR * 2 + 3;
+	const auto a = push_back_n(count, 1000);
+	const auto begin = BRANCHING_FACTOR + 3;
+	const auto end = count - BRANCHING_FACTOR * 2 - 1;
+
+	const auto b = a.slice(begin, end);
+	VERIFY(b.is_relaxed());
+	VERIFY(validate_vector(b));
+	test_values(b, 1000 + begin);
+
+	//	push_back() and pop_back() on a relaxed vector.
+	auto c = b;
+	for(int i = 0 ; i < BRANCHING_FACTOR * 3 ; i++){
+		c = c.push_back(1000 + end + i);
+		VERIFY(validate_vector(c));
+	}
+	test_values(c, 1000 + begin);
+	while(c.size() > 1){
+		c = c.pop_back();
+		VERIFY(validate_vector(c));
+	}
+	test_values(c, 1000 + begin);
+
+	//	store() on a relaxed vector.
+	const auto d = b.store(0, 7).store(b.size() / 2, 8);
+	VERIFY(d[0] == 7);
+	VERIFY(d[b.size() / 2] == 8);
+	VERIFY(d[1] == b[1]);
+	test_values(b, 1000 + begin);
+}
+
+
+////////////////////////////////////////////		insert_at(), erase_at(), push_front()
+
+
+QUARK_UNIT_TEST("vector", "insert_at()", "many positions", "correct values"){
+	test_fixture<int> f;
+	std::vector<int> expected = generate_numbers(0, BRANCHING_FACTOR * BRANCHING_FACTOR, BRANCHING_FACTOR * BRANCHING_FACTOR);
+	vector<int> a(expected);
+	uint32_t seed = 7;
+	for(int i = 0 ; i < 100 ; i++){
+		seed = seed * 1664525 + 1013904223;
+		const auto index = (seed >> 8) % (expected.size() + 1);
+		a = a.insert_at(index, -i);
+		expected.insert(expected.begin() + index, -i);
+		VERIFY(validate_vector(a));
+	}
+	VERIFY(same_values(a, expected));
+}
+
+QUARK_UNIT_TEST("vector", "erase_at()", "many positions", "correct values"){
+	test_fixture<int> f;
+	std::vector<int> expected = generate_numbers(0, BRANCHING_FACTOR * BRANCHING_FACTOR + 9, BRANCHING_FACTOR * BRANCHING_FACTOR + 9);
+	vector<int> a(expected);
+	uint32_t seed = 3;
+	while(!expected.empty()){
+		seed = seed * 1664525 + 1013904223;
+		const auto index = (seed >> 8) % expected.size();
+		a = a.erase_at(index);
+		expected.erase(expected.begin() + index);
+		VERIFY(validate_vector(a));
+		VERIFY(a.size() == expected.size());
+	}
+	VERIFY(a.empty());
+}
+
+QUARK_UNIT_TEST("vector", "push_front()", "2-levels of inodes", "correct values"){
+	test_fixture<int> f;
+	const auto count = BRANCHING_FACTOR * BRANCHING_FACTOR + 5;
+	vector<int> a;
+	for(int i = count - 1 ; i >= 0 ; i--){
+		a = a.push_front(1000 + i);
+	}
+	VERIFY(validate_vector(a));
+	test_values(a, 1000);
+}
+
+
+
+////////////////////////////////////////////		transient_vector
+
+
+QUARK_UNIT_TEST("transient_vector", "push_back()", "3-levels of inodes", "read back all values"){
+	test_fixture<int> f;
+	const auto count = BRANCHING_FACTOR * BRANCHING_FACTOR * 2 + 3;
+	transient_vector<int> t;
+	for(int i = 0 ; i < count ; i++){
+		t.push_back(1000 + i);
+	}
+	VERIFY(t.size() == count);
+	VERIFY(t[count - 1] == 1000 + count - 1);
+
+	const auto a = t.persistent();
+	VERIFY(a.size() == count);
+	test_values(a, 1000);
+}
+
+QUARK_UNIT_TEST("transient_vector", "push_back()", "fill up one leaf node", "no extra nodes allocated"){
+	test_fixture<int> f;
+	transient_vector<int> t;
+	t.push_back(1000);
+
+	const auto inode_count = get_inode_count<int>();
+	const auto leaf_count = get_leaf_count<int>();
+	for(int i = 1 ; i < BRANCHING_FACTOR ; i++){
+		t.push_back(1000 + i);
+	}
+	VERIFY_NODES(get_inode_count<int>() == inode_count);
+	VERIFY_NODES(get_leaf_count<int>() == leaf_count);
+	test_values(t.persistent(), 1000);
+}
+
+QUARK_UNIT_TEST("transient_vector", "transient_vector(const vector&)", "store() + push_back()", "original vector unchanged"){
+	test_fixture<int> f;
+	const auto data = generate_numbers(4, 50, 50);
+	const vector<int> a(data);
+
+	transient_vector<int> t(a);
+	t.store(0, 1000);
+	t.store(49, 1049);
+	t.push_back(1050);
+
+	VERIFY(a.to_vec() == data);
+
+	const auto b = t.persistent();
+	VERIFY(b.size() == 51);
+	VERIFY(b[0] == 1000);
+	VERIFY(b[1] == 5);
+	VERIFY(b[49] == 1049);
+	VERIFY(b[50] == 1050);
+}
+
+QUARK_UNIT_TEST("transient_vector", "persistent()", "keep modifying transient afterwards", "persistent vector unchanged"){
+	test_fixture<int> f;
+	transient_vector<int> t;
+	for(int i = 0 ; i < BRANCHING_FACTOR + 3 ; i++){
+		t.push_back(i);
+	}
+	const auto a = t.persistent();
+	const auto expected = a.to_vec();
+
+	t.store(0, 1000);
+	t.store(BRANCHING_FACTOR + 2, 1001);
+	for(int i = 0 ; i < BRANCHING_FACTOR * BRANCHING_FACTOR ; i++){
+		t.push_back(i);
+	}
+
+	VERIFY(a.to_vec() == expected);
+	VERIFY(a[BRANCHING_FACTOR + 2] == BRANCHING_FACTOR + 2);
+	VERIFY(t[0] == 1000);
+	VERIFY(t[BRANCHING_FACTOR + 2] == 1001);
+}
+
+QUARK_UNIT_TEST("transient_vector", "transient_vector(const vector&)", "relaxed vector", "correct values"){
+	test_fixture<int> f;
+	const auto count = BRANCHING_FACTOR * BRANCHING_FACTOR + 5;
+	const auto a = push_back_n(count, 1000).slice(3, count);
+	VERIFY(a.is_relaxed());
+
+	transient_vector<int> t(a);
+	for(int i = 0 ; i < BRANCHING_FACTOR * 3 ; i++){
+		t.push_back(1000 + count + i);
+	}
+	t.store(0, 7);
+	t.store(BRANCHING_FACTOR + 1, 8);
+
+	auto expected = generate_numbers(1003, count - 3 + BRANCHING_FACTOR * 3, count - 3 + BRANCHING_FACTOR * 3);
+	expected[0] = 7;
+	expected[BRANCHING_FACTOR + 1] = 8;
+	const auto b = t.persistent();
+	VERIFY(validate_vector(b));
+	VERIFY(same_values(b, expected));
+	test_values(a, 1003);
+}
+
+
+
+////////////////////////////////////////////		vector_editor
+
+
+
+QUARK_UNIT_TEST("vector_editor", "store()", "many stores into one leaf node", "one leaf node copied until commit()"){
+	test_fixture<int> f;
+	const auto a = push_back_n(BRANCHING_FACTOR * BRANCHING_FACTOR * 2, 1000);
+	const auto inodes = get_inode_count<int>();
+	const auto leaves = get_leaf_count<int>();
+
+	vector<int>::editor e(a);
+	for(int i = 0 ; i < 100 ; i++){
+		e.store(BRANCHING_FACTOR + 1 + i % 3, i);
+	}
+	VERIFY_NODES(get_inode_count<int>() == inodes);
+	VERIFY_NODES(get_leaf_count<int>() == leaves + 1);
+	VERIFY(e[BRANCHING_FACTOR + 1] == 99);
+	VERIFY(e[BRANCHING_FACTOR + 2] == 97);
+
+	const auto b = e.commit();
+	VERIFY_NODES(get_inode_count<int>() == inodes + 2);
+	VERIFY(b[BRANCHING_FACTOR + 1] == 99);
+	VERIFY(b[BRANCHING_FACTOR] == 1000 + BRANCHING_FACTOR);
+	test_values(a, 1000);
+}
+
+QUARK_UNIT_TEST("vector_editor", "store()", "moving window over relaxed vector and tail", "same as vector::store()"){
+	test_fixture<int> f;
+	const auto count = BRANCHING_FACTOR * BRANCHING_FACTOR + 5;
+	const auto a = push_back_n(count, 1000).slice(3, count) + push_back_n(BRANCHING_FACTOR + 3, 5000);
+	VERIFY(a.is_relaxed());
+
+	vector<int>::editor e(a);
+	auto expected = a;
+	for(size_t i = 0 ; i < a.size() ; i += 3){
+		e.store(i, int(i));
+		expected = expected.store(i, int(i));
+	}
+
+	//	commit() can be called more than once.
+	const auto b = e.commit();
+	e.store(1, 7);
+	const auto c = e.commit();
+	VERIFY(validate_vector(b));
+	VERIFY(b == expected);
+	VERIFY(c == expected.store(1, 7));
+	VERIFY(b[1] == a[1]);
+}
+
+
+
+////////////////////////////////////////////		node_allocator
+
+
+namespace {
+	size_t g_counting_allocations = 0;
+	size_t g_counting_deallocations = 0;
+
+	//	The size each live block was allocated with: freeing must pass the same size.
+	std::unordered_map<void*, std::size_t> g_counting_sizes;
+
+	void* counting_allocate(std::size_t size){
+		g_counting_allocations++;
+		const auto result = ::operator new(size);
+		g_counting_sizes[result] = size;
+		return result;
+	}
+
+	void counting_deallocate(void* p, std::size_t size){
+		g_counting_deallocations++;
+		const auto it = g_counting_sizes.find(p);
+		ASSERT(it != g_counting_sizes.end() && it->second == size);
+		g_counting_sizes.erase(it);
+		::operator delete(p);
+	}
+
+	size_t count_relaxed_inodes(const node_ref<int>& node, int shift){
+		if(shift == internals::LEAF_NODE_SHIFT){
+			return 0;
+		}
+		const auto& n = *node.get_inode();
+		size_t result = n.is_relaxed() ? 1 : 0;
+		for(size_t i = 0 ; i < n.count_children() ; i++){
+			result += count_relaxed_inodes(n.get_child(i), shift - branching_factor<int>::SHIFT);
+		}
+		return result;
+	}
+}
+
+QUARK_UNIT_TEST("", "set_node_allocator()", "counting allocator", "all nodes and size tables allocated and freed using hook"){
+	test_fixture<int> f;
+	const auto prev = get_node_allocator();
+	set_node_allocator(node_allocator{ counting_allocate, counting_deallocate });
+	g_counting_allocations = 0;
+	g_counting_deallocations = 0;
+	{
+		const auto a = push_back_n(BRANCHING_FACTOR * BRANCHING_FACTOR + 3, 1000);
+		const auto b = a.store(3, 7);
+		VERIFY_NODES(g_counting_allocations == get_inode_count<int>() + get_leaf_count<int>() + g_counting_deallocations);
+
+		//	Relaxed inodes also allocate their size table.
+		const auto c = concat(b.slice(1, b.size()), a);
+		VERIFY(c.is_relaxed());
+		const auto tables = count_relaxed_inodes(c.get_root(), c.get_shift());
+		VERIFY(tables > 0);
+		VERIFY_NODES(g_counting_allocations == get_inode_count<int>() + get_leaf_count<int>() + tables + g_counting_deallocations);
+	}
+	VERIFY(g_counting_allocations > 0);
+	VERIFY(g_counting_allocations == g_counting_deallocations);
+	VERIFY(g_counting_sizes.empty());
+	set_node_allocator(prev);
+}
+
+QUARK_UNIT_TEST("", "node_pool::allocate()", "free then allocate same size", "block is reused"){
+	void* a = node_pool::allocate(sizeof(inode<int>));
+	node_pool::deallocate(a, sizeof(inode<int>));
+	void* b = node_pool::allocate(sizeof(inode<int>));
+	VERIFY(a == b);
+	node_pool::deallocate(b, sizeof(inode<int>));
+
+	//	inodes have the same size for all T with the same branching factor.
+	VERIFY(branching_factor<double>::SHIFT == branching_factor<int>::SHIFT);
+	VERIFY(sizeof(inode<int>) == sizeof(inode<double>));
+}
+
+QUARK_UNIT_TEST("", "make_pool_node_allocator()", "build and free vectors on two threads", "correct values"){
+	test_fixture<int> f;
+	const auto prev = get_node_allocator();
+	set_node_allocator(make_pool_node_allocator());
+	{
+		const auto a = push_back_n(2000, 1000);
+		vector<int> b;
+		std::thread t([&a, &b](){
+			auto c = a;
+			for(int i = 0 ; i < 1000 ; i++){
+				c = c.store(i, -i);
+			}
+			b = c;
+		});
+		t.join();
+		test_values(a, 1000);
+		VERIFY(b[999] == -999);
+		VERIFY(b[1000] == 2000);
+	}
+	set_node_allocator(prev);
+}
+
+
+
+////////////////////////////////////////////		refcount_policy
+
+
+namespace {
+	struct nonatomic_int {
+		nonatomic_int(int value = 0) : _value(value){}
+		bool operator==(const nonatomic_int& rhs) const { return _value == rhs._value; }
+		int _value;
+	};
+
+	struct biased_int {
+		biased_int(int value = 0) : _value(value){}
+		bool operator==(const biased_int& rhs) const { return _value == rhs._value; }
+		int _value;
+	};
+}
+
+template <> struct refcount_policy<nonatomic_int> { typedef nonatomic_refcount type; };
+template <> struct refcount_policy<biased_int> { typedef biased_refcount type; };
+
+
+QUARK_UNIT_TEST("", "refcount", "inc, dec", "dec() true on last reference"){
+	atomic_refcount a;
+	nonatomic_refcount b;
+	biased_refcount c;
+
+	a.inc();
+	a.inc();
+	VERIFY(a.get() == 2);
+	VERIFY(a.dec() == false);
+	VERIFY(a.dec() == true);
+
+	b.inc();
+	b.inc();
+	VERIFY(b.get() == 2);
+	VERIFY(b.dec() == false);
+	VERIFY(b.dec() == true);
+
+	c.inc();
+	c.inc();
+	VERIFY(c.get() == 2);
+	VERIFY(c.dec() == false);
+	VERIFY(c.dec() == true);
+}
+
+QUARK_UNIT_TEST("", "biased_refcount", "other thread releases the owner's references", "last dec() true"){
+	biased_refcount rc;
+	rc.inc();
+	rc.inc();
+	rc.inc();
+
+	bool last1 = true;
+	bool last2 = true;
+	std::thread t([&rc, &last1, &last2](){
+		last1 = rc.dec();
+		last2 = rc.dec();
+	});
+	t.join();
+
+	VERIFY(last1 == false);
+	VERIFY(last2 == false);
+	VERIFY(rc.get() == 1);
+	VERIFY(rc.dec() == true);
+}
+
+QUARK_UNIT_TEST("", "refcount_policy", "vector<nonatomic_int>", "correct values, all nodes freed"){
+	{
+		vector<nonatomic_int> a;
+		for(int i = 0 ; i < 1000 ; i++){
+			a = a.push_back(i);
+		}
+		const auto b = a.store(500, -1);
+		const auto c = b.pop_back();
+		VERIFY(a[500]._value == 500);
+		VERIFY(b[500]._value == -1);
+		VERIFY(c.size() == 999);
+		VERIFY(c[998]._value == 998);
+		VERIFY(a.get_root().get_inode()->_rc.get() == 1);
+	}
+	VERIFY_NODES(get_inode_count<nonatomic_int>() == 0);
+	VERIFY_NODES(get_leaf_count<nonatomic_int>() == 0);
+}
+
+QUARK_UNIT_TEST("", "refcount_policy", "vector<biased_int> shared with other thread", "correct values, all nodes freed"){
+	{
+		vector<biased_int> a;
+		for(int i = 0 ; i < 1000 ; i++){
+			a = a.push_back(i);
+		}
+
+		vector<biased_int> b;
+		std::thread t([&a, &b](){
+			auto c = a;
+			for(int i = 0 ; i < 100 ; i++){
+				c = c.store(i, -i);
+			}
+			b = c;
+		});
+		t.join();
+
+		VERIFY(a[99]._value == 99);
+		VERIFY(b[99]._value == -99);
+		VERIFY(b[100]._value == 100);
+
+		a = vector<biased_int>();
+		VERIFY(b[999]._value == 999);
+	}
+	VERIFY_NODES(get_inode_count<biased_int>() == 0);
+	VERIFY_NODES(get_leaf_count<biased_int>() == 0);
+}
+
+
+
+////////////////////////////////////////////		leaf_node storage
+
+
+namespace {
+	int g_live_values = 0;
+
+	//	No default constructor. Counts the live instances.
+	struct counted_value {
+		explicit counted_value(int value) : _value(value){ g_live_values++; }
+		counted_value(const counted_value& other) : _value(other._value){ g_live_values++; }
+		counted_value& operator=(const counted_value& other){ _value = other._value; return *this; }
+		~counted_value(){ g_live_values--; }
+		bool operator==(const counted_value& rhs) const { return _value == rhs._value; }
+		int _value;
+	};
+}
+
+QUARK_UNIT_TEST("", "leaf_node<T>", "push_back() one value", "only one value constructed"){
+	g_live_values = 0;
+	{
+		const auto a = vector<counted_value>().push_back(counted_value(7));
+		VERIFY(g_live_values == 1);
+		VERIFY(a.get_tail().get_leaf_node()->get_count() == 1);
+		VERIFY(a[0]._value == 7);
+	}
+	VERIFY(g_live_values == 0);
+	VERIFY_NODES(get_leaf_count<counted_value>() == 0);
+}
+
+QUARK_UNIT_TEST("", "leaf_node<T>", "push_back(values), store(), truncate(), slice()", "no extra values, all destructed"){
+	g_live_values = 0;
+	{
+		std::vector<counted_value> values;
+		for(int i = 0 ; i < 200 ; i++){
+			values.push_back(counted_value(i));
+		}
+		VERIFY(g_live_values == 200);
+
+		const auto a = vector<counted_value>().push_back(&values[0], values.size());
+		VERIFY(g_live_values == 400);
+
+		const auto b = a.store(5, counted_value(-5));
+		VERIFY(g_live_values == 400 + BRANCHING_FACTOR);
+
+		auto c = a.truncate(3);
+		VERIFY(c.size() == 3);
+		VERIFY(c[2]._value == 2);
+		c = c.push_back(counted_value(-3));
+		VERIFY(c[3]._value == -3);
+
+		const auto d = a.slice(BRANCHING_FACTOR + 1, 2 * BRANCHING_FACTOR + 3);
+		VERIFY(d.size() == BRANCHING_FACTOR + 2);
+		VERIFY(d[0]._value == BRANCHING_FACTOR + 1);
+		VERIFY(b[5]._value == -5);
+	}
+	VERIFY(g_live_values == 0);
+	VERIFY_NODES(get_leaf_count<counted_value>() == 0);
+}
+
+QUARK_UNIT_TEST("", "leaf_node<T>", "transient_vector push_back(), store()", "correct values, all destructed"){
+	g_live_values = 0;
+	{
+		transient_vector<counted_value> t;
+		for(int i = 0 ; i < 100 ; i++){
+			t.push_back(counted_value(i));
+		}
+		t.store(50, counted_value(-50));
+		VERIFY(g_live_values == 100);
+
+		const auto a = t.persistent();
+		VERIFY(a[49]._value == 49);
+		VERIFY(a[50]._value == -50);
+		VERIFY(a[99]._value == 99);
+	}
+	VERIFY(g_live_values == 0);
+}
+
+QUARK_UNIT_TEST("", "equal_values()", "ints, floats, strings", "correct"){
+	VERIFY(is_bitwise_comparable<int>::value);
+	VERIFY(is_bitwise_comparable<const char*>::value);
+	VERIFY(!is_bitwise_comparable<float>::value);
+	VERIFY(!is_bitwise_comparable<std::string>::value);
+
+	const int a[] = { 1, 2, 3 };
+	const int b[] = { 1, 2, 4 };
+	VERIFY(equal_values(a, b, 2));
+	VERIFY(!equal_values(a, b, 3));
+
+	const float c[] = { 0.0f, 1.0f };
+	const float d[] = { -0.0f, 1.0f };
+	VERIFY(equal_values(c, d, 2));
+
+	const std::string e[] = { "one", "two" };
+	const std::string f[] = { "one", "three" };
+	VERIFY(equal_values(e, f, 1));
+	VERIFY(!equal_values(e, f, 2));
+}
+
+QUARK_UNIT_TEST("vector", "operator==()", "floats, 0.0 and -0.0", "equal"){
+	const auto a = vector<float>{ 1.0f, 0.0f, 2.0f };
+	const auto b = vector<float>{ 1.0f, -0.0f, 2.0f };
+	VERIFY(a == b);
+	VERIFY(a != b.store(2, 3.0f));
+}
+
+QUARK_UNIT_TEST("vector", "push_back(const T values[], size_t count)", "ints, 3 levels", "memcpy:ed leaf nodes hold correct values"){
+	test_fixture<int> f;
+	const auto data = generate_numbers(1000, 2 * BRANCHING_FACTOR * BRANCHING_FACTOR + 5, 2 * BRANCHING_FACTOR * BRANCHING_FACTOR + 5);
+	const auto a = vector<int>().push_back(&data[0], 3).push_back(&data[3], data.size() - 3);
+	test_values(a, 1000);
+
+	const auto b = a.store(7, -7);
+	VERIFY(b[7] == -7);
+	VERIFY(b[8] == 1008);
+	VERIFY(a != b);
+	VERIFY(a == b.store(7, 1007));
+}
+
+
+
+////////////////////////////////////////////		get_hash(), node_hash_policy, leaf_interner
+
+
+QUARK_UNIT_TEST("vector", "get_hash()", "equal values, different trees", "same hash"){
+	test_fixture<int> f;
+	const auto a = push_back_n(2 * BRANCHING_FACTOR * BRANCHING_FACTOR + 3, 1000);
+	const auto b = concat(a.slice(0, 7), a.slice(7, a.size()));
+	VERIFY(b.is_relaxed());
+	VERIFY(a.get_hash() == b.get_hash());
+	VERIFY(a.get_hash() != a.store(7, 0).get_hash());
+	VERIFY(a.get_hash() != a.pop_back().get_hash());
+	VERIFY(a.truncate(BRANCHING_FACTOR + 1).get_hash() == push_back_n(BRANCHING_FACTOR + 1, 1000).get_hash());
+	VERIFY(vector<int>().get_hash() == vector<int>().get_hash());
+	VERIFY((vector<int>{ 1, 2 }.get_hash() != vector<int>{ 2, 1 }.get_hash()));
+	VERIFY(std::hash<vector<int>>()(a) == a.get_hash());
+}
+
+namespace {
+	size_t g_hash_count = 0;
+
+	struct hashed_int {
+		hashed_int(int value) : _value(value){}
+		bool operator==(const hashed_int& rhs) const { return _value == rhs._value; }
+		int _value;
+	};
+
+	vector<hashed_int> make_hashed_ints(size_t count){
+		std::vector<hashed_int> values;
+		for(size_t i = 0 ; i < count ; i++){
+			values.push_back(hashed_int(int(i)));
+		}
+		return vector<hashed_int>(values);
+	}
+}
+
+template <> struct node_hash_policy<hashed_int> {
+	typedef cached_node_hash type;
+};
+
+}	//	steady
+
+namespace std {
+	template <> struct hash<steady::hashed_int> {
+		std::size_t operator()(const steady::hashed_int& value) const{
+			steady::g_hash_count++;
+			return std::hash<int>()(value._value);
+		}
+	};
+}
+
+namespace steady {
+
+QUARK_UNIT_TEST("vector", "get_hash()", "cached node hashes, store()", "only the changed leaf node is hashed"){
+	const auto a = make_hashed_ints(2 * BRANCHING_FACTOR * BRANCHING_FACTOR + 3);
+	g_hash_count = 0;
+	const auto hash_a = a.get_hash();
+	VERIFY(g_hash_count == a.size());
+
+	g_hash_count = 0;
+	VERIFY(a.get_hash() == hash_a);
+	VERIFY(g_hash_count == 0);
+
+	const auto b = a.store(BRANCHING_FACTOR + 1, hashed_int(-1));
+	g_hash_count = 0;
+	const auto hash_b = b.get_hash();
+	VERIFY(g_hash_count == BRANCHING_FACTOR);
+	VERIFY(hash_b != hash_a);
+
+	//	A copy with the same values but no shared nodes gets the same hash.
+	VERIFY(vector<hashed_int>(b.to_vec()).get_hash() == hash_b);
+
+	//	operator==() sees that the cached hashes differ without comparing values.
+	VERIFY(!(a == b));
+}
+
+QUARK_UNIT_TEST("vector", "get_hash()", "cached node hashes, transient changes nodes in place", "hash updated"){
+	auto a = make_hashed_ints(BRANCHING_FACTOR * BRANCHING_FACTOR + 3);
+	a.get_hash();
+
+	transient_vector<hashed_int> t(a);
+	a = vector<hashed_int>();
+	t.store(3, hashed_int(-3));
+	t.push_back(hashed_int(-4));
+	const auto b = t.persistent();
+
+	VERIFY(b.get_hash() == vector<hashed_int>(b.to_vec()).get_hash());
+}
+
+QUARK_UNIT_TEST("", "leaf_interner::intern()", "two vectors made separately", "equal leaf nodes shared"){
+	test_fixture<int> f;
+	const auto a = push_back_n(BRANCHING_FACTOR * BRANCHING_FACTOR + 3, 1000);
+	const auto b = push_back_n(BRANCHING_FACTOR * BRANCHING_FACTOR + 3, 1000).store(1, 0);
+	VERIFY(!same_node(a.get_tail(), b.get_tail()));
+
+	leaf_interner<int> interner;
+	const auto a2 = interner.intern(a);
+	const auto b2 = interner.intern(b);
+	VERIFY(a2 == a);
+	VERIFY(b2 == b);
+	VERIFY(interner.size() == BRANCHING_FACTOR + 2);
+
+	VERIFY(same_node(a2.get_root(), a.get_root()));
+	VERIFY(same_node(b2.get_tail(), a.get_tail()));
+	VERIFY(same_node(b2.get_root().get_inode()->get_child(1), a.get_root().get_inode()->get_child(1)));
+	VERIFY(!same_node(b2.get_root().get_inode()->get_child(0), a.get_root().get_inode()->get_child(0)));
+}
+
+
+
+////////////////////////////////////////////		branching_factor_policy
+
+
+
+namespace {
+	//	Gets branching factor 4 using branching_factor_policy.
+	struct narrow_int {
+		narrow_int(int value) : _value(value){}
+		bool operator==(const narrow_int& rhs) const { return _value == rhs._value; }
+		int _value;
+	};
+
+	//	Too big for the default branching factor.
+	struct big_value {
+		big_value(int value) : _value(value){}
+		bool operator==(const big_value& rhs) const { return _value == rhs._value; }
+		int _value;
+		char _padding[252];
+	};
+
+	template <class T>
+	vector<T> make_values(size_t count){
+		std::vector<T> values;
+		for(size_t i = 0 ; i < count ; i++){
+			values.push_back(T(int(i)));
+		}
+		return vector<T>(values);
+	}
+
+	template <class T>
+	bool check_values(const vector<T>& vec, int first){
+		for(size_t i = 0 ; i < vec.size() ; i++){
+			if(!(vec[i] == T(first + int(i)))){
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+template <> struct branching_factor_policy<narrow_int> {
+	static const int SHIFT = 2;
+};
+
+
+QUARK_UNIT_TEST("", "branching_factor<T>", "constants", "usable at compile time"){
+	static_assert(count_to_depth<int>(BRANCHING_FACTOR + 1) == 2, "");
+	static_assert(shift_to_max_size<narrow_int>(branching_factor<narrow_int>::LOWEST_LEVEL_INODE_SHIFT) == 16, "");
+	static_assert(vector_size_to_shift<narrow_int>(5) == 2, "");
+	static_assert(branching_factor<narrow_int>::MASK == 3, "");
+}
+
+QUARK_UNIT_TEST("", "branching_factor<T>", "default", "smaller for big T"){
+	VERIFY(branching_factor<int>::SHIFT == BRANCHING_FACTOR_SHIFT);
+	VERIFY(branching_factor<big_value>::SHIFT == 2);
+	VERIFY(branching_factor<big_value>::FACTOR * sizeof(big_value) <= 4 * MAX_DEFAULT_LEAF_BYTES);
+}
+
+QUARK_UNIT_TEST("vector", "branching_factor_policy<T>", "narrow_int", "uses 4 values per node"){
+	const auto a = make_values<narrow_int>(100);
+	VERIFY(check_values(a, 0));
+	VERIFY(a.get_tail_size() == 4);
+	VERIFY(a.get_shift() == 6);
+	VERIFY(a.get_root().get_inode()->count_children() == 2);
+
+	const auto b = a.store(50, narrow_int(-1)).push_back(narrow_int(100)).pop_back();
+	VERIFY(b[50] == narrow_int(-1));
+	VERIFY(b.size() == 100);
+
+	const auto c = a.slice(3, 90) + a;
+	VERIFY(c.size() == 187);
+	VERIFY(c[0] == narrow_int(3));
+	VERIFY(c[87] == narrow_int(0));
+	VERIFY(c[186] == narrow_int(99));
+}
+
+QUARK_UNIT_TEST("vector", "vector", "big_value", "correct values"){
+	const auto a = make_values<big_value>(200);
+	VERIFY(check_values(a, 0));
+	VERIFY(check_values(a.push_back(big_value(200)), 0));
+	VERIFY(a.store(7, big_value(-7))[7] == big_value(-7));
+	VERIFY(a == make_values<big_value>(200));
+}
+
+QUARK_UNIT_TEST("parallel", "transform()", "between branching factors", "correct values"){
+	const auto a = make_values<int>(1000);
+	const auto b = parallel::transform(a, [](int value){ return big_value(value + 1); });
+	VERIFY(b.size() == 1000);
+	VERIFY(check_values(b, 1));
+
+	const auto c = parallel::transform(b, [](const big_value& value){ return narrow_int(value._value); });
+	VERIFY(check_values(c, 1));
+}
+
+
+
+////////////////////////////////////////////		atomic_vector
+
+
+
+QUARK_UNIT_TEST("atomic_vector", "store()", "3 values", "load() returns them"){
+	test_fixture<int> f;
+	atomic_vector<int> a;
+	VERIFY(a.load().empty());
+
+	const vector<int> b{ 1, 2, 3 };
+	a.store(b);
+	VERIFY(same_node(a.load().get_tail(), b.get_tail()));
+	VERIFY(a.exchange(vector<int>{ 4 }) == b);
+	VERIFY(a.load() == vector<int>{ 4 });
+}
+
+QUARK_UNIT_TEST("atomic_vector", "compare_exchange()", "expected is current, then old", "true, then false"){
+	test_fixture<int> f;
+	const vector<int> b{ 1, 2, 3 };
+	atomic_vector<int> a(b);
+
+	auto expected = a.load();
+	VERIFY(a.compare_exchange(expected, b.push_back(4)));
+	VERIFY(a.load().size() == 4);
+
+	//	Equal values, but not the stored vector.
+	expected = vector<int>{ 1, 2, 3, 4 };
+	VERIFY(!a.compare_exchange(expected, b));
+	VERIFY(same_node(expected.get_tail(), a.load().get_tail()));
+}
+
+QUARK_UNIT_TEST("atomic_vector", "update()", "4 writers and 4 readers", "no update lost"){
+	test_fixture<int> f;
+	atomic_vector<int> a;
+	std::atomic<bool> stop(false);
+
+	std::vector<std::thread> threads;
+	for(int t = 0 ; t < 4 ; t++){
+		threads.push_back(std::thread([&a, &stop]{
+			while(!stop.load()){
+				const auto v = a.load();
+				for(size_t i = 0 ; i < v.size() ; i++){
+					ASSERT(v[i] == int(i));
+				}
+				std::this_thread::yield();
+			}
+		}));
+	}
+	std::vector<std::thread> writers;
+	for(int t = 0 ; t < 4 ; t++){
+		writers.push_back(std::thread([&a]{
+			for(int i = 0 ; i < 200 ; i++){
+				a.update([](const vector<int>& v){ return v.push_back(int(v.size())); });
+			}
+		}));
+	}
+	for(auto& t: writers){
+		t.join();
+	}
+	stop.store(true);
+	for(auto& t: threads){
+		t.join();
+	}
+
+	const auto result = a.load();
+	VERIFY(result.size() == 800);
+	for(size_t i = 0 ; i < result.size() ; i++){
+		VERIFY(result[i] == int(i));
+	}
+}
+
+QUARK_UNIT_TEST("atomic_vector", "exchange()", "16 readers and a writer replacing it", "every load() is a whole value"){
+	test_fixture<int> f;
+	std::vector<vector<int>> values;
+	for(int i = 0 ; i < 8 ; i++){
+		vector<int> v;
+		for(int j = 0 ; j < i * 20 ; j++){
+			v = v.push_back(i);
+		}
+		values.push_back(v);
+	}
+
+	atomic_vector<int> a(values[0]);
+	std::atomic<bool> stop(false);
+	std::vector<std::thread> readers;
+	for(int t = 0 ; t < 16 ; t++){
+		readers.push_back(std::thread([&a, &stop]{
+			while(!stop.load()){
+				const auto v = a.load();
+				for(size_t i = 0 ; i < v.size() ; i++){
+					ASSERT(v[i] * 20 == int(v.size()));
+				}
+			}
+		}));
+	}
+	for(int i = 0 ; i < 5000 ; i++){
+		const auto& value = values[i % values.size()];
+		if(i % 3 == 0){
+			a.store(value);
+		}
+		else if(i % 3 == 1){
+			const auto old = a.exchange(value);
+			ASSERT(old == values[(i - 1) % values.size()]);
+		}
+		else{
+			auto expected = a.load();
+			ASSERT(a.compare_exchange(expected, value));
+		}
+	}
+	stop.store(true);
+	for(auto& t: readers){
+		t.join();
+	}
+	VERIFY(a.load() == values[4999 % values.size()]);
+}
+
+
+
+////////////////////////////////////////////		sparse_vector
+
+
+
+QUARK_UNIT_TEST("sparse_vector", "store()", "far apart indexes", "holes between them"){
+	test_fixture<internals::sparse_slot<int>> f;
+	const auto leaves = get_leaf_count<internals::sparse_slot<int>>();
+	const sparse_vector<int> a;
+	const auto b = a.store(3, 1003).store(1000000, 1004).store(size_t(1) << 40, 1005);
+	VERIFY(a.empty());
+	VERIFY(b.size() == 3);
+	VERIFY(b[3] == 1003);
+	VERIFY(b[1000000] == 1004);
+	VERIFY(b[size_t(1) << 40] == 1005);
+	VERIFY(!b.contains(4));
+	VERIFY(!b.contains(999999));
+	VERIFY(b.find(size_t(1) << 41) == nullptr);
+
+	//	One leaf node per value, plus a path of inodes to each.
+	VERIFY_NODES(get_leaf_count<internals::sparse_slot<int>>() == leaves + 3);
+}
+
+QUARK_UNIT_TEST("sparse_vector", "store()", "replace value", "size unchanged"){
+	test_fixture<internals::sparse_slot<int>> f;
+	const auto a = sparse_vector<int>().store(7, 1000);
+	const auto b = a.store(7, 2000);
+	VERIFY(a[7] == 1000);
+	VERIFY(b[7] == 2000);
+	VERIFY(b.size() == 1);
+}
+
+QUARK_UNIT_TEST("sparse_vector", "erase()", "values", "empty subtrees and levels freed"){
+	test_fixture<internals::sparse_slot<int>> f;
+	const auto small = sparse_vector<int>().store(2, 1002);
+	const auto a = small.store(5, 1005).store(12345678, 1006);
+	VERIFY(a.get_shift() > small.get_shift());
+
+	const auto b = a.erase(12345678);
+	VERIFY(b.size() == 2);
+	VERIFY(!b.contains(12345678));
+	VERIFY(b.get_shift() == small.get_shift());
+	VERIFY(b == small.store(5, 1005));
+	VERIFY(b != small);
+
+	//	Erasing a hole changes nothing.
+	VERIFY(same_node(b.erase(3).get_root(), b.get_root()));
+
+	const auto c = b.erase(2).erase(5);
+	VERIFY(c.empty());
+	VERIFY(c.get_root().get_type() == internals::node_type::null_node);
+	VERIFY(c == sparse_vector<int>());
+}
+
+QUARK_UNIT_TEST("sparse_vector", "for_each()", "random indexes", "values in index order"){
+	test_fixture<internals::sparse_slot<int>> f;
+	std::vector<size_t> indexes;
+	sparse_vector<int> a;
+	size_t index = 17;
+	for(int i = 0 ; i < 200 ; i++){
+		index = (index * 2654435761u + 12345) % 1000000007u;
+		indexes.push_back(index);
+		a = a.store(index, int(index % 1000));
+	}
+	std::sort(indexes.begin(), indexes.end());
+	indexes.erase(std::unique(indexes.begin(), indexes.end()), indexes.end());
+	VERIFY(a.size() == indexes.size());
+
+	std::vector<size_t> visited;
+	a.for_each([&](size_t i, int value){
+		ASSERT(value == int(i % 1000));
+		visited.push_back(i);
+	});
+	VERIFY(visited == indexes);
+}
+
+
+
+////////////////////////////////////////////		node_reclamation
+
+
+
+QUARK_UNIT_TEST("", "reclaim_nodes()", "deferred, drop vector", "nodes freed a few at a time"){
+	test_fixture<int> f;
+	const auto inodes = get_inode_count<int>();
+	const auto leaves = get_leaf_count<int>();
+
+	{
+		const auto a = push_back_n(BRANCHING_FACTOR * BRANCHING_FACTOR + 3, 1000);
+		set_node_reclamation(node_reclamation::deferred);
+	}
+	set_node_reclamation(node_reclamation::immediate);
+	VERIFY_NODES(get_inode_count<int>() == inodes + 1);
+	VERIFY_NODES(get_leaf_count<int>() == leaves + BRANCHING_FACTOR + 1);
+
+	//	The root inode and the tail.
+	VERIFY(reclaim_nodes(2) == 2);
+	VERIFY_NODES(get_inode_count<int>() == inodes);
+	VERIFY_NODES(get_leaf_count<int>() == leaves + BRANCHING_FACTOR);
+
+	VERIFY(reclaim_nodes(3) == 3);
+	VERIFY_NODES(get_leaf_count<int>() == leaves + BRANCHING_FACTOR - 3);
+
+	VERIFY(reclaim_all_nodes() == BRANCHING_FACTOR - 3);
+	VERIFY(reclaim_all_nodes() == 0);
+}
+
+QUARK_UNIT_TEST("", "reclaim_nodes()", "deferred, drop vector sharing nodes", "only unused nodes freed"){
+	test_fixture<int> f;
+	const auto a = push_back_n(BRANCHING_FACTOR * BRANCHING_FACTOR + 3, 1000);
+
+	{
+		const auto b = a.store(3, 7).store(BRANCHING_FACTOR * BRANCHING_FACTOR + 1, 8);
+		set_node_reclamation(node_reclamation::deferred);
+	}
+	set_node_reclamation(node_reclamation::immediate);
+
+	//	The root inode, the leaf node and the tail that b doesn't share with a.
+	VERIFY(reclaim_all_nodes() == 3);
+	test_values(a, 1000);
+}
+
+QUARK_UNIT_TEST("", "background_reclaimer", "vector dropped on other thread", "all nodes freed"){
+	test_fixture<int> f;
+	{
+		auto a = push_back_n(BRANCHING_FACTOR * BRANCHING_FACTOR * 2, 1000);
+		set_node_reclamation(node_reclamation::deferred);
+		background_reclaimer reclaimer(4);
+		std::thread t([&a]{
+			a = vector<int>();
+		});
+		t.join();
+	}
+	set_node_reclamation(node_reclamation::immediate);
+	VERIFY(reclaim_all_nodes() == 0);
+#if STEADY_STATS_ON
+	VERIFY(get_stats()._deferred_node_count == 0);
+#endif
+}
+
+
+
+////////////////////////////////////////////		stats
+
+
+
+#if STEADY_STATS_ON
+
+QUARK_UNIT_TEST("stats", "get_stats()", "store() and push_back()", "counts path copies"){
+	test_fixture<int> f;
+	const auto a = push_back_n(BRANCHING_FACTOR * BRANCHING_FACTOR + 3, 1000);
+
+	const auto before = get_stats();
+	const auto b = a.store(3, 7);
+	const auto c = b.push_back(8);
+	const auto after = get_stats();
+
+	VERIFY(after._store_count == before._store_count + 1);
+	VERIFY(after._store_copied_nodes == before._store_copied_nodes + 2);
+	VERIFY(after._push_back_count == before._push_back_count + 1);
+	VERIFY(after._push_back_copied_nodes == before._push_back_copied_nodes + 1);
+	VERIFY(after._leaf_count == before._leaf_count + 2);
+	VERIFY(after._inode_count == before._inode_count + 1);
+	VERIFY(after._node_bytes == before._node_bytes + std::int64_t(2 * sizeof(leaf_node<int>) + sizeof(inode<int>)));
+	VERIFY(after._allocated_node_count == before._allocated_node_count + 3);
+}
+
+QUARK_UNIT_TEST("stats", "get_leaf_count()", "nodes made by other threads", "adds up all threads"){
+	test_fixture<int> f;
+	const auto leaves = get_leaf_count<int>();
+
+	steady::vector<int> a;
+	std::thread t([&a]{
+		a = push_back_n(BRANCHING_FACTOR * 2, 1000);
+	});
+	t.join();
+	VERIFY(get_leaf_count<int>() == leaves + 2);
+
+	a = steady::vector<int>();
+	VERIFY(get_leaf_count<int>() == leaves);
+}
+
+namespace {
+	struct thread_local_holder {
+		steady::vector<int> _value;
+	};
+}
+
+QUARK_UNIT_TEST("stats", "get_leaf_count()", "thread_local vector destroyed after the thread's counters", "still counted"){
+	test_fixture<int> f;
+	const auto leaves = get_leaf_count<int>();
+
+	std::thread t([]{
+		//	Made before the thread counts anything, so destroyed after its counters.
+		static thread_local thread_local_holder holder;
+		holder._value = push_back_n(BRANCHING_FACTOR * 2, 1000);
+	});
+	t.join();
+	VERIFY(get_leaf_count<int>() == leaves);
+}
+
+#endif
+
+QUARK_UNIT_TEST("stats", "get_sharing_ratio()", "vector and a changed copy", "counts shared nodes"){
+	test_fixture<int> f;
+	const auto a = push_back_n(BRANCHING_FACTOR * BRANCHING_FACTOR + 3, 1000);
+	VERIFY(get_sharing_ratio(&a, 1) == 1.0);
+
+	const steady::vector<int> vectors[] = { a, a.store(3, 7) };
+	const double references = 2 * (BRANCHING_FACTOR + 2);
+	VERIFY(get_sharing_ratio(vectors, 2) == references / (BRANCHING_FACTOR + 4));
+}
+
 
 
 ////////////////////////////////////////////		T = std::string
@@ -22,10 +22,31 @@
 
 #include "quark.h"
 #include <initializer_list>
+#include <algorithm>
+#include <cstring>
 #include <atomic>
 #include <vector>
 #include <array>
+#include <memory>
 #include <sstream>
+#include <mutex>
+#include <thread>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <iterator>
+#include <functional>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <stdexcept>
+#include <ostream>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include <unordered_map>
+#include <chrono>
+#include <limits>
 
 /*
 	### Find practical way to remove dependency to quark.h, that doesn't require client to define
@@ -39,10 +60,28 @@
 #define STEADY_TEST_VERIFY(x) QUARK_TEST_VERIFY(x)
 #define STEADY_SCOPED_TRACE(x) QUARK_SCOPED_TRACE(x)
 
+//	Set STEADY_PROFILE_ON to 1 to time push_back(), store() and concat() using QUARK_SCOPED_TIMER().
+#ifndef STEADY_PROFILE_ON
+	#define STEADY_PROFILE_ON 0
+#endif
+
+#if STEADY_PROFILE_ON
+	#define STEADY_SCOPED_TIMER(x) QUARK_SCOPED_TIMER(x)
+#else
+	#define STEADY_SCOPED_TIMER(x)
+#endif
+
+//	Hint to the CPU to start loading the cache line at address p.
+#if defined(__GNUC__) || defined(__clang__)
+	#define STEADY_PREFETCH(p) __builtin_prefetch(p)
+#else
+	#define STEADY_PREFETCH(p)
+#endif
+
 
 namespace steady {
 
-	//	#define BRANCHING_FACTOR_SHIFT to get different branching factors.
+	//	#define BRANCHING_FACTOR_SHIFT to get a different default branching factor, see branching_factor_policy<T>.
 
 	//	Branching factor shift 5 => 32 values per node is ideal.
 	#ifndef BRANCHING_FACTOR_SHIFT
@@ -50,19 +89,489 @@ namespace steady {
 	#endif
 
 
+	//	The default branching factor, used for small T.
 	static const int BRANCHING_FACTOR = 1 << BRANCHING_FACTOR_SHIFT;
 
+	//	The values of a leaf node should fit in this many bytes. Bigger T get a smaller default branching factor.
+	static const std::size_t MAX_DEFAULT_LEAF_BYTES = 512;
+
+
+
+	////////////////////////////////////////////		Memory allocation
+
+	/*
+		All inodes, their size tables and leaf nodes are allocated and freed using this hook. _size_ is the size of the
+		object, it depends on T and its branching factor. The memory must be aligned like operator new, for
+		std::max_align_t. Nodes of over-aligned T aren't supported: they don't compile.
+
+		The default allocator uses operator new / operator delete.
+		Change allocator before making any vectors: each node must be freed by the allocator that allocated it.
+	*/
+	struct node_allocator {
+		void* (*_allocate)(std::size_t size);
+		void (*_deallocate)(void* p, std::size_t size);
+	};
+
+	inline node_allocator make_default_node_allocator();
+
+	/*
+		Fixed-size block pool with one free list per size class. Each thread caches free blocks so allocating and freeing
+		nodes normally doesn't lock. The pool keeps its memory until the program ends.
+	*/
+	inline node_allocator make_pool_node_allocator();
+
+	inline const node_allocator& get_node_allocator();
+	inline void set_node_allocator(const node_allocator& allocator);
+
+
+
+	////////////////////////////////////////////		Node reclamation
+
+	/*
+		immediate: the thread that drops the last reference to a node frees it and the children only it used, so
+		releasing a big vector takes time proportional to its size. This is the default.
+
+		deferred: that thread only pushes the node onto a lock-free list. reclaim_nodes() or a background_reclaimer
+		frees the nodes later, a bounded number per call, using a work list instead of recursion. Values are
+		destructed on the reclaiming thread.
+
+		Nodes with nonatomic_refcount are shared only by one thread: reclaim them on that thread.
+	*/
+	enum class node_reclamation {
+		immediate,
+		deferred
+	};
+
+	inline void set_node_reclamation(node_reclamation mode);
+	inline node_reclamation get_node_reclamation();
+
+	//	Frees up to _max_count_ deferred nodes on the calling thread. Returns the number of nodes freed.
+	inline std::size_t reclaim_nodes(std::size_t max_count);
+
+	//	Frees all deferred nodes, including nodes that become unused while freeing.
+	inline std::size_t reclaim_all_nodes();
+
+	/*
+		Runs a thread that frees deferred nodes, _batch_count_ at a time. When there is nothing to free it checks again
+		after _idle_wait_. The destructor stops the thread, then frees the remaining nodes.
+	*/
+	class background_reclaimer {
+		public: inline background_reclaimer(std::size_t batch_count = 1024, std::chrono::milliseconds idle_wait = std::chrono::milliseconds(1));
+		public: inline ~background_reclaimer();
+
+		private: background_reclaimer(const background_reclaimer& rhs);
+		private: background_reclaimer& operator=(const background_reclaimer& rhs);
+
+		private: inline void run();
+
+
+		////////////////	State
+		private: const std::size_t _batch_count;
+		private: const std::chrono::milliseconds _idle_wait;
+		private: std::mutex _mutex;
+		private: std::condition_variable _wakeup;
+		private: bool _stop;
+		private: std::thread _thread;
+	};
+
+
+
+	////////////////////////////////////////////		Reference counting
+
+	/*
+		Each node has an intrusive reference counter. Its type is selected per value type using refcount_policy<T>.
+		The default is atomic_refcount, which is safe to share between threads. Specialize refcount_policy<T> to change
+		it for vectors of your T:
+
+			namespace steady {
+				template <> struct refcount_policy<my_type> { typedef nonatomic_refcount type; };
+			}
+
+		All counters have the same interface:
+			inc(): add a reference.
+			dec(): remove a reference, returns true when it was the last one.
+			get(): the current number of references.
+	*/
+	struct atomic_refcount {
+		public: atomic_refcount() :
+			_count(0)
+		{
+		}
+
+		public: void inc(){
+			_count.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		public: bool dec(){
+			return _count.fetch_sub(1, std::memory_order_acq_rel) == 1;
+		}
+
+		public: int32_t get() const{
+			return _count.load(std::memory_order_acquire);
+		}
+
+		private: std::atomic<int32_t> _count;
+	};
+
+	/*
+		Plain integer counter. Only use for vectors that are never shared between threads: not even read-only copies.
+	*/
+	struct nonatomic_refcount {
+		public: nonatomic_refcount() :
+			_count(0)
+		{
+		}
+
+		public: void inc(){
+			_count++;
+		}
+
+		public: bool dec(){
+			_count--;
+			return _count == 0;
+		}
+
+		public: int32_t get() const{
+			return _count;
+		}
+
+		private: int32_t _count;
+	};
+
+	/*
+		Biased counter: the thread that made the node (its owner) counts its references without atomic
+		read-modify-writes. Other threads use an atomic shared counter. Safe to share between threads and much
+		cheaper than atomic_refcount for vectors that are mostly used by the thread that made them: the owner's inc()
+		is a plain increment and its dec() a plain decrement plus a fence.
+
+		References can move between threads, so a thread can release a reference that was counted by another thread
+		and the two counters only make sense together: count = _biased + _shared - stake. While _biased > 0,
+		_shared holds an extra OWNER_STAKE so it can't reach zero while the owner has counted references. The thread
+		that sees the count reach zero claims the node by swapping _shared to CLAIMED, so exactly one thread frees it.
+	*/
+	struct biased_refcount {
+		public: static const int32_t OWNER_STAKE = 1 << 30;
+		public: static const int32_t CLAIMED = -OWNER_STAKE;
+
+		public: biased_refcount() :
+			_owner(std::this_thread::get_id()),
+			_biased(0),
+			_shared(0)
+		{
+		}
+
+		public: void inc(){
+			if(std::this_thread::get_id() == _owner){
+				const auto biased = _biased.load(std::memory_order_relaxed);
+				if(biased == 0){
+					_shared.fetch_add(OWNER_STAKE, std::memory_order_relaxed);
+				}
+				_biased.store(biased + 1, std::memory_order_release);
+			}
+			else{
+				_shared.fetch_add(1, std::memory_order_relaxed);
+			}
+		}
+
+		public: bool dec(){
+			if(std::this_thread::get_id() == _owner && _biased.load(std::memory_order_relaxed) > 0){
+				const auto biased = _biased.load(std::memory_order_relaxed) - 1;
+				_biased.store(biased, std::memory_order_relaxed);
+				if(biased == 0){
+					return release_stake();
+				}
+
+				//	Pairs with the read-modify-write + load in the other branch: one of us sees the other's write.
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				const auto shared = _shared.load(std::memory_order_relaxed);
+				return biased + shared - OWNER_STAKE == 0 && claim(shared);
+			}
+			else{
+				const auto shared = _shared.fetch_sub(1, std::memory_order_seq_cst) - 1;
+				if(shared == 0){
+					return true;
+				}
+				else if(shared >= OWNER_STAKE / 2){
+					const auto biased = _biased.load(std::memory_order_seq_cst);
+					return biased + shared - OWNER_STAKE == 0 && claim(shared);
+				}
+				else{
+					return false;
+				}
+			}
+		}
+
+		/*
+			Exact when called by the owner or when the caller holds a reference that makes the answer stable, like
+			checking for a count of 1.
+		*/
+		public: int32_t get() const{
+			const auto biased = _biased.load(std::memory_order_acquire);
+			const auto shared = _shared.load(std::memory_order_acquire);
+			if(shared == CLAIMED){
+				return 0;
+			}
+
+			//	Other threads can make _shared negative, but never by anywhere near OWNER_STAKE / 2.
+			const auto stake = shared >= OWNER_STAKE / 2 ? OWNER_STAKE : 0;
+			return biased + shared - stake;
+		}
+
+		//	Owner's _biased just reached 0: remove the stake from _shared.
+		private: bool release_stake(){
+			auto shared = _shared.load(std::memory_order_relaxed);
+			while(true){
+				if(shared == OWNER_STAKE){
+					if(_shared.compare_exchange_weak(shared, CLAIMED, std::memory_order_acq_rel)){
+						return true;
+					}
+				}
+				else if(shared == CLAIMED){
+					return false;
+				}
+				else if(_shared.compare_exchange_weak(shared, shared - OWNER_STAKE, std::memory_order_acq_rel)){
+					return false;
+				}
+			}
+		}
+
+		private: bool claim(int32_t shared){
+			return _shared.compare_exchange_strong(shared, CLAIMED, std::memory_order_acq_rel);
+		}
+
+		private: const std::thread::id _owner;
+
+		//	Only written by the owner thread. Atomic so other threads can read it.
+		private: std::atomic<int32_t> _biased;
+		private: std::atomic<int32_t> _shared;
+	};
+
+	template <class T>
+	struct refcount_policy {
+		typedef atomic_refcount type;
+	};
+
+
+
+	////////////////////////////////////////////		Node hashes
+
+	/*
+		Nodes can cache the hash of their values. Then vector<T>::get_hash() only visits nodes made since the last
+		call, which is the path to each change. Costs up to 16 bytes per node, so it is off by default. Turn it on for a T by
+		specializing node_hash_policy<T>:
+
+			namespace steady {
+				template <> struct node_hash_policy<my_type> { typedef cached_node_hash type; };
+			}
+
+		Nodes derive from the policy type, so no_node_hash takes no space.
+	*/
+	struct no_node_hash {
+		public: static const bool CACHED = false;
+
+		public: bool get_cached_hash(std::uint64_t& /*hash*/) const{
+			return false;
+		}
+
+		public: void set_cached_hash(std::uint64_t /*hash*/) const{
+		}
+
+		public: void reset_cached_hash() const{
+		}
+	};
+
+	//	Many threads can hash the same node at once: they all compute the same hash.
+	struct cached_node_hash {
+		public: static const bool CACHED = true;
+
+		public: cached_node_hash() :
+			_hash(0),
+			_valid(false)
+		{
+		}
+
+		public: bool get_cached_hash(std::uint64_t& hash) const{
+			if(_valid.load(std::memory_order_acquire)){
+				hash = _hash.load(std::memory_order_relaxed);
+				return true;
+			}
+			return false;
+		}
+
+		public: void set_cached_hash(std::uint64_t hash) const{
+			_hash.store(hash, std::memory_order_relaxed);
+			_valid.store(true, std::memory_order_release);
+		}
+
+		//	Only called when changing a node that no other vector uses.
+		public: void reset_cached_hash() const{
+			_valid.store(false, std::memory_order_relaxed);
+		}
+
+		//	Caching a hash doesn't change the node.
+		private: mutable std::atomic<std::uint64_t> _hash;
+		private: mutable std::atomic<bool> _valid;
+	};
+
+	template <class T>
+	struct node_hash_policy {
+		typedef no_node_hash type;
+	};
+
+
+
+	////////////////////////////////////////////		Branching factor
+
+	/*
+		Every inode has up to 1 << SHIFT children and every leaf node up to 1 << SHIFT values. A small branching factor
+		makes store() and push_back() copy fewer values, a big one makes the tree shallower so reading is faster.
+
+		The default is BRANCHING_FACTOR_SHIFT, made smaller for big T so a leaf node's values fit in
+		MAX_DEFAULT_LEAF_BYTES, but never smaller than 2. Specialize branching_factor_policy<T> to choose it for your T:
+
+			namespace steady {
+				template <> struct branching_factor_policy<my_type> { static const int SHIFT = 3; };
+			}
+
+		Vectors of different T can have different branching factors in the same program.
+	*/
+	constexpr int get_default_branching_factor_shift(std::size_t value_size, int shift){
+		return shift > 2 && (value_size << shift) > MAX_DEFAULT_LEAF_BYTES
+			? get_default_branching_factor_shift(value_size, shift - 1)
+			: shift;
+	}
+
+	template <class T>
+	struct branching_factor_policy {
+		static const int SHIFT = get_default_branching_factor_shift(sizeof(T), BRANCHING_FACTOR_SHIFT);
+	};
+
+	//	The constants used by the vector<T> code, all from branching_factor_policy<T>.
+	template <class T>
+	struct branching_factor {
+		static const int SHIFT = branching_factor_policy<T>::SHIFT;
+		static const int FACTOR = 1 << SHIFT;
+		static const std::size_t MASK = FACTOR - 1;
+
+		static const int EMPTY_TREE_SHIFT = -SHIFT;
+		static const int LOWEST_LEVEL_INODE_SHIFT = SHIFT;
+
+		static_assert(SHIFT >= 1 && SHIFT <= 8, "branching_factor_policy<T>::SHIFT must be 1 - 8.");
+	};
+
+	template <class T> const int branching_factor<T>::SHIFT;
+	template <class T> const int branching_factor<T>::FACTOR;
+	template <class T> const std::size_t branching_factor<T>::MASK;
+	template <class T> const int branching_factor<T>::EMPTY_TREE_SHIFT;
+	template <class T> const int branching_factor<T>::LOWEST_LEVEL_INODE_SHIFT;
+
+
+
+	////////////////////////////////////////////		Statistics
+
+	/*
+		Counts nodes, node memory and how many nodes store() and push_back() copy. Each thread counts into its own
+		block of counters without locking, get_stats() adds all blocks up. Counters of threads that have ended are kept.
+
+		#define STEADY_STATS_ON 0 to remove all counting. Then get_stats(), get_inode_count() and get_leaf_count() return
+		zeros.
+
+		trace_stats() prints the stats using STEADY_TRACE_SS(), which goes to quark::runtime_i::runtime_i__trace().
+	*/
+	#ifndef STEADY_STATS_ON
+		#define STEADY_STATS_ON 1
+	#endif
+
+	struct stats {
+		//	Live nodes, of all value types.
+		std::int64_t _inode_count = 0;
+		std::int64_t _leaf_count = 0;
+
+		//	Memory used by live nodes, including the size tables of relaxed inodes.
+		std::int64_t _node_bytes = 0;
+
+		//	Totals since the program started.
+		std::int64_t _allocated_node_count = 0;
+		std::int64_t _allocated_node_bytes = 0;
+
+		//	Each call is one path copy. _store_copied_nodes / _store_count is the copy amplification of store().
+		std::int64_t _store_count = 0;
+		std::int64_t _store_copied_nodes = 0;
+		std::int64_t _push_back_count = 0;
+		std::int64_t _push_back_copied_nodes = 0;
+
+		//	Unused nodes waiting for reclaim_nodes(), see node_reclamation.
+		std::int64_t _deferred_node_count = 0;
+	};
+
+	inline stats get_stats();
+	inline void trace_stats();
+
 
 	namespace internals {
 		template <typename T> struct node_ref;
 		template <typename T> struct inode;
 		template <typename T> struct leaf_node;
 
-		static const size_t BRANCHING_FACTOR_MASK = (BRANCHING_FACTOR - 1);
+	#if STEADY_STATS_ON
+		namespace stats_counters {
+			enum counter {
+				INODE_COUNT,
+				LEAF_COUNT,
+				NODE_BYTES,
+				ALLOCATED_NODE_COUNT,
+				ALLOCATED_NODE_BYTES,
+				STORE_COUNT,
+				STORE_COPIED_NODES,
+				PUSH_BACK_COUNT,
+				PUSH_BACK_COPIED_NODES,
+				DEFERRED_NODE_COUNT,
+
+				//	Counters for one value type, see get_type_counter(), come after these.
+				FIXED_COUNTER_COUNT
+			};
+
+			inline void add(int counter, std::int64_t delta);
+			inline std::int64_t get(int counter);
+			template <class T> int get_type_counter(int counter);
+			inline void add_node(int counter, int type_counter, std::size_t size);
+			inline void remove_node(int counter, int type_counter, std::size_t size);
+			struct operation_scope;
+		}
+
+		#define STEADY_STATS_ADD_NODE(counter, T, size) \
+			::steady::internals::stats_counters::add_node( \
+				::steady::internals::stats_counters::counter, \
+				::steady::internals::stats_counters::get_type_counter<T>(::steady::internals::stats_counters::counter), \
+				size \
+			)
+		#define STEADY_STATS_REMOVE_NODE(counter, T, size) \
+			::steady::internals::stats_counters::remove_node( \
+				::steady::internals::stats_counters::counter, \
+				::steady::internals::stats_counters::get_type_counter<T>(::steady::internals::stats_counters::counter), \
+				size \
+			)
+
+		#define STEADY_STATS_ADD(counter, delta) \
+			::steady::internals::stats_counters::add(::steady::internals::stats_counters::counter, delta)
+
+		//	Counts one call and the nodes this thread allocates until the end of the scope.
+		#define STEADY_STATS_OPERATION(count_counter, copied_counter) \
+			::steady::internals::stats_counters::operation_scope steady_stats_operation( \
+				::steady::internals::stats_counters::count_counter, \
+				::steady::internals::stats_counters::copied_counter \
+			)
+	#else
+		#define STEADY_STATS_ADD(counter, delta)
+		#define STEADY_STATS_ADD_NODE(counter, T, size)
+		#define STEADY_STATS_REMOVE_NODE(counter, T, size)
+		#define STEADY_STATS_OPERATION(count_counter, copied_counter)
+	#endif
+
+		//	Set in node_ref<T>::_ptr when it points to a leaf node.
+		static const std::uintptr_t LEAF_NODE_TAG = 1;
 
-		static const int EMPTY_TREE_SHIFT = -BRANCHING_FACTOR_SHIFT;
 		static const int LEAF_NODE_SHIFT = 0;
-		static const int LOWEST_LEVEL_INODE_SHIFT = BRANCHING_FACTOR_SHIFT;
 
 
 		////////////////////////////////////////////		node_type
@@ -80,9 +589,8 @@ namespace steady {
 		/*
 			### To be documented.
 		*/
-		inline size_t divide_round_up(size_t value, size_t align){
-			const auto r = value / align;
-			return r * align < value ? r + 1 : r;
+		constexpr size_t divide_round_up(size_t value, size_t align){
+			return value / align * align < value ? value / align + 1 : value / align;
 		}
 
 		/*
@@ -92,155 +600,440 @@ namespace steady {
 			2: one inode with 1-4 leaf nodes.
 			3: two levels of inodes plus leaf nodes.
 		*/
-		inline int count_to_depth(size_t count){
-			const auto leaf_count = divide_round_up(count, BRANCHING_FACTOR);
-
-			if(leaf_count == 0){
-				return 0;
-			}
-			else if(leaf_count == 1){
-				return 1;
-			}
-			else {
-				return 1 + count_to_depth(leaf_count);
-			}
+		template <class T>
+		constexpr int count_to_depth(size_t count){
+			return divide_round_up(count, branching_factor<T>::FACTOR) <= 1
+				? int(divide_round_up(count, branching_factor<T>::FACTOR))
+				: 1 + count_to_depth<T>(divide_round_up(count, branching_factor<T>::FACTOR));
 		}
 
 		/*
 			Given a shift value, how many values can this tree hold without introduce more levels of inodes?
 		*/
-		inline size_t shift_to_max_size(int shift){
-			const size_t size = BRANCHING_FACTOR << shift;
-			return size;
+		template <class T>
+		constexpr size_t shift_to_max_size(int shift){
+			return shift < 0 ? 0 : size_t(branching_factor<T>::FACTOR) << shift;
 		}
 
 		/*
 			Return how many steps to shift vector-index to get its *top-level* bits.
 
-			-BRANCHING_FACTOR_SHIFT: empty tree
+			-SHIFT: empty tree
 			0: leaf-node level
-			BRANCHING_FACTOR_SHIFT: inode1 (inode that points to leafnodes)
-			>=BRANCHING_FACTOR_SHIFT: inode that points to inodes.
+			SHIFT: inode1 (inode that points to leafnodes)
+			>SHIFT: inode that points to inodes.
 		*/
-		inline int vector_size_to_shift(size_t size){
-			const int shift = (count_to_depth(size) - 1) * BRANCHING_FACTOR_SHIFT;
-			return shift;
+		template <class T>
+		constexpr int vector_size_to_shift(size_t size){
+			return (count_to_depth<T>(size) - 1) * branching_factor<T>::SHIFT;
 		}
 
 
 
-		////////////////////////////////////////////		leaf_node
+		////////////////////////////////////////////		Value copying and comparison
 
 		/*
-			This object holds a number of values, of type T.
-			These nodes live at the bottom of an inode tree.
+			Types where two values are equal exactly when their bytes are equal. Not floating point: 0.0 == -0.0 and
+			NaN != NaN.
+		*/
+		template <class T>
+		struct is_bitwise_comparable : std::integral_constant<bool,
+			std::is_integral<T>::value || std::is_enum<T>::value || std::is_pointer<T>::value
+		> {};
 
-			Holds an intrusive reference counter that is used by client code.
+		template <class T>
+		bool equal_values(const T a[], const T b[], std::size_t count, std::true_type){
+			return count == 0 || std::memcmp(a, b, count * sizeof(T)) == 0;
+		}
+
+		template <class T>
+		bool equal_values(const T a[], const T b[], std::size_t count, std::false_type){
+			return std::equal(a, a + count, b);
+		}
+
+		//	Compares _count_ values. Uses memcmp() when T allows it.
+		template <class T>
+		bool equal_values(const T a[], const T b[], std::size_t count){
+			return a == b || equal_values(a, b, count, is_bitwise_comparable<T>());
+		}
+
+
+		////////////////////////////////////////////		sparse_slot
+
+		/*
+			One value position in the leaf nodes of a sparse_vector<T>: either holds a T or is a hole. The T lives in raw
+			storage, like in leaf_node, so holes don't construct a T.
 		*/
 
 		template <class T>
-		struct leaf_node {
-			public: leaf_node() :
-				_rc(0)
+		struct sparse_slot {
+			public: sparse_slot() :
+				_present(false)
 			{
-				_debug_count++;
-				STEADY_ASSERT(check_invariant());
 			}
 
-			public: leaf_node(const std::array<T, BRANCHING_FACTOR>& values) :
-				_rc(0),
-				_values(values)
+			public: sparse_slot(const T& value) :
+				_present(false)
 			{
-				_debug_count++;
-				STEADY_ASSERT(check_invariant());
+				new (&_storage) T(value);
+				_present = true;
 			}
 
-			public: ~leaf_node(){
-				STEADY_ASSERT(check_invariant());
-				STEADY_ASSERT(_rc == 0);
+			public: sparse_slot(const sparse_slot& rhs) :
+				_present(false)
+			{
+				if(rhs._present){
+					new (&_storage) T(rhs.get());
+					_present = true;
+				}
+			}
 
-				_debug_count--;
+			public: sparse_slot& operator=(const sparse_slot& rhs){
+				if(this != &rhs){
+					clear();
+					if(rhs._present){
+						new (&_storage) T(rhs.get());
+						_present = true;
+					}
+				}
+				return *this;
 			}
 
-			public: bool check_invariant() const {
-				STEADY_ASSERT(_rc >= 0);
-				STEADY_ASSERT(_rc < 1000);
-				STEADY_ASSERT(_values.size() == BRANCHING_FACTOR);
-				return true;
+			public: ~sparse_slot(){
+				clear();
 			}
 
-			private: leaf_node<T>& operator=(const leaf_node& rhs);
-			private: leaf_node(const leaf_node& rhs);
+			public: bool is_present() const{
+				return _present;
+			}
+
+			public: const T& get() const{
+				STEADY_ASSERT(_present);
+
+				return *reinterpret_cast<const T*>(&_storage);
+			}
+
+			public: void clear(){
+				if(_present){
+					reinterpret_cast<T*>(&_storage)->~T();
+					_present = false;
+				}
+			}
 
 
 			//////////////////////////////	State
 
-			public: std::atomic<int32_t> _rc;
-			public: std::array<T, BRANCHING_FACTOR> _values{};
-			public: static int _debug_count;
+			private: typename std::aligned_storage<sizeof(T), alignof(T)>::type _storage;
+			private: bool _present;
 		};
 
-		template <class T>
-		int leaf_node<T>::_debug_count = 0;
-
+		//	Trees of sparse_slot<T> can have null children anywhere in an inode, not only at the end.
+		template <class T> struct allows_holes : std::false_type {};
+		template <class T> struct allows_holes<sparse_slot<T>> : std::true_type {};
 
 
-		////////////////////////////////////////////		inode
+		////////////////////////////////////////////		leaf_node
 
 		/*
-			An inode is used to hold leaf nodes when more than one leaf node is needed. It can also hold other inodes.
+			This object holds a number of values, of type T.
+			These nodes live at the bottom of an inode tree.
 
-			An inode has these states:
-				full set of iNode pointers or
-				full set of leaf node pointers or
-				empty vector.
+			The values live in raw storage: only the first _count slots hold constructed values. Values are added using
+			placement-new and destructed explicitly, so T doesn't need a default constructor and a leaf node with one
+			value only constructs one T.
 
-			You cannot mix sub-inode and sub-leaf nodes in the same inode.
-			inode pointers and leaf node pointers can be null, but the nulls are always at the end of the arrays.
+			_count is always >= the number of values the vector uses in this leaf node. Values after that can be
+			leftovers that are just kept alive until the leaf node dies.
 
 			Holds an intrusive reference counter that is used by client code.
 		*/
 
 		template <class T>
-		struct inode {
-			public: typedef std::array<node_ref<T>, BRANCHING_FACTOR> children_t;
+		struct leaf_node : public node_hash_policy<T>::type {
+			public: leaf_node() :
+				_rc(),
+				_count(0)
+			{
+				STEADY_ASSERT(check_invariant());
+			}
 
-			//	children: 0-32 children, all of the same type. kNullNodes can only appear at end of vector.
-			public: inode(const children_t& children2) :
-				_rc(0),
-				_children(children2)
+			//	Copy-constructs the first _count_ values of _values_.
+			public: leaf_node(const T values[], std::size_t count) :
+				_rc(),
+				_count(0)
 			{
-				STEADY_ASSERT(children2.size() >= 0);
-				STEADY_ASSERT(children2.size() <= BRANCHING_FACTOR);
-		#if STEADY_ASSERT_ON
-				for(auto i: children2){
-					i.check_invariant();
+				STEADY_ASSERT(count <= branching_factor<T>::FACTOR);
+
+				try{
+					push_values(values, count);
+				}
+				catch(...){
+					destroy_values();
+					throw;
 				}
-		#endif
 
-				_debug_count++;
 				STEADY_ASSERT(check_invariant());
 			}
 
+			public: leaf_node(const std::array<T, branching_factor<T>::FACTOR>& values) :
+				leaf_node(&values[0], branching_factor<T>::FACTOR)
+			{
+			}
 
-			public: ~inode(){
+			public: ~leaf_node(){
 				STEADY_ASSERT(check_invariant());
-				STEADY_ASSERT(_rc == 0);
+				STEADY_ASSERT(_rc.get() == 0);
 
-				_debug_count--;
+				destroy_values();
 			}
 
-			private: inode<T>& operator=(const inode& rhs);
-			private: inode(const inode& rhs);
-
 			public: bool check_invariant() const {
-				STEADY_ASSERT(_rc >= 0);
-				STEADY_ASSERT(_rc < 10000);
-				STEADY_ASSERT(validate_inode_children(_children));
-
+				STEADY_ASSERT(_rc.get() >= 0);
+				STEADY_ASSERT(_rc.get() < 1000);
+				STEADY_ASSERT(_count <= branching_factor<T>::FACTOR);
 				return true;
 			}
 
+			public: static void* operator new(std::size_t size){
+				static_assert(alignof(leaf_node<T>) <= alignof(std::max_align_t), "Node allocators don't align for T");
+
+				auto result = get_node_allocator()._allocate(size);
+				STEADY_STATS_ADD_NODE(LEAF_COUNT, T, size);
+				return result;
+			}
+
+			public: static void operator delete(void* p, std::size_t size){
+				STEADY_STATS_REMOVE_NODE(LEAF_COUNT, T, size);
+				get_node_allocator()._deallocate(p, size);
+			}
+
+			private: leaf_node<T>& operator=(const leaf_node& rhs);
+			private: leaf_node(const leaf_node& rhs);
+
+			//	Number of constructed values.
+			public: std::size_t get_count() const{
+				return _count;
+			}
+
+			public: const T* get_values() const{
+				return reinterpret_cast<const T*>(&_storage[0]);
+			}
+
+			public: T* get_values(){
+				return reinterpret_cast<T*>(&_storage[0]);
+			}
+
+			//	Constructs a new value after the last constructed value.
+			public: template <class U> void push_value(U&& value){
+				STEADY_ASSERT(_count < branching_factor<T>::FACTOR);
+
+				new (&_storage[_count]) T(std::forward<U>(value));
+				_count++;
+			}
+
+			public: void push_values(const T values[], std::size_t count){
+				STEADY_ASSERT(_count + count <= branching_factor<T>::FACTOR);
+
+				push_values(values, count, std::integral_constant<bool, std::is_trivially_copyable<T>::value>());
+			}
+
+			private: void push_values(const T values[], std::size_t count, std::true_type){
+				if(count > 0){
+					std::memcpy(&_storage[_count], values, count * sizeof(T));
+					_count += count;
+				}
+			}
+
+			private: void push_values(const T values[], std::size_t count, std::false_type){
+				for(std::size_t i = 0 ; i < count ; i++){
+					push_value(values[i]);
+				}
+			}
+
+			//	Index can be a constructed value or the first unconstructed one.
+			public: template <class U> void store_value(std::size_t index, U&& value){
+				STEADY_ASSERT(index <= _count);
+
+				if(index < _count){
+					get_values()[index] = std::forward<U>(value);
+				}
+				else{
+					push_value(std::forward<U>(value));
+				}
+			}
+
+			private: void destroy_values(){
+				destroy_values(std::integral_constant<bool, std::is_trivially_destructible<T>::value>());
+				_count = 0;
+			}
+
+			private: void destroy_values(std::true_type){
+			}
+
+			private: void destroy_values(std::false_type){
+				T* values = get_values();
+				for(std::size_t i = 0 ; i < _count ; i++){
+					values[i].~T();
+				}
+			}
+
+
+			//////////////////////////////	State
+
+			public: typename refcount_policy<T>::type _rc;
+			private: std::size_t _count;
+			private: typename std::aligned_storage<sizeof(T), alignof(T)>::type _storage[branching_factor<T>::FACTOR];
+		};
+
+
+
+		////////////////////////////////////////////		inode
+
+		/*
+			An inode is used to hold leaf nodes when more than one leaf node is needed. It can also hold other inodes.
+
+			An inode has these states:
+				full set of iNode pointers or
+				full set of leaf node pointers or
+				empty vector.
+
+			You cannot mix sub-inode and sub-leaf nodes in the same inode.
+			inode pointers and leaf node pointers can be null, but the nulls are always at the end of the arrays. The
+			exception is the trees of sparse_vector<T>, where null children are holes and can be anywhere.
+
+			An inode is either strict or relaxed:
+
+			strict: all children but the last are full and strict. The child holding an index is found using the
+				bits of the index. This is the normal case.
+			relaxed: used by trees made by concatenation and slicing (RRB-trees). Each child can hold any number of
+				values and the size table records them: _sizes[i] is the number of values in children 0 to i.
+
+			Holds an intrusive reference counter that is used by client code.
+		*/
+
+		template <class T>
+		struct inode : public node_hash_policy<T>::type {
+			public: typedef std::array<node_ref<T>, branching_factor<T>::FACTOR> children_t;
+			public: typedef std::array<std::size_t, branching_factor<T>::FACTOR> size_table_t;
+
+			//	Size tables are allocated with the node allocator too, and count as node bytes.
+			public: struct size_table_deleter {
+				void operator()(size_table_t* table) const{
+					table->~size_table_t();
+					STEADY_STATS_ADD(NODE_BYTES, -static_cast<std::int64_t>(sizeof(size_table_t)));
+					get_node_allocator()._deallocate(table, sizeof(size_table_t));
+				}
+			};
+
+			private: static size_table_t* make_size_table(const size_table_t& sizes){
+				static_assert(alignof(size_table_t) <= alignof(std::max_align_t), "Node allocators don't align for size table");
+
+				auto memory = get_node_allocator()._allocate(sizeof(size_table_t));
+				STEADY_STATS_ADD(NODE_BYTES, static_cast<std::int64_t>(sizeof(size_table_t)));
+				STEADY_STATS_ADD(ALLOCATED_NODE_BYTES, static_cast<std::int64_t>(sizeof(size_table_t)));
+				return new (memory) size_table_t(sizes);
+			}
+
+			//	children: 0-32 children, all of the same type. kNullNodes can only appear at end of vector.
+			public: inode(const children_t& children2) :
+				_rc(),
+				_children(children2)
+			{
+		#if STEADY_ASSERT_ON
+				for(const auto& i: _children){
+					i.check_invariant();
+				}
+		#endif
+
+				STEADY_ASSERT(check_invariant());
+			}
+
+			//	Takes over the references in _children2_ instead of adding new ones.
+			public: inode(children_t&& children2) :
+				_rc(),
+				_children(std::move(children2))
+			{
+		#if STEADY_ASSERT_ON
+				for(const auto& i: _children){
+					i.check_invariant();
+				}
+		#endif
+
+				STEADY_ASSERT(check_invariant());
+			}
+
+			//	Makes a relaxed inode.
+			public: inode(const children_t& children2, const size_table_t& sizes) :
+				_rc(),
+				_children(children2),
+				_sizes(make_size_table(sizes))
+			{
+		#if STEADY_ASSERT_ON
+				for(const auto& i: _children){
+					i.check_invariant();
+				}
+		#endif
+
+				STEADY_ASSERT(check_invariant());
+			}
+
+			public: inode(children_t&& children2, const size_table_t& sizes) :
+				_rc(),
+				_children(std::move(children2)),
+				_sizes(make_size_table(sizes))
+			{
+		#if STEADY_ASSERT_ON
+				for(const auto& i: _children){
+					i.check_invariant();
+				}
+		#endif
+
+				STEADY_ASSERT(check_invariant());
+			}
+
+
+			public: ~inode(){
+				STEADY_ASSERT(check_invariant());
+				STEADY_ASSERT(_rc.get() == 0);
+			}
+
+			public: static void* operator new(std::size_t size){
+				static_assert(alignof(inode<T>) <= alignof(std::max_align_t), "Node allocators don't align for inode");
+
+				auto result = get_node_allocator()._allocate(size);
+				STEADY_STATS_ADD_NODE(INODE_COUNT, T, size);
+				return result;
+			}
+
+			public: static void operator delete(void* p, std::size_t size){
+				STEADY_STATS_REMOVE_NODE(INODE_COUNT, T, size);
+				get_node_allocator()._deallocate(p, size);
+			}
+
+			private: inode<T>& operator=(const inode& rhs);
+			private: inode(const inode& rhs);
+
+			public: bool check_invariant() const {
+				STEADY_ASSERT(_rc.get() >= 0);
+				STEADY_ASSERT(_rc.get() < 10000);
+				STEADY_ASSERT(validate_inode_children(_children));
+
+		#if STEADY_ASSERT_ON
+				if(_sizes){
+					size_t prev = 0;
+					for(size_t i = 0 ; i < _children.size() && _children[i].get_type() != node_type::null_node ; i++){
+						STEADY_ASSERT((*_sizes)[i] > prev);
+						prev = (*_sizes)[i];
+					}
+				}
+		#endif
+				return true;
+			}
+
+			public: bool is_relaxed() const{
+				return _sizes.get() != nullptr;
+			}
+
 			//	Counts the children actually used = skips trailing any null children.
 			public: size_t count_children() const{
 				STEADY_ASSERT(check_invariant());
@@ -261,7 +1054,7 @@ namespace steady {
 
 			public: const node_ref<T>& get_child(size_t index) const{
 				STEADY_ASSERT(check_invariant());
-				STEADY_ASSERT(index < BRANCHING_FACTOR);
+				STEADY_ASSERT(index < branching_factor<T>::FACTOR);
 				STEADY_ASSERT(index < _children.size());
 
 				return _children[index];
@@ -273,19 +1066,18 @@ namespace steady {
 				STEADY_ASSERT(index < _children.size());
 				STEADY_ASSERT(_children[0].get_type() == node_type::leaf_node);
 
-				return _children[index]._leaf_node;
+				return _children[index].get_leaf_node();
 			}
 
 
 			//////////////////////////////	State
 
-			public: std::atomic<int32_t> _rc;
+			public: typename refcount_policy<T>::type _rc;
 			public: children_t _children;
-			public: static int _debug_count;
-		};
 
-		template <class T>
-		int inode<T>::_debug_count = 0;
+			//	nullptr for strict inodes.
+			public: std::unique_ptr<size_table_t, size_table_deleter> _sizes;
+		};
 
 
 
@@ -300,6 +1092,7 @@ namespace steady {
 			public: node_ref(leaf_node<T>* node);
 
 			public: node_ref(const node_ref<T>& ref);
+			public: node_ref(node_ref<T>&& ref);
 
 			public: ~node_ref();
 
@@ -307,16 +1100,22 @@ namespace steady {
 
 			public: void swap(node_ref<T>& rhs);
 			public: node_ref<T>& operator=(const node_ref<T>& rhs);
-			
+			public: node_ref<T>& operator=(node_ref<T>&& rhs);
+
 			public: node_type get_type() const;
+
+			//	True if both refer to the same node, or both are null.
+			public: bool same_node(const node_ref<T>& other) const;
+
 			public: inline const inode<T>* get_inode() const;
+			public: inline inode<T>* get_inode();
 			public: inline const leaf_node<T>* get_leaf_node() const;
 			public: inline leaf_node<T>* get_leaf_node();
 
 			///////////////////////////////////////		State
 
-			public: inode<T>* _inode;
-			public: leaf_node<T>* _leaf_node;
+			//	inode<T>* or leaf_node<T>* | LEAF_NODE_TAG, 0 for null node.
+			public: std::uintptr_t _ptr;
 		};
 
 	}	//	Internals
@@ -326,6 +1125,9 @@ namespace steady {
 
 ////////////////////////////////////////////		vector
 
+template <class T> class vector_iterator;
+template <class T> class vector_editor;
+
 /*
 	Persistent vector class.
 */
@@ -335,27 +1137,82 @@ class vector {
 	public: typedef T value_type;
 	public: typedef std::size_t size_type;
 
+	//	The vector never changes so both iterator types are read-only.
+	public: typedef vector_iterator<T> const_iterator;
+	public: typedef vector_iterator<T> iterator;
+	public: typedef vector_editor<T> editor;
+
 	public: vector();
 	public: vector(const std::vector<T>& values);
+
+	//	Moves the values from _values_ into a new vector.
+	public: vector(std::vector<T>&& values);
 	public: vector(const T values[], size_t count);
 	public: vector(std::initializer_list<T> args);
+
+	//	Makes a vector from any range of values. Use std::make_move_iterator() to move the values instead of copying them.
+	public: template <
+		class InputIt,
+		class = typename std::enable_if<
+			std::is_convertible<typename std::iterator_traits<InputIt>::iterator_category, std::input_iterator_tag>::value
+		>::type
+	>
+	vector(InputIt first, InputIt last);
 	public: ~vector();
 
 	public: bool check_invariant() const;
 
 	public: vector(const vector& rhs);
 	public: vector& operator=(const vector& rhs);
+
+	//	Takes over the nodes of _rhs_ without touching any reference counts. _rhs_ becomes empty.
+	public: vector(vector&& rhs);
+	public: vector& operator=(vector&& rhs);
+
 	public: void swap(vector& rhs);
 	public: vector store(size_t index, const T& value) const;
 	public: vector store(size_t index, T&& value) const;
+
+	/*
+		Stores many values in one go. Each node on the paths to the changed values is copied only once, even when
+		many changes hit the same leaf node. When an index appears more than once, the last change wins.
+	*/
+	public: vector store_many(const std::pair<size_t, T> changes[], size_t count) const;
+	public: vector store_many(const std::vector<std::pair<size_t, T>>& changes) const;
+
+	/*
+		Replaces each value in [begin, end) with f(value). Each touched node is copied only once.
+	*/
+	public: template <class F> vector update_range(size_t begin, size_t end, F f) const;
+
+	/*
+		Replaces each value with f(value). Leaf nodes where all f(value) == value, and inodes where all children are
+		unchanged, are kept and shared with this vector: only the paths to changed values are allocated.
+		If no value changes, returns a vector sharing all nodes with this one.
+	*/
+	public: template <class F> vector map_preserving(F f) const;
+
 	public: vector push_back(const T& value) const;
 	public: vector push_back(T&& value) const;
 	public: vector push_back(const std::vector<T>& values) const;
 	public: vector push_back(const T values[], size_t count) const;
 
 	public: vector pop_back() const;
+	public: vector truncate(size_t new_size) const;
+
+	public: vector slice(size_t begin, size_t end) const;
+	public: vector insert_at(size_t index, const T& value) const;
+	public: vector erase_at(size_t index) const;
+	public: vector push_front(const T& value) const;
 
 	public: bool operator==(const vector& rhs) const;
+
+	/*
+		Returns a hash of the values. Equal vectors have the same hash, even when their trees have different shapes.
+		O(n), but see node_hash_policy: with cached node hashes only nodes that were not hashed before are visited.
+		Then operator==() also uses the hashes to find unequal vectors fast.
+	*/
+	public: std::size_t get_hash() const;
 	public: bool operator!=(const vector& rhs) const{
 		return !(*this == rhs);
 	}
@@ -370,9 +1227,32 @@ class vector {
 
 	public: std::vector<T> to_vec() const;
 
+	/*
+		Copies values [begin, end) to out[0 .. end - begin). Walks down the tree once per leaf node, not once per value.
+		out must point to end - begin constructed values.
+	*/
+	public: void copy_range(size_t begin, size_t end, T out[]) const;
+
+	/*
+		Reads the values at the indices, like out[i] = (*this)[indices[i]] for each i, in any order.
+		The indices are visited in sorted order, so each leaf node is found once per group of indices that
+		hit it, while the next leaf is prefetched. indices need not be sorted or unique.
+	*/
+	public: void get_many(const size_t indices[], size_t count, T out[]) const;
+
+	public: const_iterator begin() const;
+	public: const_iterator end() const;
+
+	//	Only for vectors that are not relaxed, see is_relaxed().
 	public: size_t get_block_count() const;
 	public: const T* get_block(size_t block_index) const;
 
+	/*
+		Returns true if the tree has relaxed inodes: leaf nodes in the tree can then be partially filled anywhere,
+		not only at the end. Vectors made by operator+, slice(), insert_at(), erase_at() and push_front() can be relaxed.
+	*/
+	public: bool is_relaxed() const;
+
 
 	///////////////////////////////////////		Internals
 
@@ -385,9 +1265,22 @@ class vector {
 		return _root;
 	}
 	public: vector(internals::node_ref<T> root, std::size_t size, int shift);
+	public: vector(internals::node_ref<T> root, std::size_t size, int shift, internals::node_ref<T> tail, std::size_t tail_size);
 
 	public: int get_shift() const;
 
+	public: const internals::node_ref<T>& get_tail() const{
+		return _tail;
+	}
+	public: std::size_t get_tail_size() const{
+		return _tail_size;
+	}
+
+	//	Index of the first value stored in the tail = number of values stored in the tree under _root.
+	public: std::size_t get_tail_offset() const{
+		return _size - _tail_size;
+	}
+
 
 	///////////////////////////////////////		State
 
@@ -396,1148 +1289,5590 @@ class vector {
 
 	//	This is the number of shift-steps needed to get to root.
 	//	It can be calculated from _size but that is slow so we cache it.
-	private: int _shift = internals::EMPTY_TREE_SHIFT;
+	//	A relaxed root can be higher than the number of values needs.
+	private: int _shift = branching_factor<T>::EMPTY_TREE_SHIFT;
+
+	/*
+		The last 0 - FACTOR values are kept in a separate leaf node, outside the tree, like Clojure does.
+		Appending to the tail only copies the tail, not the path from _root. The tail is pushed into the tree when
+		it is full.
+
+		When the tail is used and the root isn't relaxed, the tree holds a multiple of FACTOR values.
+		When _tail is a null node, _tail_size is 0 and the tree holds all values.
+	*/
+	private: internals::node_ref<T> _tail;
+	private: std::size_t _tail_size = 0;
 };
 
 
 
-////////////////////////////////////////////		Global functions
+////////////////////////////////////////////		transient_vector
+
+/*
+	Mutable companion to vector<T>, for building or bulk-modifying big vectors fast. Like Clojure's transients.
+
+	It mutates nodes in place as long as it is the only owner of them (their reference counter is 1), otherwise it
+	path-copies them once and then owns the copies. Use persistent() to get a normal vector<T> - this is O(1).
 
+	You can continue to use the transient_vector after calling persistent(): nodes shared with the persistent vector
+	are copied the first time the transient touches them, so the persistent vector never changes.
+
+	Not thread safe: only use a transient_vector from one thread at a time.
+*/
 
 template <class T>
-vector<T> operator+(const vector<T>& a, const vector<T>& b);
+class transient_vector {
+	public: typedef T value_type;
+	public: typedef std::size_t size_type;
 
+	public: transient_vector();
+	public: transient_vector(const vector<T>& original);
 
-//	For diagnosics and demo purposes.
-template <class T> size_t get_inode_count();
-template <class T> size_t get_leaf_count();
+	public: bool check_invariant() const;
 
+	public: void push_back(const T& value);
+	public: void push_back(T&& value);
+	public: void store(size_t index, const T& value);
+	public: void store(size_t index, T&& value);
 
+	public: std::size_t size() const;
 
+	public: bool empty() const{
+		return size() == 0;
+	}
 
+	public: const T& operator[](std::size_t index) const;
 
-////////////////////////////////////////////		IMPLEMENTATION
+	public: vector<T> persistent() const;
 
-	namespace internals {
 
+	///////////////////////////////////////		Internals
 
-		/*
-			Traces simple graph of the nodes in the tree.
-		*/
-		template <class T>
-		void trace_node(const std::string& prefix, const internals::node_ref<T>& node){
-			if(node.get_type() == internals::node_type::null_node){
-				STEADY_TRACE_SS(prefix << "<null>");
-			}
-			else if(node.get_type() == internals::node_type::inode){
-				std::stringstream s;
-				s << prefix << "<inode> RC: " << node.get_inode()->_rc;
-				STEADY_SCOPED_TRACE(s.str());
+	private: internals::leaf_node<T>* get_mutable_leaf(size_t index, size_t& slot);
+	private: void push_tail_into_tree();
 
-				int index = 0;
-				for(auto i: node.get_inode()->get_child_array()){
-					trace_node("#" + std::to_string(index) + "\t", i);
-					index++;
-				}
-			}
-			else if(node.get_type() == internals::node_type::leaf_node){
-				std::stringstream s;
-				s << prefix << "<leaf> RC: " << node.get_leaf_node()->_rc;
-				STEADY_SCOPED_TRACE(s.str());
 
-				int index = 0;
-				for(auto i: node.get_leaf_node()->_values){
-					STEADY_TRACE_SS("#" << std::to_string(index) << "\t" << i);
-					(void)i;
-					index++;
-				}
-			}
-			else{
-				STEADY_ASSERT(false);
-			}
-		}
+	///////////////////////////////////////		State
 
-		/*
-			Validates the list, not that the children är valid.
-		*/
-		template <class T>
-		bool validate_inode_children(const std::array<node_ref<T>, BRANCHING_FACTOR>& vec){
-			STEADY_ASSERT(vec.size() >= 0);
-			STEADY_ASSERT(vec.size() <= BRANCHING_FACTOR);
+	//	Same layout as vector<T>.
+	private: internals::node_ref<T> _root;
+	private: std::size_t _size = 0;
+	private: int _shift = branching_factor<T>::EMPTY_TREE_SHIFT;
+	private: internals::node_ref<T> _tail;
+	private: std::size_t _tail_size = 0;
+};
 
-			/*
-			for(auto i: vec){
-				i.check_invariant();
-			}
-			*/
-
-			if(vec.size() > 0){
-				const auto type = vec[0].get_type();
-				if(type == node_type::null_node){
-					for(const auto& i: vec){
-						STEADY_ASSERT(i.get_type() == node_type::null_node);
-					}
-				}
-				else if(type == node_type::inode){
-					size_t i = 0;
-					while(i < vec.size() && vec[i].get_type() == node_type::inode){
-						i++;
-					}
-					while(i < vec.size()){
-						STEADY_ASSERT(vec[i].get_type() == node_type::null_node);
-						i++;
-					}
-				}
-				else if(type == node_type::leaf_node){
-					size_t i = 0;
-					while(i < vec.size() && vec[i].get_type() == node_type::leaf_node){
-						i++;
-					}
-					while(i < vec.size()){
-						STEADY_ASSERT(vec[i].get_type() == node_type::null_node);
-						i++;
-					}
-				}
-				else{
-					STEADY_ASSERT(false);
-				}
-			}
-			return true;
-		}
 
 
-		template <class T>
-		node_ref<T> make_leaf_node(const std::array<T, BRANCHING_FACTOR>& values){
-			return node_ref<T>(new leaf_node<T>(values));
-		}
+////////////////////////////////////////////		vector_editor
 
-		template <class T>
-		node_ref<T> make_leaf_node(T&& first_value){
-			auto leafnode = new leaf_node<T>();
-			leafnode->_values[0] = std::move(first_value);
-			return node_ref<T>(leafnode);
-		}
+/*
+	Cursor for many store() calls close to each other, like an editor or a simulation that works in a small moving
+	window of a big vector.
 
-		template <class T>
-		node_ref<T> make_inode_from_vector(const std::vector<node_ref<T>>& children){
-			STEADY_ASSERT(children.size() <= BRANCHING_FACTOR);
+	The editor keeps a private copy of one leaf node, the focus. store() into the focus changes it in place. Storing
+	outside the focus, or calling commit(), writes the focus back into the vector - copying the path from the root once
+	- and moves the focus to the new leaf node. Writes with locality then copy one leaf node per leaf node visited
+	instead of the whole path on each store().
 
-			std::array<node_ref<T>, BRANCHING_FACTOR> temp{};
-			std::copy(children.begin(), children.end(), temp.begin());
-			return node_ref<T>(new inode<T>(temp));
-		}
+	Works with relaxed vectors and the tail. Not thread safe: only use an editor from one thread at a time.
+*/
 
+template <class T>
+class vector_editor {
+	public: typedef T value_type;
+	public: typedef std::size_t size_type;
 
-		template <class T>
-		node_ref<T> make_inode_from_array(const std::array<node_ref<T>, BRANCHING_FACTOR>& children){
-			return node_ref<T>(new inode<T>(children));
-		}
+	public: vector_editor(const vector<T>& original);
 
+	public: bool check_invariant() const;
 
-		/*
-			Verifies the tree is valid.
-			### improve
-		*/
-		template <class T>
-		bool tree_check_invariant(const node_ref<T>& tree, size_t size){
-			STEADY_ASSERT(tree.check_invariant());
-		#if STEADY_ASSERT_ON
-			if(size == 0){
-				STEADY_ASSERT(tree.get_type() == node_type::null_node);
-			}
-			else{
-				STEADY_ASSERT(tree.get_type() != node_type::null_node);
-			}
-		#endif
-			return true;
-		}
+	public: void store(size_t index, const T& value);
+	public: void store(size_t index, T&& value);
 
+	public: std::size_t size() const;
+	public: const T& operator[](std::size_t index) const;
 
-		template <class T>
-		node_ref<T> find_leaf_node(const vector<T>& original, size_t index){
-			STEADY_ASSERT(original.check_invariant());
-			STEADY_ASSERT(index < original.size());
+	//	Writes the focus back and returns the vector with all stores so far. The editor can keep storing.
+	public: vector<T> commit();
 
-			auto shift = original.get_shift();
-			node_ref<T> node_it = original.get_root();
 
-			//	Traverse all inodes.
-			while(shift > 0){
-				size_t slot_index = (index >> shift) & BRANCHING_FACTOR_MASK;
-				node_it = node_it.get_inode()->get_child(slot_index);
-				shift -= BRANCHING_FACTOR_SHIFT;
-			}
+	///////////////////////////////////////		Internals
 
-			STEADY_ASSERT(shift == LEAF_NODE_SHIFT);
-			STEADY_ASSERT(node_it.get_type() == node_type::leaf_node);
-			return node_it;
-		}
+	private: T& get_focus_value(size_t index);
+	private: void write_back();
 
+	private: vector_editor(const vector_editor& rhs);
+	private: vector_editor& operator=(const vector_editor& rhs);
 
-		/*
-			node: original tree. Not changed by function. Cannot be null node, only inode or leaf node.
 
-			shift: shift for current level in tree.
-			leaf_index0: index of the first value in the leaf.
-			new_leaf: new leaf node.
-			result: copy of "tree" that has new_leaf replaced. Same size as original.
-				result-tree and original tree shares internal state.
-		*/
-		template <class T>
-		node_ref<T> replace_leaf_node(const node_ref<T>& node, int shift, size_t leaf_index0, const node_ref<T>& new_leaf){
-			STEADY_ASSERT(node.get_type() == node_type::inode || node.get_type() == node_type::leaf_node);
-			STEADY_ASSERT(new_leaf.check_invariant());
+	///////////////////////////////////////		State
 
-			const size_t slot_index = (leaf_index0 >> shift) & BRANCHING_FACTOR_MASK;
+	//	Everything but the focus.
+	private: vector<T> _vector;
 
-			if(shift == LEAF_NODE_SHIFT){
-				STEADY_ASSERT(node.get_type() == node_type::leaf_node);
+	//	Null or a leaf node only the editor has seen, holding the values [_focus_begin, _focus_begin + _focus_size).
+	private: internals::node_ref<T> _focus;
+	private: std::size_t _focus_begin = 0;
+	private: std::size_t _focus_size = 0;
+};
 
-				return new_leaf;
-			}
-			else{
-				STEADY_ASSERT(node.get_type() == node_type::inode);
 
-				const auto child = node.get_inode()->get_child(slot_index);
-				auto child2 = replace_leaf_node(child, shift - BRANCHING_FACTOR_SHIFT, leaf_index0, new_leaf);
 
-				auto children = node.get_inode()->get_child_array();
-				children[slot_index] = child2;
-				auto copy = make_inode_from_array(children);
-				return copy;
-			}
-		}
+////////////////////////////////////////////		atomic_vector
 
+/*
+	Holds a vector<T> that many threads can read and replace at once, without locks. Use it to publish the latest
+	version of a vector: readers load() a copy and keep using it while a writer stores the next version.
+
+	The current vector lives in a reference counted "generation". The pointer to it and a count of readers that are
+	copying it are one atomic 64-bit word (a split reference count): load() adds itself to that count, copies the
+	vector, then removes itself again. store() swaps in a new generation and moves the count of the old generation's
+	readers to its own counter, so the old generation lives until its last reader is done. Readers never wait for
+	writers or each other. No more than 65535 threads can be inside load() at once, load() throws std::overflow_error
+	instead of going over.
+
+	Vectors compare by identity, not values: compare_exchange() succeeds when _expected_ is the same vector object
+	that is stored, or a copy of it.
+*/
 
-		/*
-			Recursively finds the correct leaf node and replaces the value _value_ with it. Returns new tree.
+template <class T>
+class atomic_vector {
+	public: typedef T value_type;
 
-			node: original tree. Not changed by function. Cannot be null node, only inode or leaf node.
-			shift: shift for current level in tree.
-			index: entry to store "value" to.
-			value: value to store.
-			result: copy of "tree" that has "value" stored. Same size as original.
-				result-tree and original tree shares internal state.
-		*/
+	public: atomic_vector();
+	public: atomic_vector(const vector<T>& value);
+	public: ~atomic_vector();
 
-		template <class T>
-		node_ref<T> replace_value(const node_ref<T>& node, int shift, size_t index, const T& value){
-			STEADY_ASSERT(node.get_type() == node_type::inode || node.get_type() == node_type::leaf_node);
+	private: atomic_vector(const atomic_vector& rhs);
+	private: atomic_vector& operator=(const atomic_vector& rhs);
 
-			const size_t slot_index = (index >> shift) & BRANCHING_FACTOR_MASK;
-			if(shift == LEAF_NODE_SHIFT){
-				STEADY_ASSERT(node.get_type() == node_type::leaf_node);
+	public: vector<T> load() const;
+	public: void store(const vector<T>& value);
+	public: vector<T> exchange(const vector<T>& value);
 
-				auto copy = node_ref<T>(new leaf_node<T>(node.get_leaf_node()->_values));
+	/*
+		Replaces the vector with _desired_ if it is _expected_ and returns true. Otherwise sets _expected_ to the current
+		vector and returns false.
+	*/
+	public: bool compare_exchange(vector<T>& expected, const vector<T>& desired);
 
-				STEADY_ASSERT(slot_index < copy.get_leaf_node()->_values.size());
-				copy.get_leaf_node()->_values[slot_index] = value;
+	//	Replaces the vector with f(current) and returns it. Calls f again if another thread changed the vector first.
+	public: template <class F> vector<T> update(F f);
 
-				return copy;
-			}
-			else{
-				STEADY_ASSERT(node.get_type() == node_type::inode);
 
-				const auto child = node.get_inode()->get_child(slot_index);
-				auto child2 = replace_value(child, shift - BRANCHING_FACTOR_SHIFT, index, value);
+	///////////////////////////////////////		Internals
 
-				auto children = node.get_inode()->get_child_array();
-				children[slot_index] = child2;
-				auto copy = make_inode_from_array(children);
-				return copy;
-			}
+	/*
+		_refs is 0 while the generation is current. When it's replaced the writer adds the readers that were still
+		inside load() and each of them subtracts 1 when done. Whoever brings _refs to exactly 0 deletes it.
+	*/
+	private: struct generation {
+		generation(const vector<T>& value) :
+			_refs(0),
+			_value(value)
+		{
 		}
-		template <class T>
-		node_ref<T> replace_value(const node_ref<T>& node, int shift, size_t index, T&& value){
-			STEADY_ASSERT(node.get_type() == node_type::inode || node.get_type() == node_type::leaf_node);
 
-			const size_t slot_index = (index >> shift) & BRANCHING_FACTOR_MASK;
-			if(shift == LEAF_NODE_SHIFT){
-				STEADY_ASSERT(node.get_type() == node_type::leaf_node);
+		std::atomic<std::int64_t> _refs;
+		const vector<T> _value;
+	};
 
-				auto copy = node_ref<T>(new leaf_node<T>(node.get_leaf_node()->_values));
+	private: static const int COUNT_SHIFT = 48;
+	private: static const std::uint64_t POINTER_MASK = (std::uint64_t(1) << COUNT_SHIFT) - 1;
+	private: static const std::uint64_t COUNT_ONE = std::uint64_t(1) << COUNT_SHIFT;
+	private: static const std::uint64_t MAX_READERS = (std::uint64_t(1) << (64 - COUNT_SHIFT)) - 1;
 
-				STEADY_ASSERT(slot_index < copy.get_leaf_node()->_values.size());
-				copy.get_leaf_node()->_values[slot_index] = std::move(value);
+	private: static std::uint64_t make_state(const vector<T>& value);
+	private: static generation* get_generation(std::uint64_t state);
+	private: generation* acquire() const;
+	private: void release(generation* gen) const;
+	private: static void release_replaced(std::uint64_t old_state, std::int64_t own_readers);
 
-				return copy;
-			}
-			else{
-				STEADY_ASSERT(node.get_type() == node_type::inode);
 
-				const auto child = node.get_inode()->get_child(slot_index);
-				auto child2 = replace_value(child, shift - BRANCHING_FACTOR_SHIFT, index, std::move(value));
+	///////////////////////////////////////		State
 
-				auto children = node.get_inode()->get_child_array();
-				children[slot_index] = child2;
-				auto copy = make_inode_from_array(children);
-				return copy;
-			}
-		}
+	//	generation* in the low 48 bits, number of readers in load() in the high 16 bits.
+	private: mutable std::atomic<std::uint64_t> _state;
+};
 
-		
-		/*
-			Creates a leaf node with zero to many parent inodes (all inodes only contain one item).
 
-			Example path:
-				inode
-					inode
-						inode
-							leaf_node
 
-			Example path:
-				inode
-					leaf_node
+////////////////////////////////////////////		sparse_vector
 
-			Example path:
-				leaf_node
-		*/
-		template <class T>
-		node_ref<T> make_new_path(int shift, const node_ref<T>& leaf_node){
-			STEADY_ASSERT(leaf_node.check_invariant());
-			STEADY_ASSERT(leaf_node.get_type() == node_type::leaf_node);
+/*
+	Persistent vector with holes, for big index spaces with few values in them, like an ideal hash table. Any index can
+	be stored, erased or looked up, each in O(log N). Memory scales with the number of values, not the biggest index.
 
-			if(shift == LEAF_NODE_SHIFT){
-				return leaf_node;
-			}
-			else{
-				auto a = make_new_path(shift - BRANCHING_FACTOR_SHIFT, leaf_node);
-				node_ref<T> b = make_inode_from_array<T>({ a });
-				return b;
-			}
-		}
+	Uses the same nodes as vector<T>, with internals::sparse_slot<T> as leaf values: each slot in a leaf node holds a
+	value or is a hole, and subtrees without values are null children anywhere in their inode. The tree is always
+	as shallow as the biggest index allows, so two sparse vectors with the same values have the same shape.
+*/
 
-		/*
-			Adds the new leaf-node last in the tree. Returns new tree.
+template <class T>
+class sparse_vector {
+	public: typedef T value_type;
+	public: typedef std::size_t size_type;
+	public: typedef internals::sparse_slot<T> slot_t;
 
-			original: original tree. Not changed by function. Cannot be null node, only inode or leaf node.
-			index: point to location of new leaf-mode = current number of values in tree.
-			value: value to store.
-			result: copy of "tree" that has "value" stored. Same size as original.
-				result-tree and original tree shares internal state
+	public: sparse_vector();
 
-			New tree may be same depth or +1 deep.
+	public: bool check_invariant() const;
 
-			Cannot append node when root gets full!
-		*/
-		template <class T>
-		node_ref<T> append_leaf_node(const node_ref<T>& original, int shift, size_t index, const node_ref<T>& leaf_node){
-			STEADY_ASSERT(original.check_invariant());
-			STEADY_ASSERT(original.get_type() == node_type::inode);
-			STEADY_ASSERT(leaf_node.check_invariant());
-			STEADY_ASSERT(leaf_node.get_type() == node_type::leaf_node);
+	//	_index_ can be any index - the tree grows to hold it.
+	public: sparse_vector store(size_t index, const T& value) const;
 
-			size_t slot_index = (index >> shift) & BRANCHING_FACTOR_MASK;
-			auto children = original.get_inode()->get_child_array();
+	//	Makes _index_ a hole. Returns the same vector if it already is one.
+	public: sparse_vector erase(size_t index) const;
 
-			//	Lowest level inode, pointing to leaf nodes.
-			if(shift == LOWEST_LEVEL_INODE_SHIFT){
-				children[slot_index] = leaf_node;
-				return make_inode_from_array<T>(children);
-			}
-			else {
-				const auto child = children[slot_index];
-				if(child.get_type() == node_type::null_node){
-					node_ref<T> child2 = make_new_path(shift - BRANCHING_FACTOR_SHIFT, leaf_node);
-					children[slot_index] = child2;
-					return make_inode_from_array<T>(children);
-				}
-				else{
-					node_ref<T> child2 = append_leaf_node(child, shift - BRANCHING_FACTOR_SHIFT, index, leaf_node);
-					children[slot_index] = child2;
-					return make_inode_from_array<T>(children);
-				}
-			}
-		}
+	public: bool contains(size_t index) const;
 
+	//	Returns nullptr if _index_ is a hole.
+	public: const T* find(size_t index) const;
 
-		/*
-			Original must be a multiple of BRANCHING_FACTOR - no partial leaf node.
-		*/
-		template <class T>
-		vector<T> push_back_leaf_node(const vector<T>& original, const node_ref<T>& new_leaf, size_t leaf_item_count){
-			STEADY_ASSERT(original.check_invariant());
-			STEADY_ASSERT(new_leaf.check_invariant());
-			STEADY_ASSERT(new_leaf.get_type() == node_type::leaf_node);
-			STEADY_ASSERT((original.size() & BRANCHING_FACTOR_MASK) == 0);
-			STEADY_ASSERT(leaf_item_count <= BRANCHING_FACTOR);
+	//	_index_ must hold a value.
+	public: const T& operator[](size_t index) const;
 
-			const auto original_size = original.size();
-			const auto original_shift = original.get_shift();
+	//	Number of values, holes not counted.
+	public: std::size_t size() const;
 
-			if(original_size == 0){
-				const auto result = vector<T>(new_leaf, leaf_item_count, LEAF_NODE_SHIFT);
-				STEADY_ASSERT(result.check_invariant());
-				return result;
-			}
-			else{
-				//	How many values can we fit in tree with this shift-constant?
-				size_t max_values = internals::shift_to_max_size(original_shift);
-				bool fits_in_root = (original_size + leaf_item_count) <= max_values;
+	public: bool empty() const{
+		return size() == 0;
+	}
 
-				//	Space left in root?
-				if(fits_in_root){
-					const auto root = append_leaf_node(original.get_root(), original_shift, original_size, new_leaf);
-					const auto result = vector<T>(root, original_size + leaf_item_count, original_shift);
-					STEADY_ASSERT(result.check_invariant());
-					return result;
-				}
-				else{
-					auto new_path = make_new_path(original_shift, new_leaf);
-					auto new_root = make_inode_from_array<T>({ original.get_root(), new_path });
-					const auto result = vector<T>(new_root, original_size + leaf_item_count, original_shift + BRANCHING_FACTOR_SHIFT);
-					STEADY_ASSERT(result.check_invariant());
-					return result;
-				}
-			}
-		}
+	//	Calls f(index, value) for each value, in index order. Skips whole subtrees of holes.
+	public: template <class F> void for_each(F f) const;
 
+	public: bool operator==(const sparse_vector& rhs) const;
+	public: bool operator!=(const sparse_vector& rhs) const{
+		return !(*this == rhs);
+	}
 
 
+	///////////////////////////////////////		Internals
 
-		template <class T>
-		vector<T> push_back_1(const vector<T>& original, const T& value) {
-			STEADY_ASSERT(original.check_invariant());
-			const auto size = original.size();
-			//	Does last leaf node have space for one more value? Then we use replace_value() - keeping tree same size.
-			if((size & BRANCHING_FACTOR_MASK) != 0){
-				const auto shift = original.get_shift();
-				const auto root = replace_value(original.get_root(), shift, size, value);
-				return vector<T>(root, size + 1, shift);
-			}
-			else {
-				const auto leaf = make_leaf_node<T>({ value });
-				return push_back_leaf_node(original, leaf, 1);
-			}
-		}
+	public: const internals::node_ref<slot_t>& get_root() const{
+		return _root;
+	}
 
-		template <class T>
-		vector<T> push_back_1(const vector<T>& original, T&& value) {
-			STEADY_ASSERT(original.check_invariant());
-			const auto size = original.size();
-			//	Does last leaf node have space for one more value? Then we use replace_value() - keeping tree same size.
-			if((size & BRANCHING_FACTOR_MASK) != 0) {
-				const auto shift = original.get_shift();
-				const auto root = replace_value(original.get_root(), shift, size, std::forward<T>(value));
-				return vector<T>(root, size + 1, shift);
-			}
-			else {
-				const auto leaf = make_leaf_node<T>(std::move( value ));
-				return push_back_leaf_node(original, leaf, 1);
-			}
-		}
+	public: int get_shift() const{
+		return _shift;
+	}
 
-		/*
-			This is the central building block: adds many values to a vector (or a create a new vector) fast.
-		*/
-#if 0
-		template <class T>
-		vector<T> push_back_batch(const vector<T>& original, const T values[], size_t count){
-			STEADY_ASSERT(original.check_invariant());
-			STEADY_ASSERT(values != nullptr);
+	private: sparse_vector(internals::node_ref<slot_t> root, std::size_t size, int shift);
 
-			vector<T> result = original;
-			for(size_t i = 0 ; i < count ; i++){
-				result = result.push_back(values[i]);
-			}
-			return result;
-		}
 
-#else
+	///////////////////////////////////////		State
 
-		template <class T>
-		vector<T> push_back_batch(const vector<T>& original, const T values[], std::size_t count){
-			STEADY_ASSERT(original.check_invariant());
-			STEADY_ASSERT(values != nullptr);
+	//	null or an inode at _shift.
+	private: internals::node_ref<slot_t> _root;
+	private: std::size_t _size = 0;
+	private: int _shift = branching_factor<slot_t>::LOWEST_LEVEL_INODE_SHIFT;
+};
 
-			vector<T> result = original;
-			size_t source_pos = 0;
+
+
+////////////////////////////////////////////		vector_iterator
+
+/*
+	Random access iterator for vector<T>. Caches the leaf node it's in, so stepping through the vector only walks down
+	the tree when it crosses into the next leaf node. Use it with range-for and STL algorithms:
+
+		for(const auto& value: vec){ ... }
+		const auto sum = std::accumulate(vec.begin(), vec.end(), 0);
+
+	The iterator refers to the vector object: it's valid as long as that vector object lives and isn't assigned to.
+*/
+
+template <class T>
+class vector_iterator {
+	public: typedef std::random_access_iterator_tag iterator_category;
+	public: typedef T value_type;
+	public: typedef std::ptrdiff_t difference_type;
+	public: typedef const T* pointer;
+	public: typedef const T& reference;
+
+	public: vector_iterator();
+	public: vector_iterator(const vector<T>* vec, std::size_t index);
+	public: bool check_invariant() const;
+
+	public: const T& operator*() const;
+	public: const T* operator->() const;
+	public: const T& operator[](difference_type offset) const;
+
+	public: vector_iterator& operator++();
+	public: vector_iterator operator++(int);
+	public: vector_iterator& operator--();
+	public: vector_iterator operator--(int);
+	public: vector_iterator& operator+=(difference_type offset);
+	public: vector_iterator& operator-=(difference_type offset);
+	public: vector_iterator operator+(difference_type offset) const;
+	public: vector_iterator operator-(difference_type offset) const;
+	public: difference_type operator-(const vector_iterator& rhs) const;
+
+	public: bool operator==(const vector_iterator& rhs) const;
+	public: bool operator!=(const vector_iterator& rhs) const;
+	public: bool operator<(const vector_iterator& rhs) const;
+	public: bool operator>(const vector_iterator& rhs) const;
+	public: bool operator<=(const vector_iterator& rhs) const;
+	public: bool operator>=(const vector_iterator& rhs) const;
+
+	public: std::size_t get_index() const{
+		return _index;
+	}
+
+	//	Looks up the leaf node holding _index.
+	private: void load_leaf() const;
+
+
+	///////////////////////////////////////		State
+
+	private: const vector<T>* _vector;
+	private: std::size_t _index;
+
+	//	Cache: values [_leaf_begin, _leaf_end) of the vector are at _leaf_values.
+	private: mutable const T* _leaf_values;
+	private: mutable std::size_t _leaf_begin;
+	private: mutable std::size_t _leaf_end;
+};
+
+template <class T>
+vector_iterator<T> operator+(typename vector_iterator<T>::difference_type offset, const vector_iterator<T>& it);
+
+
+
+////////////////////////////////////////////		Global functions
+
+
+template <class T>
+vector<T> concat(const vector<T>& a, const vector<T>& b);
+
+template <class T>
+vector<T> operator+(const vector<T>& a, const vector<T>& b);
+
+/*
+	Returns the index ranges [first, second) where _a_ and _b_ have different values, in order. Neighbouring ranges
+	are merged. If the vectors have different sizes, the values only in the longer vector are the last range.
+
+	Subtrees that _a_ and _b_ share are skipped without reading their values, so comparing two generations of a vector
+	takes time proportional to the nodes that differ, not to the size of the vectors.
+*/
+template <class T>
+std::vector<std::pair<size_t, size_t>> diff(const vector<T>& a, const vector<T>& b);
+
+
+
+////////////////////////////////////////////		Parallel algorithms
+
+/*
+	The vector is split at inode boundaries into a few subtrees per CPU core. The subtrees are processed by the calling
+	thread and a shared pool of worker threads, which claim subtrees until all are done. Exceptions thrown by the
+	function are rethrown to the caller after all subtrees have finished.
+*/
+namespace parallel {
+
+	//	Calls f(value) for each value. f is called from several threads at once and in no particular order.
+	template <class T, class F>
+	void for_each(const vector<T>& vec, F f);
+
+	//	Returns op(op(op(init, v0), v1), v2)... op must be associative: values are combined in a tree-shaped order.
+	template <class T, class Op>
+	T reduce(const vector<T>& vec, T init, Op op);
+
+	/*
+		Returns a vector with f(value) of each value. The new tree has the same shape as _vec_ and is built bottom-up
+		by the threads, each making the nodes of its subtrees.
+	*/
+	template <class T, class F>
+	auto transform(const vector<T>& vec, F f) -> vector<typename std::decay<decltype(f(std::declval<const T&>()))>::type>;
+
+}	//	parallel
+
+
+
+////////////////////////////////////////////		Snapshots
+
+/*
+	Saves many vectors - typically many generations of the same vector - in one binary snapshot. Each node is written
+	once, even when it is shared by several of the vectors, so a new generation only adds its changed nodes.
+	read_snapshot() gets the vectors back with the same sharing.
+
+	Only for trivially copyable T: values are stored as raw bytes. The format is for the machine that wrote it:
+	reading checks byte order, sizeof(T) and the branching factor.
+
+	The writer keeps the added vectors alive so nodes can be identified by their address.
+*/
+template <class T>
+class snapshot_writer {
+	static_assert(std::is_trivially_copyable<T>::value, "Snapshots store values as raw bytes.");
+
+	public: snapshot_writer();
+
+	//	Adds _vec_ to the snapshot. Nodes written by earlier vectors are referred to, not written again.
+	public: void add(const vector<T>& vec);
+
+	//	Writes header, nodes and vector table.
+	public: void write(std::ostream& out) const;
+
+	public: size_t get_node_count() const;
+
+	private: std::uint64_t add_node(const internals::node_ref<T>& node, int shift);
+
+
+	////////////////	State
+	private: std::vector<vector<T>> _vectors;
+	private: std::unordered_map<std::uintptr_t, std::uint64_t> _node_ids;
+	private: std::string _nodes;
+	private: std::string _vector_table;
+};
+
+/*
+	Returns the vectors in a snapshot written by snapshot_writer<T>, in the order they were added. Nodes that were
+	shared in the snapshot are shared by the new vectors. The values of each leaf node are copied with one memcpy(),
+	_data_ can be a memory mapped file.
+
+	Throws std::runtime_error if _data_ isn't a valid snapshot for T.
+*/
+template <class T>
+std::vector<vector<T>> read_snapshot(const void* data, size_t size);
+
+
+////////////////////////////////////////////		leaf_interner
+
+/*
+	Hash-consing of leaf nodes. intern() replaces each leaf node with an equal leaf node it has seen before, in any
+	vector. Vectors that were made separately then share their equal leaf nodes, which saves memory and makes
+	operator==() and diff() skip them.
+
+	The interner keeps all leaf nodes it has seen alive. Use one interner per batch of vectors to deduplicate.
+*/
+template <class T>
+class leaf_interner {
+	//	Returns a vector with the same values as _vec_, using the interned leaf nodes.
+	public: vector<T> intern(const vector<T>& vec);
+
+	//	Number of unique leaf nodes.
+	public: size_t size() const;
+
+	private: internals::node_ref<T> intern_tree(const internals::node_ref<T>& node, size_t size, int shift);
+
+
+	////////////////	State
+	private: std::unordered_multimap<std::uint64_t, internals::node_ref<T>> _leaf_nodes;
+};
+
+
+//	For diagnosics and demo purposes. Live nodes for one value type, see stats.
+template <class T> size_t get_inode_count();
+template <class T> size_t get_leaf_count();
+
+/*
+	Number of node references in the trees of _vectors_ divided by the number of unique nodes. 1.0 when they share no
+	nodes. Visits the nodes each vector uses.
+*/
+template <class T>
+double get_sharing_ratio(const vector<T> vectors[], size_t count);
+
+
+
+
+
+////////////////////////////////////////////		IMPLEMENTATION
+
+	namespace internals {
+
+
+		////////////////////////////////////////////		stats_counters
+
+	#if STEADY_STATS_ON
+		namespace stats_counters {
+
+			static const int MAX_COUNTER_COUNT = 512;
+
+			//	Only its own thread writes a block, so adding doesn't need a read-modify-write.
+			struct thread_block {
+				thread_block(){
+					for(auto& value: _values){
+						value.store(0, std::memory_order_relaxed);
+					}
+				}
+
+				std::atomic<std::int64_t> _values[MAX_COUNTER_COUNT];
+			};
+
+			struct registry {
+				registry() :
+					_next_type_counter(FIXED_COUNTER_COUNT)
+				{
+					for(auto& value: _ended_threads){
+						value = 0;
+					}
+				}
+
+				std::mutex _mutex;
+				std::vector<thread_block*> _blocks;
+				std::int64_t _ended_threads[MAX_COUNTER_COUNT];
+				int _next_type_counter;
+			};
+
+			//	Never deleted: threads can count after static objects have been destroyed.
+			inline registry& get_registry(){
+				static registry* result = new registry();
+				return *result;
+			}
 
 			/*
-				1) If the last leaf node in destination is partially filled, pad it out.
+				Set when the thread's thread_block_owner has been destroyed. Trivially destructible, so it can still be
+				read by the destructors of thread_local and static objects that run after it.
 			*/
-			{
-				size_t last_leaf_size = original.size() & BRANCHING_FACTOR_MASK;
-				if(last_leaf_size > 0){
-					size_t last_leaf_node_index = original.size() & ~(BRANCHING_FACTOR_MASK);
-#if 0
-					size_t copy_count = std::min(BRANCHING_FACTOR - last_leaf_size, count);
-					for(size_t i = 0 ; i < copy_count ; i++){
-						result = push_back_1(result, values[source_pos]);
-						source_pos++;
+			inline bool& get_thread_ended(){
+				static thread_local bool result = false;
+				return result;
+			}
+
+			//	Adds the counters of the thread to _ended_threads when the thread ends.
+			struct thread_block_owner {
+				thread_block_owner() :
+					_block(new thread_block())
+				{
+					auto& r = get_registry();
+					std::lock_guard<std::mutex> lock(r._mutex);
+					r._blocks.push_back(_block);
+				}
+
+				~thread_block_owner(){
+					auto& r = get_registry();
+					{
+						std::lock_guard<std::mutex> lock(r._mutex);
+						for(int i = 0 ; i < MAX_COUNTER_COUNT ; i++){
+							r._ended_threads[i] += _block->_values[i].load(std::memory_order_relaxed);
+						}
+						r._blocks.erase(std::find(r._blocks.begin(), r._blocks.end(), _block));
 					}
-#else
-					size_t copy_count = std::min(BRANCHING_FACTOR - last_leaf_size, count);
-					node_ref<T> prev_leaf = find_leaf_node(result, last_leaf_node_index);
-					node_ref<T> new_leaf_node(new leaf_node<T>());
+					delete _block;
+					_block = nullptr;
+					get_thread_ended() = true;
+				}
 
-					//	Copy existing values.
-					std::copy(&prev_leaf.get_leaf_node()->_values[0],
-						&prev_leaf.get_leaf_node()->_values[last_leaf_size],
-						new_leaf_node.get_leaf_node()->_values.begin());
+				thread_block* _block;
+			};
 
-					//	Append our new values.
-					std::copy(&values[source_pos],
-						&values[source_pos + copy_count],
-						new_leaf_node.get_leaf_node()->_values.begin() + last_leaf_size);
+			//	nullptr once the thread's block has been destroyed: its counts go straight to _ended_threads then.
+			inline thread_block* get_thread_block(){
+				if(get_thread_ended()){
+					return nullptr;
+				}
+				static thread_local thread_block_owner owner;
+				return owner._block;
+			}
 
-					node_ref<T> new_root = replace_leaf_node(result.get_root(), result.get_shift(), last_leaf_node_index, new_leaf_node);
-					result = vector<T>(new_root, result.size() + copy_count, result.get_shift());
-					source_pos += copy_count;
+			void add(int counter, std::int64_t delta){
+				STEADY_ASSERT(counter >= 0 && counter < MAX_COUNTER_COUNT);
 
-#endif
+				const auto block = get_thread_block();
+				if(block == nullptr){
+					auto& r = get_registry();
+					std::lock_guard<std::mutex> lock(r._mutex);
+					r._ended_threads[counter] += delta;
+					return;
+				}
+				auto& value = block->_values[counter];
+				value.store(value.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+			}
+
+			//	Only the counts of the current thread. 0 after its block has been destroyed.
+			inline std::int64_t get_thread_value(int counter){
+				const auto block = get_thread_block();
+				return block == nullptr ? 0 : block->_values[counter].load(std::memory_order_relaxed);
+			}
+
+			std::int64_t get(int counter){
+				STEADY_ASSERT(counter >= 0 && counter < MAX_COUNTER_COUNT);
+
+				auto& r = get_registry();
+				std::lock_guard<std::mutex> lock(r._mutex);
+				auto result = r._ended_threads[counter];
+				for(const auto block: r._blocks){
+					result += block->_values[counter].load(std::memory_order_relaxed);
 				}
+				return result;
 			}
 
 			/*
-				Append _entire leaf nodes_ while there are enough source values. Includes appending a last, partial leaf.
+				Returns the counter that counts _counter_ for value type T only. It is allocated the first time. A
+				function static, not a class static, so it works during static initialization.
 			*/
-			if(source_pos < count){
-				while(source_pos < count){
-					STEADY_ASSERT((result.size() & BRANCHING_FACTOR_MASK) == 0);
+			template <class T> int get_type_counter(int counter){
+				STEADY_ASSERT(counter == INODE_COUNT || counter == LEAF_COUNT);
+
+				static const int first = []{
+					auto& r = get_registry();
+					std::lock_guard<std::mutex> lock(r._mutex);
+					STEADY_ASSERT(r._next_type_counter + 2 <= MAX_COUNTER_COUNT);
+
+					const auto result = r._next_type_counter;
+					r._next_type_counter += 2;
+					return result;
+				}();
+				return first + (counter == INODE_COUNT ? 0 : 1);
+			}
+
+			void add_node(int counter, int type_counter, std::size_t size){
+				add(counter, 1);
+				add(type_counter, 1);
+				add(NODE_BYTES, static_cast<std::int64_t>(size));
+				add(ALLOCATED_NODE_COUNT, 1);
+				add(ALLOCATED_NODE_BYTES, static_cast<std::int64_t>(size));
+			}
+
+			void remove_node(int counter, int type_counter, std::size_t size){
+				add(counter, -1);
+				add(type_counter, -1);
+				add(NODE_BYTES, -static_cast<std::int64_t>(size));
+			}
+
+			struct operation_scope {
+				operation_scope(int count_counter, int copied_counter) :
+					_count_counter(count_counter),
+					_copied_counter(copied_counter),
+					_allocated_node_count(get_thread_value(ALLOCATED_NODE_COUNT))
+				{
+				}
+
+				~operation_scope(){
+					add(_count_counter, 1);
+					add(_copied_counter, get_thread_value(ALLOCATED_NODE_COUNT) - _allocated_node_count);
+				}
+
+				const int _count_counter;
+				const int _copied_counter;
+				const std::int64_t _allocated_node_count;
+			};
+
+		}	//	stats_counters
+	#endif
+
+
+		////////////////////////////////////////////		node_pool
+
+		namespace node_pool {
+
+			//	Blocks are rounded up to multiples of GRANULARITY bytes. Bigger blocks than the biggest size class use
+			//	operator new directly.
+			static const std::size_t GRANULARITY = 16;
+			static const std::size_t SIZE_CLASS_COUNT = 128;
+
+			//	Blocks are carved from operator new memory, so every block is as aligned as it is.
+			static_assert(GRANULARITY % alignof(std::max_align_t) == 0, "Pool blocks must be aligned for any node");
+
+			//	Blocks move between a thread cache and the global lists BATCH_COUNT at a time.
+			static const std::size_t BATCH_COUNT = 32;
+			static const std::size_t THREAD_CACHE_MAX = BATCH_COUNT * 4;
+
+			struct free_block {
+				free_block* _next;
+			};
+
+			struct free_list {
+				free_block* _first = nullptr;
+				std::size_t _count = 0;
+
+				void push(free_block* block){
+					block->_next = _first;
+					_first = block;
+					_count++;
+				}
+
+				free_block* pop(){
+					auto block = _first;
+					_first = block->_next;
+					_count--;
+					return block;
+				}
+			};
+
+			struct global_lists {
+				std::mutex _mutex;
+				std::array<free_list, SIZE_CLASS_COUNT> _lists;
+			};
 
-					auto new_leaf_node = node_ref<T>(new leaf_node<T>());
-					const size_t batch_count = std::min(count - source_pos, static_cast<std::size_t>(BRANCHING_FACTOR));
+			//	Never destructed: nodes can be freed by destructors of static objects.
+			inline global_lists& get_global_lists(){
+				static global_lists* lists = new global_lists();
+				return *lists;
+			}
 
-					std::copy(&values[source_pos],
-						&values[source_pos + batch_count],
-						new_leaf_node.get_leaf_node()->_values.begin());
+			inline std::size_t block_size(std::size_t size_class){
+				return (size_class + 1) * GRANULARITY;
+			}
 
-					result = internals::push_back_leaf_node(result, new_leaf_node, batch_count);
+			//	Moves up to _count_ free blocks of _size_class_ to _dest_. Allocates new memory if there are no free blocks.
+			inline void take_from_global(std::size_t size_class, free_list& dest, std::size_t count){
+				auto& global = get_global_lists();
+				{
+					std::lock_guard<std::mutex> lock(global._mutex);
+					auto& list = global._lists[size_class];
+					while(list._count > 0 && dest._count < count){
+						dest.push(list.pop());
+					}
+				}
+				if(dest._count == 0){
+					const auto size = block_size(size_class);
+					auto memory = static_cast<char*>(::operator new(size * count));
+					for(std::size_t i = 0 ; i < count ; i++){
+						dest.push(reinterpret_cast<free_block*>(memory + i * size));
+					}
+				}
+			}
 
-					source_pos += batch_count;
+			inline void give_to_global(std::size_t size_class, free_list& source, std::size_t count){
+				auto& global = get_global_lists();
+				std::lock_guard<std::mutex> lock(global._mutex);
+				auto& list = global._lists[size_class];
+				while(source._count > 0 && count > 0){
+					list.push(source.pop());
+					count--;
 				}
 			}
 
-			STEADY_ASSERT(result.check_invariant());
-			STEADY_ASSERT(result.size() == original.size() + count);
-			return result;
+			inline bool& is_thread_cache_destructed(){
+				static thread_local bool destructed = false;
+				return destructed;
+			}
+
+			struct thread_cache {
+				std::array<free_list, SIZE_CLASS_COUNT> _lists;
+
+				~thread_cache(){
+					for(std::size_t i = 0 ; i < SIZE_CLASS_COUNT ; i++){
+						give_to_global(i, _lists[i], _lists[i]._count);
+					}
+					is_thread_cache_destructed() = true;
+				}
+			};
+
+			//	Returns nullptr when the thread is exiting and its cache is gone.
+			inline thread_cache* get_thread_cache(){
+				if(is_thread_cache_destructed()){
+					return nullptr;
+				}
+				static thread_local thread_cache cache;
+				return &cache;
+			}
+
+			inline void* allocate(std::size_t size){
+				const auto size_class = (size - 1) / GRANULARITY;
+				if(size == 0 || size_class >= SIZE_CLASS_COUNT){
+					return ::operator new(size);
+				}
+
+				auto cache = get_thread_cache();
+				if(cache == nullptr){
+					free_list temp;
+					take_from_global(size_class, temp, 1);
+					return temp.pop();
+				}
+
+				auto& list = cache->_lists[size_class];
+				if(list._count == 0){
+					take_from_global(size_class, list, BATCH_COUNT);
+				}
+				return list.pop();
+			}
+
+			inline void deallocate(void* p, std::size_t size){
+				const auto size_class = (size - 1) / GRANULARITY;
+				if(size == 0 || size_class >= SIZE_CLASS_COUNT){
+					::operator delete(p);
+					return;
+				}
+
+				auto block = static_cast<free_block*>(p);
+				auto cache = get_thread_cache();
+				if(cache == nullptr){
+					free_list temp;
+					temp.push(block);
+					give_to_global(size_class, temp, 1);
+					return;
+				}
+
+				auto& list = cache->_lists[size_class];
+				list.push(block);
+				if(list._count > THREAD_CACHE_MAX){
+					give_to_global(size_class, list, BATCH_COUNT);
+				}
+			}
+
+		}	//	node_pool
+
+
+		inline void* default_allocate(std::size_t size){
+			return ::operator new(size);
 		}
-#endif
 
+		inline void default_deallocate(void* p, std::size_t size){
+			(void)size;
+			::operator delete(p);
+		}
+
+		inline node_allocator& get_node_allocator_storage(){
+			static node_allocator allocator = make_default_node_allocator();
+			return allocator;
+		}
+
+	}	//	internals
+
+
+	node_allocator make_default_node_allocator(){
+		return node_allocator{ internals::default_allocate, internals::default_deallocate };
+	}
+
+	node_allocator make_pool_node_allocator(){
+		return node_allocator{ internals::node_pool::allocate, internals::node_pool::deallocate };
+	}
+
+	const node_allocator& get_node_allocator(){
+		return internals::get_node_allocator_storage();
+	}
+
+	void set_node_allocator(const node_allocator& allocator){
+		STEADY_ASSERT(allocator._allocate != nullptr && allocator._deallocate != nullptr);
+
+		internals::get_node_allocator_storage() = allocator;
+	}
+
+
+
+	namespace internals {
+
+
+		////////////////////////////////////////////		node_reclaimer
+
+		namespace node_reclaimer {
+
+			/*
+				A node nobody uses. _reclaim_ frees the node and adds the children that became unused to _pending_. It
+				knows the value type, so one list holds nodes of all vector types.
+			*/
+			struct dead_node;
+			typedef void (*reclaim_function)(std::uintptr_t ptr, std::vector<dead_node>& pending);
+
+			struct dead_node {
+				std::uintptr_t _ptr;
+				reclaim_function _reclaim;
+			};
+
+			//	Cells of the lock-free list. They come from the node allocator, like nodes.
+			struct cell {
+				cell* _next;
+				dead_node _node;
+			};
+
+			struct state {
+				state() :
+					_deferred(false),
+					_incoming(nullptr)
+				{
+				}
+
+				std::atomic<bool> _deferred;
+				std::atomic<cell*> _incoming;
+
+				//	Only used by the thread that reclaims, while holding _mutex.
+				std::mutex _mutex;
+				std::vector<dead_node> _pending;
+			};
+
+			//	Never deleted: nodes can be released after static objects have been destroyed.
+			inline state& get_state(){
+				static state* result = new state();
+				return *result;
+			}
+
+			inline bool is_deferred(){
+				return get_state()._deferred.load(std::memory_order_relaxed);
+			}
+
+			//	Lock-free: reclaim_nodes() takes the whole list at once, so there is no ABA problem.
+			inline void defer(std::uintptr_t ptr, reclaim_function reclaim){
+				auto& s = get_state();
+				auto c = static_cast<cell*>(get_node_allocator()._allocate(sizeof(cell)));
+				c->_node = dead_node{ ptr, reclaim };
+				c->_next = s._incoming.load(std::memory_order_relaxed);
+				while(!s._incoming.compare_exchange_weak(c->_next, c, std::memory_order_release, std::memory_order_relaxed)){
+				}
+				STEADY_STATS_ADD(DEFERRED_NODE_COUNT, 1);
+			}
+
+			inline void take_incoming(state& s){
+				auto c = s._incoming.exchange(nullptr, std::memory_order_acquire);
+				while(c != nullptr){
+					const auto next = c->_next;
+					s._pending.push_back(c->_node);
+					get_node_allocator()._deallocate(c, sizeof(cell));
+					c = next;
+				}
+			}
+
+		}	//	node_reclaimer
+
+	}	//	internals
+
+
+	void set_node_reclamation(node_reclamation mode){
+		internals::node_reclaimer::get_state()._deferred.store(mode == node_reclamation::deferred, std::memory_order_relaxed);
+	}
+
+	node_reclamation get_node_reclamation(){
+		return internals::node_reclaimer::is_deferred() ? node_reclamation::deferred : node_reclamation::immediate;
+	}
+
+	std::size_t reclaim_nodes(std::size_t max_count){
+		auto& s = internals::node_reclaimer::get_state();
+		std::lock_guard<std::mutex> lock(s._mutex);
+
+		std::size_t count = 0;
+		while(count < max_count){
+			if(s._pending.empty()){
+				internals::node_reclaimer::take_incoming(s);
+				if(s._pending.empty()){
+					break;
+				}
+			}
+			const auto node = s._pending.back();
+			s._pending.pop_back();
+			node._reclaim(node._ptr, s._pending);
+			count++;
+		}
+		return count;
+	}
+
+	std::size_t reclaim_all_nodes(){
+		return reclaim_nodes(std::numeric_limits<std::size_t>::max());
+	}
+
+	background_reclaimer::background_reclaimer(std::size_t batch_count, std::chrono::milliseconds idle_wait) :
+		_batch_count(batch_count),
+		_idle_wait(idle_wait),
+		_stop(false)
+	{
+		STEADY_ASSERT(batch_count > 0);
+
+		_thread = std::thread(&background_reclaimer::run, this);
+	}
+
+	background_reclaimer::~background_reclaimer(){
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_stop = true;
+		}
+		_wakeup.notify_one();
+		_thread.join();
+		reclaim_all_nodes();
+	}
+
+	void background_reclaimer::run(){
+		std::unique_lock<std::mutex> lock(_mutex);
+		while(!_stop){
+			lock.unlock();
+			const auto count = reclaim_nodes(_batch_count);
+			lock.lock();
+			if(count < _batch_count){
+				_wakeup.wait_for(lock, _idle_wait, [this]{ return _stop; });
+			}
+		}
+	}
+
+
+	stats get_stats(){
+		stats result;
+	#if STEADY_STATS_ON
+		using namespace internals::stats_counters;
+		result._inode_count = get(INODE_COUNT);
+		result._leaf_count = get(LEAF_COUNT);
+		result._node_bytes = get(NODE_BYTES);
+		result._allocated_node_count = get(ALLOCATED_NODE_COUNT);
+		result._allocated_node_bytes = get(ALLOCATED_NODE_BYTES);
+		result._store_count = get(STORE_COUNT);
+		result._store_copied_nodes = get(STORE_COPIED_NODES);
+		result._push_back_count = get(PUSH_BACK_COUNT);
+		result._push_back_copied_nodes = get(PUSH_BACK_COPIED_NODES);
+		result._deferred_node_count = get(DEFERRED_NODE_COUNT);
+	#endif
+		return result;
+	}
+
+	void trace_stats(){
+		const auto s = get_stats();
+		STEADY_TRACE_SS("steady stats:"
+			" inodes: " << s._inode_count <<
+			", leaf nodes: " << s._leaf_count <<
+			", node bytes: " << s._node_bytes <<
+			", allocated nodes: " << s._allocated_node_count <<
+			", allocated node bytes: " << s._allocated_node_bytes <<
+			", store(): " << s._store_count << " copied " << s._store_copied_nodes <<
+			", push_back(): " << s._push_back_count << " copied " << s._push_back_copied_nodes <<
+			", deferred nodes: " << s._deferred_node_count);
+		(void)s;
+	}
+
+
+
+	namespace internals {
+
+
+		/*
+			Traces simple graph of the nodes in the tree.
+		*/
+		template <class T>
+		void trace_node(const std::string& prefix, const internals::node_ref<T>& node){
+			if(node.get_type() == internals::node_type::null_node){
+				STEADY_TRACE_SS(prefix << "<null>");
+			}
+			else if(node.get_type() == internals::node_type::inode){
+				std::stringstream s;
+				s << prefix << "<inode> RC: " << node.get_inode()->_rc.get();
+				if(node.get_inode()->is_relaxed()){
+					s << " sizes:";
+					for(size_t i = 0 ; i < node.get_inode()->count_children() ; i++){
+						s << " " << (*node.get_inode()->_sizes)[i];
+					}
+				}
+				STEADY_SCOPED_TRACE(s.str());
+
+				int index = 0;
+				for(auto i: node.get_inode()->get_child_array()){
+					trace_node("#" + std::to_string(index) + "\t", i);
+					index++;
+				}
+			}
+			else if(node.get_type() == internals::node_type::leaf_node){
+				std::stringstream s;
+				s << prefix << "<leaf> RC: " << node.get_leaf_node()->_rc.get();
+				STEADY_SCOPED_TRACE(s.str());
+
+				const auto& leaf = *node.get_leaf_node();
+				for(size_t index = 0 ; index < leaf.get_count() ; index++){
+					STEADY_TRACE_SS("#" << std::to_string(index) << "\t" << leaf.get_values()[index]);
+				}
+			}
+			else{
+				STEADY_ASSERT(false);
+			}
+		}
+
+		/*
+			Validates the list, not that the children är valid.
+		*/
+		template <class T>
+		bool validate_inode_children(const std::array<node_ref<T>, branching_factor<T>::FACTOR>& vec){
+			return validate_inode_children(vec, allows_holes<T>());
+		}
+
+		//	Holes: non-null children can be anywhere but must all have the same type.
+		template <class T>
+		bool validate_inode_children(const std::array<node_ref<T>, branching_factor<T>::FACTOR>& vec, std::true_type){
+			auto type = node_type::null_node;
+			for(const auto& i: vec){
+				if(i.get_type() != node_type::null_node){
+					STEADY_ASSERT(type == node_type::null_node || i.get_type() == type);
+					type = i.get_type();
+				}
+			}
+			return true;
+		}
+
+		template <class T>
+		bool validate_inode_children(const std::array<node_ref<T>, branching_factor<T>::FACTOR>& vec, std::false_type){
+			STEADY_ASSERT(vec.size() >= 0);
+			STEADY_ASSERT(vec.size() <= branching_factor<T>::FACTOR);
+
+			/*
+			for(auto i: vec){
+				i.check_invariant();
+			}
+			*/
+
+			if(vec.size() > 0){
+				const auto type = vec[0].get_type();
+				if(type == node_type::null_node){
+					for(const auto& i: vec){
+						STEADY_ASSERT(i.get_type() == node_type::null_node);
+					}
+				}
+				else if(type == node_type::inode){
+					size_t i = 0;
+					while(i < vec.size() && vec[i].get_type() == node_type::inode){
+						i++;
+					}
+					while(i < vec.size()){
+						STEADY_ASSERT(vec[i].get_type() == node_type::null_node);
+						i++;
+					}
+				}
+				else if(type == node_type::leaf_node){
+					size_t i = 0;
+					while(i < vec.size() && vec[i].get_type() == node_type::leaf_node){
+						i++;
+					}
+					while(i < vec.size()){
+						STEADY_ASSERT(vec[i].get_type() == node_type::null_node);
+						i++;
+					}
+				}
+				else{
+					STEADY_ASSERT(false);
+				}
+			}
+			return true;
+		}
+
+
+		template <class T>
+		node_ref<T> make_leaf_node(const std::array<T, branching_factor<T>::FACTOR>& values){
+			return node_ref<T>(new leaf_node<T>(values));
+		}
+
+		//	Makes a leaf node holding copies of the first _count_ values of _values_.
+		template <class T>
+		node_ref<T> make_leaf_node(const T values[], size_t count){
+			return node_ref<T>(new leaf_node<T>(values, count));
+		}
+
+		template <class T>
+		node_ref<T> make_leaf_node(const T& first_value){
+			node_ref<T> result(new leaf_node<T>());
+			result.get_leaf_node()->push_value(first_value);
+			return result;
+		}
+
+		template <class T>
+		node_ref<T> make_leaf_node(T&& first_value){
+			node_ref<T> result(new leaf_node<T>());
+			result.get_leaf_node()->push_value(std::move(first_value));
+			return result;
+		}
+
+		//	Copies the constructed values of _leaf_ into a new leaf node.
+		template <class T>
+		node_ref<T> copy_leaf_node(const leaf_node<T>& leaf){
+			return make_leaf_node<T>(leaf.get_values(), leaf.get_count());
+		}
+
+		template <class T>
+		node_ref<T> make_inode_from_vector(const std::vector<node_ref<T>>& children){
+			STEADY_ASSERT(children.size() <= branching_factor<T>::FACTOR);
+
+			std::array<node_ref<T>, branching_factor<T>::FACTOR> temp{};
+			std::copy(children.begin(), children.end(), temp.begin());
+			return node_ref<T>(new inode<T>(std::move(temp)));
+		}
+
+
+		template <class T>
+		node_ref<T> make_inode_from_array(const std::array<node_ref<T>, branching_factor<T>::FACTOR>& children){
+			return node_ref<T>(new inode<T>(children));
+		}
+
+		//	Moves the children into the new inode. Use this when building a new child array to avoid adding and
+		//	removing a reference to each child.
+		template <class T>
+		node_ref<T> make_inode_from_array(std::array<node_ref<T>, branching_factor<T>::FACTOR>&& children){
+			return node_ref<T>(new inode<T>(std::move(children)));
+		}
+
+		//	Copies the children and the size table of _node_.
+		template <class T>
+		node_ref<T> copy_inode(const inode<T>& node){
+			if(node.is_relaxed()){
+				return node_ref<T>(new inode<T>(node._children, *node._sizes));
+			}
+			else{
+				return make_inode_from_array(node._children);
+			}
+		}
+
+
+		/*
+			Returns the leaf node of _node_ so it can be modified in place. If someone else also references the leaf
+			node, _node_ is first changed to refer to a private copy of it.
+
+			Only safe if the caller owns the path down to _node_ exclusively too.
+		*/
+		template <class T>
+		leaf_node<T>* make_leaf_node_unique(node_ref<T>& node){
+			STEADY_ASSERT(node.get_type() == node_type::leaf_node);
+
+			if(node.get_leaf_node()->_rc.get() > 1){
+				node = copy_leaf_node(*node.get_leaf_node());
+			}
+			STEADY_ASSERT(node.get_leaf_node()->_rc.get() == 1);
+
+			//	The caller will change the values.
+			node.get_leaf_node()->reset_cached_hash();
+			return node.get_leaf_node();
+		}
+
+		/*
+			Same as make_leaf_node_unique() but for inodes. Copying an inode adds a reference to each of its
+			children, so they in turn will be copied when they are made unique.
+		*/
+		template <class T>
+		inode<T>* make_inode_unique(node_ref<T>& node){
+			STEADY_ASSERT(node.get_type() == node_type::inode);
+
+			if(node.get_inode()->_rc.get() > 1){
+				node = copy_inode(*node.get_inode());
+			}
+			STEADY_ASSERT(node.get_inode()->_rc.get() == 1);
+
+			node.get_inode()->reset_cached_hash();
+			return node.get_inode();
+		}
+
+
+
+		////////////////////////////////////////////		Relaxed inodes
+
+
+		template <class T>
+		bool is_relaxed(const node_ref<T>& node){
+			return node.get_type() == node_type::inode && node.get_inode()->is_relaxed();
+		}
+
+		/*
+			A node and the number of values in its subtree. Strict nodes don't know their size so algorithms that
+			work on relaxed trees carry it along with the node.
+		*/
+		template <class T>
+		struct sized_node {
+			public: node_ref<T> _node;
+			public: size_t _size;
+		};
+
+		/*
+			Returns the number of values in child _slot_ of _node_.
+
+			shift: shift of _node_.
+			node_size: number of values in _node_. Only used for strict inodes.
+		*/
+		template <class T>
+		size_t get_child_size(const inode<T>& node, int shift, size_t node_size, size_t slot){
+			if(node.is_relaxed()){
+				const auto& sizes = *node._sizes;
+				return slot == 0 ? sizes[0] : sizes[slot] - sizes[slot - 1];
+			}
+			else{
+				const size_t child_max = size_t(1) << shift;
+				return std::min(child_max, node_size - slot * child_max);
+			}
+		}
+
+		/*
+			Returns the slot of the child of _node_ that holds _index_ and changes _index_ to the index inside that child.
+
+			A child of a relaxed inode never holds more values than a child of a strict inode, so we start looking at the
+			slot a strict inode would use and scan forward.
+		*/
+		template <class T>
+		size_t find_child(const inode<T>& node, int shift, size_t& index){
+			if(node.is_relaxed()){
+				const auto& sizes = *node._sizes;
+				size_t slot = index >> shift;
+				while(sizes[slot] <= index){
+					slot++;
+				}
+				if(slot > 0){
+					index -= sizes[slot - 1];
+				}
+				return slot;
+			}
+			else{
+				const size_t slot = (index >> shift) & branching_factor<T>::MASK;
+				index &= (size_t(1) << shift) - 1;
+				return slot;
+			}
+		}
+
+		/*
+			Returns a copy of _node_ where child _slot_ is replaced by _child_. The size table is kept, so _child_ must
+			hold as many values as the child it replaces.
+
+			The new child array is built in place: each kept child gets one new reference and _child_ is moved in.
+		*/
+		template <class T>
+		node_ref<T> replace_child(const inode<T>& node, size_t slot, node_ref<T>&& child){
+			typename inode<T>::children_t children;
+			for(size_t i = 0 ; i < branching_factor<T>::FACTOR ; i++){
+				if(i != slot){
+					children[i] = node._children[i];
+				}
+			}
+			children[slot] = std::move(child);
+
+			if(node.is_relaxed()){
+				return node_ref<T>(new inode<T>(std::move(children), *node._sizes));
+			}
+			else{
+				return make_inode_from_array(std::move(children));
+			}
+		}
+
+		template <class T>
+		node_ref<T> replace_child(const inode<T>& node, size_t slot, const node_ref<T>& child){
+			return replace_child(node, slot, node_ref<T>(child));
+		}
+
+		/*
+			Returns the children of the inode _node_, at level _shift_, together with their sizes.
+		*/
+		template <class T>
+		std::vector<sized_node<T>> get_sized_children(const sized_node<T>& node, int shift){
+			const auto& n = *node._node.get_inode();
+			const auto count = n.count_children();
+
+			std::vector<sized_node<T>> result;
+			result.reserve(count);
+			for(size_t i = 0 ; i < count ; i++){
+				result.push_back(sized_node<T>{ n.get_child(i), get_child_size(n, shift, node._size, i) });
+			}
+			return result;
+		}
+
+		/*
+			Makes an inode at level _shift_ from 1 - FACTOR children. The inode is strict when its children allow
+			it, else it is relaxed and gets a size table.
+		*/
+		template <class T>
+		sized_node<T> make_inode_from_sized(const sized_node<T>* begin, const sized_node<T>* end, int shift){
+			const size_t count = end - begin;
+			STEADY_ASSERT(count > 0 && count <= branching_factor<T>::FACTOR);
+
+			const size_t child_max = size_t(1) << shift;
+			typename inode<T>::children_t children{};
+			typename inode<T>::size_table_t sizes{};
+			bool strict = true;
+			size_t total = 0;
+			for(size_t i = 0 ; i < count ; i++){
+				children[i] = begin[i]._node;
+				total += begin[i]._size;
+				sizes[i] = total;
+				if(is_relaxed(begin[i]._node) || (i + 1 < count && begin[i]._size != child_max)){
+					strict = false;
+				}
+			}
+
+			auto node = strict ? node_ref<T>(new inode<T>(std::move(children))) : node_ref<T>(new inode<T>(std::move(children), sizes));
+			return sized_node<T>{ node, total };
+		}
+
+
+		/*
+			Verifies the tree is valid.
+			### improve
+		*/
+		template <class T>
+		bool tree_check_invariant(const node_ref<T>& tree, size_t size){
+			STEADY_ASSERT(tree.check_invariant());
+		#if STEADY_ASSERT_ON
+			if(size == 0){
+				STEADY_ASSERT(tree.get_type() == node_type::null_node);
+			}
+			else{
+				STEADY_ASSERT(tree.get_type() != node_type::null_node);
+			}
+		#endif
+			return true;
+		}
+
+		/*
+			Checks the entire tree, recursively: that all leaf nodes are at the same level, that relaxed inodes have
+			correct size tables and that strict inodes only have strict children. Slow - walks all nodes.
+		*/
+		template <class T>
+		bool validate_tree(const sized_node<T>& node, int shift){
+			if(shift == LEAF_NODE_SHIFT){
+				STEADY_ASSERT(node._node.get_type() == node_type::leaf_node);
+				STEADY_ASSERT(node._size > 0 && node._size <= branching_factor<T>::FACTOR);
+			}
+			else{
+				STEADY_ASSERT(node._node.get_type() == node_type::inode);
+				STEADY_ASSERT(node._size > 0 && node._size <= shift_to_max_size<T>(shift));
+
+				const auto& n = *node._node.get_inode();
+				const auto count = n.count_children();
+				if(n.is_relaxed()){
+					STEADY_ASSERT((*n._sizes)[count - 1] == node._size);
+				}
+				else{
+					STEADY_ASSERT(count == divide_round_up(node._size, size_t(1) << shift));
+				}
+
+				for(const auto& child: get_sized_children(node, shift)){
+					STEADY_ASSERT(n.is_relaxed() || !is_relaxed(child._node));
+					STEADY_ASSERT(validate_tree(child, shift - branching_factor<T>::SHIFT));
+				}
+			}
+			return true;
+		}
+
+
+		template <class T>
+		node_ref<T> find_leaf_node(const vector<T>& original, size_t index){
+			STEADY_ASSERT(original.check_invariant());
+			STEADY_ASSERT(index < original.size());
+
+			if(index >= original.get_tail_offset()){
+				return original.get_tail();
+			}
+
+			auto shift = original.get_shift();
+			node_ref<T> node_it = original.get_root();
+
+			//	Traverse all inodes.
+			while(shift > 0){
+				const size_t slot_index = find_child(*node_it.get_inode(), shift, index);
+				node_it = node_it.get_inode()->get_child(slot_index);
+				shift -= branching_factor<T>::SHIFT;
+			}
+
+			STEADY_ASSERT(shift == LEAF_NODE_SHIFT);
+			STEADY_ASSERT(node_it.get_type() == node_type::leaf_node);
+			return node_it;
+		}
+
+		/*
+			Finds the leaf node holding _index_ in the tree _node_, which can be relaxed.
+			Sets _leaf_index_ to the position of the value inside the leaf node and _leaf_size_ to the number of values
+			in the leaf node.
+		*/
+		template <class T>
+		node_ref<T> find_leaf_node(const sized_node<T>& tree, int shift, size_t index, size_t& leaf_index, size_t& leaf_size){
+			STEADY_ASSERT(index < tree._size);
+
+			node_ref<T> node_it = tree._node;
+			size_t size = tree._size;
+			while(shift > 0){
+				const auto& node = *node_it.get_inode();
+				const size_t slot_index = find_child(node, shift, index);
+				size = get_child_size(node, shift, size, slot_index);
+				node_it = node.get_child(slot_index);
+				shift -= branching_factor<T>::SHIFT;
+			}
+
+			STEADY_ASSERT(node_it.get_type() == node_type::leaf_node);
+			leaf_index = index;
+			leaf_size = size;
+			return node_it;
+		}
+
+		/*
+			Finds the values of the leaf node (or tail) holding _index_, without touching any reference counters.
+			Sets _leaf_begin_ to the vector index of the first of them and _leaf_size_ to how many there are.
+			The pointer is valid as long as _vec_ lives.
+		*/
+		template <class T>
+		const T* find_leaf_values(const vector<T>& vec, size_t index, size_t& leaf_begin, size_t& leaf_size){
+			STEADY_ASSERT(index < vec.size());
+
+			const auto tail_offset = vec.get_tail_offset();
+			if(index >= tail_offset){
+				leaf_begin = tail_offset;
+				leaf_size = vec.get_tail_size();
+				return vec.get_tail().get_leaf_node()->get_values();
+			}
+
+			const node_ref<T>* node_it = &vec.get_root();
+			int shift = vec.get_shift();
+			size_t size = tail_offset;
+			size_t rest = index;
+			while(shift > 0){
+				const auto& node = *node_it->get_inode();
+				const size_t slot_index = find_child(node, shift, rest);
+				size = get_child_size(node, shift, size, slot_index);
+				node_it = &node.get_child(slot_index);
+				shift -= branching_factor<T>::SHIFT;
+			}
+
+			leaf_begin = index - rest;
+			leaf_size = size;
+			return node_it->get_leaf_node()->get_values();
+		}
+
+
+		/*
+			node: original tree. Not changed by function. Cannot be null node, only inode or leaf node.
+
+			shift: shift for current level in tree.
+			leaf_index0: index of the first value in the leaf.
+			new_leaf: new leaf node.
+			result: copy of "tree" that has new_leaf replaced. Same size as original.
+				result-tree and original tree shares internal state.
+		*/
+		template <class T>
+		node_ref<T> replace_leaf_node(const node_ref<T>& node, int shift, size_t leaf_index0, const node_ref<T>& new_leaf){
+			STEADY_ASSERT(node.get_type() == node_type::inode || node.get_type() == node_type::leaf_node);
+			STEADY_ASSERT(new_leaf.check_invariant());
+
+			const size_t slot_index = (leaf_index0 >> shift) & branching_factor<T>::MASK;
+
+			if(shift == LEAF_NODE_SHIFT){
+				STEADY_ASSERT(node.get_type() == node_type::leaf_node);
+
+				return new_leaf;
+			}
+			else{
+				STEADY_ASSERT(node.get_type() == node_type::inode);
+
+				const auto& child = node.get_inode()->get_child(slot_index);
+				auto child2 = replace_leaf_node(child, shift - branching_factor<T>::SHIFT, leaf_index0, new_leaf);
+				return replace_child(*node.get_inode(), slot_index, std::move(child2));
+			}
+		}
+
+
+		/*
+			Removes all values at and after _new_size_ from the tree. Returns new tree.
+
+			node: original tree. Not changed by function. Cannot be null node, only inode or leaf node.
+			shift: shift for current level in tree. The result is at the same level.
+			new_size: a multiple of FACTOR. [0 < new_size <= values in tree]
+			result: copy of the tree where only the right edge is copied. Whole subtrees after _new_size_ are
+				dropped. Subtrees that are kept are shared with the original tree.
+		*/
+		template <class T>
+		node_ref<T> trim_tree(const node_ref<T>& node, int shift, size_t new_size){
+			STEADY_ASSERT(node.get_type() == node_type::inode || node.get_type() == node_type::leaf_node);
+			STEADY_ASSERT(new_size > 0);
+			STEADY_ASSERT((new_size & branching_factor<T>::MASK) == 0);
+
+			if(shift == LEAF_NODE_SHIFT){
+				STEADY_ASSERT(node.get_type() == node_type::leaf_node);
+				return node;
+			}
+			else{
+				STEADY_ASSERT(node.get_type() == node_type::inode);
+
+				const size_t last_slot = ((new_size - 1) >> shift) & branching_factor<T>::MASK;
+				const auto& child = node.get_inode()->get_child(last_slot);
+				const auto child2 = trim_tree(child, shift - branching_factor<T>::SHIFT, new_size);
+
+				const bool unchanged = child2.same_node(child)
+					&& (last_slot + 1 == branching_factor<T>::FACTOR || node.get_inode()->get_child(last_slot + 1).get_type() == node_type::null_node);
+				if(unchanged){
+					return node;
+				}
+
+				typename inode<T>::children_t children;
+				for(size_t i = 0 ; i < last_slot ; i++){
+					children[i] = node.get_inode()->_children[i];
+				}
+				children[last_slot] = child2;
+				return make_inode_from_array(std::move(children));
+			}
+		}
+
+
+		/*
+			Recursively finds the correct leaf node and replaces the value _value_ with it. Returns new tree.
+
+			node: original tree. Not changed by function. Cannot be null node, only inode or leaf node.
+			shift: shift for current level in tree.
+			index: entry to store "value" to.
+			value: value to store.
+			result: copy of "tree" that has "value" stored. Same size as original.
+				result-tree and original tree shares internal state.
+		*/
+
+		template <class T>
+		node_ref<T> replace_value(const node_ref<T>& node, int shift, size_t index, const T& value){
+			STEADY_ASSERT(node.get_type() == node_type::inode || node.get_type() == node_type::leaf_node);
+
+			const size_t slot_index = (index >> shift) & branching_factor<T>::MASK;
+			if(shift == LEAF_NODE_SHIFT){
+				STEADY_ASSERT(node.get_type() == node_type::leaf_node);
+
+				auto copy = copy_leaf_node(*node.get_leaf_node());
+				copy.get_leaf_node()->store_value(slot_index, value);
+
+				return copy;
+			}
+			else{
+				STEADY_ASSERT(node.get_type() == node_type::inode);
+
+				size_t child_index = index;
+				const size_t child_slot = find_child(*node.get_inode(), shift, child_index);
+				const auto& child = node.get_inode()->get_child(child_slot);
+				auto child2 = replace_value(child, shift - branching_factor<T>::SHIFT, child_index, value);
+				return replace_child(*node.get_inode(), child_slot, std::move(child2));
+			}
+		}
+		template <class T>
+		node_ref<T> replace_value(const node_ref<T>& node, int shift, size_t index, T&& value){
+			STEADY_ASSERT(node.get_type() == node_type::inode || node.get_type() == node_type::leaf_node);
+
+			const size_t slot_index = (index >> shift) & branching_factor<T>::MASK;
+			if(shift == LEAF_NODE_SHIFT){
+				STEADY_ASSERT(node.get_type() == node_type::leaf_node);
+
+				auto copy = copy_leaf_node(*node.get_leaf_node());
+				copy.get_leaf_node()->store_value(slot_index, std::move(value));
+
+				return copy;
+			}
+			else{
+				STEADY_ASSERT(node.get_type() == node_type::inode);
+
+				size_t child_index = index;
+				const size_t child_slot = find_child(*node.get_inode(), shift, child_index);
+				const auto& child = node.get_inode()->get_child(child_slot);
+				auto child2 = replace_value(child, shift - branching_factor<T>::SHIFT, child_index, std::move(value));
+				return replace_child(*node.get_inode(), child_slot, std::move(child2));
+			}
+		}
+
+		
+		/*
+			Creates a leaf node with zero to many parent inodes (all inodes only contain one item).
+
+			Example path:
+				inode
+					inode
+						inode
+							leaf_node
+
+			Example path:
+				inode
+					leaf_node
+
+			Example path:
+				leaf_node
+		*/
+		template <class T>
+		node_ref<T> make_new_path(int shift, const node_ref<T>& leaf_node){
+			STEADY_ASSERT(leaf_node.check_invariant());
+			STEADY_ASSERT(leaf_node.get_type() == node_type::leaf_node);
+
+			if(shift == LEAF_NODE_SHIFT){
+				return leaf_node;
+			}
+			else{
+				auto a = make_new_path(shift - branching_factor<T>::SHIFT, leaf_node);
+				node_ref<T> b = make_inode_from_array<T>({ a });
+				return b;
+			}
+		}
+
+		/*
+			Adds the new leaf-node last in the tree. Returns new tree.
+
+			original: original tree. Not changed by function. Cannot be null node, only inode or leaf node.
+			index: point to location of new leaf-mode = current number of values in tree.
+			value: value to store.
+			result: copy of "tree" that has "value" stored. Same size as original.
+				result-tree and original tree shares internal state
+
+			New tree may be same depth or +1 deep.
+
+			Cannot append node when root gets full!
+		*/
+		template <class T>
+		node_ref<T> append_leaf_node(const node_ref<T>& original, int shift, size_t index, const node_ref<T>& leaf_node){
+			STEADY_ASSERT(original.check_invariant());
+			STEADY_ASSERT(original.get_type() == node_type::inode);
+			STEADY_ASSERT(leaf_node.check_invariant());
+			STEADY_ASSERT(leaf_node.get_type() == node_type::leaf_node);
+
+			size_t slot_index = (index >> shift) & branching_factor<T>::MASK;
+			const auto& node = *original.get_inode();
+
+			//	Lowest level inode, pointing to leaf nodes.
+			if(shift == branching_factor<T>::LOWEST_LEVEL_INODE_SHIFT){
+				return replace_child(node, slot_index, leaf_node);
+			}
+			else {
+				const auto& child = node.get_child(slot_index);
+				if(child.get_type() == node_type::null_node){
+					return replace_child(node, slot_index, make_new_path(shift - branching_factor<T>::SHIFT, leaf_node));
+				}
+				else{
+					return replace_child(node, slot_index, append_leaf_node(child, shift - branching_factor<T>::SHIFT, index, leaf_node));
+				}
+			}
+		}
+
+
+		/*
+			Original must be a multiple of FACTOR - no partial leaf node.
+		*/
+		template <class T>
+		vector<T> push_back_leaf_node(const vector<T>& original, const node_ref<T>& new_leaf, size_t leaf_item_count){
+			STEADY_ASSERT(original.check_invariant());
+			STEADY_ASSERT(new_leaf.check_invariant());
+			STEADY_ASSERT(new_leaf.get_type() == node_type::leaf_node);
+			STEADY_ASSERT((original.size() & branching_factor<T>::MASK) == 0);
+			STEADY_ASSERT(leaf_item_count <= branching_factor<T>::FACTOR);
+
+			const auto original_size = original.size();
+			const auto original_shift = original.get_shift();
+
+			if(original_size == 0){
+				const auto result = vector<T>(new_leaf, leaf_item_count, LEAF_NODE_SHIFT);
+				STEADY_ASSERT(result.check_invariant());
+				return result;
+			}
+			else{
+				//	How many values can we fit in tree with this shift-constant?
+				size_t max_values = internals::shift_to_max_size<T>(original_shift);
+				bool fits_in_root = (original_size + leaf_item_count) <= max_values;
+
+				//	Space left in root?
+				if(fits_in_root){
+					const auto root = append_leaf_node(original.get_root(), original_shift, original_size, new_leaf);
+					const auto result = vector<T>(root, original_size + leaf_item_count, original_shift);
+					STEADY_ASSERT(result.check_invariant());
+					return result;
+				}
+				else{
+					auto new_path = make_new_path(original_shift, new_leaf);
+					auto new_root = make_inode_from_array<T>({ original.get_root(), new_path });
+					const auto result = vector<T>(new_root, original_size + leaf_item_count, original_shift + branching_factor<T>::SHIFT);
+					STEADY_ASSERT(result.check_invariant());
+					return result;
+				}
+			}
+		}
+
+
+
+
+		/*
+			Moves the tail of _original_ into its tree. Returns a vector with the same values but no tail.
+		*/
+		template <class T>
+		vector<T> push_tail_into_tree(const vector<T>& original){
+			STEADY_ASSERT(original.check_invariant());
+			STEADY_ASSERT(original.get_tail_size() > 0);
+
+			if(original.is_relaxed()){
+				auto shift = original.get_shift();
+				const auto root = push_leaf_relaxed(
+					sized_node<T>{ original.get_root(), original.get_tail_offset() },
+					shift,
+					sized_node<T>{ original.get_tail(), original.get_tail_size() }
+				);
+				return vector<T>(root, original.size(), shift, node_ref<T>(), 0);
+			}
+
+			const auto tree = vector<T>(original.get_root(), original.get_tail_offset(), original.get_shift());
+			const auto result = push_back_leaf_node(tree, original.get_tail(), original.get_tail_size());
+			STEADY_ASSERT(result.size() == original.size());
+			return result;
+		}
+
+		/*
+			Returns a copy of the tail leaf node of _original_ with room for more values.
+		*/
+		template <class T>
+		node_ref<T> copy_tail(const vector<T>& original){
+			STEADY_ASSERT(original.get_tail_size() > 0 && original.get_tail_size() < branching_factor<T>::FACTOR);
+
+			return make_leaf_node<T>(original.get_tail().get_leaf_node()->get_values(), original.get_tail_size());
+		}
+
+		template <class T>
+		vector<T> push_back_1(const vector<T>& original, const T& value) {
+			STEADY_ASSERT(original.check_invariant());
+			const auto size = original.size();
+			const auto tail_size = original.get_tail_size();
+
+			//	Room in tail? Then we only need to copy the tail.
+			if(tail_size > 0 && tail_size < branching_factor<T>::FACTOR){
+				auto tail = copy_tail(original);
+				tail.get_leaf_node()->push_value(value);
+				return vector<T>(original.get_root(), size + 1, original.get_shift(), std::move(tail), tail_size + 1);
+			}
+			else if(tail_size == branching_factor<T>::FACTOR){
+				const auto tree = push_tail_into_tree(original);
+				return vector<T>(tree.get_root(), size + 1, tree.get_shift(), make_leaf_node<T>(value), 1);
+			}
+
+			//	No tail. Does last leaf node in tree have space for one more value? Then we use replace_value() - keeping tree same size.
+			else if(!original.is_relaxed() && (size & branching_factor<T>::MASK) != 0){
+				const auto shift = original.get_shift();
+				auto root = replace_value(original.get_root(), shift, size, value);
+				return vector<T>(std::move(root), size + 1, shift);
+			}
+			else {
+				return vector<T>(original.get_root(), size + 1, original.get_shift(), make_leaf_node<T>(value), 1);
+			}
+		}
+
+		template <class T>
+		vector<T> push_back_1(const vector<T>& original, T&& value) {
+			STEADY_ASSERT(original.check_invariant());
+			const auto size = original.size();
+			const auto tail_size = original.get_tail_size();
+
+			if(tail_size > 0 && tail_size < branching_factor<T>::FACTOR){
+				auto tail = copy_tail(original);
+				tail.get_leaf_node()->push_value(std::move(value));
+				return vector<T>(original.get_root(), size + 1, original.get_shift(), std::move(tail), tail_size + 1);
+			}
+			else if(tail_size == branching_factor<T>::FACTOR){
+				const auto tree = push_tail_into_tree(original);
+				return vector<T>(tree.get_root(), size + 1, tree.get_shift(), make_leaf_node<T>(std::move(value)), 1);
+			}
+			else if(!original.is_relaxed() && (size & branching_factor<T>::MASK) != 0) {
+				const auto shift = original.get_shift();
+				auto root = replace_value(original.get_root(), shift, size, std::forward<T>(value));
+				return vector<T>(std::move(root), size + 1, shift);
+			}
+			else {
+				return vector<T>(original.get_root(), size + 1, original.get_shift(), make_leaf_node<T>(std::move(value)), 1);
+			}
+		}
+
+		/*
+			This is the central building block: adds many values to a vector (or a create a new vector) fast.
+		*/
+#if 0
+		template <class T>
+		vector<T> push_back_batch(const vector<T>& original, const T values[], size_t count){
+			STEADY_ASSERT(original.check_invariant());
+			STEADY_ASSERT(values != nullptr);
+
+			vector<T> result = original;
+			for(size_t i = 0 ; i < count ; i++){
+				result = result.push_back(values[i]);
+			}
+			return result;
+		}
+
+#else
+
+		template <class T>
+		vector<T> push_back_batch(const vector<T>& original, const T values[], std::size_t count){
+			STEADY_ASSERT(original.check_invariant());
+			STEADY_ASSERT(values != nullptr);
+
+			vector<T> result = original;
+			size_t source_pos = 0;
+
+			/*
+				1) If the last leaf node in destination is partially filled, pad it out.
+				The last leaf node is the tail or - if there is no tail - the last leaf node in the tree.
+			*/
+			{
+				const size_t tail_size = original.get_tail_size();
+				const size_t last_leaf_size = original.size() & branching_factor<T>::MASK;
+				if(tail_size > 0 && tail_size < branching_factor<T>::FACTOR){
+					const size_t copy_count = std::min(branching_factor<T>::FACTOR - tail_size, count);
+					node_ref<T> new_tail = copy_tail(result);
+
+					new_tail.get_leaf_node()->push_values(&values[source_pos], copy_count);
+
+					result = vector<T>(result.get_root(), result.size() + copy_count, result.get_shift(), new_tail, tail_size + copy_count);
+					source_pos += copy_count;
+				}
+				else if(tail_size == 0 && last_leaf_size > 0 && !original.is_relaxed()){
+					size_t last_leaf_node_index = original.size() & ~(branching_factor<T>::MASK);
+#if 0
+					size_t copy_count = std::min(branching_factor<T>::FACTOR - last_leaf_size, count);
+					for(size_t i = 0 ; i < copy_count ; i++){
+						result = push_back_1(result, values[source_pos]);
+						source_pos++;
+					}
+#else
+					size_t copy_count = std::min(branching_factor<T>::FACTOR - last_leaf_size, count);
+					node_ref<T> prev_leaf = find_leaf_node(result, last_leaf_node_index);
+
+					//	Copy existing values.
+					node_ref<T> new_leaf_node = make_leaf_node<T>(prev_leaf.get_leaf_node()->get_values(), last_leaf_size);
+
+					//	Append our new values.
+					new_leaf_node.get_leaf_node()->push_values(&values[source_pos], copy_count);
+
+					node_ref<T> new_root = replace_leaf_node(result.get_root(), result.get_shift(), last_leaf_node_index, new_leaf_node);
+					result = vector<T>(new_root, result.size() + copy_count, result.get_shift());
+					source_pos += copy_count;
+
+#endif
+				}
+			}
+
+			/*
+				2) Append _entire leaf nodes_ while there are enough source values. The last leaf node - full or
+				partial - becomes the new tail.
+			*/
+			while(source_pos < count){
+				if(result.get_tail_size() > 0){
+					result = push_tail_into_tree(result);
+				}
+				STEADY_ASSERT(result.is_relaxed() || (result.size() & branching_factor<T>::MASK) == 0);
+
+				const size_t batch_count = std::min(count - source_pos, static_cast<std::size_t>(branching_factor<T>::FACTOR));
+				auto new_leaf_node = make_leaf_node<T>(&values[source_pos], batch_count);
+
+				result = vector<T>(result.get_root(), result.size() + batch_count, result.get_shift(), new_leaf_node, batch_count);
+				source_pos += batch_count;
+			}
+
+			STEADY_ASSERT(result.check_invariant());
+			STEADY_ASSERT(result.size() == original.size() + count);
+			return result;
+		}
+#endif
+
+
+		/*
+			Makes a new vector from values added in order, bottom-up. Leaf nodes are filled one at a time, each inode
+			is made once when it has all its children: no inodes are path-copied. The last leaf node becomes the tail.
+			Extra memory is one level of children per level in the tree.
+		*/
+		template <class T>
+		class tree_builder {
+			public: tree_builder() :
+				_size(0)
+			{
+			}
+
+			public: template <class U> void push_back(U&& value){
+				start_leaf();
+				_leaf.get_leaf_node()->push_value(std::forward<U>(value));
+				_size++;
+			}
+
+			public: void push_back(const T values[], size_t count){
+				size_t pos = 0;
+				while(pos < count){
+					start_leaf();
+					auto& leaf = *_leaf.get_leaf_node();
+					const size_t copy_count = std::min(count - pos, branching_factor<T>::FACTOR - leaf.get_count());
+					leaf.push_values(&values[pos], copy_count);
+					pos += copy_count;
+					_size += copy_count;
+				}
+			}
+
+			public: vector<T> build(){
+				const size_t tail_size = _leaf.get_type() == node_type::null_node ? 0 : _leaf.get_leaf_node()->get_count();
+
+				//	Make inodes of the partial levels, from the bottom up. The top level must have only one node.
+				node_ref<T> root;
+				int shift = branching_factor<T>::EMPTY_TREE_SHIFT;
+				for(size_t level = 0 ; level < _levels.size() ; level++){
+					auto& children = _levels[level];
+					if(level + 1 == _levels.size() && children._count == 1){
+						root = std::move(children._children[0]);
+						shift = int(level) * branching_factor<T>::SHIFT;
+					}
+					else if(children._count > 0){
+						//	add_node() can grow _levels, which moves _children_.
+						node_ref<T> node(new inode<T>(std::move(children._children)));
+						children._count = 0;
+						add_node(std::move(node), level + 1);
+					}
+				}
+
+				vector<T> result(std::move(root), _size, shift, std::move(_leaf), tail_size);
+				_levels.clear();
+				_size = 0;
+
+				STEADY_ASSERT(result.check_invariant());
+				return result;
+			}
+
+			//	Makes sure there is a leaf node with room for a value. A full leaf node is added to the tree.
+			private: void start_leaf(){
+				if(_leaf.get_type() == node_type::null_node){
+					_leaf = node_ref<T>(new leaf_node<T>());
+				}
+				else if(_leaf.get_leaf_node()->get_count() == branching_factor<T>::FACTOR){
+					add_node(std::move(_leaf), 0);
+					_leaf = node_ref<T>(new leaf_node<T>());
+				}
+			}
+
+			//	Level 0 holds leaf nodes. A full level becomes an inode at the level above.
+			private: void add_node(node_ref<T>&& node, size_t level){
+				if(level == _levels.size()){
+					_levels.push_back(level_t());
+				}
+				auto& children = _levels[level];
+				children._children[children._count] = std::move(node);
+				children._count++;
+				if(children._count == branching_factor<T>::FACTOR){
+					node_ref<T> full(new inode<T>(std::move(children._children)));
+					children._count = 0;
+					add_node(std::move(full), level + 1);
+				}
+			}
+
+
+			////////////////	State
+			private: struct level_t {
+				level_t() :
+					_count(0)
+				{
+				}
+
+				typename inode<T>::children_t _children;
+				size_t _count;
+			};
+
+			private: std::vector<level_t> _levels;
+			private: node_ref<T> _leaf;
+			private: size_t _size;
+		};
+
+
+
+		////////////////////////////////////////////		RRB-trees
+
+		/*
+			Relaxed radix balanced trees, see "RRB-Trees: Efficient Immutable Vectors" by Bagwell and Rompf and
+			"Improving RRB-Tree Performance through Transience" by L'orange.
+
+			Concatenation and slicing make trees where leaf nodes and inodes are not full. These trees use relaxed
+			inodes. Strict subtrees are kept strict when possible, so the trees stay fast to index.
+		*/
+
+
+		/*
+			Adds the leaf node last in the tree _node_. Returns the new tree or a null node if there is no room for the
+			leaf node without making the tree higher.
+
+			node: inode at level _shift_. Can be strict or relaxed.
+		*/
+		template <class T>
+		node_ref<T> append_leaf_relaxed(const sized_node<T>& node, int shift, const sized_node<T>& leaf){
+			STEADY_ASSERT(node._node.get_type() == node_type::inode);
+			STEADY_ASSERT(leaf._node.get_type() == node_type::leaf_node);
+
+			//	A strict tree without a partial leaf node stays strict.
+			if(!is_relaxed(node._node) && (node._size & branching_factor<T>::MASK) == 0){
+				if(node._size < shift_to_max_size<T>(shift)){
+					return append_leaf_node(node._node, shift, node._size, leaf._node);
+				}
+				else{
+					return node_ref<T>();
+				}
+			}
+
+			auto children = get_sized_children(node, shift);
+			if(shift > branching_factor<T>::LOWEST_LEVEL_INODE_SHIFT){
+				const auto last = append_leaf_relaxed(children.back(), shift - branching_factor<T>::SHIFT, leaf);
+				if(last.get_type() != node_type::null_node){
+					children.back() = sized_node<T>{ last, children.back()._size + leaf._size };
+					return make_inode_from_sized(&children[0], &children[0] + children.size(), shift)._node;
+				}
+			}
+			if(children.size() < branching_factor<T>::FACTOR){
+				children.push_back(sized_node<T>{ make_new_path(shift - branching_factor<T>::SHIFT, leaf._node), leaf._size });
+				return make_inode_from_sized(&children[0], &children[0] + children.size(), shift)._node;
+			}
+			return node_ref<T>();
+		}
+
+		/*
+			Adds the leaf node last in the tree _root_, which can be empty, strict or relaxed. Returns the new root and
+			updates _shift_: the tree can get one level higher.
+		*/
+		template <class T>
+		node_ref<T> push_leaf_relaxed(const sized_node<T>& root, int& shift, const sized_node<T>& leaf){
+			STEADY_ASSERT(leaf._node.get_type() == node_type::leaf_node);
+
+			if(root._size == 0){
+				shift = LEAF_NODE_SHIFT;
+				return leaf._node;
+			}
+			if(shift > LEAF_NODE_SHIFT){
+				const auto result = append_leaf_relaxed(root, shift, leaf);
+				if(result.get_type() != node_type::null_node){
+					return result;
+				}
+			}
+
+			const sized_node<T> children[] = { root, sized_node<T>{ make_new_path(shift, leaf._node), leaf._size } };
+			shift += branching_factor<T>::SHIFT;
+			return make_inode_from_sized(&children[0], &children[2], shift)._node;
+		}
+
+		/*
+			Keeps the first _new_size_ values of the tree and drops the rest. _new_size_ must be where a leaf node starts.
+			Only the right edge of the tree is copied. The result is at the same level and can have just one child.
+		*/
+		template <class T>
+		node_ref<T> trim_right(const sized_node<T>& node, int shift, size_t new_size){
+			STEADY_ASSERT(new_size > 0 && new_size <= node._size);
+
+			if(new_size == node._size){
+				return node._node;
+			}
+
+			STEADY_ASSERT(shift > LEAF_NODE_SHIFT);
+			if(!is_relaxed(node._node)){
+				return trim_tree(node._node, shift, new_size);
+			}
+
+			auto children = get_sized_children(node, shift);
+			size_t index = new_size - 1;
+			const size_t slot = find_child(*node._node.get_inode(), shift, index);
+			children[slot] = sized_node<T>{ trim_right(children[slot], shift - branching_factor<T>::SHIFT, index + 1), index + 1 };
+			return make_inode_from_sized(&children[0], &children[0] + slot + 1, shift)._node;
+		}
+
+		/*
+			Drops the first _begin_ values of the tree. Only the left edge of the tree is copied. The result is at the same
+			level and can have just one child.
+		*/
+		template <class T>
+		node_ref<T> trim_left(const sized_node<T>& node, int shift, size_t begin){
+			STEADY_ASSERT(begin < node._size);
+
+			if(begin == 0){
+				return node._node;
+			}
+			else if(shift == LEAF_NODE_SHIFT){
+				const auto values = node._node.get_leaf_node()->get_values();
+				return make_leaf_node<T>(values + begin, node._size - begin);
+			}
+			else{
+				auto children = get_sized_children(node, shift);
+				size_t index = begin;
+				const size_t slot = find_child(*node._node.get_inode(), shift, index);
+				children[slot] = sized_node<T>{ trim_left(children[slot], shift - branching_factor<T>::SHIFT, index), children[slot]._size - index };
+				return make_inode_from_sized(&children[slot], &children[0] + children.size(), shift)._node;
+			}
+		}
+
+
+		//	Concatenation allows this many more nodes than the optimal number, on each level of the seam.
+		static const size_t RRB_EXTRAS = 2;
+
+		//	Nodes with fewer than FACTOR - RRB_INVARIANT slots used are merged into the nodes after them.
+		static const size_t RRB_INVARIANT = 1;
+
+		//	Values in a leaf node or children in an inode.
+		template <class T>
+		size_t count_slots(const sized_node<T>& node){
+			return node._node.get_type() == node_type::leaf_node ? node._size : node._node.get_inode()->count_children();
+		}
+
+		/*
+			Moves the contents of the nodes in _all_, which are siblings at level _shift_, so there are at most
+			RRB_EXTRAS more nodes than needed. This is the concatenation plan from the papers: full nodes are skipped
+			and the first underfull node is spread out over the nodes after it, until one node has become empty.
+			Nodes that are left as they were are shared, not copied.
+		*/
+		template <class T>
+		std::vector<sized_node<T>> rebalance(const std::vector<sized_node<T>>& all, int shift){
+			std::vector<size_t> plan;
+			size_t total_slots = 0;
+			for(const auto& i: all){
+				plan.push_back(count_slots(i));
+				total_slots += plan.back();
+			}
+
+			const size_t optimal = divide_round_up(total_slots, branching_factor<T>::FACTOR);
+			if(plan.size() <= optimal + RRB_EXTRAS){
+				return all;
+			}
+
+			size_t i = 0;
+			while(plan.size() > optimal + RRB_EXTRAS){
+				while(plan[i] > branching_factor<T>::FACTOR - RRB_INVARIANT){
+					i++;
+				}
+
+				size_t remaining = plan[i];
+				do {
+					STEADY_ASSERT(i + 1 < plan.size());
+					const size_t new_count = std::min(remaining + plan[i + 1], static_cast<size_t>(branching_factor<T>::FACTOR));
+					remaining = remaining + plan[i + 1] - new_count;
+					plan[i] = new_count;
+					i++;
+				} while(remaining > 0);
+
+				plan.erase(plan.begin() + i);
+				i--;
+			}
+
+			//	Execute the plan.
+			std::vector<sized_node<T>> result;
+			size_t source = 0;
+			size_t offset = 0;
+			for(const auto new_count: plan){
+				if(offset == 0 && count_slots(all[source]) == new_count){
+					result.push_back(all[source]);
+					source++;
+				}
+				else if(shift == LEAF_NODE_SHIFT){
+					auto leaf = node_ref<T>(new leaf_node<T>());
+					size_t pos = 0;
+					while(pos < new_count){
+						const auto& from = all[source];
+						const size_t copy_count = std::min(from._size - offset, new_count - pos);
+						leaf.get_leaf_node()->push_values(from._node.get_leaf_node()->get_values() + offset, copy_count);
+						pos += copy_count;
+						offset += copy_count;
+						if(offset == from._size){
+							source++;
+							offset = 0;
+						}
+					}
+					result.push_back(sized_node<T>{ leaf, new_count });
+				}
+				else{
+					std::vector<sized_node<T>> children;
+					while(children.size() < new_count){
+						const auto from = get_sized_children(all[source], shift);
+						const size_t copy_count = std::min(from.size() - offset, new_count - children.size());
+						children.insert(children.end(), from.begin() + offset, from.begin() + offset + copy_count);
+						offset += copy_count;
+						if(offset == from.size()){
+							source++;
+							offset = 0;
+						}
+					}
+					result.push_back(make_inode_from_sized(&children[0], &children[0] + children.size(), shift));
+				}
+			}
+			STEADY_ASSERT(source == all.size());
+			return result;
+		}
+
+		/*
+			Concatenates two trees. Returns one or two nodes at the level of the higher tree.
+			Only the nodes along the seam between the trees are merged and rebalanced - everything else is shared.
+		*/
+		template <class T>
+		std::vector<sized_node<T>> concat_nodes(const sized_node<T>& left, int left_shift, const sized_node<T>& right, int right_shift){
+			if(left_shift == LEAF_NODE_SHIFT && right_shift == LEAF_NODE_SHIFT){
+				return { left, right };
+			}
+
+			const int shift = std::max(left_shift, right_shift);
+			std::vector<sized_node<T>> all;
+			if(left_shift > right_shift){
+				const auto left_children = get_sized_children(left, left_shift);
+				const auto middle = concat_nodes(left_children.back(), left_shift - branching_factor<T>::SHIFT, right, right_shift);
+				all.insert(all.end(), left_children.begin(), left_children.end() - 1);
+				all.insert(all.end(), middle.begin(), middle.end());
+			}
+			else if(left_shift < right_shift){
+				const auto right_children = get_sized_children(right, right_shift);
+				const auto middle = concat_nodes(left, left_shift, right_children.front(), right_shift - branching_factor<T>::SHIFT);
+				all.insert(all.end(), middle.begin(), middle.end());
+				all.insert(all.end(), right_children.begin() + 1, right_children.end());
+			}
+			else{
+				const auto left_children = get_sized_children(left, left_shift);
+				const auto right_children = get_sized_children(right, right_shift);
+				const auto middle = concat_nodes(left_children.back(), shift - branching_factor<T>::SHIFT, right_children.front(), shift - branching_factor<T>::SHIFT);
+				all.insert(all.end(), left_children.begin(), left_children.end() - 1);
+				all.insert(all.end(), middle.begin(), middle.end());
+				all.insert(all.end(), right_children.begin() + 1, right_children.end());
+			}
+
+			all = rebalance(all, shift - branching_factor<T>::SHIFT);
+
+			std::vector<sized_node<T>> result;
+			for(size_t i = 0 ; i < all.size() ; i += branching_factor<T>::FACTOR){
+				const size_t end = std::min(all.size(), i + branching_factor<T>::FACTOR);
+				result.push_back(make_inode_from_sized(&all[i], &all[0] + end, shift));
+			}
+			STEADY_ASSERT(result.size() <= 2);
+			return result;
+		}
+
+		/*
+			Concatenates two non-empty trees. Returns the new root and sets _shift_ to its level.
+		*/
+		template <class T>
+		node_ref<T> concat_trees(const sized_node<T>& left, int left_shift, const sized_node<T>& right, int right_shift, int& shift){
+			STEADY_ASSERT(left._size > 0 && right._size > 0);
+
+			const auto nodes = concat_nodes(left, left_shift, right, right_shift);
+			shift = std::max(left_shift, right_shift);
+			if(nodes.size() == 1){
+				return nodes[0]._node;
+			}
+			else{
+				shift += branching_factor<T>::SHIFT;
+				return make_inode_from_sized(&nodes[0], &nodes[0] + nodes.size(), shift)._node;
+			}
+		}
+
+		/*
+			Makes a vector from a tree and a tail after concatenation or slicing - the tree can be relaxed and higher
+			than needed. Root inodes with only one child are removed.
+			A tree that isn't relaxed cannot end with a partial leaf node when there is a tail: then the tail is added to
+			the tree instead.
+		*/
+		template <class T>
+		vector<T> make_vector(node_ref<T> root, int shift, size_t tree_size, const node_ref<T>& tail, size_t tail_size){
+			if(tree_size == 0){
+				return vector<T>(node_ref<T>(), tail_size, branching_factor<T>::EMPTY_TREE_SHIFT, tail, tail_size);
+			}
+
+			while(shift > LEAF_NODE_SHIFT && root.get_inode()->count_children() == 1){
+				root = root.get_inode()->get_child(0);
+				shift -= branching_factor<T>::SHIFT;
+			}
+
+			if(tail_size > 0 && !is_relaxed(root) && (tree_size & branching_factor<T>::MASK) != 0){
+				root = push_leaf_relaxed(sized_node<T>{ root, tree_size }, shift, sized_node<T>{ tail, tail_size });
+				return vector<T>(root, tree_size + tail_size, shift, node_ref<T>(), 0);
+			}
+			return vector<T>(root, tree_size + tail_size, shift, tail, tail_size);
+		}
+
+		/*
+			Calls f(values, count) for each leaf node in the tree of _size_ values, in order. Walks the children in
+			place: no allocations and no reference counting.
+		*/
+		template <class T, class F>
+		void for_each_leaf_node(const node_ref<T>& node, size_t size, int shift, F& f){
+			if(shift == LEAF_NODE_SHIFT){
+				f(node.get_leaf_node()->get_values(), size);
+			}
+			else{
+				const auto& n = *node.get_inode();
+				const auto count = n.count_children();
+				for(size_t i = 0 ; i < count ; i++){
+					for_each_leaf_node(n.get_child(i), get_child_size(n, shift, size, i), shift - branching_factor<T>::SHIFT, f);
+				}
+			}
+		}
+
+		template <class T, class F>
+		void for_each_leaf_node(const sized_node<T>& node, int shift, F& f){
+			for_each_leaf_node(node._node, node._size, shift, f);
+		}
+
+		/*
+			Calls f(values, count) for each block of values in _v_, in order: the leaf nodes of the tree, then the tail.
+			Works for relaxed vectors too.
+		*/
+		template <class T, class F>
+		void for_each_block(const vector<T>& v, F& f){
+			if(v.get_tail_offset() > 0){
+				for_each_leaf_node(v.get_root(), v.get_tail_offset(), v.get_shift(), f);
+			}
+			if(v.get_tail_size() > 0){
+				f(v.get_tail().get_leaf_node()->get_values(), v.get_tail_size());
+			}
+		}
+
+
+		/*
+			Walks down the tree of a vector, then the tail, as a stack of nodes. The top of the stack is the current
+			node. No refcounts are changed: the vector must outlive the cursor.
+		*/
+		template <class T>
+		struct tree_cursor {
+			public: struct frame {
+				const node_ref<T>* _node;
+				int _shift;
+				size_t _begin;
+				size_t _size;
+			};
+
+			public: tree_cursor(const vector<T>& vec) :
+				_vector(vec),
+				_depth(0)
+			{
+				if(vec.get_tail_offset() > 0){
+					push(&vec.get_root(), vec.get_shift(), 0, vec.get_tail_offset());
+				}
+			}
+
+			public: const frame& top() const{
+				STEADY_ASSERT(_depth > 0);
+				return _stack[_depth - 1];
+			}
+
+			public: bool is_leaf() const{
+				return top()._shift == LEAF_NODE_SHIFT;
+			}
+
+			//	Pops nodes until the top node holds _index_. It may start before _index_.
+			public: void seek(size_t index){
+				STEADY_ASSERT(index < _vector.size());
+
+				while(_depth > 0 && top()._begin + top()._size <= index){
+					_depth--;
+				}
+				if(_depth == 0){
+					STEADY_ASSERT(index >= _vector.get_tail_offset());
+					push(&_vector.get_tail(), LEAF_NODE_SHIFT, _vector.get_tail_offset(), _vector.get_tail_size());
+				}
+			}
+
+			//	Pushes the child of the top inode that holds _index_.
+			public: void descend(size_t index){
+				STEADY_ASSERT(!is_leaf());
+
+				const frame parent = top();
+				const auto& node = *parent._node->get_inode();
+				size_t rest = index - parent._begin;
+				const size_t slot = find_child(node, parent._shift, rest);
+				push(
+					&node.get_child(slot),
+					parent._shift - branching_factor<T>::SHIFT,
+					index - rest,
+					get_child_size(node, parent._shift, parent._size, slot)
+				);
+			}
+
+			private: void push(const node_ref<T>* node, int shift, size_t begin, size_t size){
+				STEADY_ASSERT(_depth < MAX_DEPTH);
+				_stack[_depth++] = frame{ node, shift, begin, size };
+			}
+
+
+			////////////////	State
+			private: static const size_t MAX_DEPTH = (sizeof(size_t) * 8) / branching_factor<T>::SHIFT + 2;
+			private: const vector<T>& _vector;
+			private: frame _stack[MAX_DEPTH];
+			private: size_t _depth;
+		};
+
+		////////////////////////////////////////////		worker_pool
+
+		/*
+			Threads that run jobs for the parallel algorithms. A job is _count_ tasks numbered 0 - count. The thread that
+			starts a job works on it too, so a job always finishes, even if all workers are busy with other jobs.
+		*/
+		class worker_pool {
+			private: struct job {
+				job(size_t count, const std::function<void(size_t)>& f) :
+					_count(count),
+					_f(f),
+					_next(0),
+					_done(0)
+				{
+				}
+
+				const size_t _count;
+				const std::function<void(size_t)> _f;
+				std::atomic<size_t> _next;
+				size_t _done;
+				std::exception_ptr _exception;
+				std::mutex _mutex;
+				std::condition_variable _finished;
+			};
+
+			public: static worker_pool& get(){
+				static worker_pool pool(std::max<size_t>(std::thread::hardware_concurrency(), 1) - 1);
+				return pool;
+			}
+
+			public: explicit worker_pool(size_t worker_count) :
+				_stop(false)
+			{
+				for(size_t i = 0 ; i < worker_count ; i++){
+					_threads.push_back(std::thread([this](){ work(); }));
+				}
+			}
+
+			public: ~worker_pool(){
+				{
+					std::lock_guard<std::mutex> lock(_mutex);
+					_stop = true;
+				}
+				_wakeup.notify_all();
+				for(auto& thread: _threads){
+					thread.join();
+				}
+			}
+
+			//	Worker threads + the calling thread.
+			public: size_t get_thread_count() const{
+				return _threads.size() + 1;
+			}
+
+			//	Calls f(0) ... f(count - 1) on any threads and returns when all calls have returned.
+			public: void run(size_t count, const std::function<void(size_t)>& f){
+				if(count <= 1 || _threads.empty()){
+					for(size_t i = 0 ; i < count ; i++){
+						f(i);
+					}
+					return;
+				}
+
+				auto j = std::make_shared<job>(count, f);
+				{
+					std::lock_guard<std::mutex> lock(_mutex);
+					_jobs.push_back(j);
+				}
+				_wakeup.notify_all();
+
+				run_tasks(*j);
+
+				std::unique_lock<std::mutex> lock(j->_mutex);
+				j->_finished.wait(lock, [&j](){ return j->_done == j->_count; });
+				if(j->_exception){
+					std::rethrow_exception(j->_exception);
+				}
+			}
+
+			private: static void run_tasks(job& j){
+				while(true){
+					const size_t task = j._next++;
+					if(task >= j._count){
+						return;
+					}
+
+					std::exception_ptr exception;
+					try {
+						j._f(task);
+					}
+					catch(...){
+						exception = std::current_exception();
+					}
+
+					std::lock_guard<std::mutex> lock(j._mutex);
+					if(exception && !j._exception){
+						j._exception = exception;
+					}
+					j._done++;
+					if(j._done == j._count){
+						j._finished.notify_all();
+					}
+				}
+			}
+
+			private: void work(){
+				while(true){
+					std::shared_ptr<job> j;
+					{
+						std::unique_lock<std::mutex> lock(_mutex);
+						while(true){
+							while(!_jobs.empty() && _jobs.front()->_next >= _jobs.front()->_count){
+								_jobs.pop_front();
+							}
+							if(_stop){
+								return;
+							}
+							if(!_jobs.empty()){
+								break;
+							}
+							_wakeup.wait(lock);
+						}
+						j = _jobs.front();
+					}
+					run_tasks(*j);
+				}
+			}
+
+
+			////////////////	State
+			private: std::mutex _mutex;
+			private: std::condition_variable _wakeup;
+			private: std::deque<std::shared_ptr<job>> _jobs;
+			private: bool _stop;
+			private: std::vector<std::thread> _threads;
+		};
+
+
+		//	A subtree of a vector, for processing by one thread. _begin_ is the index of its first value.
+		template <class T>
+		struct parallel_chunk {
+			sized_node<T> _node;
+			int _shift;
+			size_t _begin;
+		};
+
+		//	Appends the subtrees of _node_ that are at level _chunk_shift_ to _chunks_, in order.
+		template <class T>
+		void collect_chunks(const sized_node<T>& node, int shift, int chunk_shift, size_t begin, std::vector<parallel_chunk<T>>& chunks){
+			if(shift == chunk_shift){
+				chunks.push_back(parallel_chunk<T>{ node, shift, begin });
+			}
+			else{
+				const auto& n = *node._node.get_inode();
+				const auto count = n.count_children();
+				size_t child_begin = begin;
+				for(size_t i = 0 ; i < count ; i++){
+					const sized_node<T> child{ n.get_child(i), get_child_size(n, shift, node._size, i) };
+					collect_chunks(child, shift - branching_factor<T>::SHIFT, chunk_shift, child_begin, chunks);
+					child_begin += child._size;
+				}
+			}
+		}
+
+		/*
+			Returns the level in the tree of _vec_ to split it at: high enough to give a few chunks per thread, but no
+			more, so each thread gets big subtrees.
+		*/
+		template <class T>
+		int get_chunk_shift(const vector<T>& vec){
+			const size_t wanted = worker_pool::get().get_thread_count() * 4;
+			int shift = vec.get_shift();
+			size_t count = 1;
+			while(shift > LEAF_NODE_SHIFT && count < wanted){
+				shift -= branching_factor<T>::SHIFT;
+				count *= branching_factor<T>::FACTOR;
+			}
+			return shift;
+		}
+
+		//	Splits the vector into subtrees at level _chunk_shift_. The tail is the last chunk.
+		template <class T>
+		std::vector<parallel_chunk<T>> split_vector(const vector<T>& vec, int chunk_shift){
+			std::vector<parallel_chunk<T>> result;
+			if(vec.get_tail_offset() > 0){
+				collect_chunks(sized_node<T>{ vec.get_root(), vec.get_tail_offset() }, vec.get_shift(), chunk_shift, 0, result);
+			}
+			if(vec.get_tail_size() > 0){
+				result.push_back(parallel_chunk<T>{ sized_node<T>{ vec.get_tail(), vec.get_tail_size() }, LEAF_NODE_SHIFT, vec.get_tail_offset() });
+			}
+			return result;
+		}
+
+		//	Returns a tree with the same shape as _node_ that holds f(value) for each value.
+		template <class U, class T, class F>
+		sized_node<U> transform_tree(const sized_node<T>& node, int shift, F& f){
+			if(shift == LEAF_NODE_SHIFT){
+				const T* values = node._node.get_leaf_node()->get_values();
+				node_ref<U> result(new leaf_node<U>());
+				for(size_t i = 0 ; i < node._size ; i++){
+					result.get_leaf_node()->push_value(f(values[i]));
+				}
+				return sized_node<U>{ result, node._size };
+			}
+			else{
+				std::vector<sized_node<U>> children;
+				for(const auto& child: get_sized_children(node, shift)){
+					children.push_back(transform_tree<U>(child, shift - branching_factor<T>::SHIFT, f));
+				}
+				return make_inode_from_sized(&children[0], &children[0] + children.size(), shift);
+			}
+		}
+
+		//	Makes the inodes above level _chunk_shift_, with the same shape as _node_, from already transformed chunks.
+		template <class U, class T>
+		sized_node<U> join_chunks(const sized_node<T>& node, int shift, int chunk_shift, const sized_node<U> chunks[], size_t& next){
+			if(shift == chunk_shift){
+				return chunks[next++];
+			}
+			else{
+				std::vector<sized_node<U>> children;
+				for(const auto& child: get_sized_children(node, shift)){
+					children.push_back(join_chunks(child, shift - branching_factor<T>::SHIFT, chunk_shift, chunks, next));
+				}
+				return make_inode_from_sized(&children[0], &children[0] + children.size(), shift);
+			}
+		}
+
+
+		/*
+			Returns a tree with f(value) for each value in _node_. Subtrees where f doesn't change any value are
+			returned as is. The tree keeps its shape: the same nodes are strict or relaxed.
+		*/
+		template <class T, class F>
+		node_ref<T> map_tree_preserving(const sized_node<T>& node, int shift, F& f){
+			if(shift == LEAF_NODE_SHIFT){
+				const T* values = node._node.get_leaf_node()->get_values();
+				for(size_t i = 0 ; i < node._size ; i++){
+					T value = f(values[i]);
+					if(!(value == values[i])){
+						node_ref<T> result(new leaf_node<T>());
+						auto& leaf = *result.get_leaf_node();
+						leaf.push_values(values, i);
+						leaf.push_value(std::move(value));
+						for(size_t j = i + 1 ; j < node._size ; j++){
+							leaf.push_value(f(values[j]));
+						}
+						return result;
+					}
+				}
+				return node._node;
+			}
+			else{
+				auto children = get_sized_children(node, shift);
+				bool changed = false;
+				for(auto& child: children){
+					auto mapped = map_tree_preserving(child, shift - branching_factor<T>::SHIFT, f);
+					if(!mapped.same_node(child._node)){
+						child._node = std::move(mapped);
+						changed = true;
+					}
+				}
+				return changed ? make_inode_from_sized(&children[0], &children[0] + children.size(), shift)._node : node._node;
+			}
+		}
+
+
+		////////////////////////////////////////////		Hashing
+
+		/*
+			The hash of values v0 ... vn-1 is h(v0) * P^(n-1) + h(v1) * P^(n-2) + ... + h(vn-1), modulo 2^64.
+			The hash of a run of values can then be made from the hashes of its parts:
+
+				hash(a + b) = hash(a) * P^size(b) + hash(b)
+
+			so a vector has the same hash whatever the shape of its tree, and each node's hash can be cached.
+		*/
+		static const std::uint64_t HASH_MULTIPLIER = 0x9e3779b97f4a7c15ULL;
+
+		inline std::uint64_t hash_power(std::uint64_t exponent){
+			std::uint64_t result = 1;
+			std::uint64_t base = HASH_MULTIPLIER;
+			while(exponent > 0){
+				if(exponent & 1){
+					result *= base;
+				}
+				base *= base;
+				exponent >>= 1;
+			}
+			return result;
+		}
+
+		//	std::hash<int> is often the value itself: mix the bits so each bit affects the whole hash.
+		template <class T>
+		std::uint64_t hash_value(const T& value){
+			std::uint64_t h = std::hash<T>()(value);
+			h ^= h >> 30;
+			h *= 0xbf58476d1ce4e5b9ULL;
+			h ^= h >> 27;
+			h *= 0x94d049bb133111ebULL;
+			h ^= h >> 31;
+			return h;
+		}
+
+		template <class T>
+		std::uint64_t hash_values(const T values[], size_t count){
+			std::uint64_t result = 0;
+			for(size_t i = 0 ; i < count ; i++){
+				result = result * HASH_MULTIPLIER + hash_value(values[i]);
+			}
+			return result;
+		}
+
+		/*
+			Returns the number of values _node_ holds when it is not the end of a truncated vector. This is the size the
+			cached hash of a node is for.
+		*/
+		template <class T>
+		size_t get_natural_size(const node_ref<T>& node, int shift){
+			if(shift == LEAF_NODE_SHIFT){
+				return node.get_leaf_node()->get_count();
+			}
+			const auto& n = *node.get_inode();
+			const size_t count = n.count_children();
+			if(n.is_relaxed()){
+				return (*n._sizes)[count - 1];
+			}
+			return ((count - 1) << shift) + get_natural_size(n.get_child(count - 1), shift - branching_factor<T>::SHIFT);
+		}
+
+		/*
+			Returns the hash of the first _size_ values of the tree. Stores the hashes of nodes if possible. Walks the
+			children in place.
+		*/
+		template <class T>
+		std::uint64_t hash_tree(const node_ref<T>& node, size_t size, int shift){
+			const bool natural = node_hash_policy<T>::type::CACHED && size == get_natural_size(node, shift);
+
+			std::uint64_t result = 0;
+			if(shift == LEAF_NODE_SHIFT){
+				auto& leaf = *node.get_leaf_node();
+				if(natural && leaf.get_cached_hash(result)){
+					return result;
+				}
+				result = hash_values(leaf.get_values(), size);
+				if(natural){
+					leaf.set_cached_hash(result);
+				}
+			}
+			else{
+				auto& n = *node.get_inode();
+				if(natural && n.get_cached_hash(result)){
+					return result;
+				}
+				const auto count = n.count_children();
+				for(size_t i = 0 ; i < count ; i++){
+					const auto child_size = get_child_size(n, shift, size, i);
+					result = result * hash_power(child_size) + hash_tree(n.get_child(i), child_size, shift - branching_factor<T>::SHIFT);
+				}
+				if(natural){
+					n.set_cached_hash(result);
+				}
+			}
+			return result;
+		}
+
+		template <class T>
+		std::uint64_t hash_vector(const vector<T>& vec){
+			std::uint64_t result = 0;
+			if(vec.get_tail_offset() > 0){
+				result = hash_tree(vec.get_root(), vec.get_tail_offset(), vec.get_shift());
+			}
+			if(vec.get_tail_size() > 0){
+				result = result * hash_power(vec.get_tail_size())
+					+ hash_tree(vec.get_tail(), vec.get_tail_size(), LEAF_NODE_SHIFT);
+			}
+			return result;
+		}
+
+		//	Gets the hash of _vec_ only if it can be made from cached hashes of the root and the tail.
+		template <class T>
+		bool get_cached_vector_hash(const vector<T>& vec, std::uint64_t& hash){
+			if(!node_hash_policy<T>::type::CACHED){
+				return false;
+			}
+
+			std::uint64_t root_hash = 0;
+			if(vec.get_tail_offset() > 0){
+				const auto& root = vec.get_root();
+				const size_t natural_size = get_natural_size(root, vec.get_shift());
+				const bool cached = vec.get_shift() == LEAF_NODE_SHIFT
+					? natural_size == vec.get_tail_offset() && root.get_leaf_node()->get_cached_hash(root_hash)
+					: natural_size == vec.get_tail_offset() && root.get_inode()->get_cached_hash(root_hash);
+				if(!cached){
+					return false;
+				}
+			}
+
+			std::uint64_t tail_hash = 0;
+			if(vec.get_tail_size() > 0){
+				const auto& tail = *vec.get_tail().get_leaf_node();
+				if(tail.get_count() != vec.get_tail_size() || !tail.get_cached_hash(tail_hash)){
+					return false;
+				}
+			}
+
+			hash = root_hash * hash_power(vec.get_tail_size()) + tail_hash;
+			return true;
+		}
+
+
+		/*
+			Calls f(values_a, values_b, index, count) for each run of values [index, index + count) that _a_ and _b_
+			don't share, in order, until f returns false. Subtrees that both vectors share at the same index are
+			skipped without looking at their values. This works even when the leaf nodes of relaxed trees don't line up.
+
+			Only the first _size_ values are compared. Returns false if f stopped the walk.
+		*/
+		template <class T, class F>
+		bool compare_trees(const vector<T>& a, const vector<T>& b, size_t size, F& f){
+			STEADY_ASSERT(size <= a.size() && size <= b.size());
+
+			tree_cursor<T> cursor_a(a);
+			tree_cursor<T> cursor_b(b);
+			size_t index = 0;
+			while(index < size){
+				cursor_a.seek(index);
+				cursor_b.seek(index);
+				const auto frame_a = cursor_a.top();
+				const auto frame_b = cursor_b.top();
+
+				if(frame_a._begin == index && frame_b._begin == index && frame_a._size == frame_b._size
+					&& frame_a._node->same_node(*frame_b._node))
+				{
+					index += frame_a._size;
+				}
+				else if(cursor_a.is_leaf() && cursor_b.is_leaf()){
+					const size_t end = std::min(size, std::min(frame_a._begin + frame_a._size, frame_b._begin + frame_b._size));
+					const T* values_a = frame_a._node->get_leaf_node()->get_values() + (index - frame_a._begin);
+					const T* values_b = frame_b._node->get_leaf_node()->get_values() + (index - frame_b._begin);
+					if(!f(values_a, values_b, index, end - index)){
+						return false;
+					}
+					index = end;
+				}
+				else{
+					//	Go down the bigger node, or both if same size: their children may be shared.
+					if(!cursor_a.is_leaf() && (cursor_b.is_leaf() || frame_a._size >= frame_b._size)){
+						cursor_a.descend(index);
+					}
+					if(!cursor_b.is_leaf() && (cursor_a.is_leaf() || frame_b._size >= frame_a._size)){
+						cursor_b.descend(index);
+					}
+				}
+			}
+			return true;
+		}
+
+
+
+
+		////////////////////////////////////////////		node_ref<T>
+
+		/*
+			Safe, reference counted handle that holds either an inode, a LeadNode or null.
+
+			Stored as one tagged pointer: the lowest bit is set for leaf nodes. Nodes are at least 4-byte aligned.
+		*/
+
+		template <typename T>
+		node_ref<T>::node_ref() :
+			_ptr(0)
+		{
+			STEADY_ASSERT(check_invariant());
+		}
+
+		/*
+			Will assume ownership of the input node - caller must not delete it after call returns.
+			Adds ref.
+			node == nullptr => null_node
+		*/
+		template <typename T>
+		node_ref<T>::node_ref(inode<T>* node) :
+			_ptr(0)
+		{
+			if(node != nullptr){
+				STEADY_ASSERT(node->check_invariant());
+				STEADY_ASSERT(node->_rc.get() >= 0);
+				STEADY_ASSERT((reinterpret_cast<std::uintptr_t>(node) & LEAF_NODE_TAG) == 0);
+
+				_ptr = reinterpret_cast<std::uintptr_t>(node);
+				node->_rc.inc();
+			}
+
+			STEADY_ASSERT(check_invariant());
+		}
+
+		/*
+			Will assume ownership of the input node - caller must not delete it after call returns.
+			Adds ref.
+			node == nullptr => null_node
+		*/
+		template <typename T>
+		node_ref<T>::node_ref(leaf_node<T>* node) :
+			_ptr(0)
+		{
+			static_assert(alignof(leaf_node<T>) > LEAF_NODE_TAG, "leaf_node<T> alignment leaves no room for tag");
+
+			if(node != nullptr){
+				STEADY_ASSERT(node->check_invariant());
+				STEADY_ASSERT(node->_rc.get() >= 0);
+				STEADY_ASSERT((reinterpret_cast<std::uintptr_t>(node) & LEAF_NODE_TAG) == 0);
+
+				_ptr = reinterpret_cast<std::uintptr_t>(node) | LEAF_NODE_TAG;
+				node->_rc.inc();
+			}
+
+			STEADY_ASSERT(check_invariant());
+		}
+
+		//	Uses reference counting to share all state.
+		template <typename T>
+		node_ref<T>::node_ref(const node_ref<T>& ref) :
+			_ptr(ref._ptr)
+		{
+			STEADY_ASSERT(ref.check_invariant());
+
+			if(_ptr == 0){
+			}
+			else if((_ptr & LEAF_NODE_TAG) == 0){
+				get_inode()->_rc.inc();
+			}
+			else{
+				get_leaf_node()->_rc.inc();
+			}
+
+			STEADY_ASSERT(check_invariant());
+		}
+
+		//	Takes over the reference of _ref_, which becomes a null node. No reference counts change.
+		template <typename T>
+		node_ref<T>::node_ref(node_ref<T>&& ref) :
+			_ptr(ref._ptr)
+		{
+			ref._ptr = 0;
+
+			STEADY_ASSERT(check_invariant());
+		}
+
+		/*
+			Frees a node with no references, see node_reclamation. Takes over the references to the children of an inode
+			and adds the children that become unused to _pending_, so freeing never recurses.
+		*/
+		template <typename T>
+		void reclaim_node(std::uintptr_t ptr, std::vector<node_reclaimer::dead_node>& pending){
+			if((ptr & LEAF_NODE_TAG) == 0){
+				const auto node = reinterpret_cast<inode<T>*>(ptr);
+				for(auto& child: node->_children){
+					const auto child_ptr = child._ptr;
+					child._ptr = 0;
+
+					if(child_ptr == 0){
+					}
+					else if((child_ptr & LEAF_NODE_TAG) == 0){
+						if(reinterpret_cast<inode<T>*>(child_ptr)->_rc.dec()){
+							pending.push_back(node_reclaimer::dead_node{ child_ptr, &reclaim_node<T> });
+							STEADY_STATS_ADD(DEFERRED_NODE_COUNT, 1);
+						}
+					}
+					else{
+						if(reinterpret_cast<leaf_node<T>*>(child_ptr & ~LEAF_NODE_TAG)->_rc.dec()){
+							pending.push_back(node_reclaimer::dead_node{ child_ptr, &reclaim_node<T> });
+							STEADY_STATS_ADD(DEFERRED_NODE_COUNT, 1);
+						}
+					}
+				}
+				delete node;
+			}
+			else{
+				delete reinterpret_cast<leaf_node<T>*>(ptr & ~LEAF_NODE_TAG);
+			}
+			STEADY_STATS_ADD(DEFERRED_NODE_COUNT, -1);
+		}
+
+		template <typename T>
+		node_ref<T>::~node_ref(){
+			STEADY_ASSERT(check_invariant());
+
+			if(_ptr == 0){
+			}
+			else if((_ptr & LEAF_NODE_TAG) == 0){
+				const auto node = get_inode();
+				if(node->_rc.dec()){
+					if(node_reclaimer::is_deferred()){
+						node_reclaimer::defer(_ptr, &reclaim_node<T>);
+					}
+					else{
+						delete node;
+					}
+				}
+			}
+			else{
+				const auto node = get_leaf_node();
+				if(node->_rc.dec()){
+					if(node_reclaimer::is_deferred()){
+						node_reclaimer::defer(_ptr, &reclaim_node<T>);
+					}
+					else{
+						delete node;
+					}
+				}
+			}
+			_ptr = 0;
+		}
+
+		template <typename T>
+		bool node_ref<T>::check_invariant() const {
+			if(_ptr == 0){
+			}
+			else if((_ptr & LEAF_NODE_TAG) == 0){
+				const auto node = reinterpret_cast<const inode<T>*>(_ptr);
+				STEADY_ASSERT(node->check_invariant());
+				STEADY_ASSERT(node->_rc.get() > 0);
+			}
+			else{
+				const auto node = reinterpret_cast<const leaf_node<T>*>(_ptr & ~LEAF_NODE_TAG);
+				STEADY_ASSERT(node->check_invariant());
+				STEADY_ASSERT(node->_rc.get() > 0);
+			}
+			return true;
+		}
+
+		template <typename T>
+		void node_ref<T>::swap(node_ref<T>& rhs){
+			STEADY_ASSERT(check_invariant());
+			STEADY_ASSERT(rhs.check_invariant());
+
+			std::swap(_ptr, rhs._ptr);
+
+			STEADY_ASSERT(check_invariant());
+			STEADY_ASSERT(rhs.check_invariant());
+		}
+
+		template <typename T>
+		node_ref<T>& node_ref<T>::operator=(const node_ref<T>& rhs){
+			STEADY_ASSERT(check_invariant());
+			STEADY_ASSERT(rhs.check_invariant());
+
+			node_ref<T> temp(rhs);
+
+			temp.swap(*this);
+
+			STEADY_ASSERT(check_invariant());
+			STEADY_ASSERT(rhs.check_invariant());
+			return *this;
+		}
+
+		template <typename T>
+		node_ref<T>& node_ref<T>::operator=(node_ref<T>&& rhs){
+			STEADY_ASSERT(check_invariant());
+			STEADY_ASSERT(rhs.check_invariant());
+
+			node_ref<T> temp(std::move(rhs));
+
+			temp.swap(*this);
+
+			STEADY_ASSERT(check_invariant());
+			return *this;
+		}
+
+		template <typename T>
+		node_type node_ref<T>::get_type() const {
+			if(_ptr == 0){
+				return node_type::null_node;
+			}
+			else if((_ptr & LEAF_NODE_TAG) == 0){
+				return node_type::inode;
+			}
+			else{
+				return node_type::leaf_node;
+			}
+		}
+
+		template <typename T>
+		bool node_ref<T>::same_node(const node_ref<T>& other) const {
+			return _ptr == other._ptr;
+		}
+
+		template <typename T>
+		const inode<T>* node_ref<T>::get_inode() const {
+			STEADY_ASSERT(check_invariant());
+			STEADY_ASSERT(get_type() == node_type::inode);
+
+			return reinterpret_cast<const inode<T>*>(_ptr);
+		}
+
+		template <typename T>
+		inode<T>* node_ref<T>::get_inode() {
+			STEADY_ASSERT(check_invariant());
+			STEADY_ASSERT(get_type() == node_type::inode);
+
+			return reinterpret_cast<inode<T>*>(_ptr);
+		}
+
+		template <typename T>
+		const leaf_node<T>* node_ref<T>::get_leaf_node() const {
+			STEADY_ASSERT(check_invariant());
+			STEADY_ASSERT(get_type() == node_type::leaf_node);
+
+			return reinterpret_cast<const leaf_node<T>*>(_ptr & ~LEAF_NODE_TAG);
+		}
+
+		template <typename T>
+		leaf_node<T>* node_ref<T>::get_leaf_node() {
+			STEADY_ASSERT(check_invariant());
+			STEADY_ASSERT(get_type() == node_type::leaf_node);
+
+			return reinterpret_cast<leaf_node<T>*>(_ptr & ~LEAF_NODE_TAG);
+		}
+
+	}	//	internals
+
+
+
+
+/////////////////////////////////////////////			vector implementation
+
+
+
+template <class T>
+vector<T>::vector(){
+	STEADY_ASSERT(check_invariant());
+}
+
+
+template <class T>
+vector<T>::vector(const std::vector<T>& values){
+	//	!!! Illegal to take adress of first element of vec if it's empty.
+	if(!values.empty()){
+		internals::tree_builder<T> builder;
+		builder.push_back(values.data(), values.size());
+		builder.build().swap(*this);
+	}
+
+	STEADY_ASSERT(size() == values.size());
+	STEADY_ASSERT(check_invariant());
+}
+
+template <class T>
+vector<T>::vector(std::vector<T>&& values){
+	internals::tree_builder<T> builder;
+	for(auto& value: values){
+		builder.push_back(std::move(value));
+	}
+	builder.build().swap(*this);
+
+	STEADY_ASSERT(size() == values.size());
+	STEADY_ASSERT(check_invariant());
+}
+
+template <class T>
+vector<T>::vector(const T values[], size_t count){
+	STEADY_ASSERT(values != nullptr);
+
+	internals::tree_builder<T> builder;
+	builder.push_back(values, count);
+	builder.build().swap(*this);
+
+	STEADY_ASSERT(size() == count);
+	STEADY_ASSERT(check_invariant());
+}
+
+
+template <class T>
+vector<T>::vector(std::initializer_list<T> args){
+	internals::tree_builder<T> builder;
+	builder.push_back(args.begin(), args.size());
+	builder.build().swap(*this);
+
+	STEADY_ASSERT(size() == args.size());
+	STEADY_ASSERT(check_invariant());
+}
+
+template <class T>
+template <class InputIt, class>
+vector<T>::vector(InputIt first, InputIt last){
+	internals::tree_builder<T> builder;
+	for(auto it = first ; it != last ; ++it){
+		builder.push_back(*it);
+	}
+	builder.build().swap(*this);
+
+	STEADY_ASSERT(check_invariant());
+}
+
+
+template <class T>
+vector<T>::~vector(){
+	STEADY_ASSERT(check_invariant());
+#if STEADY_ASSERT_ON
+	_size = -1;
+#endif
+}
+
+
+template <class T>
+bool vector<T>::check_invariant() const{
+	if(_root.get_type() == internals::node_type::null_node){
+		STEADY_ASSERT(_size == _tail_size);
+	}
+	else{
+		STEADY_ASSERT(_size >= 0);
+	}
+	STEADY_ASSERT(tree_check_invariant(_root, get_tail_offset()));
+
+	STEADY_ASSERT(_shift >= branching_factor<T>::EMPTY_TREE_SHIFT && _shift < 32);
+	if(internals::is_relaxed(_root)){
+		STEADY_ASSERT(_shift >= internals::vector_size_to_shift<T>(get_tail_offset()));
+	}
+	else{
+		STEADY_ASSERT(_shift == internals::vector_size_to_shift<T>(get_tail_offset()));
+	}
+
+	STEADY_ASSERT(_tail_size <= branching_factor<T>::FACTOR);
+	if(_tail_size == 0){
+		STEADY_ASSERT(_tail.get_type() == internals::node_type::null_node);
+	}
+	else{
+		STEADY_ASSERT(_tail.get_type() == internals::node_type::leaf_node);
+		STEADY_ASSERT(internals::is_relaxed(_root) || (get_tail_offset() & branching_factor<T>::MASK) == 0);
+	}
+
+	return true;
+}
+
+
+template <class T>
+vector<T>::vector(const vector& rhs){
+	STEADY_ASSERT(rhs.check_invariant());
+
+	internals::node_ref<T> newRef(rhs._root);
+
+	_root = newRef;
+	_size = rhs._size;
+	_shift = rhs._shift;
+	_tail = rhs._tail;
+	_tail_size = rhs._tail_size;
+
+	STEADY_ASSERT(check_invariant());
+}
+
+
+template <class T>
+vector<T>& vector<T>::operator=(const vector& rhs){
+	STEADY_ASSERT(check_invariant());
+	STEADY_ASSERT(rhs.check_invariant());
+
+	vector<T> temp(rhs);
+	temp.swap(*this);
+
+	STEADY_ASSERT(check_invariant());
+	return *this;
+}
+
+
+template <class T>
+vector<T>::vector(vector&& rhs) :
+	_root(std::move(rhs._root)),
+	_size(rhs._size),
+	_shift(rhs._shift),
+	_tail(std::move(rhs._tail)),
+	_tail_size(rhs._tail_size)
+{
+	rhs._size = 0;
+	rhs._shift = branching_factor<T>::EMPTY_TREE_SHIFT;
+	rhs._tail_size = 0;
+
+	STEADY_ASSERT(check_invariant());
+	STEADY_ASSERT(rhs.check_invariant());
+}
+
+
+template <class T>
+vector<T>& vector<T>::operator=(vector&& rhs){
+	STEADY_ASSERT(check_invariant());
+	STEADY_ASSERT(rhs.check_invariant());
+
+	vector<T> temp(std::move(rhs));
+	temp.swap(*this);
+
+	STEADY_ASSERT(check_invariant());
+	return *this;
+}
+
+
+template <class T>
+void vector<T>::swap(vector& rhs){
+	STEADY_ASSERT(check_invariant());
+	STEADY_ASSERT(rhs.check_invariant());
+
+	_root.swap(rhs._root);
+	std::swap(_size, rhs._size);
+	std::swap(_shift, rhs._shift);
+	_tail.swap(rhs._tail);
+	std::swap(_tail_size, rhs._tail_size);
+
+	STEADY_ASSERT(check_invariant());
+	STEADY_ASSERT(rhs.check_invariant());
+}
+
+
+template <class T>
+vector<T>::vector(internals::node_ref<T> root, std::size_t size, int shift) :
+	_root(std::move(root)),
+	_size(size),
+	_shift(shift)
+{
+	STEADY_ASSERT(shift >= branching_factor<T>::EMPTY_TREE_SHIFT);
+	STEADY_ASSERT(internals::vector_size_to_shift<T>(size) == shift);
+	STEADY_ASSERT(check_invariant());
+}
+
+/*
+	root, shift: the tree, holding (size - tail_size) values.
+	tail, tail_size: leaf node with the last values. tail_size == 0 means no tail.
+*/
+template <class T>
+vector<T>::vector(internals::node_ref<T> root, std::size_t size, int shift, internals::node_ref<T> tail, std::size_t tail_size) :
+	_root(std::move(root)),
+	_size(size),
+	_shift(shift),
+	_tail(std::move(tail)),
+	_tail_size(tail_size)
+{
+	STEADY_ASSERT(tail_size <= size);
+	STEADY_ASSERT(internals::is_relaxed(_root) || internals::vector_size_to_shift<T>(size - tail_size) == shift);
+	STEADY_ASSERT(check_invariant());
+}
+
+
+template <class T>
+int vector<T>::get_shift() const{
+	STEADY_ASSERT(check_invariant());
+
+	return _shift;
+}
+
+
+
+template <class T>
+size_t vector<T>::get_block_count() const{
+	STEADY_ASSERT(check_invariant());
+	STEADY_ASSERT(!is_relaxed());
+
+	const size_t count = internals::divide_round_up(_size, branching_factor<T>::FACTOR);
+	return count;
+}
+
+template <class T>
+const T* vector<T>::get_block(size_t block_index) const{
+	STEADY_ASSERT(check_invariant());
+	STEADY_ASSERT(get_block_count() > 0);
+	STEADY_ASSERT(block_index < get_block_count());
+
+	const auto leaf = internals::find_leaf_node(*this, block_index * branching_factor<T>::FACTOR);
+	return leaf.get_leaf_node()->get_values();
+}
+
+template <class T>
+bool vector<T>::is_relaxed() const{
+	return internals::is_relaxed(_root);
+}
+
+
+
+template <class T>
+vector<T> vector<T>::push_back(const T& value) const{
+	STEADY_ASSERT(check_invariant());
+	STEADY_STATS_OPERATION(PUSH_BACK_COUNT, PUSH_BACK_COPIED_NODES);
+	STEADY_SCOPED_TIMER("steady::vector::push_back");
+	return internals::push_back_1(*this, value);
+}
+template <class T>
+vector<T> vector<T>::push_back(T&& value) const {
+	STEADY_ASSERT(check_invariant());
+	STEADY_STATS_OPERATION(PUSH_BACK_COUNT, PUSH_BACK_COPIED_NODES);
+	STEADY_SCOPED_TIMER("steady::vector::push_back");
+	return internals::push_back_1(*this, std::forward<T>(value));
+}
+
+
+
+
+template <class T>
+vector<T> vector<T>::push_back(const std::vector<T>& values) const{
+	STEADY_ASSERT(check_invariant());
+	if(values.size() > 0){
+		return internals::push_back_batch<T>(*this, values.data(), values.size());
+	}
+	else {
+		return *this;
+	}
+}
+
+template <class T>
+vector<T> vector<T>::push_back(const T values[], size_t count) const {
+	STEADY_ASSERT(check_invariant());
+	STEADY_ASSERT(values != nullptr);
+
+	return internals::push_back_batch(*this, values, count);
+}
+
+
+
+
+
+
+template <class T>
+vector<T> vector<T>::pop_back() const{
+	STEADY_ASSERT(check_invariant());
+	STEADY_ASSERT(_size > 0);
+
+	return truncate(_size - 1);
+}
+
+
+/*
+	If the new end is inside the tail, only the tail is copied.
+	Else the leaf node holding the new last value becomes the new tail and the tree is trimmed: only the inodes on the
+	new right edge of the tree are copied and the root collapses when the tree gets shallower.
+*/
+template <class T>
+vector<T> vector<T>::truncate(size_t new_size) const{
+	STEADY_ASSERT(check_invariant());
+	STEADY_ASSERT(new_size <= _size);
+
+	if(new_size == _size){
+		return *this;
+	}
+	else if(new_size == 0){
+		return vector<T>();
+	}
+
+	const auto tail_offset = get_tail_offset();
+	if(new_size > tail_offset){
+		const auto tail_size = new_size - tail_offset;
+		auto tail = internals::make_leaf_node<T>(_tail.get_leaf_node()->get_values(), tail_size);
+		return vector<T>(_root, new_size, _shift, std::move(tail), tail_size);
+	}
+	else if(is_relaxed()){
+		//	Leaf nodes can have any size: look up the one holding the new last value.
+		const internals::sized_node<T> tree{ _root, tail_offset };
+		size_t leaf_index = 0;
+		size_t leaf_size = 0;
+		auto tail = internals::find_leaf_node(tree, _shift, new_size - 1, leaf_index, leaf_size);
+		const size_t tail_size = leaf_index + 1;
+		const size_t tree_size = new_size - tail_size;
+
+		if(tail_size < leaf_size){
+			tail = internals::make_leaf_node<T>(tail.get_leaf_node()->get_values(), tail_size);
+		}
+
+		const auto root = tree_size > 0 ? internals::trim_right(tree, _shift, tree_size) : internals::node_ref<T>();
+		return internals::make_vector(root, _shift, tree_size, tail, tail_size);
+	}
+	else{
+		const size_t tree_size = (new_size - 1) & ~branching_factor<T>::MASK;
+		const size_t tail_size = new_size - tree_size;
+
+		//	Reuse the leaf node as tail if it's full, else copy the values we keep.
+		auto tail = internals::find_leaf_node(*this, tree_size);
+		if(tail_size < branching_factor<T>::FACTOR){
+			tail = internals::make_leaf_node<T>(tail.get_leaf_node()->get_values(), tail_size);
+		}
+
+		if(tree_size == 0){
+			return vector<T>(internals::node_ref<T>(), new_size, branching_factor<T>::EMPTY_TREE_SHIFT, tail, tail_size);
+		}
+		else{
+			//	Collapse root first: all kept values are inside child 0 as long as the tree is too high.
+			const auto new_shift = internals::vector_size_to_shift<T>(tree_size);
+			auto shift = _shift;
+			auto root = _root;
+			while(shift > new_shift){
+				root = root.get_inode()->get_child(0);
+				shift -= branching_factor<T>::SHIFT;
+			}
+
+			root = internals::trim_tree(root, shift, tree_size);
+			return vector<T>(root, new_size, shift, tail, tail_size);
+		}
+	}
+}
+
+
+/*
+	Truncates to _end_ then drops the values before _begin_ from the left edge of the tree. The result is usually
+	relaxed.
+*/
+template <class T>
+vector<T> vector<T>::slice(size_t begin, size_t end) const{
+	STEADY_ASSERT(check_invariant());
+	STEADY_ASSERT(begin <= end && end <= _size);
+
+	const auto right = truncate(end);
+	if(begin == 0){
+		return right;
+	}
+	else if(begin == end){
+		return vector<T>();
+	}
+
+	const auto tail_offset = right.get_tail_offset();
+	if(begin >= tail_offset){
+		const auto values = right._tail.get_leaf_node()->get_values();
+		auto tail = internals::make_leaf_node<T>(values + (begin - tail_offset), end - begin);
+		return vector<T>(internals::node_ref<T>(), end - begin, branching_factor<T>::EMPTY_TREE_SHIFT, tail, end - begin);
+	}
+	else{
+		const internals::sized_node<T> tree{ right._root, tail_offset };
+		const auto root = internals::trim_left(tree, right._shift, begin);
+		return internals::make_vector(root, right._shift, tail_offset - begin, right._tail, right._tail_size);
+	}
+}
+
+template <class T>
+vector<T> vector<T>::insert_at(size_t index, const T& value) const{
+	STEADY_ASSERT(check_invariant());
+	STEADY_ASSERT(index <= _size);
+
+	if(index == _size){
+		return push_back(value);
+	}
+	return concat(truncate(index).push_back(value), slice(index, _size));
+}
+
+template <class T>
+vector<T> vector<T>::erase_at(size_t index) const{
+	STEADY_ASSERT(check_invariant());
+	STEADY_ASSERT(index < _size);
+
+	if(index == _size - 1){
+		return pop_back();
+	}
+	return concat(truncate(index), slice(index + 1, _size));
+}
+
+template <class T>
+vector<T> vector<T>::push_front(const T& value) const{
+	return insert_at(0, value);
+}
+
+
+/*
+	Correct but inefficient.
+*/
+#if 0
+template <class T>
+bool vector<T>::operator==(const vector& rhs) const{
+	STEADY_ASSERT(check_invariant());
+
+	const auto a = to_vec();
+	const auto b = rhs.to_vec();
+	return a == b;
+}
+
+#else
+
+template <class T>
+bool vector<T>::operator==(const vector& rhs) const{
+	STEADY_ASSERT(check_invariant());
+
+	if(_size != rhs._size){
+		return false;
+	}
+	if(_size == 0){
+		return true;
+	}
+
+	if(_root.same_node(rhs._root) && _tail.same_node(rhs._tail) && _tail_size == rhs._tail_size){
+		return true;
+	}
+
+	std::uint64_t hash_a = 0;
+	std::uint64_t hash_b = 0;
+	if(internals::get_cached_vector_hash(*this, hash_a) && internals::get_cached_vector_hash(rhs, hash_b) && hash_a != hash_b){
+		return false;
+	}
+
+	//	Shared subtrees are skipped, only the values of nodes that differ are compared.
+	auto equal = [](const T* values_a, const T* values_b, size_t /*index*/, size_t count){
+		return internals::equal_values(values_a, values_b, count);
+	};
+	return internals::compare_trees(*this, rhs, _size, equal);
+}
+
+#endif
+
+
+template <class T>
+std::size_t vector<T>::get_hash() const{
+	STEADY_ASSERT(check_invariant());
+
+	return static_cast<std::size_t>(internals::hash_vector(*this));
+}
+
+
+template <class T>
+vector<T> vector<T>::store(size_t index, const T& value) const{
+	STEADY_ASSERT(check_invariant());
+	STEADY_ASSERT(index < _size);
+	STEADY_STATS_OPERATION(STORE_COUNT, STORE_COPIED_NODES);
+	STEADY_SCOPED_TIMER("steady::vector::store");
+
+	const auto tail_offset = get_tail_offset();
+	if(index >= tail_offset){
+		auto tail = internals::make_leaf_node<T>(_tail.get_leaf_node()->get_values(), _tail_size);
+		tail.get_leaf_node()->store_value(index - tail_offset, value);
+		return vector<T>(_root, _size, _shift, std::move(tail), _tail_size);
+	}
+
+	auto root = replace_value(_root, _shift, index, value);
+	return vector<T>(std::move(root), _size, _shift, _tail, _tail_size);
+}
+
+
+template <class T>
+vector<T> vector<T>::store(size_t index, T&& value) const{
+	STEADY_ASSERT(check_invariant());
+	STEADY_ASSERT(index < _size);
+	STEADY_STATS_OPERATION(STORE_COUNT, STORE_COPIED_NODES);
+	STEADY_SCOPED_TIMER("steady::vector::store");
+
+	const auto tail_offset = get_tail_offset();
+	if(index >= tail_offset){
+		auto tail = internals::make_leaf_node<T>(_tail.get_leaf_node()->get_values(), _tail_size);
+		tail.get_leaf_node()->store_value(index - tail_offset, std::move(value));
+		return vector<T>(_root, _size, _shift, std::move(tail), _tail_size);
+	}
+
+	auto root = replace_value(_root, _shift, index, std::forward<T>(value));
+	return vector<T>(std::move(root), _size, _shift, _tail, _tail_size);
+}
+
+
+/*
+	Uses a transient_vector: the first change below a node copies it, later changes find it unique and modify it in
+	place.
+*/
+template <class T>
+vector<T> vector<T>::store_many(const std::pair<size_t, T> changes[], size_t count) const{
+	STEADY_ASSERT(check_invariant());
+	STEADY_ASSERT(changes != nullptr || count == 0);
+
+	if(count == 0){
+		return *this;
+	}
+
+	transient_vector<T> temp(*this);
+	for(size_t i = 0 ; i < count ; i++){
+		STEADY_ASSERT(changes[i].first < _size);
+		temp.store(changes[i].first, changes[i].second);
+	}
+	return temp.persistent();
+}
+
+template <class T>
+vector<T> vector<T>::store_many(const std::vector<std::pair<size_t, T>>& changes) const{
+	return changes.empty() ? *this : store_many(&changes[0], changes.size());
+}
+
+template <class T>
+template <class F>
+vector<T> vector<T>::update_range(size_t begin, size_t end, F f) const{
+	STEADY_ASSERT(check_invariant());
+	STEADY_ASSERT(begin <= end && end <= _size);
+
+	if(begin == end){
+		return *this;
+	}
+
+	transient_vector<T> temp(*this);
+	for(size_t index = begin ; index < end ; index++){
+		temp.store(index, f(temp[index]));
+	}
+	return temp.persistent();
+}
+
+template <class T>
+template <class F>
+vector<T> vector<T>::map_preserving(F f) const{
+	STEADY_ASSERT(check_invariant());
+
+	auto root = _root;
+	if(get_tail_offset() > 0){
+		root = internals::map_tree_preserving(internals::sized_node<T>{ _root, get_tail_offset() }, _shift, f);
+	}
+	auto tail = _tail;
+	if(_tail_size > 0){
+		tail = internals::map_tree_preserving(internals::sized_node<T>{ _tail, _tail_size }, internals::LEAF_NODE_SHIFT, f);
+	}
+	return vector<T>(std::move(root), _size, _shift, std::move(tail), _tail_size);
+}
+
+
+template <class T>
+std::size_t vector<T>::size() const{
+	STEADY_ASSERT(check_invariant());
+	return _size;
+}
+
+
+#if 0
+
+//	Correct, reference implementation.
+template <class T>
+T vector<T>::operator[](const std::size_t index) const{
+	STEADY_ASSERT(check_invariant());
+	STEADY_ASSERT(index < _size);
+
+	const auto leaf = internals::find_leaf_node(*this, index);
+	const auto slot_index = index & branching_factor<T>::MASK;
+
+	STEADY_ASSERT(slot_index < leaf.get_leaf_node()->get_count());
+	const T result = leaf.get_leaf_node()->get_values()[slot_index];
+	return result;
+}
+
+#else
+
+/*
+Speed-optimized implementation of operator[].
+Avoids updating reference counters, avoids function calls etc.
+Values in the tail are read directly, without walking the tree.
+Strict inodes use the bits of the index, only relaxed inodes need to look in their size table.
+*/
+template <class T>
+const T& vector<T>::operator[](std::size_t index) const{
+	STEADY_ASSERT(check_invariant());
+	STEADY_ASSERT(index < _size);
+
+	const auto tail_offset = get_tail_offset();
+	if(index >= tail_offset){
+		return _tail.get_leaf_node()->get_values()[index - tail_offset];
+	}
+
+	auto shift = _shift;
+	const internals::node_ref<T>* node_it = &_root;
+
+	//	Traverse all inodes.
+	while(shift > 0){
+		const auto node = node_it->get_inode();
+		if(node->_sizes){
+			const auto& sizes = *node->_sizes;
+			size_t slot_index = index >> shift;
+			while(sizes[slot_index] <= index){
+				slot_index++;
+			}
+			if(slot_index > 0){
+				index -= sizes[slot_index - 1];
+			}
+			node_it = &node->_children[slot_index];
+		}
+		else{
+			const size_t slot_index = (index >> shift) & branching_factor<T>::MASK;
+			node_it = &node->_children[slot_index];
+		}
+		shift -= branching_factor<T>::SHIFT;
+	}
+
+	STEADY_ASSERT(shift == internals::LEAF_NODE_SHIFT);
+	STEADY_ASSERT(node_it->get_type() == internals::node_type::leaf_node);
+
+	const auto slot_index = index & branching_factor<T>::MASK;
+
+	STEADY_ASSERT(slot_index < node_it->get_leaf_node()->get_count());
+	const auto& result = node_it->get_leaf_node()->get_values()[slot_index];
+	return result;
+}
+
+#endif
+
+
+#if 0
+
+//	Correct but slow reference implementation.
+template <class T>
+std::vector<T> vector<T>::to_vec() const{
+	STEADY_ASSERT(check_invariant());
+
+	std::vector<T> result;
+	result.reserve(size());
+
+	for(size_t i = 0 ; i < size() ; i++){
+		const auto value = operator[](i);
+		result.push_back(value);
+	}
+
+	return result;
+}
+
+#else
+
+template <class T>
+std::vector<T> vector<T>::to_vec() const{
+	STEADY_ASSERT(check_invariant());
+
+	std::vector<T> result;
+	result.reserve(size());
+
+	//	Block-wise copy.
+	auto append = [&result](const T* values, size_t count){ result.insert(result.end(), values, values + count); };
+	internals::for_each_block(*this, append);
+	return result;
+}
+
+#endif
+
+
+template <class T>
+void vector<T>::copy_range(size_t begin, size_t end, T out[]) const{
+	STEADY_ASSERT(check_invariant());
+	STEADY_ASSERT(begin <= end && end <= _size);
+	STEADY_ASSERT(begin == end || out != nullptr);
+
+	size_t index = begin;
+	while(index < end){
+		size_t leaf_begin = 0;
+		size_t leaf_size = 0;
+		const T* values = internals::find_leaf_values(*this, index, leaf_begin, leaf_size);
+		const size_t count = std::min(leaf_begin + leaf_size, end) - index;
+		const T* first = values + (index - leaf_begin);
+		std::copy(first, first + count, out);
+		out += count;
+		index += count;
+	}
+}
+
+template <class T>
+void vector<T>::get_many(const size_t indices[], size_t count, T out[]) const{
+	STEADY_ASSERT(check_invariant());
+	STEADY_ASSERT(count == 0 || (indices != nullptr && out != nullptr));
+
+	if(count == 0){
+		return;
+	}
+
+	//	order[i] is the position in indices[] of the i:th smallest index. Not needed if indices are already sorted.
+	const bool sorted = std::is_sorted(indices, indices + count);
+	std::vector<size_t> order;
+	if(!sorted){
+		order.resize(count);
+		for(size_t i = 0 ; i < count ; i++){
+			order[i] = i;
+		}
+		std::sort(order.begin(), order.end(), [indices](size_t a, size_t b){ return indices[a] < indices[b]; });
+	}
+	const size_t* positions = sorted ? nullptr : &order[0];
+
+	size_t leaf_begin = 0;
+	size_t leaf_size = 0;
+	const T* values = internals::find_leaf_values(*this, indices[sorted ? 0 : positions[0]], leaf_begin, leaf_size);
+
+	size_t i = 0;
+	while(i < count){
+		//	Find the group of indices that are in the current leaf.
+		const size_t leaf_end = leaf_begin + leaf_size;
+		size_t group_end = i + 1;
+		while(group_end < count && indices[sorted ? group_end : positions[group_end]] < leaf_end){
+			group_end++;
+		}
+
+		//	Find the next leaf and start loading it before reading from the current leaf.
+		size_t next_begin = 0;
+		size_t next_size = 0;
+		const T* next_values = nullptr;
+		if(group_end < count){
+			const size_t next_index = indices[sorted ? group_end : positions[group_end]];
+			next_values = internals::find_leaf_values(*this, next_index, next_begin, next_size);
+			STEADY_PREFETCH(next_values + (next_index - next_begin));
+		}
+
+		for(size_t j = i ; j < group_end ; j++){
+			const size_t position = sorted ? j : positions[j];
+			STEADY_ASSERT(indices[position] >= leaf_begin && indices[position] < leaf_end);
+			out[position] = values[indices[position] - leaf_begin];
+		}
+
+		i = group_end;
+		values = next_values;
+		leaf_begin = next_begin;
+		leaf_size = next_size;
+	}
+}
+
+
+template <class T>
+void vector<T>::trace_internals() const{
+	STEADY_ASSERT(check_invariant());
+
+	STEADY_TRACE_SS("Vector (size: " << _size << ") "
+		"total inodes: " << get_inode_count<T>() << ", "
+		"total leaf nodes: " << get_leaf_count<T>());
+
+	trace_node("", _root);
+	trace_node("tail ", _tail);
+}
+
+
+
+template <class T>
+typename vector<T>::const_iterator vector<T>::begin() const{
+	STEADY_ASSERT(check_invariant());
+
+	return const_iterator(this, 0);
+}
+
+template <class T>
+typename vector<T>::const_iterator vector<T>::end() const{
+	STEADY_ASSERT(check_invariant());
+
+	return const_iterator(this, _size);
+}
+
+
+
+/////////////////////////////////////////////			vector_iterator implementation
+
+
+
+template <class T>
+vector_iterator<T>::vector_iterator() :
+	_vector(nullptr),
+	_index(0),
+	_leaf_values(nullptr),
+	_leaf_begin(0),
+	_leaf_end(0)
+{
+}
+
+template <class T>
+vector_iterator<T>::vector_iterator(const vector<T>* vec, std::size_t index) :
+	_vector(vec),
+	_index(index),
+	_leaf_values(nullptr),
+	_leaf_begin(0),
+	_leaf_end(0)
+{
+	STEADY_ASSERT(vec != nullptr);
+	STEADY_ASSERT(check_invariant());
+}
+
+template <class T>
+bool vector_iterator<T>::check_invariant() const{
+	STEADY_ASSERT(_vector == nullptr || _index <= _vector->size());
+	STEADY_ASSERT(_leaf_begin <= _leaf_end);
+	STEADY_ASSERT(_leaf_values != nullptr || _leaf_begin == _leaf_end);
+	return true;
+}
+
+template <class T>
+void vector_iterator<T>::load_leaf() const{
+	STEADY_ASSERT(_vector != nullptr);
+	STEADY_ASSERT(_index < _vector->size());
+
+	size_t leaf_size = 0;
+	_leaf_values = internals::find_leaf_values(*_vector, _index, _leaf_begin, leaf_size);
+	_leaf_end = _leaf_begin + leaf_size;
+}
+
+template <class T>
+const T& vector_iterator<T>::operator*() const{
+	STEADY_ASSERT(check_invariant());
+
+	if(_index < _leaf_begin || _index >= _leaf_end){
+		load_leaf();
+	}
+	return _leaf_values[_index - _leaf_begin];
+}
+
+template <class T>
+const T* vector_iterator<T>::operator->() const{
+	return &operator*();
+}
+
+template <class T>
+const T& vector_iterator<T>::operator[](difference_type offset) const{
+	return *(*this + offset);
+}
+
+template <class T>
+vector_iterator<T>& vector_iterator<T>::operator++(){
+	_index++;
+	STEADY_ASSERT(check_invariant());
+	return *this;
+}
+
+template <class T>
+vector_iterator<T> vector_iterator<T>::operator++(int){
+	const auto result = *this;
+	++*this;
+	return result;
+}
+
+template <class T>
+vector_iterator<T>& vector_iterator<T>::operator--(){
+	STEADY_ASSERT(_index > 0);
+	_index--;
+	return *this;
+}
+
+template <class T>
+vector_iterator<T> vector_iterator<T>::operator--(int){
+	const auto result = *this;
+	--*this;
+	return result;
+}
+
+template <class T>
+vector_iterator<T>& vector_iterator<T>::operator+=(difference_type offset){
+	_index += offset;
+	STEADY_ASSERT(check_invariant());
+	return *this;
+}
+
+template <class T>
+vector_iterator<T>& vector_iterator<T>::operator-=(difference_type offset){
+	_index -= offset;
+	STEADY_ASSERT(check_invariant());
+	return *this;
+}
+
+template <class T>
+vector_iterator<T> vector_iterator<T>::operator+(difference_type offset) const{
+	auto result = *this;
+	result += offset;
+	return result;
+}
+
+template <class T>
+vector_iterator<T> vector_iterator<T>::operator-(difference_type offset) const{
+	auto result = *this;
+	result -= offset;
+	return result;
+}
+
+template <class T>
+typename vector_iterator<T>::difference_type vector_iterator<T>::operator-(const vector_iterator& rhs) const{
+	STEADY_ASSERT(_vector == rhs._vector);
+	return static_cast<difference_type>(_index) - static_cast<difference_type>(rhs._index);
+}
+
+template <class T>
+bool vector_iterator<T>::operator==(const vector_iterator& rhs) const{
+	STEADY_ASSERT(_vector == rhs._vector);
+	return _index == rhs._index;
+}
+
+template <class T>
+bool vector_iterator<T>::operator!=(const vector_iterator& rhs) const{
+	return !(*this == rhs);
+}
+
+template <class T>
+bool vector_iterator<T>::operator<(const vector_iterator& rhs) const{
+	STEADY_ASSERT(_vector == rhs._vector);
+	return _index < rhs._index;
+}
+
+template <class T>
+bool vector_iterator<T>::operator>(const vector_iterator& rhs) const{
+	return rhs < *this;
+}
+
+template <class T>
+bool vector_iterator<T>::operator<=(const vector_iterator& rhs) const{
+	return !(rhs < *this);
+}
+
+template <class T>
+bool vector_iterator<T>::operator>=(const vector_iterator& rhs) const{
+	return !(*this < rhs);
+}
+
+template <class T>
+vector_iterator<T> operator+(typename vector_iterator<T>::difference_type offset, const vector_iterator<T>& it){
+	return it + offset;
+}
+
+
+
+/////////////////////////////////////////////			transient_vector implementation
+
+
+
+template <class T>
+transient_vector<T>::transient_vector(){
+	STEADY_ASSERT(check_invariant());
+}
+
+template <class T>
+transient_vector<T>::transient_vector(const vector<T>& original) :
+	_root(original.get_root()),
+	_size(original.size()),
+	_shift(original.get_shift()),
+	_tail(original.get_tail()),
+	_tail_size(original.get_tail_size())
+{
+	STEADY_ASSERT(check_invariant());
+}
+
+template <class T>
+bool transient_vector<T>::check_invariant() const{
+	STEADY_ASSERT(tree_check_invariant(_root, _size - _tail_size));
+	STEADY_ASSERT(internals::is_relaxed(_root) || _shift == internals::vector_size_to_shift<T>(_size - _tail_size));
+	STEADY_ASSERT(_tail_size <= branching_factor<T>::FACTOR);
+	STEADY_ASSERT((_tail_size == 0) == (_tail.get_type() == internals::node_type::null_node));
+	return true;
+}
+
+/*
+	Walks from the root to the leaf node holding _index_, making each node on the path unique. Returns the leaf node
+	and the value's _slot_ in it. The caller can overwrite the value or, if it's the end of the leaf node, append to
+	it using leaf_node::store_value().
+*/
+template <class T>
+internals::leaf_node<T>* transient_vector<T>::get_mutable_leaf(size_t index, size_t& slot){
+	STEADY_ASSERT(check_invariant());
+
+	const auto tail_offset = _size - _tail_size;
+	if(_tail_size > 0 && index >= tail_offset){
+		slot = index - tail_offset;
+		return internals::make_leaf_node_unique(_tail);
+	}
+
+	STEADY_ASSERT(index < internals::shift_to_max_size<T>(_shift));
+
+	auto shift = _shift;
+	internals::node_ref<T>* node_it = &_root;
+	while(shift > 0){
+		auto node = internals::make_inode_unique(*node_it);
+		const size_t slot_index = internals::find_child(*node, shift, index);
+		node_it = &node->_children[slot_index];
+		shift -= branching_factor<T>::SHIFT;
+	}
+
+	STEADY_ASSERT(shift == internals::LEAF_NODE_SHIFT);
+	slot = index & branching_factor<T>::MASK;
+	return internals::make_leaf_node_unique(*node_it);
+}
+
+/*
+	Moves the tail last into the tree. The tree must hold a multiple of FACTOR values or be relaxed.
+	Inodes on the right edge of a strict tree are updated in place when we own them.
+*/
+template <class T>
+void transient_vector<T>::push_tail_into_tree(){
+	STEADY_ASSERT(check_invariant());
+	STEADY_ASSERT(_tail_size > 0);
+
+	const auto tree_size = _size - _tail_size;
+	STEADY_ASSERT(internals::is_relaxed(_root) || (tree_size & branching_factor<T>::MASK) == 0);
+
+	if(internals::is_relaxed(_root)){
+		_root = internals::push_leaf_relaxed(internals::sized_node<T>{ _root, tree_size }, _shift, internals::sized_node<T>{ _tail, _tail_size });
+	}
+	else if(tree_size == 0){
+		_root = _tail;
+		_shift = internals::LEAF_NODE_SHIFT;
+	}
+	else if(tree_size < internals::shift_to_max_size<T>(_shift)){
+		auto shift = _shift;
+		internals::node_ref<T>* node_it = &_root;
+		while(true){
+			const size_t slot_index = (tree_size >> shift) & branching_factor<T>::MASK;
+			auto node = internals::make_inode_unique(*node_it);
+			auto& child = node->_children[slot_index];
+
+			if(child.get_type() == internals::node_type::null_node){
+				child = internals::make_new_path(shift - branching_factor<T>::SHIFT, _tail);
+				break;
+			}
+			STEADY_ASSERT(shift > branching_factor<T>::LOWEST_LEVEL_INODE_SHIFT);
+			node_it = &child;
+			shift -= branching_factor<T>::SHIFT;
+		}
+	}
+	else{
+		auto new_path = internals::make_new_path(_shift, _tail);
+		_root = internals::make_inode_from_array<T>({ _root, new_path });
+		_shift += branching_factor<T>::SHIFT;
+	}
+	_tail = internals::node_ref<T>();
+	_tail_size = 0;
+
+	STEADY_ASSERT(check_invariant());
+}
+
+template <class T>
+void transient_vector<T>::push_back(const T& value){
+	STEADY_ASSERT(check_invariant());
+
+	if(_tail_size == branching_factor<T>::FACTOR){
+		push_tail_into_tree();
+	}
+
+	size_t slot = 0;
+	if(_tail_size > 0){
+		get_mutable_leaf(_size, slot)->store_value(slot, value);
+		_tail_size++;
+	}
+	//	No tail but last leaf node in tree has room: mutate it.
+	else if(!internals::is_relaxed(_root) && (_size & branching_factor<T>::MASK) != 0){
+		get_mutable_leaf(_size, slot)->store_value(slot, value);
+	}
+	else{
+		_tail = internals::make_leaf_node<T>(value);
+		_tail_size = 1;
+	}
+	_size++;
+}
+
+template <class T>
+void transient_vector<T>::push_back(T&& value){
+	STEADY_ASSERT(check_invariant());
+
+	if(_tail_size == branching_factor<T>::FACTOR){
+		push_tail_into_tree();
+	}
+
+	size_t slot = 0;
+	if(_tail_size > 0){
+		get_mutable_leaf(_size, slot)->store_value(slot, std::move(value));
+		_tail_size++;
+	}
+	else if(!internals::is_relaxed(_root) && (_size & branching_factor<T>::MASK) != 0){
+		get_mutable_leaf(_size, slot)->store_value(slot, std::move(value));
+	}
+	else{
+		_tail = internals::make_leaf_node<T>(std::move(value));
+		_tail_size = 1;
+	}
+	_size++;
+}
+
+template <class T>
+void transient_vector<T>::store(size_t index, const T& value){
+	STEADY_ASSERT(check_invariant());
+	STEADY_ASSERT(index < _size);
+
+	size_t slot = 0;
+	get_mutable_leaf(index, slot)->store_value(slot, value);
+}
+
+template <class T>
+void transient_vector<T>::store(size_t index, T&& value){
+	STEADY_ASSERT(check_invariant());
+	STEADY_ASSERT(index < _size);
+
+	size_t slot = 0;
+	get_mutable_leaf(index, slot)->store_value(slot, std::move(value));
+}
+
+template <class T>
+std::size_t transient_vector<T>::size() const{
+	STEADY_ASSERT(check_invariant());
+	return _size;
+}
+
+template <class T>
+const T& transient_vector<T>::operator[](std::size_t index) const{
+	STEADY_ASSERT(check_invariant());
+	STEADY_ASSERT(index < _size);
+
+	const auto tail_offset = _size - _tail_size;
+	if(index >= tail_offset){
+		return _tail.get_leaf_node()->get_values()[index - tail_offset];
+	}
+
+	auto shift = _shift;
+	const internals::node_ref<T>* node_it = &_root;
+	while(shift > 0){
+		const size_t slot_index = internals::find_child(*node_it->get_inode(), shift, index);
+		node_it = &node_it->get_inode()->_children[slot_index];
+		shift -= branching_factor<T>::SHIFT;
+	}
+	return node_it->get_leaf_node()->get_values()[index & branching_factor<T>::MASK];
+}
+
+/*
+	The vector shares all nodes with the transient, which makes them read-only for both.
+*/
+template <class T>
+vector<T> transient_vector<T>::persistent() const{
+	STEADY_ASSERT(check_invariant());
+
+	return vector<T>(_root, _size, _shift, _tail, _tail_size);
+}
+
+
+
+////////////////////////////////////////////			vector_editor implementation
+
+
+namespace internals {
+
+	/*
+		Returns a copy of the tree _node_ where the leaf node holding _index_ is _new_leaf_, which must hold as many
+		values as the leaf node it replaces. Works in relaxed trees too.
+	*/
+	template <class T>
+	node_ref<T> replace_leaf_at(const node_ref<T>& node, int shift, size_t index, node_ref<T>&& new_leaf){
+		if(shift == LEAF_NODE_SHIFT){
+			STEADY_ASSERT(node.get_type() == node_type::leaf_node);
+
+			return std::move(new_leaf);
+		}
+		else{
+			const auto& inode = *node.get_inode();
+			size_t rest = index;
+			const size_t slot = find_child(inode, shift, rest);
+			auto child = replace_leaf_at(inode.get_child(slot), shift - branching_factor<T>::SHIFT, rest, std::move(new_leaf));
+			return replace_child(inode, slot, std::move(child));
+		}
+	}
+
+}
+
+
+template <class T>
+vector_editor<T>::vector_editor(const vector<T>& original) :
+	_vector(original)
+{
+	STEADY_ASSERT(check_invariant());
+}
+
+template <class T>
+bool vector_editor<T>::check_invariant() const{
+	STEADY_ASSERT(_vector.check_invariant());
+	STEADY_ASSERT(_focus.check_invariant());
+
+	if(_focus.get_type() == internals::node_type::null_node){
+		STEADY_ASSERT(_focus_size == 0);
+	}
+	else{
+		STEADY_ASSERT(_focus.get_type() == internals::node_type::leaf_node);
+		STEADY_ASSERT(_focus.get_leaf_node()->_rc.get() == 1);
+		STEADY_ASSERT(_focus_size > 0 && _focus_begin + _focus_size <= _vector.size());
+	}
+	return true;
+}
+
+/*
+	Moves the focus to the leaf node holding _index_, if it's not there already, and returns the value.
+*/
+template <class T>
+T& vector_editor<T>::get_focus_value(size_t index){
+	STEADY_ASSERT(check_invariant());
+	STEADY_ASSERT(index < _vector.size());
+
+	if(index < _focus_begin || index >= _focus_begin + _focus_size){
+		write_back();
+
+		size_t leaf_begin = 0;
+		size_t leaf_size = 0;
+		const T* values = internals::find_leaf_values(_vector, index, leaf_begin, leaf_size);
+		_focus = internals::make_leaf_node<T>(values, leaf_size);
+		_focus_begin = leaf_begin;
+		_focus_size = leaf_size;
+	}
+	return _focus.get_leaf_node()->get_values()[index - _focus_begin];
+}
+
+//	After this the focus node is shared with _vector, so it must never change again.
+template <class T>
+void vector_editor<T>::write_back(){
+	STEADY_ASSERT(check_invariant());
+
+	if(_focus.get_type() == internals::node_type::null_node){
+		return;
+	}
+
+	const auto tail_offset = _vector.get_tail_offset();
+	if(_focus_begin >= tail_offset){
+		_vector = vector<T>(_vector.get_root(), _vector.size(), _vector.get_shift(), std::move(_focus), _vector.get_tail_size());
+	}
+	else{
+		auto root = internals::replace_leaf_at(_vector.get_root(), _vector.get_shift(), _focus_begin, std::move(_focus));
+		_vector = vector<T>(std::move(root), _vector.size(), _vector.get_shift(), _vector.get_tail(), _vector.get_tail_size());
+	}
+	_focus = internals::node_ref<T>();
+	_focus_begin = 0;
+	_focus_size = 0;
+
+	STEADY_ASSERT(check_invariant());
+}
+
+template <class T>
+void vector_editor<T>::store(size_t index, const T& value){
+	STEADY_ASSERT(check_invariant());
+	STEADY_ASSERT(index < size());
+
+	get_focus_value(index) = value;
+}
+
+template <class T>
+void vector_editor<T>::store(size_t index, T&& value){
+	STEADY_ASSERT(check_invariant());
+	STEADY_ASSERT(index < size());
+
+	get_focus_value(index) = std::move(value);
+}
+
+template <class T>
+std::size_t vector_editor<T>::size() const{
+	STEADY_ASSERT(check_invariant());
+
+	return _vector.size();
+}
+
+template <class T>
+const T& vector_editor<T>::operator[](std::size_t index) const{
+	STEADY_ASSERT(check_invariant());
+	STEADY_ASSERT(index < size());
+
+	if(index >= _focus_begin && index < _focus_begin + _focus_size){
+		return _focus.get_leaf_node()->get_values()[index - _focus_begin];
+	}
+	return _vector[index];
+}
+
+template <class T>
+vector<T> vector_editor<T>::commit(){
+	STEADY_ASSERT(check_invariant());
+
+	write_back();
+	return _vector;
+}
+
+
+
+////////////////////////////////////////////			atomic_vector implementation
+
+
+template <class T>
+atomic_vector<T>::atomic_vector() :
+	_state(make_state(vector<T>()))
+{
+}
+
+template <class T>
+atomic_vector<T>::atomic_vector(const vector<T>& value) :
+	_state(make_state(value))
+{
+}
+
+template <class T>
+atomic_vector<T>::~atomic_vector(){
+	const auto state = _state.load(std::memory_order_acquire);
+	STEADY_ASSERT((state >> COUNT_SHIFT) == 0);
+
+	release_replaced(state, 0);
+}
+
+//	A new generation holding _value_, with no readers. Throws if its address doesn't fit in the pointer bits.
+template <class T>
+std::uint64_t atomic_vector<T>::make_state(const vector<T>& value){
+	const auto gen = new generation(value);
+	const auto result = static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(gen));
+	if((result & ~POINTER_MASK) != 0){
+		delete gen;
+		throw std::runtime_error("atomic_vector: address doesn't fit in 48 bits");
+	}
+	return result;
+}
+
+template <class T>
+typename atomic_vector<T>::generation* atomic_vector<T>::get_generation(std::uint64_t state){
+	return reinterpret_cast<generation*>(static_cast<std::uintptr_t>(state & POINTER_MASK));
+}
+
+//	Adds this thread to the readers of the current generation, so it stays alive until release().
+template <class T>
+typename atomic_vector<T>::generation* atomic_vector<T>::acquire() const{
+	auto state = _state.load(std::memory_order_relaxed);
+	do{
+		//	One more would carry into the pointer bits.
+		if((state >> COUNT_SHIFT) == MAX_READERS){
+			throw std::overflow_error("atomic_vector: too many threads in load()");
+		}
+	}
+	while(!_state.compare_exchange_weak(state, state + COUNT_ONE, std::memory_order_acquire, std::memory_order_relaxed));
+	return get_generation(state);
+}
+
+/*
+	Removes this thread from the readers in _state, if _gen_ is still current. Otherwise the writer that replaced _gen_
+	has moved the readers to _gen->_refs_.
+*/
+template <class T>
+void atomic_vector<T>::release(generation* gen) const{
+	auto state = _state.load(std::memory_order_relaxed);
+	while(get_generation(state) == gen){
+		if(_state.compare_exchange_weak(state, state - COUNT_ONE, std::memory_order_release, std::memory_order_relaxed)){
+			return;
+		}
+	}
+	if(gen->_refs.fetch_sub(1, std::memory_order_acq_rel) == 1){
+		delete gen;
+	}
+}
+
+/*
+	_old_state_ was just replaced in _state by the caller. Moves its readers to _refs, except _own_readers_: 1 if the
+	caller counted itself as a reader using acquire(), which it won't release(). The caller must not use the
+	generation after this.
+*/
+template <class T>
+void atomic_vector<T>::release_replaced(std::uint64_t old_state, std::int64_t own_readers){
+	const auto gen = get_generation(old_state);
+	const auto late_readers = static_cast<std::int64_t>(old_state >> COUNT_SHIFT) - own_readers;
+	STEADY_ASSERT(late_readers >= 0);
+
+	if(gen->_refs.fetch_add(late_readers, std::memory_order_acq_rel) + late_readers == 0){
+		delete gen;
+	}
+}
+
+template <class T>
+vector<T> atomic_vector<T>::load() const{
+	const auto gen = acquire();
+	vector<T> result = gen->_value;
+	release(gen);
+	return result;
+}
+
+template <class T>
+void atomic_vector<T>::store(const vector<T>& value){
+	exchange(value);
+}
+
+template <class T>
+vector<T> atomic_vector<T>::exchange(const vector<T>& value){
+	const auto new_state = make_state(value);
+	const auto old_state = _state.exchange(new_state, std::memory_order_acq_rel);
 
+	//	Late readers can't delete the old generation until release_replaced() has added them.
+	vector<T> result = get_generation(old_state)->_value;
+	release_replaced(old_state, 0);
+	return result;
+}
 
+template <class T>
+bool atomic_vector<T>::compare_exchange(vector<T>& expected, const vector<T>& desired){
+	const auto gen = acquire();
+	const auto& current = gen->_value;
+	const bool same = current.get_root().same_node(expected.get_root())
+		&& current.get_tail().same_node(expected.get_tail())
+		&& current.size() == expected.size();
+	if(!same){
+		expected = current;
+		release(gen);
+		return false;
+	}
 
-		////////////////////////////////////////////		node_ref<T>
+	const auto new_state = make_state(desired);
+	auto state = _state.load(std::memory_order_relaxed);
+	while(get_generation(state) == gen){
+		if(_state.compare_exchange_weak(state, new_state, std::memory_order_acq_rel, std::memory_order_relaxed)){
+			release_replaced(state, 1);
+			return true;
+		}
+	}
 
-		/*
-			Safe, reference counted handle that holds either an inode, a LeadNode or null.
-		*/
+	//	Another thread replaced it first.
+	delete get_generation(new_state);
+	release(gen);
+	expected = load();
+	return false;
+}
 
-		template <typename T>
-		node_ref<T>::node_ref() :
-			_inode(nullptr),
-			_leaf_node(nullptr)
-		{
-			STEADY_ASSERT(check_invariant());
+template <class T>
+template <class F>
+vector<T> atomic_vector<T>::update(F f){
+	auto expected = load();
+	while(true){
+		const auto desired = f(static_cast<const vector<T>&>(expected));
+		if(compare_exchange(expected, desired)){
+			return desired;
 		}
+	}
+}
 
-		/*
-			Will assume ownership of the input node - caller must not delete it after call returns.
-			Adds ref.
-			node == nullptr => null_node
-		*/
-		template <typename T>
-		node_ref<T>::node_ref(inode<T>* node) :
-			_inode(nullptr),
-			_leaf_node(nullptr)
-		{
-			if(node != nullptr){
-				STEADY_ASSERT(node->check_invariant());
-				STEADY_ASSERT(node->_rc >= 0);
 
-				_inode = node;
-				_inode->_rc++;
-			}
 
-			STEADY_ASSERT(check_invariant());
-		}
+/*
+	O(log n): the trees are joined along their seam and the result is usually relaxed.
+	If _b_ only has a tail its values are appended instead, which keeps a strict _a_ strict.
+*/
+template <class T>
+vector<T> concat(const vector<T>& a, const vector<T>& b){
+	STEADY_ASSERT(a.check_invariant());
+	STEADY_ASSERT(b.check_invariant());
+	STEADY_SCOPED_TIMER("steady::concat");
 
-		/*
-			Will assume ownership of the input node - caller must not delete it after call returns.
-			Adds ref.
-			node == nullptr => null_node
-		*/
-		template <typename T>
-		node_ref<T>::node_ref(leaf_node<T>* node) :
-			_inode(nullptr),
-			_leaf_node(nullptr)
-		{
-			if(node != nullptr){
-				STEADY_ASSERT(node->check_invariant());
-				STEADY_ASSERT(node->_rc >= 0);
+	if(a.empty()){
+		return b;
+	}
+	else if(b.empty()){
+		return a;
+	}
+	else if(b.get_tail_offset() == 0){
+		return internals::push_back_batch(a, b.get_tail().get_leaf_node()->get_values(), b.get_tail_size());
+	}
 
-				_leaf_node = node;
-				_leaf_node->_rc++;
-			}
+	//	The tail of _a_ goes into the tree. The tail of _b_ becomes the tail of the result.
+	internals::sized_node<T> left{ a.get_root(), a.get_tail_offset() };
+	auto left_shift = a.get_shift();
+	if(a.get_tail_size() > 0){
+		left._node = internals::push_leaf_relaxed(left, left_shift, internals::sized_node<T>{ a.get_tail(), a.get_tail_size() });
+		left._size += a.get_tail_size();
+	}
 
-			STEADY_ASSERT(check_invariant());
-		}
+	const internals::sized_node<T> right{ b.get_root(), b.get_tail_offset() };
+	int shift = 0;
+	const auto root = internals::concat_trees(left, left_shift, right, b.get_shift(), shift);
+	const auto result = internals::make_vector(root, shift, left._size + right._size, b.get_tail(), b.get_tail_size());
 
-		//	Uses reference counting to share all state.
-		template <typename T>
-		node_ref<T>::node_ref(const node_ref<T>& ref) :
-			_inode(nullptr),
-			_leaf_node(nullptr)
-		{
-			STEADY_ASSERT(ref.check_invariant());
+	STEADY_ASSERT(result.size() == a.size() + b.size());
+	return result;
+}
 
-			if(ref.get_type() == node_type::null_node){
-			}
-			else if(ref.get_type() == node_type::inode){
-				_inode = ref._inode;
-				_inode->_rc++;
-			}
-			else if(ref.get_type() == node_type::leaf_node){
-				_leaf_node = ref._leaf_node;
-				_leaf_node->_rc++;
-			}
-			else{
-				STEADY_ASSERT(false);
-			}
+template <class T>
+vector<T> operator+(const vector<T>& a, const vector<T>& b){
+	return concat(a, b);
+}
 
-			STEADY_ASSERT(check_invariant());
+template <class T>
+std::vector<std::pair<size_t, size_t>> diff(const vector<T>& a, const vector<T>& b){
+	STEADY_ASSERT(a.check_invariant());
+	STEADY_ASSERT(b.check_invariant());
+
+	typedef std::pair<size_t, size_t> range_t;
+	std::vector<range_t> result;
+	auto add = [&result](size_t begin, size_t end){
+		if(!result.empty() && result.back().second == begin){
+			result.back().second = end;
 		}
+		else{
+			result.push_back(range_t(begin, end));
+		}
+	};
 
-		template <typename T>
-		node_ref<T>::~node_ref(){
-			STEADY_ASSERT(check_invariant());
-
-			if(get_type() == node_type::null_node){
-			}
-			else if(get_type() == node_type::inode){
-				_inode->_rc--;
-				if(_inode->_rc == 0){
-					delete _inode;
-					_inode = nullptr;
-				}
-			}
-			else if(get_type() == node_type::leaf_node){
-				_leaf_node->_rc--;
-				if(_leaf_node->_rc == 0){
-					delete _leaf_node;
-					_leaf_node = nullptr;
-				}
+	auto compare = [&add](const T* values_a, const T* values_b, size_t index, size_t count){
+		size_t i = 0;
+		while(i < count){
+			if(values_a[i] == values_b[i]){
+				i++;
 			}
 			else{
-				STEADY_ASSERT(false);
+				const size_t begin = i;
+				while(i < count && !(values_a[i] == values_b[i])){
+					i++;
+				}
+				add(index + begin, index + i);
 			}
 		}
+		return true;
+	};
 
-		template <typename T>
-		bool node_ref<T>::check_invariant() const {
-			STEADY_ASSERT(_inode == nullptr || _leaf_node == nullptr);
-
-			if(_inode != nullptr){
-				STEADY_ASSERT(_inode->check_invariant());
-				STEADY_ASSERT(_inode->_rc > 0);
-			}
-			else if(_leaf_node != nullptr){
-				STEADY_ASSERT(_leaf_node->check_invariant());
-				STEADY_ASSERT(_leaf_node->_rc > 0);
-			}
-			return true;
-		}
+	const size_t common_size = std::min(a.size(), b.size());
+	internals::compare_trees(a, b, common_size, compare);
 
-		template <typename T>
-		void node_ref<T>::swap(node_ref<T>& rhs){
-			STEADY_ASSERT(check_invariant());
-			STEADY_ASSERT(rhs.check_invariant());
+	const size_t max_size = std::max(a.size(), b.size());
+	if(common_size < max_size){
+		add(common_size, max_size);
+	}
+	return result;
+}
 
-			std::swap(_inode, rhs._inode);
-			std::swap(_leaf_node, rhs._leaf_node);
 
-			STEADY_ASSERT(check_invariant());
-			STEADY_ASSERT(rhs.check_invariant());
-		}
 
-		template <typename T>
-		node_ref<T>& node_ref<T>::operator=(const node_ref<T>& rhs){
-			STEADY_ASSERT(check_invariant());
-			STEADY_ASSERT(rhs.check_invariant());
+////////////////////////////////////////////			sparse_vector implementation
 
-			node_ref<T> temp(rhs);
 
-			temp.swap(*this);
+namespace internals {
 
-			STEADY_ASSERT(check_invariant());
-			STEADY_ASSERT(rhs.check_invariant());
-			return *this;
+	template <class T>
+	bool is_empty_inode(const typename inode<T>::children_t& children){
+		for(const auto& i: children){
+			if(i.get_type() != node_type::null_node){
+				return false;
+			}
 		}
+		return true;
+	}
 
-		template <typename T>
-		node_type node_ref<T>::get_type() const {
-			STEADY_ASSERT(_inode == nullptr || _leaf_node == nullptr);
+	//	Returns a copy of _node_ with _value_ at _index_. _node_ can be null. Sets _added_ if _index_ was a hole.
+	template <class T>
+	node_ref<sparse_slot<T>> sparse_store(const node_ref<sparse_slot<T>>& node, int shift, size_t index, const T& value, bool& added){
+		typedef sparse_slot<T> slot_t;
+		const size_t slot = (index >> shift) & branching_factor<slot_t>::MASK;
+
+		if(shift == LEAF_NODE_SHIFT){
+			node_ref<slot_t> result(new leaf_node<slot_t>());
+			auto leaf = result.get_leaf_node();
+			if(node.get_type() != node_type::null_node){
+				const auto original = node.get_leaf_node();
+				leaf->push_values(original->get_values(), original->get_count());
+			}
+			added = slot >= leaf->get_count() || !leaf->get_values()[slot].is_present();
+			while(leaf->get_count() < slot){
+				leaf->push_value(slot_t());
+			}
+			leaf->store_value(slot, slot_t(value));
+			return result;
+		}
+		else{
+			auto children = node.get_type() == node_type::null_node
+				? typename inode<slot_t>::children_t()
+				: node.get_inode()->get_child_array();
+			children[slot] = sparse_store(children[slot], shift - branching_factor<slot_t>::SHIFT, index, value, added);
+			return node_ref<slot_t>(new inode<slot_t>(std::move(children)));
+		}
+	}
 
-			if(_inode == nullptr && _leaf_node == nullptr){
-				return node_type::null_node;
+	//	Returns a copy of _node_ with a hole at _index_, or null if nothing is left. _index_ must hold a value.
+	template <class T>
+	node_ref<sparse_slot<T>> sparse_erase(const node_ref<sparse_slot<T>>& node, int shift, size_t index){
+		typedef sparse_slot<T> slot_t;
+		const size_t slot = (index >> shift) & branching_factor<slot_t>::MASK;
+
+		if(shift == LEAF_NODE_SHIFT){
+			const auto original = node.get_leaf_node();
+			const auto values = original->get_values();
+
+			//	Drops trailing holes.
+			size_t count = 0;
+			for(size_t i = 0 ; i < original->get_count() ; i++){
+				if(i != slot && values[i].is_present()){
+					count = i + 1;
+				}
 			}
-			else if(_inode != nullptr){
-				return node_type::inode;
+			if(count == 0){
+				return node_ref<slot_t>();
 			}
-			else if(_leaf_node != nullptr){
-				return node_type::leaf_node;
+			auto result = make_leaf_node(values, count);
+			if(slot < count){
+				result.get_leaf_node()->get_values()[slot].clear();
 			}
-			else{
-				STEADY_ASSERT(false);
-				throw nullptr;//	Dummy to stop warning.
+			return result;
+		}
+		else{
+			auto children = node.get_inode()->get_child_array();
+			children[slot] = sparse_erase(children[slot], shift - branching_factor<slot_t>::SHIFT, index);
+			if(is_empty_inode<slot_t>(children)){
+				return node_ref<slot_t>();
 			}
+			return node_ref<slot_t>(new inode<slot_t>(std::move(children)));
 		}
+	}
 
-		template <typename T>
-		const inode<T>* node_ref<T>::get_inode() const {
-			STEADY_ASSERT(check_invariant());
-			STEADY_ASSERT(get_type() == node_type::inode);
+	template <class T, class F>
+	void sparse_for_each(const node_ref<sparse_slot<T>>& node, int shift, size_t offset, F& f){
+		typedef sparse_slot<T> slot_t;
 
-			return _inode;
+		const auto type = node.get_type();
+		if(type == node_type::null_node){
 		}
-
-		template <typename T>
-		const leaf_node<T>* node_ref<T>::get_leaf_node() const {
-			STEADY_ASSERT(check_invariant());
-			STEADY_ASSERT(get_type() == node_type::leaf_node);
-
-			return _leaf_node;
+		else if(type == node_type::leaf_node){
+			const auto leaf = node.get_leaf_node();
+			const auto values = leaf->get_values();
+			for(size_t i = 0 ; i < leaf->get_count() ; i++){
+				if(values[i].is_present()){
+					f(offset + i, values[i].get());
+				}
+			}
 		}
-
-		template <typename T>
-		leaf_node<T>* node_ref<T>::get_leaf_node() {
-			STEADY_ASSERT(check_invariant());
-			STEADY_ASSERT(get_type() == node_type::leaf_node);
-
-			return _leaf_node;
+		else{
+			const auto& children = node.get_inode()->_children;
+			for(size_t i = 0 ; i < children.size() ; i++){
+				sparse_for_each(children[i], shift - branching_factor<slot_t>::SHIFT, offset + (i << shift), f);
+			}
 		}
-
-	}	//	internals
-
-
-
-
-/////////////////////////////////////////////			vector implementation
-
-
-
-template <class T>
-vector<T>::vector(){
-	STEADY_ASSERT(check_invariant());
-}
-
-
-template <class T>
-vector<T>::vector(const std::vector<T>& values){
-	//	!!! Illegal to take adress of first element of vec if it's empty.
-	if(!values.empty()){
-		auto temp = internals::push_back_batch(vector<T>(), values.data(), values.size());
-		temp.swap(*this);
 	}
 
-	STEADY_ASSERT(size() == values.size());
-	STEADY_ASSERT(check_invariant());
-}
-
-template <class T>
-vector<T>::vector(const T values[], size_t count){
-	STEADY_ASSERT(values != nullptr);
-
-	auto temp = internals::push_back_batch(vector<T>(), values, count);
-	temp.swap(*this);
+	//	Both trees have the same shape when they hold the same values, so they are compared node by node.
+	template <class T>
+	bool sparse_equal(const node_ref<sparse_slot<T>>& a, const node_ref<sparse_slot<T>>& b){
+		if(a.same_node(b)){
+			return true;
+		}
+		if(a.get_type() != b.get_type() || a.get_type() == node_type::null_node){
+			return false;
+		}
+		if(a.get_type() == node_type::leaf_node){
+			const auto a_leaf = a.get_leaf_node();
+			const auto b_leaf = b.get_leaf_node();
+			if(a_leaf->get_count() != b_leaf->get_count()){
+				return false;
+			}
+			for(size_t i = 0 ; i < a_leaf->get_count() ; i++){
+				const auto& a_slot = a_leaf->get_values()[i];
+				const auto& b_slot = b_leaf->get_values()[i];
+				if(a_slot.is_present() != b_slot.is_present() || (a_slot.is_present() && !(a_slot.get() == b_slot.get()))){
+					return false;
+				}
+			}
+			return true;
+		}
+		else{
+			const auto& a_children = a.get_inode()->_children;
+			const auto& b_children = b.get_inode()->_children;
+			for(size_t i = 0 ; i < a_children.size() ; i++){
+				if(!sparse_equal(a_children[i], b_children[i])){
+					return false;
+				}
+			}
+			return true;
+		}
+	}
 
-	STEADY_ASSERT(size() == count);
-	STEADY_ASSERT(check_invariant());
 }
 
 
 template <class T>
-vector<T>::vector(std::initializer_list<T> args){
-	auto temp = internals::push_back_batch(vector<T>(), args.begin(), args.end() - args.begin());
-	temp.swap(*this);
-
-	STEADY_ASSERT(size() == args.size());
+sparse_vector<T>::sparse_vector(){
 	STEADY_ASSERT(check_invariant());
 }
 
-
 template <class T>
-vector<T>::~vector(){
+sparse_vector<T>::sparse_vector(internals::node_ref<slot_t> root, std::size_t size, int shift) :
+	_root(root),
+	_size(size),
+	_shift(shift)
+{
 	STEADY_ASSERT(check_invariant());
-#if STEADY_ASSERT_ON
-	_size = -1;
-#endif
 }
 
-
 template <class T>
-bool vector<T>::check_invariant() const{
+bool sparse_vector<T>::check_invariant() const{
+	STEADY_ASSERT(_root.check_invariant());
+	STEADY_ASSERT(_shift >= branching_factor<slot_t>::LOWEST_LEVEL_INODE_SHIFT);
+	STEADY_ASSERT(_shift % branching_factor<slot_t>::SHIFT == 0);
+
 	if(_root.get_type() == internals::node_type::null_node){
 		STEADY_ASSERT(_size == 0);
+		STEADY_ASSERT(_shift == branching_factor<slot_t>::LOWEST_LEVEL_INODE_SHIFT);
 	}
 	else{
-		STEADY_ASSERT(_size >= 0);
+		STEADY_ASSERT(_size > 0);
+		STEADY_ASSERT(_root.get_type() == internals::node_type::inode);
 	}
-	STEADY_ASSERT(tree_check_invariant(_root, _size));
-
-	STEADY_ASSERT(_shift >= internals::EMPTY_TREE_SHIFT && _shift < 32);
-	STEADY_ASSERT(_shift == internals::vector_size_to_shift(_size));
-
 	return true;
 }
 
-
 template <class T>
-vector<T>::vector(const vector& rhs){
-	STEADY_ASSERT(rhs.check_invariant());
-
-	internals::node_ref<T> newRef(rhs._root);
+sparse_vector<T> sparse_vector<T>::store(size_t index, const T& value) const{
+	STEADY_ASSERT(check_invariant());
 
-	_root = newRef;
-	_size = rhs._size;
-	_shift = rhs._shift;
+	//	Add levels on top until the root can hold _index_. The old root becomes child 0.
+	auto root = _root;
+	int shift = _shift;
+	while(((index >> shift) >> branching_factor<slot_t>::SHIFT) != 0){
+		if(root.get_type() != internals::node_type::null_node){
+			typename internals::inode<slot_t>::children_t children;
+			children[0] = root;
+			root = internals::node_ref<slot_t>(new internals::inode<slot_t>(std::move(children)));
+		}
+		shift += branching_factor<slot_t>::SHIFT;
+	}
 
-	STEADY_ASSERT(check_invariant());
+	bool added = false;
+	const auto new_root = internals::sparse_store(root, shift, index, value, added);
+	return sparse_vector<T>(new_root, added ? _size + 1 : _size, shift);
 }
 
-
 template <class T>
-vector<T>& vector<T>::operator=(const vector& rhs){
+sparse_vector<T> sparse_vector<T>::erase(size_t index) const{
 	STEADY_ASSERT(check_invariant());
-	STEADY_ASSERT(rhs.check_invariant());
 
-	vector<T> temp(rhs);
-	temp.swap(*this);
+	if(!contains(index)){
+		return *this;
+	}
 
-	STEADY_ASSERT(check_invariant());
-	return *this;
+	auto root = internals::sparse_erase(_root, _shift, index);
+	int shift = _shift;
+	if(root.get_type() == internals::node_type::null_node){
+		shift = branching_factor<slot_t>::LOWEST_LEVEL_INODE_SHIFT;
+	}
+	else{
+		//	Remove levels on top that only have child 0, so the tree is as shallow as possible.
+		while(shift > branching_factor<slot_t>::LOWEST_LEVEL_INODE_SHIFT){
+			auto children = root.get_inode()->get_child_array();
+			const auto first = children[0];
+			children[0] = internals::node_ref<slot_t>();
+			if(first.get_type() == internals::node_type::null_node || !internals::is_empty_inode<slot_t>(children)){
+				break;
+			}
+			root = first;
+			shift -= branching_factor<slot_t>::SHIFT;
+		}
+	}
+	return sparse_vector<T>(root, _size - 1, shift);
 }
 
-
 template <class T>
-void vector<T>::swap(vector& rhs){
+const T* sparse_vector<T>::find(size_t index) const{
 	STEADY_ASSERT(check_invariant());
-	STEADY_ASSERT(rhs.check_invariant());
 
-	_root.swap(rhs._root);
-	std::swap(_size, rhs._size);
-	std::swap(_shift, rhs._shift);
+	if(((index >> _shift) >> branching_factor<slot_t>::SHIFT) != 0){
+		return nullptr;
+	}
 
-	STEADY_ASSERT(check_invariant());
-	STEADY_ASSERT(rhs.check_invariant());
+	const internals::node_ref<slot_t>* node = &_root;
+	int shift = _shift;
+	while(shift > internals::LEAF_NODE_SHIFT){
+		if(node->get_type() == internals::node_type::null_node){
+			return nullptr;
+		}
+		node = &node->get_inode()->_children[(index >> shift) & branching_factor<slot_t>::MASK];
+		shift -= branching_factor<slot_t>::SHIFT;
+	}
+	if(node->get_type() == internals::node_type::null_node){
+		return nullptr;
+	}
+
+	const auto leaf = node->get_leaf_node();
+	const size_t slot = index & branching_factor<slot_t>::MASK;
+	if(slot >= leaf->get_count() || !leaf->get_values()[slot].is_present()){
+		return nullptr;
+	}
+	return &leaf->get_values()[slot].get();
 }
 
-
 template <class T>
-vector<T>::vector(internals::node_ref<T> root, std::size_t size, int shift) :
-	_root(root),
-	_size(size),
-	_shift(shift)
-{
-	STEADY_ASSERT(shift >= internals::EMPTY_TREE_SHIFT);
-	STEADY_ASSERT(internals::vector_size_to_shift(size) == shift);
-	STEADY_ASSERT(check_invariant());
+bool sparse_vector<T>::contains(size_t index) const{
+	return find(index) != nullptr;
 }
 
-
 template <class T>
-int vector<T>::get_shift() const{
-	STEADY_ASSERT(check_invariant());
+const T& sparse_vector<T>::operator[](size_t index) const{
+	const auto result = find(index);
+	STEADY_ASSERT(result != nullptr);
 
-	return _shift;
+	return *result;
 }
 
+template <class T>
+std::size_t sparse_vector<T>::size() const{
+	STEADY_ASSERT(check_invariant());
 
+	return _size;
+}
 
 template <class T>
-size_t vector<T>::get_block_count() const{
+template <class F>
+void sparse_vector<T>::for_each(F f) const{
 	STEADY_ASSERT(check_invariant());
 
-	const size_t count = internals::divide_round_up(_size, BRANCHING_FACTOR);
-	return count;
+	internals::sparse_for_each(_root, _shift, 0, f);
 }
 
 template <class T>
-const T* vector<T>::get_block(size_t block_index) const{
+bool sparse_vector<T>::operator==(const sparse_vector& rhs) const{
 	STEADY_ASSERT(check_invariant());
-	STEADY_ASSERT(get_block_count() > 0);
-	STEADY_ASSERT(block_index < get_block_count());
+	STEADY_ASSERT(rhs.check_invariant());
 
-	const auto leaf = internals::find_leaf_node(*this, block_index * BRANCHING_FACTOR);
-	return &leaf.get_leaf_node()->_values[0];
+	return _size == rhs._size && _shift == rhs._shift && internals::sparse_equal(_root, rhs._root);
 }
 
 
 
-template <class T>
-vector<T> vector<T>::push_back(const T& value) const{
-	STEADY_ASSERT(check_invariant());
-	return internals::push_back_1(*this, value);
-}
-template <class T>
-vector<T> vector<T>::push_back(T&& value) const {
-	STEADY_ASSERT(check_invariant());
-	return internals::push_back_1(*this, std::forward<T>(value));
-}
+////////////////////////////////////////////		Parallel algorithms implementation
 
 
+namespace parallel {
 
+	template <class T, class F>
+	void for_each(const vector<T>& vec, F f){
+		STEADY_ASSERT(vec.check_invariant());
 
-template <class T>
-vector<T> vector<T>::push_back(const std::vector<T>& values) const{
-	STEADY_ASSERT(check_invariant());
-	if(values.size() > 0){
-		return internals::push_back_batch<T>(*this, values.data(), values.size());
+		const auto chunks = internals::split_vector(vec, internals::get_chunk_shift(vec));
+		internals::worker_pool::get().run(chunks.size(), [&chunks, &f](size_t index){
+			auto call = [&f](const T* values, size_t count){
+				for(size_t i = 0 ; i < count ; i++){
+					f(values[i]);
+				}
+			};
+			internals::for_each_leaf_node(chunks[index]._node, chunks[index]._shift, call);
+		});
 	}
-	else {
-		return *this;
+
+	template <class T, class Op>
+	T reduce(const vector<T>& vec, T init, Op op){
+		STEADY_ASSERT(vec.check_invariant());
+
+		/*
+			Each chunk is reduced starting with its first value, then the chunk results are reduced in order. Workers
+			reduce into a local and store it once. The results are wrapped so std::vector<bool> doesn't pack them into
+			shared words, which workers can't write at the same time.
+		*/
+		struct chunk_result {
+			T _value;
+		};
+		const auto chunks = internals::split_vector(vec, internals::get_chunk_shift(vec));
+		std::vector<chunk_result> results(chunks.size(), chunk_result{ init });
+		internals::worker_pool::get().run(chunks.size(), [&chunks, &results, &init, &op](size_t index){
+			T result = init;
+			bool first = true;
+			auto combine = [&result, &first, &op](const T* values, size_t count){
+				for(size_t i = 0 ; i < count ; i++){
+					if(first){
+						result = values[i];
+						first = false;
+					}
+					else{
+						result = op(result, values[i]);
+					}
+				}
+			};
+			internals::for_each_leaf_node(chunks[index]._node, chunks[index]._shift, combine);
+			results[index]._value = result;
+		});
+
+		T result = init;
+		for(const auto& value: results){
+			result = op(result, value._value);
+		}
+		return result;
 	}
-}
 
-template <class T>
-vector<T> vector<T>::push_back(const T values[], size_t count) const {
-	STEADY_ASSERT(check_invariant());
-	STEADY_ASSERT(values != nullptr);
+}	//	parallel
 
-	return internals::push_back_batch(*this, values, count);
-}
+	namespace internals {
+
+		//	U has another branching factor than T: transform the chunks to values, then build the tree in one go.
+		template <class U, class T, class F>
+		vector<U> transform_vector(const vector<T>& vec, F& f, std::false_type){
+			const auto chunks = split_vector(vec, get_chunk_shift(vec));
+			std::vector<std::vector<U>> results(chunks.size());
+			worker_pool::get().run(chunks.size(), [&chunks, &results, &f](size_t index){
+				auto& values = results[index];
+				values.reserve(chunks[index]._node._size);
+				auto transform_leaf = [&values, &f](const T leaf_values[], size_t count){
+					for(size_t i = 0 ; i < count ; i++){
+						values.push_back(f(leaf_values[i]));
+					}
+				};
+				for_each_leaf_node(chunks[index]._node, chunks[index]._shift, transform_leaf);
+			});
+
+			tree_builder<U> builder;
+			for(auto& values: results){
+				for(auto& value: values){
+					builder.push_back(std::move(value));
+				}
+			}
+			return builder.build();
+		}
+
+		//	Same branching factor: the result gets the same shape as _vec_.
+		template <class U, class T, class F>
+		vector<U> transform_vector(const vector<T>& vec, F& f, std::true_type){
+			const auto chunk_shift = get_chunk_shift(vec);
+			const auto chunks = split_vector(vec, chunk_shift);
+			std::vector<sized_node<U>> results(chunks.size());
+			worker_pool::get().run(chunks.size(), [&chunks, &results, &f](size_t index){
+				results[index] = transform_tree<U>(chunks[index]._node, chunks[index]._shift, f);
+			});
+
+			node_ref<U> root;
+			size_t next = 0;
+			if(vec.get_tail_offset() > 0){
+				const sized_node<T> tree{ vec.get_root(), vec.get_tail_offset() };
+				root = join_chunks(tree, vec.get_shift(), chunk_shift, &results[0], next)._node;
+			}
+			node_ref<U> tail;
+			if(vec.get_tail_size() > 0){
+				tail = results[next++]._node;
+			}
+			STEADY_ASSERT(next == results.size());
 
+			const vector<U> result(root, vec.size(), vec.get_shift(), tail, vec.get_tail_size());
+			STEADY_ASSERT(result.check_invariant());
+			return result;
+		}
 
+	}	//	internals
 
+namespace parallel {
 
+	template <class T, class F>
+	auto transform(const vector<T>& vec, F f) -> vector<typename std::decay<decltype(f(std::declval<const T&>()))>::type>{
+		typedef typename std::decay<decltype(f(std::declval<const T&>()))>::type U;
+		STEADY_ASSERT(vec.check_invariant());
 
+		return internals::transform_vector<U>(
+			vec,
+			f,
+			std::integral_constant<bool, branching_factor<U>::SHIFT == branching_factor<T>::SHIFT>()
+		);
+	}
 
-/*
-	### Correct but inefficient.
-*/
-template <class T>
-vector<T> vector<T>::pop_back() const{
-	STEADY_ASSERT(check_invariant());
-	STEADY_ASSERT(_size > 0);
+}	//	parallel
 
-	const auto temp = to_vec();
-	const auto result = vector<T>(&temp[0], _size - 1);
-	return result;
-}
 
+////////////////////////////////////////////		Snapshots implementation
 
 /*
-	Correct but inefficient.
-*/
-#if 0
-template <class T>
-bool vector<T>::operator==(const vector& rhs) const{
-	STEADY_ASSERT(check_invariant());
+	FORMAT
 
-	const auto a = to_vec();
-	const auto b = rhs.to_vec();
-	return a == b;
-}
+	All integers are std::uint32_t or std::uint64_t in the byte order of the writer.
 
-#else
+	header: "STEADYV1", uint32 byte order marker 0x01020304, uint32 branching factor shift, uint32 sizeof(T),
+		uint32 alignof(T), uint64 node count, uint64 vector count.
 
-template <class T>
-bool vector<T>::operator==(const vector& rhs) const{
-	STEADY_ASSERT(check_invariant());
+	nodes: Children come before their parents. A node's id is its position in this list.
+		leaf node: uint32 1, uint32 count, padding up to alignof(T) from the start of the snapshot, count * T.
+		inode: uint32 2, uint32 child count, uint32 relaxed (0 or 1), child count * uint64 child id.
+			Relaxed inodes then have child count * uint64 size table.
 
-	if(_size != rhs._size){
-		return false;
-	}
-	if(_size == 0){
-		return true;
-	}
+	vectors: uint64 size, uint64 shift + branching factor shift, uint64 root id, uint64 tail id, uint64 tail size.
+		A null node has id NULL_NODE_ID.
+*/
 
-	if(_root.get_type() != rhs._root.get_type()){
-		return false;
-	}
-	if(_root.get_type() == internals::node_type::inode && _root.get_inode() == rhs._root.get_inode()){
-		return true;
-	}
-	if(_root.get_type() == internals::node_type::leaf_node && _root.get_leaf_node() == rhs._root.get_leaf_node()){
-		return true;
+namespace internals {
+	static const char SNAPSHOT_MAGIC[8] = { 'S', 'T', 'E', 'A', 'D', 'Y', 'V', '1' };
+	static const std::uint32_t SNAPSHOT_BYTE_ORDER = 0x01020304;
+	static const std::uint32_t SNAPSHOT_LEAF_NODE = 1;
+	static const std::uint32_t SNAPSHOT_INODE = 2;
+	static const std::uint64_t NULL_NODE_ID = ~std::uint64_t(0);
+
+	template <class U>
+	void append_raw(std::string& dest, const U& value){
+		dest.append(reinterpret_cast<const char*>(&value), sizeof(U));
 	}
 
-	//	### optimize by comparing node by node, hiearchically.
-	//	First check node to see if they are the same pointer. If not, only then compare their values.
+	//	Reads a snapshot from memory, front to back. Throws if reading past the end.
+	struct snapshot_reader {
+		public: snapshot_reader(const char* begin, const char* end) :
+			_begin(begin),
+			_pos(begin),
+			_end(end)
+		{
+		}
 
-	{
-		const size_t block_count = get_block_count();
-		for(size_t index = 0 ; index < block_count ; index++){
-			const T* valuesA = get_block(index);
-			const T* valuesB = rhs.get_block(index);
-
-			const size_t r = std::min(static_cast<size_t>(BRANCHING_FACTOR), _size - index * BRANCHING_FACTOR);
-			const bool equal = std::equal(valuesA, valuesA + r, valuesB);
-			if(!equal){
-				return false;
+		public: const char* read_bytes(size_t count){
+			if(size_t(_end - _pos) < count){
+				throw std::runtime_error("Snapshot is truncated.");
 			}
+			const char* result = _pos;
+			_pos += count;
+			return result;
 		}
-	}
 
-	return true;
-}
+		public: template <class U> U read(){
+			U result;
+			std::memcpy(&result, read_bytes(sizeof(U)), sizeof(U));
+			return result;
+		}
 
-#endif
+		public: bool at_end() const{
+			return _pos == _end;
+		}
 
+		//	Skips padding so the position is a multiple of _alignment_ from the start.
+		public: void align(size_t alignment){
+			read_bytes((alignment - size_t(_pos - _begin) % alignment) % alignment);
+		}
 
-template <class T>
-vector<T> vector<T>::store(size_t index, const T& value) const{
-	STEADY_ASSERT(check_invariant());
-	STEADY_ASSERT(index < _size);
-	const auto root = replace_value(_root, _shift, index, value);
-	return vector<T>(root, _size, _shift);
-}
 
+		////////////////	State
+		private: const char* _begin;
+		private: const char* _pos;
+		private: const char* _end;
+	};
 
-template <class T>
-vector<T> vector<T>::store(size_t index, T&& value) const{
-	STEADY_ASSERT(check_invariant());
-	STEADY_ASSERT(index < _size);
-	const auto root = replace_value(_root, _shift, index, std::forward<T>(value));
-	return vector<T>(root, _size, _shift);
+	inline void check_snapshot(bool ok, const char* message){
+		if(!ok){
+			throw std::runtime_error(message);
+		}
+	}
 }
 
 
 template <class T>
-std::size_t vector<T>::size() const{
-	STEADY_ASSERT(check_invariant());
-	return _size;
+snapshot_writer<T>::snapshot_writer(){
 }
 
-
-#if 0
-
-//	Correct, reference implementation.
 template <class T>
-T vector<T>::operator[](const std::size_t index) const{
-	STEADY_ASSERT(check_invariant());
-	STEADY_ASSERT(index < _size);
-
-	const auto leaf = internals::find_leaf_node(*this, index);
-	const auto slot_index = index & internals::BRANCHING_FACTOR_MASK;
-
-	STEADY_ASSERT(slot_index < leaf.get_leaf_node()->_values.size());
-	const T result = leaf.get_leaf_node()->_values[slot_index];
-	return result;
+void snapshot_writer<T>::add(const vector<T>& vec){
+	STEADY_ASSERT(vec.check_invariant());
+
+	const auto root = vec.get_tail_offset() > 0 ? add_node(vec.get_root(), vec.get_shift()) : internals::NULL_NODE_ID;
+	const auto tail = vec.get_tail_size() > 0 ? add_node(vec.get_tail(), internals::LEAF_NODE_SHIFT) : internals::NULL_NODE_ID;
+
+	internals::append_raw(_vector_table, std::uint64_t(vec.size()));
+	internals::append_raw(_vector_table, std::uint64_t(vec.get_shift() + branching_factor<T>::SHIFT));
+	internals::append_raw(_vector_table, root);
+	internals::append_raw(_vector_table, tail);
+	internals::append_raw(_vector_table, std::uint64_t(vec.get_tail_size()));
+	_vectors.push_back(vec);
 }
 
-#else
-
-/*
-Speed-optimized implementation of operator[].
-Avoids updating reference counters, avoids function calls etc.
-*/
+//	The positions in _nodes are written as if the header was before them, so that values can be aligned.
 template <class T>
-const T& vector<T>::operator[](const std::size_t index) const{
-	STEADY_ASSERT(check_invariant());
-	STEADY_ASSERT(index < _size);
+std::uint64_t snapshot_writer<T>::add_node(const internals::node_ref<T>& node, int shift){
+	const auto key = node.get_type() == internals::node_type::leaf_node
+		? reinterpret_cast<std::uintptr_t>(node.get_leaf_node())
+		: reinterpret_cast<std::uintptr_t>(node.get_inode());
+	const auto found = _node_ids.find(key);
+	if(found != _node_ids.end()){
+		return found->second;
+	}
 
-	auto shift = _shift;
-	const internals::node_ref<T>* node_it = &_root;
+	if(shift == internals::LEAF_NODE_SHIFT){
+		const auto& leaf = *node.get_leaf_node();
+		internals::append_raw(_nodes, internals::SNAPSHOT_LEAF_NODE);
+		internals::append_raw(_nodes, std::uint32_t(leaf.get_count()));
 
-	//	Traverse all inodes.
-	while(shift > 0){
-		const size_t slot_index = (index >> shift) & internals::BRANCHING_FACTOR_MASK;
-		node_it = &node_it->_inode->_children[slot_index];
-		shift -= BRANCHING_FACTOR_SHIFT;
+		const size_t header_size = sizeof(internals::SNAPSHOT_MAGIC) + 4 * sizeof(std::uint32_t) + 2 * sizeof(std::uint64_t);
+		const size_t padding = (alignof(T) - (header_size + _nodes.size()) % alignof(T)) % alignof(T);
+		_nodes.append(padding, '\0');
+		_nodes.append(reinterpret_cast<const char*>(leaf.get_values()), leaf.get_count() * sizeof(T));
 	}
+	else{
+		const auto& n = *node.get_inode();
+		const size_t count = n.count_children();
+		std::uint64_t child_ids[branching_factor<T>::FACTOR];
+		for(size_t i = 0 ; i < count ; i++){
+			child_ids[i] = add_node(n.get_child(i), shift - branching_factor<T>::SHIFT);
+		}
 
-	STEADY_ASSERT(shift == internals::LEAF_NODE_SHIFT);
-	STEADY_ASSERT(node_it->get_type() == internals::node_type::leaf_node);
-
-	const auto slot_index = index & internals::BRANCHING_FACTOR_MASK;
+		internals::append_raw(_nodes, internals::SNAPSHOT_INODE);
+		internals::append_raw(_nodes, std::uint32_t(count));
+		internals::append_raw(_nodes, std::uint32_t(n.is_relaxed() ? 1 : 0));
+		for(size_t i = 0 ; i < count ; i++){
+			internals::append_raw(_nodes, child_ids[i]);
+		}
+		if(n.is_relaxed()){
+			for(size_t i = 0 ; i < count ; i++){
+				internals::append_raw(_nodes, std::uint64_t((*n._sizes)[i]));
+			}
+		}
+	}
 
-	STEADY_ASSERT(slot_index < node_it->get_leaf_node()->_values.size());
-	const auto& result = node_it->_leaf_node->_values[slot_index];
-	return result;
+	const auto id = std::uint64_t(_node_ids.size());
+	_node_ids.insert(std::make_pair(key, id));
+	return id;
 }
 
-#endif
+template <class T>
+void snapshot_writer<T>::write(std::ostream& out) const{
+	std::string header(internals::SNAPSHOT_MAGIC, sizeof(internals::SNAPSHOT_MAGIC));
+	internals::append_raw(header, internals::SNAPSHOT_BYTE_ORDER);
+	internals::append_raw(header, std::uint32_t(branching_factor<T>::SHIFT));
+	internals::append_raw(header, std::uint32_t(sizeof(T)));
+	internals::append_raw(header, std::uint32_t(alignof(T)));
+	internals::append_raw(header, std::uint64_t(_node_ids.size()));
+	internals::append_raw(header, std::uint64_t(_vectors.size()));
+
+	out.write(header.data(), header.size());
+	out.write(_nodes.data(), _nodes.size());
+	out.write(_vector_table.data(), _vector_table.size());
+}
 
+template <class T>
+size_t snapshot_writer<T>::get_node_count() const{
+	return _node_ids.size();
+}
 
-#if 0
 
-//	Correct but slow reference implementation.
 template <class T>
-std::vector<T> vector<T>::to_vec() const{
-	STEADY_ASSERT(check_invariant());
+std::vector<vector<T>> read_snapshot(const void* data, size_t size){
+	static_assert(std::is_trivially_copyable<T>::value, "Snapshots store values as raw bytes.");
+	using internals::check_snapshot;
 
-	std::vector<T> result;
-	result.reserve(size());
+	const char* begin = static_cast<const char*>(data);
+	internals::snapshot_reader reader(begin, begin + size);
 
-	for(size_t i = 0 ; i < size() ; i++){
-		const auto value = operator[](i);
-		result.push_back(value);
-	}
+	check_snapshot(std::memcmp(reader.read_bytes(sizeof(internals::SNAPSHOT_MAGIC)), internals::SNAPSHOT_MAGIC, sizeof(internals::SNAPSHOT_MAGIC)) == 0, "Not a snapshot.");
+	check_snapshot(reader.read<std::uint32_t>() == internals::SNAPSHOT_BYTE_ORDER, "Snapshot has wrong byte order.");
+	check_snapshot(reader.read<std::uint32_t>() == branching_factor<T>::SHIFT, "Snapshot has wrong branching factor.");
+	check_snapshot(reader.read<std::uint32_t>() == sizeof(T), "Snapshot has wrong value size.");
+	check_snapshot(reader.read<std::uint32_t>() == alignof(T), "Snapshot has wrong value alignment.");
+	const auto node_count = reader.read<std::uint64_t>();
+	const auto vector_count = reader.read<std::uint64_t>();
 
-	return result;
-}
+	/*
+		The level of each node in the tree: 0 for leaf nodes, and the number of values under it. The nodes are checked
+		like validate_tree() does, so a bad snapshot can't make a vector that breaks its invariant.
+	*/
+	std::vector<internals::node_ref<T>> nodes;
+	std::vector<int> levels;
+	std::vector<size_t> value_counts;
+	for(std::uint64_t id = 0 ; id < node_count ; id++){
+		const auto type = reader.read<std::uint32_t>();
+		const auto count = reader.read<std::uint32_t>();
+		check_snapshot(count > 0 && count <= branching_factor<T>::FACTOR, "Snapshot has bad node.");
+
+		if(type == internals::SNAPSHOT_LEAF_NODE){
+			reader.align(alignof(T));
+			const char* bytes = reader.read_bytes(count * sizeof(T));
+
+			internals::node_ref<T> leaf(new internals::leaf_node<T>());
+			if(reinterpret_cast<std::uintptr_t>(bytes) % alignof(T) == 0){
+				leaf.get_leaf_node()->push_values(reinterpret_cast<const T*>(bytes), count);
+			}
+			else{
+				typename std::aligned_storage<sizeof(T) * branching_factor<T>::FACTOR, alignof(T)>::type temp;
+				std::memcpy(&temp, bytes, count * sizeof(T));
+				leaf.get_leaf_node()->push_values(reinterpret_cast<const T*>(&temp), count);
+			}
+			nodes.push_back(std::move(leaf));
+			levels.push_back(0);
+			value_counts.push_back(count);
+		}
+		else if(type == internals::SNAPSHOT_INODE){
+			const auto relaxed = reader.read<std::uint32_t>();
+			check_snapshot(relaxed == 0 || relaxed == 1, "Snapshot has bad node.");
 
-#else
+			typename internals::inode<T>::children_t children{};
+			std::uint64_t child_ids[branching_factor<T>::FACTOR];
+			int child_level = -1;
+			for(size_t i = 0 ; i < count ; i++){
+				const auto child_id = reader.read<std::uint64_t>();
+				check_snapshot(child_id < id, "Snapshot has bad child.");
+				check_snapshot(child_level == -1 || levels[child_id] == child_level, "Snapshot has bad child.");
+				child_level = levels[child_id];
+				child_ids[i] = child_id;
+				children[i] = nodes[child_id];
+			}
 
-template <class T>
-std::vector<T> vector<T>::to_vec() const{
-	STEADY_ASSERT(check_invariant());
+			//	Each child holds up to _child_max_ values. Same limit on the depth as vector::check_invariant().
+			const auto shift = (child_level + 1) * branching_factor<T>::SHIFT;
+			check_snapshot(shift < 32, "Snapshot has too deep tree.");
+			const auto child_max = size_t(1) << shift;
+
+			size_t total = 0;
+			if(relaxed == 1){
+				typename internals::inode<T>::size_table_t sizes{};
+				for(size_t i = 0 ; i < count ; i++){
+					total += value_counts[child_ids[i]];
+					sizes[i] = size_t(reader.read<std::uint64_t>());
+					check_snapshot(sizes[i] == total, "Snapshot has bad size table.");
+				}
+				check_snapshot(total <= internals::shift_to_max_size<T>(shift), "Snapshot has bad size table.");
+				nodes.push_back(internals::node_ref<T>(new internals::inode<T>(std::move(children), sizes)));
+			}
+			else{
+				//	All children but the last are full, and strict too.
+				for(size_t i = 0 ; i < count ; i++){
+					check_snapshot(!internals::is_relaxed(children[i]), "Snapshot has relaxed child in strict inode.");
+					check_snapshot(i + 1 == count || value_counts[child_ids[i]] == child_max, "Snapshot has strict inode that isn't full.");
+					total += value_counts[child_ids[i]];
+				}
+				nodes.push_back(internals::node_ref<T>(new internals::inode<T>(std::move(children))));
+			}
+			levels.push_back(child_level + 1);
+			value_counts.push_back(total);
+		}
+		else{
+			check_snapshot(false, "Snapshot has bad node.");
+		}
+	}
 
-	std::vector<T> result;
-	result.reserve(size());
+	std::vector<vector<T>> result;
+	for(std::uint64_t i = 0 ; i < vector_count ; i++){
+		const auto vector_size = size_t(reader.read<std::uint64_t>());
+		const auto shift = int(reader.read<std::uint64_t>()) - branching_factor<T>::SHIFT;
+		const auto root_id = reader.read<std::uint64_t>();
+		const auto tail_id = reader.read<std::uint64_t>();
+		const auto tail_size = size_t(reader.read<std::uint64_t>());
+
+		internals::node_ref<T> root;
+		if(root_id != internals::NULL_NODE_ID){
+			check_snapshot(root_id < nodes.size() && shift >= 0 && levels[root_id] * branching_factor<T>::SHIFT == shift, "Snapshot has bad vector shift.");
+			check_snapshot(vector_size >= tail_size && value_counts[root_id] == vector_size - tail_size, "Snapshot has bad vector size.");
+			root = nodes[root_id];
+
+			//	A strict tree has the lowest shift for its size and a full last leaf node, relaxed trees can be taller.
+			const auto min_shift = internals::vector_size_to_shift<T>(vector_size - tail_size);
+			if(internals::is_relaxed(root)){
+				check_snapshot(shift >= min_shift, "Snapshot has bad vector shift.");
+			}
+			else{
+				check_snapshot(shift == min_shift, "Snapshot has bad vector shift.");
+				check_snapshot(tail_size == 0 || ((vector_size - tail_size) & branching_factor<T>::MASK) == 0, "Snapshot has bad vector size.");
+			}
+		}
+		else{
+			check_snapshot(shift == branching_factor<T>::EMPTY_TREE_SHIFT && vector_size == tail_size, "Snapshot has bad vector.");
+		}
 
-	//	Block-wise copy.
-	const auto block_count = get_block_count();
-	for(size_t index = 0 ; index < block_count ; index++){
-		const T* values_a = get_block(index);
-		const auto size = std::min(static_cast<size_t>(BRANCHING_FACTOR), _size - index * BRANCHING_FACTOR);
-		result.insert(result.end(), values_a, values_a + size);
+		internals::node_ref<T> tail;
+		if(tail_id != internals::NULL_NODE_ID){
+			check_snapshot(tail_id < nodes.size() && levels[tail_id] == 0, "Snapshot has bad vector.");
+			check_snapshot(tail_size > 0 && tail_size <= nodes[tail_id].get_leaf_node()->get_count(), "Snapshot has bad vector.");
+			tail = nodes[tail_id];
+		}
+		else{
+			check_snapshot(tail_size == 0, "Snapshot has bad vector.");
+		}
+		check_snapshot(vector_size >= tail_size, "Snapshot has bad vector.");
+
+		result.push_back(vector<T>(std::move(root), vector_size, shift, std::move(tail), tail_size));
 	}
+	check_snapshot(reader.at_end(), "Snapshot has extra data.");
 	return result;
 }
 
-#endif
 
 
-template <class T>
-void vector<T>::trace_internals() const{
-	STEADY_ASSERT(check_invariant());
+////////////////////////////////////////////		leaf_interner implementation
 
-	STEADY_TRACE_SS("Vector (size: " << _size << ") "
-		"total inodes: " << internals::inode<T>::_debug_count << ", "
-		"total leaf nodes: " << internals::leaf_node<T>::_debug_count);
 
-	trace_node("", _root);
-}
+template <class T>
+vector<T> leaf_interner<T>::intern(const vector<T>& vec){
+	STEADY_ASSERT(vec.check_invariant());
 
+	auto root = vec.get_root();
+	if(vec.get_tail_offset() > 0){
+		root = intern_tree(vec.get_root(), vec.get_tail_offset(), vec.get_shift());
+	}
+	auto tail = vec.get_tail();
+	if(vec.get_tail_size() > 0){
+		tail = intern_tree(vec.get_tail(), vec.get_tail_size(), internals::LEAF_NODE_SHIFT);
+	}
+	return vector<T>(std::move(root), vec.size(), vec.get_shift(), std::move(tail), vec.get_tail_size());
+}
 
+template <class T>
+size_t leaf_interner<T>::size() const{
+	return _leaf_nodes.size();
+}
 
-//	### Optimization potential here.
+//	Like internals::map_tree_preserving(): inodes are only copied if a leaf node below them was replaced.
 template <class T>
-vector<T> operator+(const vector<T>& a, const vector<T>& b){
-	vector<T> result;
+internals::node_ref<T> leaf_interner<T>::intern_tree(const internals::node_ref<T>& node, size_t size, int shift){
+	if(shift == internals::LEAF_NODE_SHIFT){
+		const auto& leaf = *node.get_leaf_node();
 
-#if 1
-	if(b.empty()){
+		//	Leaf nodes with leftover values can't be shared with vectors that use all the values.
+		if(leaf.get_count() != size){
+			return node;
+		}
+
+		const auto hash = internals::hash_tree(node, size, shift);
+		const auto range = _leaf_nodes.equal_range(hash);
+		for(auto it = range.first ; it != range.second ; ++it){
+			const auto& other = *it->second.get_leaf_node();
+			if(other.get_count() == size && internals::equal_values(other.get_values(), leaf.get_values(), size)){
+				return it->second;
+			}
+		}
+		_leaf_nodes.insert(std::make_pair(hash, node));
+		return node;
 	}
 	else{
-		const auto v = b.to_vec();
-		result = internals::push_back_batch(a, &v[0], v.size());
-	}
-#else
-	for(size_t i = 0 ; i < b.size() ; i++){
-		result = result.push_back(b[i]);
+		auto children = internals::get_sized_children(internals::sized_node<T>{ node, size }, shift);
+		bool changed = false;
+		for(auto& child: children){
+			auto interned = intern_tree(child._node, child._size, shift - branching_factor<T>::SHIFT);
+			if(!interned.same_node(child._node)){
+				child._node = std::move(interned);
+				changed = true;
+			}
+		}
+		return changed ? internals::make_inode_from_sized(&children[0], &children[0] + children.size(), shift)._node : node;
 	}
-#endif
-
-	STEADY_ASSERT(result.size() == a.size() + b.size());
-	return result;
 }
 
 
+
 template <class T> size_t get_inode_count(){
-	return internals::inode<T>::_debug_count;
+#if STEADY_STATS_ON
+	using namespace internals::stats_counters;
+	return static_cast<size_t>(get(get_type_counter<T>(INODE_COUNT)));
+#else
+	return 0;
+#endif
 }
 
 template <class T> size_t get_leaf_count(){
-	return internals::leaf_node<T>::_debug_count;
+#if STEADY_STATS_ON
+	using namespace internals::stats_counters;
+	return static_cast<size_t>(get(get_type_counter<T>(LEAF_COUNT)));
+#else
+	return 0;
+#endif
+}
+
+template <class T>
+double get_sharing_ratio(const vector<T> vectors[], size_t count){
+	STEADY_ASSERT(vectors != nullptr || count == 0);
+
+	std::unordered_map<std::uintptr_t, size_t> seen;
+	size_t references = 0;
+	std::function<void(const internals::node_ref<T>&)> visit = [&](const internals::node_ref<T>& node){
+		const auto type = node.get_type();
+		if(type == internals::node_type::null_node){
+			return;
+		}
+		references++;
+		seen.insert(std::make_pair(node._ptr, size_t(0)));
+		if(type == internals::node_type::leaf_node){
+			return;
+		}
+		for(const auto& child: node.get_inode()->_children){
+			visit(child);
+		}
+	};
+	for(size_t i = 0 ; i < count ; i++){
+		visit(vectors[i].get_root());
+		visit(vectors[i].get_tail());
+	}
+	return seen.empty() ? 1.0 : static_cast<double>(references) / static_cast<double>(seen.size());
 }
 
 
 
 
 }	//	steady
+
+
+namespace std {
+	template <class T>
+	struct hash<steady::vector<T>> {
+		std::size_t operator()(const steady::vector<T>& vec) const{
+			return vec.get_hash();
+		}
+	};
+}
 	
 #endif /* defined(__steady__vector__) */